@@ -0,0 +1,29 @@
+# Replay BAG with the release and the checked batch binaries and require identical trajectories.
+# Usage: cmake -DBAG=<bag> -DBATCH=<wildcat_slam_batch> -DBATCH_CHECKED=<wildcat_slam_batch_checked> -DWORK_DIR=<dir> -P compare_checked_trajectory.cmake
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(WRITE ${WORK_DIR}/manifest.txt "regression ${BAG}\n")
+
+foreach(VARIANT release checked)
+    if (VARIANT STREQUAL "release")
+        set(BINARY ${BATCH})
+    else()
+        set(BINARY ${BATCH_CHECKED})
+    endif()
+    execute_process(
+        COMMAND ${BINARY} --manifest_filename=${WORK_DIR}/manifest.txt --output_dir=${WORK_DIR}/${VARIANT} --num_jobs=1
+        RESULT_VARIABLE RESULT
+    )
+    if (NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "${BINARY} failed with ${RESULT}")
+    endif()
+endforeach()
+
+execute_process(
+    COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/release/regression.trajectory.txt ${WORK_DIR}/checked/regression.trajectory.txt
+    RESULT_VARIABLE RESULT
+)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "The checked build replays ${BAG} to a different trajectory")
+endif()
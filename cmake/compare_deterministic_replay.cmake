@@ -0,0 +1,32 @@
+# Replay BAG in deterministic mode with 1 and 4 threads in every parallel stage and require bit-identical outputs:
+# the solver threads of the config, the refinement threads of --num_threads and the chunk decompression threads of
+# --bag_reader_thread_num. Each replay is a separate process, so the hash seeds differ as well. The lidar filter
+# threads are one per lidar, their number is set by the lidars of the bag.
+# Usage: cmake -DBAG=<bag> -DBATCH=<wildcat_slam_batch> -DWORK_DIR=<dir> -P compare_deterministic_replay.cmake
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(WRITE ${WORK_DIR}/manifest.txt "regression ${BAG}\n")
+
+foreach(THREAD_NUM 1 4)
+    file(WRITE ${WORK_DIR}/threads_${THREAD_NUM}.pbtxt "deterministic: true\nsolver_num_threads: ${THREAD_NUM}\n")
+    execute_process(
+        COMMAND ${BATCH} --manifest_filename=${WORK_DIR}/manifest.txt --output_dir=${WORK_DIR}/threads_${THREAD_NUM}
+            --config_filename=${WORK_DIR}/threads_${THREAD_NUM}.pbtxt --refine --num_threads=${THREAD_NUM} --num_jobs=1
+            --bag_reader_thread_num=${THREAD_NUM}
+        RESULT_VARIABLE RESULT
+    )
+    if (NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "${BATCH} failed with ${RESULT}")
+    endif()
+endforeach()
+
+foreach(OUTPUT regression.trajectory.txt regression.refined_trajectory.txt)
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK_DIR}/threads_1/${OUTPUT} ${WORK_DIR}/threads_4/${OUTPUT}
+        RESULT_VARIABLE RESULT
+    )
+    if (NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "${OUTPUT} of ${BAG} differs between 1 and 4 threads")
+    endif()
+endforeach()
@@ -0,0 +1,28 @@
+# Replay BAG with double and with float surfel residuals and require the float trajectories to stay within the
+# --max_translation_deviation and --max_rotation_deviation defaults of wildcat_slam_batch of the double ones.
+# Usage: cmake -DBAG=<bag> -DBATCH=<wildcat_slam_batch> -DWORK_DIR=<dir> -P compare_float_residuals.cmake
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+file(WRITE ${WORK_DIR}/manifest.txt "regression ${BAG}\n")
+file(WRITE ${WORK_DIR}/double.pbtxt "deterministic: true\n")
+file(WRITE ${WORK_DIR}/float.pbtxt "deterministic: true\nfloat_lidar_residuals: true\n")
+
+execute_process(
+    COMMAND ${BATCH} --manifest_filename=${WORK_DIR}/manifest.txt --output_dir=${WORK_DIR}/double
+        --config_filename=${WORK_DIR}/double.pbtxt --refine --num_jobs=1
+    RESULT_VARIABLE RESULT
+)
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${BATCH} with double residuals failed with ${RESULT}")
+endif()
+
+execute_process(
+    COMMAND ${BATCH} --manifest_filename=${WORK_DIR}/manifest.txt --output_dir=${WORK_DIR}/float
+        --config_filename=${WORK_DIR}/float.pbtxt --refine --num_jobs=1 --reference_dir=${WORK_DIR}/double
+    RESULT_VARIABLE RESULT
+)
+if (NOT RESULT EQUAL 0)
+    file(READ ${WORK_DIR}/float/regression.metrics.txt METRICS)
+    message(FATAL_ERROR "Trajectories of ${BAG} with float residuals deviate from the double ones:\n${METRICS}")
+endif()
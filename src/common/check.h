@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glog/logging.h>
+
+/**
+ * @brief Tiered invariant checks
+ *
+ * CHECK of glog stays on in every build and guards inputs and rare control flow. Checks inside per point and per
+ * residual loops use the tiers below, selected per build target by WILDCAT_CHECK_LEVEL:
+ *   0: release, the tiers compile to nothing, their arguments are not evaluated
+ *   1: debug, DEBUG_CHECK is on, the default without NDEBUG
+ *   2: paranoid, PARANOID_CHECK is on as well, for the _checked targets and the tests together with
+ *      _GLIBCXX_ASSERTIONS
+ */
+#ifndef WILDCAT_CHECK_LEVEL
+#ifdef NDEBUG
+#define WILDCAT_CHECK_LEVEL 0
+#else
+#define WILDCAT_CHECK_LEVEL 1
+#endif
+#endif
+
+// a disabled check still compiles its arguments, so that they can not rot, but never runs them
+#define WILDCAT_DISABLED_CHECK(check) \
+  while (false) check
+
+#if WILDCAT_CHECK_LEVEL >= 1
+#define DEBUG_CHECK(condition) CHECK(condition)
+#define DEBUG_CHECK_EQ(val1, val2) CHECK_EQ(val1, val2)
+#define DEBUG_CHECK_NE(val1, val2) CHECK_NE(val1, val2)
+#define DEBUG_CHECK_LE(val1, val2) CHECK_LE(val1, val2)
+#define DEBUG_CHECK_LT(val1, val2) CHECK_LT(val1, val2)
+#define DEBUG_CHECK_GE(val1, val2) CHECK_GE(val1, val2)
+#define DEBUG_CHECK_GT(val1, val2) CHECK_GT(val1, val2)
+#else
+#define DEBUG_CHECK(condition) WILDCAT_DISABLED_CHECK(CHECK(condition))
+#define DEBUG_CHECK_EQ(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_EQ(val1, val2))
+#define DEBUG_CHECK_NE(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_NE(val1, val2))
+#define DEBUG_CHECK_LE(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_LE(val1, val2))
+#define DEBUG_CHECK_LT(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_LT(val1, val2))
+#define DEBUG_CHECK_GE(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_GE(val1, val2))
+#define DEBUG_CHECK_GT(val1, val2) WILDCAT_DISABLED_CHECK(CHECK_GT(val1, val2))
+#endif
+
+#if WILDCAT_CHECK_LEVEL >= 2
+#define PARANOID_CHECK(condition) CHECK(condition)
+#else
+#define PARANOID_CHECK(condition) WILDCAT_DISABLED_CHECK(CHECK(condition))
+#endif
@@ -0,0 +1,16 @@
+#include <gtest/gtest.h>
+
+// the tiers are macros only, so this test can select a level different from the rest of the build
+#undef WILDCAT_CHECK_LEVEL
+#define WILDCAT_CHECK_LEVEL 1
+#include "common/check.h"
+
+TEST(Check, DisabledTierDoesNotEvaluate) {
+  int evaluated = 0;
+  PARANOID_CHECK(++evaluated < 0) << "never printed " << ++evaluated;
+  EXPECT_EQ(evaluated, 0);
+
+  DEBUG_CHECK_GE(++evaluated, 1);
+  EXPECT_EQ(evaluated, 1);
+  EXPECT_DEATH(DEBUG_CHECK_LT(evaluated, 1), "evaluated");
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "common/common.h"
+
+/**
+ * @brief Stable LSD radix sort by an unsigned 64 bit key, 8 bits per pass
+ *
+ * Keys and indices are sorted instead of the values, which are moved once at the end. Passes over bytes in which all
+ * keys agree are skipped, so keys spanning few bits take few passes.
+ *
+ * @param key_fn returns the uint64_t key of a value
+ */
+template <typename T, typename KeyFn>
+void RadixSort(std::vector<T> &values, KeyFn key_fn) {
+  const size_t n = values.size();
+  if (n < 2) {
+    return;
+  }
+  std::vector<std::pair<uint64_t, uint32_t>> items(n), buffer(n);
+  uint64_t                                   varying_bits = 0;
+  for (size_t i = 0; i < n; ++i) {
+    items[i] = {key_fn(values[i]), uint32_t(i)};
+    varying_bits |= items[i].first ^ items[0].first;
+  }
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    if (((varying_bits >> shift) & 0xff) == 0) {
+      continue;
+    }
+    size_t offsets[257] = {};
+    for (const auto &item : items) {
+      ++offsets[((item.first >> shift) & 0xff) + 1];
+    }
+    for (int i = 1; i < 257; ++i) {
+      offsets[i] += offsets[i - 1];
+    }
+    for (const auto &item : items) {
+      buffer[offsets[(item.first >> shift) & 0xff]++] = item;
+    }
+    items.swap(buffer);
+  }
+
+  std::vector<T> sorted;
+  sorted.reserve(n);
+  for (const auto &item : items) {
+    sorted.push_back(std::move(values[item.second]));
+  }
+  values.swap(sorted);
+}
+
+/**
+ * @brief Map a double to a key with the same order, including negative values
+ */
+inline uint64_t OrderedKey(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits & 0x8000000000000000ull ? ~bits : bits | 0x8000000000000000ull;
+}
+
+/**
+ * @brief Stable sort of points by time
+ *
+ * Points of a scan span a short time, so their keys differ in the low bytes only and take about 3 radix passes.
+ * Points that are already in order, as from most drivers, are only checked.
+ */
+inline void SortPointsByTime(std::vector<hilti_ros::Point> &points) {
+  if (std::is_sorted(points.begin(), points.end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; })) {
+    return;
+  }
+  RadixSort(points, [](const hilti_ros::Point &point) { return OrderedKey(point.time); });
+}
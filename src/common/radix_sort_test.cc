@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+
+#include "common/radix_sort.h"
+
+TEST(RadixSort, MatchesStableSort) {
+  std::mt19937                           rng(42);
+  std::uniform_real_distribution<double> distribution(-1e3, 1e3);
+  std::vector<std::pair<double, int>>    values;
+  for (int i = 0; i < 10000; ++i) {
+    // repeated keys check stability
+    values.emplace_back(i % 7 == 0 ? 1.5 : distribution(rng), i);
+  }
+  values.emplace_back(-0.0, -1);
+  values.emplace_back(0.0, -2);
+
+  auto expected = values;
+  std::stable_sort(expected.begin(), expected.end(), [](const auto &lhs, const auto &rhs) { return OrderedKey(lhs.first) < OrderedKey(rhs.first); });
+  RadixSort(values, [](const std::pair<double, int> &value) { return OrderedKey(value.first); });
+  EXPECT_EQ(values, expected);
+}
+
+TEST(RadixSort, PointsByTime) {
+  std::mt19937                           rng(7);
+  std::uniform_real_distribution<double> distribution(1.6e9, 1.6e9 + 0.1);
+  std::vector<hilti_ros::Point>          points(5000);
+  for (auto &point : points) {
+    point.time = distribution(rng);
+  }
+  SortPointsByTime(points);
+  EXPECT_TRUE(std::is_sorted(points.begin(), points.end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; }));
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glog/logging.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free queue for exactly one producer thread and one consumer thread
+ *
+ * Neither side ever blocks: TryPush fails if the queue is full, TryPop fails if it is empty.
+ * Capacity is rounded up to a power of two.
+ */
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity) {
+    CHECK_GT(capacity, 0);
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+    buffer_.reset(new T[size]);
+  }
+
+  SpscQueue(const SpscQueue &)            = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  /**
+   * @brief Called by the producer only
+   *
+   * @return false if the queue is full, value is left untouched
+   */
+  bool TryPush(T &&value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) {
+        return false;
+      }
+    }
+    buffer_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Called by the consumer only
+   *
+   * @return false if the queue is empty
+   */
+  bool TryPop(T *value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    *value = std::move(buffer_[head & mask_]);
+    buffer_[head & mask_] = T();  // release resources held by the slot
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Approximate number of queued elements, exact only when called from the producer or consumer while the other side is idle
+   */
+  size_t Size() const { return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire); }
+
+  size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  std::unique_ptr<T[]> buffer_;
+  size_t               mask_;
+
+  // producer and consumer indices on separate cache lines, each side caches the index of the other one
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;  // consumer side
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;  // producer side
+};
@@ -0,0 +1,49 @@
+#include "common/spsc_queue.h"
+
+#include <gtest/gtest.h>
+#include <thread>
+
+TEST(SpscQueue, PushPop) {
+  SpscQueue<int> queue(3);
+  EXPECT_EQ(queue.Capacity(), 4);
+
+  int value;
+  EXPECT_FALSE(queue.TryPop(&value));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.TryPush(int(i)));
+  }
+  EXPECT_FALSE(queue.TryPush(4));
+  EXPECT_EQ(queue.Size(), 4);
+
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(value, i);
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+}
+
+TEST(SpscQueue, Concurrent) {
+  constexpr int                   kNum = 100'000;
+  SpscQueue<std::unique_ptr<int>> queue(64);
+  std::thread                     producer([&]() {
+    for (int i = 0; i < kNum; ++i) {
+      auto value = std::make_unique<int>(i);
+      while (!queue.TryPush(std::move(value))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int expected = 0;
+  while (expected < kNum) {
+    std::unique_ptr<int> value;
+    if (queue.TryPop(&value)) {
+      ASSERT_EQ(*value, expected);
+      ++expected;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  EXPECT_EQ(queue.Size(), 0);
+}
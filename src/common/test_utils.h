@@ -0,0 +1,19 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <string>
+
+/**
+ * @brief Name unique to this test process, so that tests of parallel runs do not share files or shared memory
+ */
+inline std::string UniqueTestName(const std::string &suffix) {
+  return "wildcat_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+/**
+ * @brief Path of a file or directory in the test temp dir, unique to this test process
+ */
+inline std::string UniqueTestPath(const std::string &suffix) {
+  return testing::TempDir() + UniqueTestName(suffix);  // TempDir ends with a slash
+}
@@ -0,0 +1,53 @@
+#include "common/thread_pool.h"
+
+#include <glog/logging.h>
+
+#include "common/thread_utils.h"
+
+ThreadPool::ThreadPool(int num_threads, const std::vector<int> &cpus) : cpus_(cpus) {
+  CHECK_GT(num_threads, 0);
+  for (int i = 0; i < num_threads; ++i) {
+    pool_.emplace_back([this, i]() { DoWork(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    absl::MutexLock lock(&mutex_);
+    CHECK(running_);
+    running_ = false;
+  }
+  for (auto &thread : pool_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> work) {
+  absl::MutexLock lock(&mutex_);
+  CHECK(running_);
+  work_queue_.push_back(std::move(work));
+}
+
+void ThreadPool::DoWork(int worker_index) {
+  if (!cpus_.empty()) {
+    SetCurrentThreadAffinity({cpus_[worker_index % cpus_.size()]});
+  }
+
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !work_queue_.empty() || !running_;
+  };
+  while (true) {
+    std::function<void()> work;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(&predicate));
+      if (work_queue_.empty()) {
+        return;  // stopped and drained
+      }
+      work = std::move(work_queue_.front());
+      work_queue_.pop_front();
+    }
+    CHECK(work);
+    work();
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+/**
+ * @brief A fixed number of worker threads executing scheduled work in FIFO order
+ *
+ * Workers can be pinned to CPUs, worker i runs on cpus[i % cpus.size()]. The destructor
+ * waits until all scheduled work is done.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads, const std::vector<int> &cpus = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &)            = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void Schedule(std::function<void()> work) LOCKS_EXCLUDED(mutex_);
+
+  int NumThreads() const { return pool_.size(); }
+
+ private:
+  void DoWork(int worker_index);
+
+  absl::Mutex                       mutex_;
+  bool                              running_ GUARDED_BY(mutex_) = true;
+  std::deque<std::function<void()>> work_queue_ GUARDED_BY(mutex_);
+  std::vector<std::thread>          pool_;
+  std::vector<int>                  cpus_;
+};
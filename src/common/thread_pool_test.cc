@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+#include "common/thread_pool.h"
+#include "common/thread_utils.h"
+
+TEST(ThreadPool, RunsAllScheduledWork) {
+  std::atomic<int> counter{0};
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 1000; ++i) {
+      pool.Schedule([&counter]() { ++counter; });
+    }
+  }
+  EXPECT_EQ(counter, 1000);
+}
+
+TEST(ThreadPool, PinnedWorkers) {
+  std::atomic<int> counter{0};
+  {
+    ThreadPool pool(2, {0});
+    for (int i = 0; i < 10; ++i) {
+      pool.Schedule([&counter]() { ++counter; });
+    }
+  }
+  EXPECT_EQ(counter, 10);
+}
+
+TEST(ThreadUtils, ParseCpuList) {
+  EXPECT_TRUE(ParseCpuList("").empty());
+  EXPECT_EQ(ParseCpuList("3"), std::vector<int>({3}));
+  EXPECT_EQ(ParseCpuList("0-3, 8,10-11"), std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+}
+
+TEST(ThreadUtils, ParseInvalidCpuList) {
+  std::vector<int> cpus;
+  EXPECT_FALSE(ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(ParseCpuList("0-1-2", &cpus));
+  EXPECT_FALSE(ParseCpuList("a", &cpus));
+}
+
+TEST(ThreadUtils, ConfigureCurrentThread) {
+  SetThreadConfigs({{"configured", "0", 0}});
+  std::thread thread([]() {
+    ConfigureCurrentThread("configured");
+    char name[16];
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    EXPECT_STREQ(name, "configured");
+    cpu_set_t cpu_set;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    EXPECT_EQ(CPU_COUNT(&cpu_set), 1);
+    EXPECT_TRUE(CPU_ISSET(0, &cpu_set));
+  });
+  thread.join();
+  SetThreadConfigs({});
+}
+
+TEST(ThreadUtils, FindThreadConfig) {
+  SetThreadConfigs({{"odometry", "2-3", 50}, {"backend", "4", 0}});
+  ThreadConfig config;
+  ASSERT_TRUE(FindThreadConfig("odometry", &config));
+  EXPECT_EQ(config.cpu_list, "2-3");
+  EXPECT_EQ(config.fifo_priority, 50);
+  ASSERT_TRUE(FindThreadConfig("backend", &config));
+  EXPECT_EQ(config.cpu_list, "4");
+  EXPECT_EQ(config.fifo_priority, 0);
+  EXPECT_FALSE(FindThreadConfig("dense_map", &config));
+  SetThreadConfigs({});
+  EXPECT_FALSE(FindThreadConfig("odometry", &config));
+}
+
+TEST(ThreadUtils, ConfigureUnlistedThread) {
+  SetThreadConfigs({{"configured", "0", 0}});
+  std::thread thread([]() {
+    cpu_set_t cpu_set_before, cpu_set_after;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_before), &cpu_set_before);
+    // only named, the scheduling stays as inherited
+    ConfigureCurrentThread("unlisted");
+    char name[16];
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    EXPECT_STREQ(name, "unlisted");
+    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_after), &cpu_set_after);
+    EXPECT_TRUE(CPU_EQUAL(&cpu_set_before, &cpu_set_after));
+  });
+  thread.join();
+  SetThreadConfigs({});
+}
+
+TEST(ThreadUtils, RunPollingLoop) {
+  int               work_num = 5, poll_num = 0;
+  std::atomic<bool> running{true};
+  RunPollingLoop(
+      "test", std::chrono::milliseconds(1),
+      [&]() {
+        ++poll_num;
+        if (work_num == 0) {
+          running = false;
+          return false;
+        }
+        --work_num;
+        return true;
+      },
+      [&]() { return running.load(); });
+  // all work is done before the loop ends, without sleeping in between
+  EXPECT_EQ(work_num, 0);
+  EXPECT_EQ(poll_num, 6);
+}
@@ -0,0 +1,135 @@
+#include "common/thread_utils.h"
+
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/mutex.h"
+#include "common/histogram.h"
+
+namespace {
+
+absl::Mutex               g_thread_configs_mutex(absl::kConstInit);
+std::vector<ThreadConfig> g_thread_configs GUARDED_BY(g_thread_configs_mutex);
+
+}  // namespace
+
+std::vector<int> ParseCpuList(const std::string &cpu_list) {
+  std::vector<int> cpus;
+  CHECK(ParseCpuList(cpu_list, &cpus)) << "Invalid cpu list: " << cpu_list;
+  return cpus;
+}
+
+bool ParseCpuList(const std::string &cpu_list, std::vector<int> *cpus) {
+  cpus->clear();
+  for (absl::string_view range : absl::StrSplit(cpu_list, ',', absl::SkipWhitespace())) {
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int                            first = 0, last = -1;
+    if (bounds.size() > 2 || !absl::SimpleAtoi(bounds.front(), &first) || !absl::SimpleAtoi(bounds.back(), &last) ||
+        first < 0 || first > last || last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+  return true;
+}
+
+bool SetCurrentThreadAffinity(const std::vector<int> &cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : cpus) {
+    CHECK_GE(cpu, 0);
+    CHECK_LT(cpu, CPU_SETSIZE);
+    CPU_SET(cpu, &cpu_set);
+  }
+  int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  LOG_IF(WARNING, ret != 0) << "Failed to set thread affinity, error " << ret;
+  return ret == 0;
+}
+
+bool SetCurrentThreadName(const std::string &name) {
+  int ret = pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+  LOG_IF(WARNING, ret != 0) << "Failed to set thread name " << name << ", error " << ret;
+  return ret == 0;
+}
+
+bool SetCurrentThreadFifoPriority(int priority) {
+  CHECK_GE(priority, sched_get_priority_min(SCHED_FIFO));
+  CHECK_LE(priority, sched_get_priority_max(SCHED_FIFO));
+  sched_param param{};
+  param.sched_priority = priority;
+  int ret              = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  LOG_IF(WARNING, ret != 0) << "Failed to set SCHED_FIFO priority " << priority << ", error " << ret;
+  return ret == 0;
+}
+
+bool LockProcessMemory() {
+  int ret = mlockall(MCL_CURRENT | MCL_FUTURE);
+  LOG_IF(WARNING, ret != 0) << "Failed to lock memory, error " << errno;
+  return ret == 0;
+}
+
+void SetThreadConfigs(const std::vector<ThreadConfig> &configs) {
+  absl::MutexLock lock(&g_thread_configs_mutex);
+  g_thread_configs = configs;
+}
+
+bool FindThreadConfig(const std::string &name, ThreadConfig *config) {
+  absl::MutexLock lock(&g_thread_configs_mutex);
+  auto            it = std::find_if(g_thread_configs.begin(), g_thread_configs.end(), [&name](const ThreadConfig &config) { return config.name == name; });
+  if (it == g_thread_configs.end()) {
+    return false;
+  }
+  *config = *it;
+  return true;
+}
+
+void ConfigureCurrentThread(const std::string &name) {
+  SetCurrentThreadName(name);
+  ThreadConfig config;
+  if (!FindThreadConfig(name, &config)) {
+    return;
+  }
+  if (!config.cpu_list.empty()) {
+    SetCurrentThreadAffinity(ParseCpuList(config.cpu_list));
+  }
+  if (config.fifo_priority > 0) {
+    SetCurrentThreadFifoPriority(config.fifo_priority);
+  }
+  LOG(INFO) << "Thread " << name << " runs on cpus [" << config.cpu_list << "] with SCHED_FIFO priority " << config.fifo_priority << ".";
+}
+
+void RunPollingLoop(const std::string           &name,
+                    std::chrono::milliseconds    period,
+                    const std::function<bool()> &poll,
+                    const std::function<bool()> &running,
+                    std::chrono::seconds         report_period) {
+  Histogram wakeup_latency_us;
+  auto      report_time = std::chrono::steady_clock::now();
+  while (true) {
+    if (poll()) {
+      continue;
+    }
+    if (!running()) {
+      break;
+    }
+    auto sleep_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(period);
+    auto now = std::chrono::steady_clock::now();
+    wakeup_latency_us.Add(std::chrono::duration<double, std::micro>(now - sleep_start - period).count());
+    if (now - report_time >= report_period) {
+      LOG(INFO) << "Wakeup latency of the " << name << " thread in us: " << wakeup_latency_us.ToString(5);
+      wakeup_latency_us = Histogram();
+      report_time       = now;
+    }
+  }
+  LOG(INFO) << "Wakeup latency of the " << name << " thread in us: " << wakeup_latency_us.ToString(5);
+}
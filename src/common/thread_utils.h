@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Scheduling of the threads with one name
+ */
+struct ThreadConfig {
+  std::string name;               // as passed to ConfigureCurrentThread, e.g. odometry
+  std::string cpu_list;           // cpus the threads are pinned to like "2-3", empty to leave it to the os
+  int         fifo_priority = 0;  // SCHED_FIFO priority in [1, 99], 0 to keep the default scheduler
+};
+
+/**
+ * @brief Parse a cpu list like "0-3,8,10-11"
+ *
+ * @return cpu ids in the order given, empty for an empty string
+ */
+std::vector<int> ParseCpuList(const std::string &cpu_list);
+
+/**
+ * @brief Parse a cpu list like "0-3,8,10-11"
+ *
+ * @return false if the list is malformed
+ */
+bool ParseCpuList(const std::string &cpu_list, std::vector<int> *cpus);
+
+/**
+ * @brief Restrict the calling thread to the given cpus
+ *
+ * @return false if the affinity could not be set, e.g. a cpu does not exist
+ */
+bool SetCurrentThreadAffinity(const std::vector<int> &cpus);
+
+/**
+ * @brief Name the calling thread as shown by top -H and gdb, truncated to 15 characters
+ */
+bool SetCurrentThreadName(const std::string &name);
+
+/**
+ * @brief Run the calling thread with SCHED_FIFO at the given priority
+ *
+ * @return false without CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO
+ */
+bool SetCurrentThreadFifoPriority(int priority);
+
+/**
+ * @brief Lock all current and future pages of the process in memory, so that page faults do not add latency
+ *
+ * @return false without CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK
+ */
+bool LockProcessMemory();
+
+/**
+ * @brief Set the configs applied by ConfigureCurrentThread, call before starting the threads
+ */
+void SetThreadConfigs(const std::vector<ThreadConfig> &configs);
+
+/**
+ * @brief Find the config of the threads with this name
+ *
+ * @return false if no config has this name, the threads keep the os defaults then
+ */
+bool FindThreadConfig(const std::string &name, ThreadConfig *config);
+
+/**
+ * @brief Name the calling thread and apply the affinity and priority of the config with this name, if any
+ *
+ * Called at the start of every long running thread of the pipeline.
+ */
+void ConfigureCurrentThread(const std::string &name);
+
+/**
+ * @brief Loop of a long running consumer thread
+ *
+ * Calls poll until it returns false, i.e. it found nothing to do, then returns if running returns false and sleeps
+ * for the period otherwise. How much later than the period the thread wakes up is its scheduling latency, a histogram
+ * of it is logged every report_period and when the loop ends.
+ *
+ * @param name of the thread in the log
+ */
+void RunPollingLoop(const std::string           &name,
+                    std::chrono::milliseconds    period,
+                    const std::function<bool()> &poll,
+                    const std::function<bool()> &running,
+                    std::chrono::seconds         report_period = std::chrono::seconds(60));
@@ -0,0 +1,75 @@
+#include "common/trajectory.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+bool InterpolatePose(const std::vector<TimedPose> &trajectory, double timestamp, Rigid3d *pose) {
+  if (trajectory.empty() || timestamp < trajectory.front().timestamp || timestamp > trajectory.back().timestamp) {
+    return false;
+  }
+  auto it = std::lower_bound(trajectory.begin(), trajectory.end(), timestamp, [](const TimedPose &a, double b) { return a.timestamp < b; });
+  if (it->timestamp == timestamp) {
+    *pose = it->pose;
+    return true;
+  }
+  const auto &left   = *(it - 1);
+  const auto &right  = *it;
+  double      factor = (timestamp - left.timestamp) / (right.timestamp - left.timestamp);
+  *pose              = Rigid3d(
+      left.pose.translation() * (1 - factor) + right.pose.translation() * factor,
+      left.pose.rotation().slerp(factor, right.pose.rotation()));
+  return true;
+}
+
+void WriteTumPose(std::ostream &os, const TimedPose &timed_pose) {
+  const auto &pose = timed_pose.pose;
+  os << std::fixed << std::setprecision(9) << timed_pose.timestamp << " "
+     << pose.translation().x() << " " << pose.translation().y() << " " << pose.translation().z() << " "
+     << pose.rotation().x() << " " << pose.rotation().y() << " " << pose.rotation().z() << " " << pose.rotation().w() << "\n";
+}
+
+void WriteTumTrajectory(const std::string &filename, const std::vector<TimedPose> &trajectory) {
+  std::ofstream ofs(filename);
+  CHECK(ofs) << "Failed to open " << filename;
+  for (auto &timed_pose : trajectory) {
+    WriteTumPose(ofs, timed_pose);
+  }
+}
+
+bool ReadTumTrajectory(const std::string &filename, std::vector<TimedPose> *trajectory) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    return false;
+  }
+  trajectory->clear();
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    double             timestamp, tx, ty, tz, qx, qy, qz, qw;
+    if (!(iss >> timestamp >> tx >> ty >> tz >> qx >> qy >> qz >> qw)) {
+      return false;
+    }
+    trajectory->push_back({timestamp, Rigid3d(Eigen::Vector3d(tx, ty, tz), Eigen::Quaterniond(qw, qx, qy, qz).normalized())});
+  }
+  return true;
+}
+
+TrajectoryDeviation CompareTrajectories(const std::vector<TimedPose> &trajectory, const std::vector<TimedPose> &reference) {
+  TrajectoryDeviation deviation;
+  for (const auto &timed_pose : trajectory) {
+    Rigid3d reference_pose;
+    if (!InterpolatePose(reference, timed_pose.timestamp, &reference_pose)) {
+      continue;
+    }
+    ++deviation.pose_num;
+    deviation.max_translation = std::max(deviation.max_translation, (timed_pose.pose.translation() - reference_pose.translation()).norm());
+    deviation.max_rotation    = std::max(deviation.max_rotation, timed_pose.pose.rotation().angularDistance(reference_pose.rotation()));
+  }
+  return deviation;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "common/rigid_transform.h"
+
+struct TimedPose {
+  double  timestamp;
+  Rigid3d pose;
+};
+
+/**
+ * @brief Interpolate a pose of a trajectory sorted by timestamp, linear in position and slerp in rotation
+ *
+ * @return false if timestamp is out of the trajectory time range
+ */
+bool InterpolatePose(const std::vector<TimedPose> &trajectory, double timestamp, Rigid3d *pose);
+
+/**
+ * @brief Write one pose in TUM format: timestamp tx ty tz qx qy qz qw
+ */
+void WriteTumPose(std::ostream &os, const TimedPose &timed_pose);
+
+void WriteTumTrajectory(const std::string &filename, const std::vector<TimedPose> &trajectory);
+
+/**
+ * @return false if the file can not be opened or a line is not a TUM pose
+ */
+bool ReadTumTrajectory(const std::string &filename, std::vector<TimedPose> *trajectory);
+
+struct TrajectoryDeviation {
+  int    pose_num        = 0;  // poses within the time range of the reference
+  double max_translation = 0;  // in meters
+  double max_rotation    = 0;  // in radians
+};
+
+/**
+ * @brief Largest deviation of the poses of a trajectory from the reference, interpolated at their timestamps
+ *
+ * Used to check that a faster but less exact configuration converges to the same trajectory.
+ */
+TrajectoryDeviation CompareTrajectories(const std::vector<TimedPose> &trajectory, const std::vector<TimedPose> &reference);
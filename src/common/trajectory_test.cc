@@ -0,0 +1,44 @@
+#include "common/trajectory.h"
+
+#include <gtest/gtest.h>
+
+TEST(Trajectory, InterpolatePose) {
+  std::vector<TimedPose> trajectory = {
+      {1.0, Rigid3d(Eigen::Vector3d(0, 0, 0), Eigen::Quaterniond::Identity())},
+      {2.0, Rigid3d(Eigen::Vector3d(2, 0, 0), Eigen::Quaterniond(Eigen::AngleAxisd(M_PI / 2, Eigen::Vector3d::UnitZ())))},
+  };
+
+  Rigid3d pose;
+  EXPECT_FALSE(InterpolatePose(trajectory, 0.5, &pose));
+  EXPECT_FALSE(InterpolatePose(trajectory, 2.5, &pose));
+
+  ASSERT_TRUE(InterpolatePose(trajectory, 1.5, &pose));
+  EXPECT_NEAR(pose.translation().x(), 1.0, 1e-9);
+  EXPECT_NEAR(Eigen::AngleAxisd(pose.rotation()).angle(), M_PI / 4, 1e-9);
+
+  ASSERT_TRUE(InterpolatePose(trajectory, 2.0, &pose));
+  EXPECT_NEAR(pose.translation().x(), 2.0, 1e-9);
+}
+
+TEST(Trajectory, ReadAndCompare) {
+  std::vector<TimedPose> reference = {
+      {1.0, Rigid3d(Eigen::Vector3d(0, 0, 0), Eigen::Quaterniond::Identity())},
+      {2.0, Rigid3d(Eigen::Vector3d(2, 0, 0), Eigen::Quaterniond(Eigen::AngleAxisd(0.2, Eigen::Vector3d::UnitZ())))},
+  };
+  std::string filename = testing::TempDir() + "/trajectory.txt";
+  WriteTumTrajectory(filename, reference);
+  std::vector<TimedPose> read;
+  ASSERT_TRUE(ReadTumTrajectory(filename, &read));
+  ASSERT_EQ(read.size(), 2);
+  EXPECT_EQ(read[1].timestamp, 2.0);
+
+  std::vector<TimedPose> trajectory = {
+      {0.5, Rigid3d(Eigen::Vector3d(5, 0, 0), Eigen::Quaterniond::Identity())},
+      {1.5, Rigid3d(Eigen::Vector3d(1, 0.01, 0), Eigen::Quaterniond(Eigen::AngleAxisd(0.1, Eigen::Vector3d::UnitZ())))},
+      {2.0, Rigid3d(Eigen::Vector3d(2, 0, 0), Eigen::Quaterniond(Eigen::AngleAxisd(0.23, Eigen::Vector3d::UnitZ())))},
+  };
+  TrajectoryDeviation deviation = CompareTrajectories(trajectory, read);
+  EXPECT_EQ(deviation.pose_num, 2);
+  EXPECT_NEAR(deviation.max_translation, 0.01, 1e-6);
+  EXPECT_NEAR(deviation.max_rotation, 0.03, 1e-6);
+}
@@ -25,6 +25,14 @@ inline Quaterniond Exp(const Vector3d& v) {
   return Sophus::SO3d::exp(v).unit_quaternion();
 }
 
+/**
+ * @brief Exp in the precision of v, e.g. for float kernels
+ */
+template <typename Scalar>
+Eigen::Quaternion<Scalar> TypedExp(const Eigen::Matrix<Scalar, 3, 1>& v) {
+  return Sophus::SO3<Scalar>::exp(v).unit_quaternion();
+}
+
 inline Vector3d Log(const Quaterniond& q) {
   return Sophus::SO3d(q).log();
 }
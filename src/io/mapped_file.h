@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class MappedFile {
+ public:
+  enum class Access {
+    kSequential,  // read ahead aggressively, pages are dropped early
+    kRandom,
+  };
+
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile &)            = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /**
+   * @brief Map a file, unmapping the previous one
+   *
+   * @return false if the file can not be opened or mapped
+   */
+  bool Open(const std::string &filename, Access access = Access::kSequential);
+
+  void Close();
+
+  const char *Data() const { return data_; }
+
+  size_t Size() const { return size_; }
+
+ private:
+  const char *data_ = nullptr;  // null for empty files, which can not be mapped
+  size_t      size_ = 0;
+};
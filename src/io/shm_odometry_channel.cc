@@ -0,0 +1,41 @@
+#include "io/shm_odometry_channel.h"
+
+#include <glog/logging.h>
+
+ShmOdometryWriter::ShmOdometryWriter(const std::string &channel_name, int pose_slot_num, int sweep_slot_num, int sweep_max_points)
+    : pose_ring_(ShmPoseRingName(channel_name), pose_slot_num, sizeof(ShmPoseRecord)),
+      sweep_ring_(ShmSweepRingName(channel_name), sweep_slot_num, sizeof(ShmSweepHeader) + uint64_t(sweep_max_points) * sizeof(ShmPoint)),
+      sweep_max_points_(sweep_max_points) {
+  CHECK_GT(sweep_max_points, 0);
+}
+
+void ShmOdometryWriter::WritePose(const ShmPoseRecord &pose) {
+  pose_ring_.Write(&pose, sizeof(pose));
+}
+
+bool ShmOdometryReader::Open(const std::string &channel_name) {
+  if (!pose_ring_.IsOpen() && !pose_ring_.Open(ShmPoseRingName(channel_name))) {
+    return false;
+  }
+  if (!sweep_ring_.IsOpen() && !sweep_ring_.Open(ShmSweepRingName(channel_name))) {
+    return false;
+  }
+  return true;
+}
+
+bool ShmOdometryReader::ReadPose(uint64_t index, ShmPoseRecord *pose) const {
+  uint64_t size = 0;
+  return pose_ring_.Read(index, pose, sizeof(*pose), &size) && size == sizeof(*pose);
+}
+
+bool ShmOdometryReader::ReadLatestPose(ShmPoseRecord *pose) const {
+  uint64_t size = 0;
+  return pose_ring_.ReadLatest(pose, sizeof(*pose), &size) && size == sizeof(*pose);
+}
+
+bool ShmOdometryReader::ReadSweep(uint64_t index, ShmSweepHeader *header, std::vector<ShmPoint> *points) const {
+  return VisitSweep(index, [&](const ShmSweepHeader &h, const ShmPoint *data) {
+    *header = h;
+    points->assign(data, data + h.num_points);
+  });
+}
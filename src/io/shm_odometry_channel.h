@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "io/shm_ring_buffer.h"
+
+/**
+ * @brief Shared memory output of the odometry for consumers on the same host
+ *
+ * Two rings are created per channel:
+ *   <name>_pose:  one ShmPoseRecord per sweep
+ *   <name>_sweep: one ShmSweepHeader followed by num_points ShmPoint per sweep
+ *
+ * All records are plain old data with fixed layout, readers only need this header and
+ * io/shm_ring_buffer.{h,cc}.
+ */
+struct ShmPoseRecord {
+  static constexpr uint32_t kCovarianceValid = 1u << 0;
+
+  double   timestamp;
+  double   position[3];     // imu_link in world
+  double   orientation[4];  // x, y, z, w
+  double   covariance[36];  // row major, [rotation, position] in the tangent space of the pose
+  uint32_t sweep_id;
+  uint32_t flags;
+};
+
+struct ShmSweepHeader {
+  static constexpr uint32_t kTruncated = 1u << 0;
+
+  double   timestamp;  // time of the first point
+  uint32_t sweep_id;
+  uint32_t num_points;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+struct ShmPoint {
+  float  x, y, z;  // undistorted, in world
+  float  intensity;
+  double time;
+};
+
+inline std::string ShmPoseRingName(const std::string &channel_name) {
+  return channel_name + "_pose";
+}
+
+inline std::string ShmSweepRingName(const std::string &channel_name) {
+  return channel_name + "_sweep";
+}
+
+class ShmOdometryWriter {
+ public:
+  ShmOdometryWriter(const std::string &channel_name, int pose_slot_num, int sweep_slot_num, int sweep_max_points);
+
+  void WritePose(const ShmPoseRecord &pose);
+
+  /**
+   * @brief Write a sweep directly into the shared memory slot, points beyond the slot capacity are dropped
+   */
+  template <typename PointT>
+  void WriteSweep(double timestamp, uint32_t sweep_id, const std::vector<PointT> &points) {
+    uint8_t *payload = sweep_ring_.BeginWrite();
+    auto     header  = reinterpret_cast<ShmSweepHeader *>(payload);
+    auto     out     = reinterpret_cast<ShmPoint *>(payload + sizeof(ShmSweepHeader));
+    size_t   size    = std::min<size_t>(points.size(), sweep_max_points_);
+    for (size_t i = 0; i < size; ++i) {
+      out[i].x         = points[i].x;
+      out[i].y         = points[i].y;
+      out[i].z         = points[i].z;
+      out[i].intensity = points[i].intensity;
+      out[i].time      = points[i].time;
+    }
+    header->timestamp  = timestamp;
+    header->sweep_id   = sweep_id;
+    header->num_points = size;
+    header->flags      = size < points.size() ? ShmSweepHeader::kTruncated : 0;
+    header->reserved   = 0;
+    sweep_ring_.EndWrite(sizeof(ShmSweepHeader) + size * sizeof(ShmPoint));
+  }
+
+ private:
+  ShmRingWriter pose_ring_;
+  ShmRingWriter sweep_ring_;
+  int           sweep_max_points_;
+};
+
+/**
+ * @brief Reader library entry point for processes consuming the odometry output
+ */
+class ShmOdometryReader {
+ public:
+  /**
+   * @brief Map both rings of a channel
+   *
+   * @return false if the odometry has not created the channel yet
+   */
+  bool Open(const std::string &channel_name);
+
+  uint64_t PoseCount() const { return pose_ring_.WriteCount(); }
+  uint64_t SweepCount() const { return sweep_ring_.WriteCount(); }
+
+  bool ReadPose(uint64_t index, ShmPoseRecord *pose) const;
+  bool ReadLatestPose(ShmPoseRecord *pose) const;
+
+  /**
+   * @brief Zero-copy access to a sweep, see ShmRingReader::Visit for the consistency contract
+   *
+   * @param visitor callable as visitor(const ShmSweepHeader &header, const ShmPoint *points)
+   */
+  template <typename Visitor>
+  bool VisitSweep(uint64_t index, Visitor &&visitor) const {
+    bool visited    = false;
+    bool consistent = sweep_ring_.Visit(index, [&](const uint8_t *payload, uint64_t payload_size) {
+      if (payload_size < sizeof(ShmSweepHeader)) {
+        return;
+      }
+      auto header = reinterpret_cast<const ShmSweepHeader *>(payload);
+      if (sizeof(ShmSweepHeader) + uint64_t(header->num_points) * sizeof(ShmPoint) > payload_size) {
+        return;  // torn read, rejected by the sequence check afterwards
+      }
+      visitor(*header, reinterpret_cast<const ShmPoint *>(payload + sizeof(ShmSweepHeader)));
+      visited = true;
+    });
+    return consistent && visited;
+  }
+
+  /**
+   * @brief Copy a sweep out of shared memory
+   */
+  bool ReadSweep(uint64_t index, ShmSweepHeader *header, std::vector<ShmPoint> *points) const;
+
+ private:
+  ShmRingReader pose_ring_;
+  ShmRingReader sweep_ring_;
+};
@@ -0,0 +1,166 @@
+#include "io/shm_ring_buffer.h"
+
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t kSlotAlignment = 64;
+
+uint64_t AlignUp(uint64_t size, uint64_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+uint64_t HeaderSize() {
+  return AlignUp(sizeof(ShmRingHeader), kSlotAlignment);
+}
+
+}  // namespace
+
+ShmRingWriter::ShmRingWriter(const std::string &name, uint32_t slot_num, uint64_t slot_capacity) : name_(name) {
+  CHECK_GT(slot_num, 0);
+  CHECK_GT(slot_capacity, 0);
+  uint64_t slot_stride = AlignUp(sizeof(ShmRingSlotHeader) + slot_capacity, kSlotAlignment);
+  mapped_size_         = HeaderSize() + slot_stride * slot_num;
+
+  // drop a stale ring left behind by a crashed writer, readers still mapping it are unaffected
+  shm_unlink(name_.c_str());
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  PCHECK(fd >= 0) << "shm_open " << name_;
+  PCHECK(ftruncate(fd, mapped_size_) == 0) << "ftruncate " << name_;
+  void *addr = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  PCHECK(addr != MAP_FAILED) << "mmap " << name_;
+  close(fd);
+
+  // ftruncate zero-fills the object, so all slot sequences start at 0 (never written)
+  header_                = new (addr) ShmRingHeader;
+  header_->version       = ShmRingHeader::kVersion;
+  header_->slot_num      = slot_num;
+  header_->slot_capacity = slot_capacity;
+  header_->slot_stride   = slot_stride;
+  header_->write_count.store(0, std::memory_order_relaxed);
+  header_->magic.store(ShmRingHeader::kMagic, std::memory_order_release);
+
+  LOG(INFO) << "Created shared memory ring " << name_ << " with " << slot_num << " slots of " << slot_capacity << " bytes";
+}
+
+ShmRingWriter::~ShmRingWriter() {
+  if (header_) {
+    munmap(header_, mapped_size_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+ShmRingSlotHeader *ShmRingWriter::Slot(uint64_t write_index) const {
+  auto base = reinterpret_cast<uint8_t *>(header_) + HeaderSize();
+  return reinterpret_cast<ShmRingSlotHeader *>(base + (write_index % header_->slot_num) * header_->slot_stride);
+}
+
+uint8_t *ShmRingWriter::BeginWrite() {
+  CHECK(!is_writing_) << "BeginWrite called twice without EndWrite";
+  is_writing_    = true;
+  writing_index_ = header_->write_count.load(std::memory_order_relaxed);
+
+  ShmRingSlotHeader *slot = Slot(writing_index_);
+  slot->sequence.store(2 * writing_index_ + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return reinterpret_cast<uint8_t *>(slot + 1);
+}
+
+void ShmRingWriter::EndWrite(uint64_t payload_size) {
+  CHECK(is_writing_) << "EndWrite called without BeginWrite";
+  CHECK_LE(payload_size, header_->slot_capacity);
+  is_writing_ = false;
+
+  ShmRingSlotHeader *slot = Slot(writing_index_);
+  slot->payload_size      = payload_size;
+  slot->sequence.store(2 * (writing_index_ + 1), std::memory_order_release);
+  header_->write_count.store(writing_index_ + 1, std::memory_order_release);
+}
+
+void ShmRingWriter::Write(const void *payload, uint64_t payload_size) {
+  CHECK_LE(payload_size, header_->slot_capacity);
+  std::memcpy(BeginWrite(), payload, payload_size);
+  EndWrite(payload_size);
+}
+
+ShmRingReader::~ShmRingReader() {
+  if (header_) {
+    munmap(const_cast<ShmRingHeader *>(header_), mapped_size_);
+  }
+}
+
+bool ShmRingReader::Open(const std::string &name) {
+  CHECK(!header_) << "Ring already opened";
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(HeaderSize())) {
+    close(fd);
+    return false;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  auto header = reinterpret_cast<const ShmRingHeader *>(addr);
+  if (header->magic.load(std::memory_order_acquire) != ShmRingHeader::kMagic ||
+      header->version != ShmRingHeader::kVersion ||
+      HeaderSize() + header->slot_stride * header->slot_num > static_cast<uint64_t>(st.st_size)) {
+    munmap(addr, st.st_size);
+    return false;
+  }
+  header_      = header;
+  mapped_size_ = st.st_size;
+  return true;
+}
+
+const ShmRingSlotHeader *ShmRingReader::Slot(uint64_t write_index) const {
+  auto base = reinterpret_cast<const uint8_t *>(header_) + HeaderSize();
+  return reinterpret_cast<const ShmRingSlotHeader *>(base + (write_index % header_->slot_num) * header_->slot_stride);
+}
+
+bool ShmRingReader::Read(uint64_t write_index, void *payload, uint64_t max_size, uint64_t *payload_size) const {
+  uint64_t size       = 0;
+  bool     consistent = Visit(write_index, [&](const uint8_t *data, uint64_t data_size) {
+    size = data_size;
+    if (size <= max_size) {
+      std::memcpy(payload, data, size);
+    }
+  });
+  *payload_size = consistent ? size : 0;
+  if (consistent && size > max_size) {
+    uint64_t oversized_read_num = oversized_read_num_.fetch_add(1, std::memory_order_relaxed) + 1;
+    LOG_IF(WARNING, oversized_read_num % 100 == 1) << "Write " << write_index << " of " << size << " bytes does not fit into a buffer of "
+                                                   << max_size << " bytes, " << oversized_read_num << " oversized reads so far";
+    return false;
+  }
+  return consistent;
+}
+
+bool ShmRingReader::ReadLatest(void *payload, uint64_t max_size, uint64_t *payload_size, uint64_t *write_index) const {
+  while (true) {
+    uint64_t count = WriteCount();
+    if (count == 0) {
+      return false;
+    }
+    if (Read(count - 1, payload, max_size, payload_size)) {
+      if (write_index) {
+        *write_index = count - 1;
+      }
+      return true;
+    }
+    if (*payload_size > max_size) {
+      return false;
+    }
+  }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Layout of a ring buffer living in POSIX shared memory
+ *
+ * Memory layout: [ShmRingHeader][slot 0][slot 1]...[slot n-1]
+ * Every slot starts with a ShmRingSlotHeader followed by slot_capacity bytes of payload.
+ *
+ * Each slot is protected by its own seqlock. The sequence of a slot is odd while the writer
+ * is modifying it and equals 2 * (write_index + 1) once the write with index write_index has
+ * been committed, so readers can tell both torn reads and overwritten slots apart.
+ */
+struct ShmRingHeader {
+  static constexpr uint64_t kMagic   = 0x57434154'52494e47;  // "WCATRING"
+  static constexpr uint32_t kVersion = 1;
+
+  std::atomic<uint64_t> magic;
+  uint32_t              version;
+  uint32_t              slot_num;
+  uint64_t              slot_capacity;  // payload bytes per slot
+  uint64_t              slot_stride;    // bytes between two consecutive slot headers
+  std::atomic<uint64_t> write_count;    // number of committed writes
+};
+
+struct alignas(64) ShmRingSlotHeader {
+  std::atomic<uint64_t> sequence;
+  uint64_t              payload_size;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+/**
+ * @brief Single producer side of a shared memory ring
+ *
+ * The writer owns the shared memory object: it is created in the constructor and unlinked in
+ * the destructor. Readers that still have it mapped keep working on the old mapping.
+ */
+class ShmRingWriter {
+ public:
+  ShmRingWriter(const std::string &name, uint32_t slot_num, uint64_t slot_capacity);
+  ~ShmRingWriter();
+
+  ShmRingWriter(const ShmRingWriter &)            = delete;
+  ShmRingWriter &operator=(const ShmRingWriter &) = delete;
+
+  /**
+   * @brief Start writing the next slot in place
+   *
+   * @return pointer to slot_capacity bytes of payload, valid until EndWrite is called
+   */
+  uint8_t *BeginWrite();
+
+  /**
+   * @brief Publish the slot started by BeginWrite
+   *
+   * @param payload_size number of valid payload bytes, at most slot_capacity
+   */
+  void EndWrite(uint64_t payload_size);
+
+  /**
+   * @brief Copy payload into the next slot and publish it
+   */
+  void Write(const void *payload, uint64_t payload_size);
+
+  uint64_t SlotCapacity() const { return header_->slot_capacity; }
+
+ private:
+  ShmRingSlotHeader *Slot(uint64_t write_index) const;
+
+  std::string    name_;
+  size_t         mapped_size_ = 0;
+  ShmRingHeader *header_      = nullptr;
+  uint64_t       writing_index_;
+  bool           is_writing_ = false;
+};
+
+/**
+ * @brief Read side of a shared memory ring, usable from any number of processes
+ *
+ * The reader never writes to the shared memory, the object is mapped read only.
+ */
+class ShmRingReader {
+ public:
+  ShmRingReader() = default;
+  ~ShmRingReader();
+
+  ShmRingReader(const ShmRingReader &)            = delete;
+  ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+  /**
+   * @brief Map an existing ring
+   *
+   * @return false if the ring does not exist (yet) or is not initialized
+   */
+  bool Open(const std::string &name);
+
+  bool IsOpen() const { return header_ != nullptr; }
+
+  /**
+   * @brief Number of writes committed so far, the latest one has index WriteCount() - 1
+   */
+  uint64_t WriteCount() const { return header_->write_count.load(std::memory_order_acquire); }
+
+  uint32_t SlotNum() const { return header_->slot_num; }
+
+  /**
+   * @brief Zero-copy read of the write with the given index
+   *
+   * The visitor is called with a pointer into shared memory, as in any seqlock the data may be
+   * modified concurrently while it is visited. Everything the visitor derived from it must be
+   * discarded when this function returns false.
+   *
+   * @param write_index
+   * @param visitor callable as visitor(const uint8_t *payload, uint64_t payload_size)
+   * @return true if the visited data was consistent and belongs to write_index
+   */
+  template <typename Visitor>
+  bool Visit(uint64_t write_index, Visitor &&visitor) const {
+    const ShmRingSlotHeader *slot     = Slot(write_index);
+    const uint64_t           expected = 2 * (write_index + 1);
+    if (slot->sequence.load(std::memory_order_acquire) != expected) {
+      return false;
+    }
+    uint64_t payload_size = slot->payload_size;
+    if (payload_size > header_->slot_capacity) {
+      return false;
+    }
+    visitor(reinterpret_cast<const uint8_t *>(slot + 1), payload_size);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot->sequence.load(std::memory_order_relaxed) == expected;
+  }
+
+  /**
+   * @brief Copy out the write with the given index
+   *
+   * A write larger than max_size is not copied, instead of handing out a truncated payload.
+   *
+   * @param write_index
+   * @param payload buffer of at least max_size bytes
+   * @param max_size
+   * @param payload_size set to the number of copied bytes, to the required size if the write does not fit into
+   *                     max_size, or to 0 if the write was overwritten
+   * @return true if the copy is consistent and belongs to write_index
+   */
+  bool Read(uint64_t write_index, void *payload, uint64_t max_size, uint64_t *payload_size) const;
+
+  /**
+   * @brief Copy out the most recent write, retrying while the writer laps the reader
+   *
+   * @return false if nothing has been written yet, or if the latest write is larger than max_size, see Read
+   */
+  bool ReadLatest(void *payload, uint64_t max_size, uint64_t *payload_size, uint64_t *write_index = nullptr) const;
+
+  /**
+   * @brief Number of reads refused so far because the write did not fit into the buffer
+   */
+  uint64_t OversizedReadNum() const { return oversized_read_num_.load(std::memory_order_relaxed); }
+
+ private:
+  const ShmRingSlotHeader *Slot(uint64_t write_index) const;
+
+  size_t                        mapped_size_ = 0;
+  const ShmRingHeader          *header_      = nullptr;
+  mutable std::atomic<uint64_t> oversized_read_num_{0};
+};
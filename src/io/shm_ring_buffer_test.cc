@@ -0,0 +1,164 @@
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "common/common.h"
+#include "common/histogram.h"
+#include "common/test_utils.h"
+#include "io/shm_odometry_channel.h"
+#include "io/shm_ring_buffer.h"
+
+namespace {
+
+struct TestRecord {
+  int64_t  write_time_ns;
+  uint64_t index;
+  uint64_t payload[64];  // every element equals index, used to detect torn reads
+};
+
+int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+TEST(ShmRingBuffer, WriteRead) {
+  std::string   name = "/" + UniqueTestName("write_read");
+  ShmRingWriter writer(name, 4, sizeof(uint64_t));
+  ShmRingReader reader;
+  ASSERT_TRUE(reader.Open(name));
+  EXPECT_EQ(reader.WriteCount(), 0);
+
+  uint64_t value = 0, size = 0;
+  EXPECT_FALSE(reader.ReadLatest(&value, sizeof(value), &size));
+
+  for (uint64_t i = 0; i < 6; ++i) {
+    writer.Write(&i, sizeof(i));
+  }
+  EXPECT_EQ(reader.WriteCount(), 6);
+
+  // the first two writes have been overwritten by the ring
+  EXPECT_FALSE(reader.Read(0, &value, sizeof(value), &size));
+  EXPECT_FALSE(reader.Read(1, &value, sizeof(value), &size));
+  for (uint64_t i = 2; i < 6; ++i) {
+    EXPECT_TRUE(reader.Read(i, &value, sizeof(value), &size));
+    EXPECT_EQ(size, sizeof(value));
+    EXPECT_EQ(value, i);
+  }
+  // not written yet
+  EXPECT_FALSE(reader.Read(6, &value, sizeof(value), &size));
+
+  uint64_t index = 0;
+  EXPECT_TRUE(reader.ReadLatest(&value, sizeof(value), &size, &index));
+  EXPECT_EQ(value, 5);
+  EXPECT_EQ(index, 5);
+
+  // a too small buffer gets the required size instead of a truncated payload
+  uint32_t small = 0;
+  EXPECT_FALSE(reader.Read(5, &small, sizeof(small), &size));
+  EXPECT_EQ(size, sizeof(value));
+  EXPECT_EQ(small, 0);
+  EXPECT_FALSE(reader.ReadLatest(&small, sizeof(small), &size));
+  EXPECT_EQ(size, sizeof(value));
+  EXPECT_EQ(reader.OversizedReadNum(), 2);
+  EXPECT_FALSE(reader.Read(0, &value, sizeof(value), &size));
+  EXPECT_EQ(size, 0);
+}
+
+TEST(ShmRingBuffer, OpenMissing) {
+  ShmRingReader reader;
+  EXPECT_FALSE(reader.Open("/" + UniqueTestName("missing")));
+}
+
+TEST(ShmRingBuffer, OdometryChannel) {
+  std::string       name = "/" + UniqueTestName("odometry");
+  ShmOdometryWriter writer(name, 8, 2, 3);
+  ShmOdometryReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  ShmPoseRecord pose{};
+  pose.timestamp = 12.5;
+  pose.sweep_id  = 3;
+  writer.WritePose(pose);
+
+  std::vector<hilti_ros::Point> points(5);
+  for (int i = 0; i < points.size(); ++i) {
+    points[i].getVector3fMap() = Eigen::Vector3f::Constant(i);
+    points[i].time             = i * 0.1;
+  }
+  writer.WriteSweep(0.0, 3, points);
+
+  ShmPoseRecord pose_read;
+  ASSERT_TRUE(reader.ReadLatestPose(&pose_read));
+  EXPECT_EQ(pose_read.timestamp, 12.5);
+  EXPECT_EQ(pose_read.sweep_id, 3);
+
+  ShmSweepHeader        header;
+  std::vector<ShmPoint> points_read;
+  ASSERT_TRUE(reader.ReadSweep(0, &header, &points_read));
+  EXPECT_EQ(header.num_points, 3);
+  EXPECT_EQ(header.flags, ShmSweepHeader::kTruncated);
+  ASSERT_EQ(points_read.size(), 3);
+  EXPECT_EQ(points_read[2].x, 2);
+  EXPECT_EQ(points_read[2].time, 0.2);
+}
+
+TEST(ShmRingBuffer, ConcurrentLatency) {
+  constexpr uint64_t kWriteNum = 20'000;
+  std::string        name      = "/" + UniqueTestName("latency");
+  ShmRingWriter      writer(name, 16, sizeof(TestRecord));
+
+  std::atomic<bool> reader_ready{false};
+  Histogram         latency_us;
+  uint64_t          read_num = 0, torn_num = 0;
+
+  std::thread reader_thread([&]() {
+    // a second mapping of the same object, as a reader in another process would have
+    ShmRingReader reader;
+    CHECK(reader.Open(name));
+    reader_ready = true;
+
+    uint64_t next_index = 0;
+    while (next_index < kWriteNum) {
+      uint64_t count = reader.WriteCount();
+      if (count <= next_index) {
+        continue;
+      }
+      next_index = std::max(next_index, count - 1);  // always read the most recent write
+      TestRecord record;
+      uint64_t   size;
+      if (!reader.Read(next_index, &record, sizeof(record), &size)) {
+        ++next_index;  // lapped by the writer
+        continue;
+      }
+      int64_t now = NowNs();
+      for (auto &e : record.payload) {
+        if (e != record.index) {
+          ++torn_num;
+          break;
+        }
+      }
+      latency_us.Add((now - record.write_time_ns) * 1e-3);
+      ++read_num;
+      ++next_index;
+    }
+  });
+
+  while (!reader_ready) {
+  }
+  for (uint64_t i = 0; i < kWriteNum; ++i) {
+    auto record   = reinterpret_cast<TestRecord *>(writer.BeginWrite());
+    record->index = i;
+    std::fill(std::begin(record->payload), std::end(record->payload), i);
+    record->write_time_ns = NowNs();
+    writer.EndWrite(sizeof(TestRecord));
+    std::this_thread::sleep_for(std::chrono::microseconds(20));
+  }
+  reader_thread.join();
+
+  EXPECT_EQ(torn_num, 0);
+  EXPECT_GT(read_num, 0);
+  LOG(INFO) << "Read " << read_num << " of " << kWriteNum << " records, write-to-read latency in us: " << latency_us.ToString(10);
+}
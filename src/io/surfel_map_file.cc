@@ -0,0 +1,304 @@
+#include "io/surfel_map_file.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "common/thread_utils.h"
+
+namespace {
+
+template <typename T>
+T Quantize(double value) {
+  return static_cast<T>(std::round(std::clamp<double>(value, std::numeric_limits<T>::min(), std::numeric_limits<T>::max())));
+}
+
+/**
+ * @brief Octahedral normal encoding, about 1e-4 rad error with 16 bits per component
+ */
+void EncodeNorm(const Vector3d &norm, int16_t encoded[2]) {
+  Eigen::Vector2d p = norm.head<2>() / norm.cwiseAbs().sum();
+  if (norm.z() < 0) {
+    p = Eigen::Vector2d((1 - std::abs(p.y())) * (p.x() >= 0 ? 1 : -1), (1 - std::abs(p.x())) * (p.y() >= 0 ? 1 : -1));
+  }
+  encoded[0] = Quantize<int16_t>(p.x() * 32767);
+  encoded[1] = Quantize<int16_t>(p.y() * 32767);
+}
+
+Vector3d DecodeNorm(const int16_t encoded[2]) {
+  Vector3d norm(encoded[0] / 32767.0, encoded[1] / 32767.0, 0);
+  norm.z() = 1 - std::abs(norm.x()) - std::abs(norm.y());
+  if (norm.z() < 0) {
+    double x = norm.x();
+    norm.x() = (1 - std::abs(norm.y())) * (x >= 0 ? 1 : -1);
+    norm.y() = (1 - std::abs(x)) * (norm.y() >= 0 ? 1 : -1);
+  }
+  return norm.normalized();
+}
+
+// points of a surfel lie in a voxel of size resolution, so the covariance entries are bounded by resolution^2 / 4
+double CovarianceUnit(double resolution) {
+  return resolution * resolution / 4 / 32767;
+}
+
+SurfelMapSurfelRecord EncodeSurfel(const Surfel &surfel, double start_time, const Vector3d &origin, double position_resolution) {
+  SurfelMapSurfelRecord record;
+  record.time_offset = surfel.timestamp - start_time;
+
+  Vector3d center = (surfel.GetCenterInWorld() - origin) / position_resolution;
+  for (int i = 0; i < 3; ++i) {
+    record.center[i] = Quantize<int32_t>(center[i]);
+  }
+  EncodeNorm(surfel.GetNormInWorld(), record.norm);
+
+  Matrix3d covariance = surfel.GetCovarianceInWorld();
+  double   unit       = CovarianceUnit(surfel.resolution);
+  int      k          = 0;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = i; j < 3; ++j) {
+      record.covariance[k++] = Quantize<int16_t>(covariance(i, j) / unit);
+    }
+  }
+  record.resolution          = Quantize<uint16_t>(surfel.resolution * 1e3);
+  record.plane_std_deviation = Quantize<uint16_t>(surfel.plane_std_deviation * 1e5);
+  return record;
+}
+
+Surfel::Ptr DecodeSurfel(const SurfelMapSurfelRecord &record, double start_time, const Vector3d &origin, double position_resolution) {
+  Vector3d center = origin + Vector3d(record.center[0], record.center[1], record.center[2]) * position_resolution;
+
+  double   resolution = record.resolution * 1e-3;
+  double   unit       = CovarianceUnit(resolution);
+  Matrix3d covariance;
+  int      k = 0;
+  for (int i = 0; i < 3; ++i) {
+    for (int j = i; j < 3; ++j) {
+      covariance(i, j) = covariance(j, i) = record.covariance[k++] * unit;
+    }
+  }
+  auto surfel = std::make_shared<Surfel>(start_time + record.time_offset, center, covariance, DecodeNorm(record.norm), resolution, record.plane_std_deviation * 1e-5);
+  surfel->UpdatePose(Vector3d::Zero(), Quaterniond::Identity());
+  return surfel;
+}
+
+}  // namespace
+
+SurfelMapWriter::SurfelMapWriter(const std::string &filename, const SurfelMapWriterOptions &options)
+    : options_(options), ofs_(filename, std::ios::binary), queue_(options.queue_capacity) {
+  CHECK(ofs_) << "Failed to open surfel map " << filename;
+  SurfelMapFileHeader header;
+  header.magic               = SurfelMapFileHeader::kMagic;
+  header.version             = SurfelMapFileHeader::kVersion;
+  header.position_resolution = options_.position_resolution;
+  ofs_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  thread_ = std::thread(&SurfelMapWriter::Run, this);
+}
+
+SurfelMapWriter::~SurfelMapWriter() {
+  running_ = false;
+  thread_.join();
+
+  WriteChunk();
+  SurfelMapFooter footer;
+  footer.index_offset = ofs_.tellp();
+  footer.chunk_num    = chunk_infos_.size();
+  footer.magic        = SurfelMapFooter::kMagic;
+  ofs_.write(reinterpret_cast<const char *>(chunk_infos_.data()), chunk_infos_.size() * sizeof(SurfelMapChunkInfo));
+  ofs_.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+  ofs_.close();
+  LOG_IF(WARNING, dropped_num_ > 0) << "Surfel map writer dropped " << dropped_num_ << " commits.";
+}
+
+bool SurfelMapWriter::AddCommit(const OdometryCommit &commit) {
+  Batch batch;
+  batch.surfels = commit.surfels;
+  batch.poses.reserve(commit.sample_states.size());
+  for (const auto &state : commit.sample_states) {
+    batch.poses.push_back({state->timestamp, Rigid3d(state->pos, state->rot)});
+  }
+  if (!queue_.TryPush(std::move(batch))) {
+    ++dropped_num_;
+    return false;
+  }
+  return true;
+}
+
+void SurfelMapWriter::Run() {
+  ConfigureCurrentThread("surfel_writer");
+  RunPollingLoop(
+      "surfel_writer", std::chrono::milliseconds(10),
+      [this]() {
+        Batch batch;
+        if (!queue_.TryPop(&batch)) {
+          return false;
+        }
+        pending_.surfels.insert(pending_.surfels.end(), batch.surfels.begin(), batch.surfels.end());
+        pending_.poses.insert(pending_.poses.end(), batch.poses.begin(), batch.poses.end());
+        if (pending_.surfels.size() >= options_.chunk_surfel_num) {
+          WriteChunk();
+        }
+        return true;
+      },
+      [this]() { return running_.load(); });
+}
+
+void SurfelMapWriter::WriteChunk() {
+  if (pending_.surfels.empty() && pending_.poses.empty()) {
+    return;
+  }
+  SurfelMapChunkHeader header;
+  header.magic           = SurfelMapChunkHeader::kMagic;
+  header.info.offset     = ofs_.tellp();
+  header.info.surfel_num = pending_.surfels.size();
+  header.info.pose_num   = pending_.poses.size();
+  header.info.start_time = std::numeric_limits<double>::max();
+  header.info.end_time   = std::numeric_limits<double>::lowest();
+
+  Eigen::AlignedBox3d bounds;
+  for (const auto &surfel : pending_.surfels) {
+    bounds.extend(surfel->GetCenterInWorld());
+    header.info.start_time = std::min(header.info.start_time, surfel->timestamp);
+    header.info.end_time   = std::max(header.info.end_time, surfel->timestamp);
+  }
+  for (const auto &pose : pending_.poses) {
+    header.info.start_time = std::min(header.info.start_time, pose.timestamp);
+    header.info.end_time   = std::max(header.info.end_time, pose.timestamp);
+  }
+  Vector3d origin = bounds.isEmpty() ? Vector3d::Zero() : Vector3d(bounds.center());
+  for (int i = 0; i < 3; ++i) {
+    header.origin[i]          = origin[i];
+    header.info.bounds_min[i] = bounds.isEmpty() ? 0 : bounds.min()[i];
+    header.info.bounds_max[i] = bounds.isEmpty() ? 0 : bounds.max()[i];
+  }
+
+  std::vector<SurfelMapPoseRecord> pose_records;
+  pose_records.reserve(pending_.poses.size());
+  for (const auto &pose : pending_.poses) {
+    SurfelMapPoseRecord record;
+    Quaterniond         rot = pose.pose.rotation();
+    record.timestamp        = pose.timestamp;
+    std::copy(pose.pose.translation().data(), pose.pose.translation().data() + 3, record.position);
+    std::copy(rot.coeffs().data(), rot.coeffs().data() + 4, record.orientation);
+    pose_records.push_back(record);
+  }
+  std::vector<SurfelMapSurfelRecord> surfel_records;
+  surfel_records.reserve(pending_.surfels.size());
+  for (const auto &surfel : pending_.surfels) {
+    surfel_records.push_back(EncodeSurfel(*surfel, header.info.start_time, origin, options_.position_resolution));
+  }
+
+  ofs_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs_.write(reinterpret_cast<const char *>(pose_records.data()), pose_records.size() * sizeof(SurfelMapPoseRecord));
+  ofs_.write(reinterpret_cast<const char *>(surfel_records.data()), surfel_records.size() * sizeof(SurfelMapSurfelRecord));
+  ofs_.flush();
+  LOG_IF(ERROR, !ofs_) << "Failed to write surfel map chunk " << chunk_infos_.size();
+
+  chunk_infos_.push_back(header.info);
+  pending_ = Batch();
+}
+
+bool SurfelMapReader::Open(const std::string &filename) {
+  ifs_.close();
+  ifs_.clear();
+  chunk_infos_.clear();
+  ifs_.open(filename, std::ios::binary | std::ios::ate);
+  if (!ifs_) {
+    return false;
+  }
+  file_size_ = ifs_.tellg();
+  ifs_.seekg(0);
+  if (!ifs_.read(reinterpret_cast<char *>(&file_header_), sizeof(file_header_)) ||
+      file_header_.magic != SurfelMapFileHeader::kMagic || file_header_.version != SurfelMapFileHeader::kVersion) {
+    return false;
+  }
+  if (!ReadIndex()) {
+    LOG(WARNING) << "Surfel map " << filename << " has no valid index, scanning chunk headers.";
+    return ScanChunkHeaders();
+  }
+  return true;
+}
+
+bool SurfelMapReader::ReadIndex() {
+  SurfelMapFooter footer;
+  if (file_size_ < sizeof(file_header_) + sizeof(footer)) {
+    return false;
+  }
+  ifs_.seekg(file_size_ - sizeof(footer));
+  if (!ifs_.read(reinterpret_cast<char *>(&footer), sizeof(footer)) || footer.magic != SurfelMapFooter::kMagic ||
+      footer.index_offset + footer.chunk_num * sizeof(SurfelMapChunkInfo) + sizeof(footer) != file_size_) {
+    ifs_.clear();
+    return false;
+  }
+  chunk_infos_.resize(footer.chunk_num);
+  ifs_.seekg(footer.index_offset);
+  return static_cast<bool>(ifs_.read(reinterpret_cast<char *>(chunk_infos_.data()), chunk_infos_.size() * sizeof(SurfelMapChunkInfo)));
+}
+
+bool SurfelMapReader::ScanChunkHeaders() {
+  chunk_infos_.clear();
+  uint64_t offset = sizeof(file_header_);
+  while (offset + sizeof(SurfelMapChunkHeader) <= file_size_) {
+    SurfelMapChunkHeader header;
+    ifs_.seekg(offset);
+    if (!ifs_.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != SurfelMapChunkHeader::kMagic || header.info.offset != offset) {
+      break;
+    }
+    uint64_t next = offset + sizeof(header) + header.info.pose_num * sizeof(SurfelMapPoseRecord) + header.info.surfel_num * sizeof(SurfelMapSurfelRecord);
+    if (next > file_size_) {
+      break;  // truncated by a crash
+    }
+    chunk_infos_.push_back(header.info);
+    offset = next;
+  }
+  ifs_.clear();
+  return true;
+}
+
+std::vector<int> SurfelMapReader::ChunksInBox(const Eigen::AlignedBox3d &box) const {
+  std::vector<int> ret;
+  for (int i = 0; i < chunk_infos_.size(); ++i) {
+    const auto         &info = chunk_infos_[i];
+    Eigen::AlignedBox3d bounds(Vector3d(info.bounds_min[0], info.bounds_min[1], info.bounds_min[2]),
+                               Vector3d(info.bounds_max[0], info.bounds_max[1], info.bounds_max[2]));
+    if (info.surfel_num > 0 && box.intersects(bounds)) {
+      ret.push_back(i);
+    }
+  }
+  return ret;
+}
+
+bool SurfelMapReader::ReadChunk(int chunk_id, std::vector<Surfel::Ptr> *surfels, std::vector<TimedPose> *poses) {
+  CHECK(surfels);
+  CHECK_GE(chunk_id, 0);
+  CHECK_LT(chunk_id, chunk_infos_.size());
+
+  SurfelMapChunkHeader header;
+  ifs_.clear();
+  ifs_.seekg(chunk_infos_[chunk_id].offset);
+  if (!ifs_.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != SurfelMapChunkHeader::kMagic) {
+    return false;
+  }
+  std::vector<SurfelMapPoseRecord>   pose_records(header.info.pose_num);
+  std::vector<SurfelMapSurfelRecord> surfel_records(header.info.surfel_num);
+  if (!ifs_.read(reinterpret_cast<char *>(pose_records.data()), pose_records.size() * sizeof(SurfelMapPoseRecord)) ||
+      !ifs_.read(reinterpret_cast<char *>(surfel_records.data()), surfel_records.size() * sizeof(SurfelMapSurfelRecord))) {
+    return false;
+  }
+
+  if (poses) {
+    poses->clear();
+    for (const auto &record : pose_records) {
+      Quaterniond rot(record.orientation[3], record.orientation[0], record.orientation[1], record.orientation[2]);
+      poses->push_back({record.timestamp, Rigid3d(Vector3d(record.position[0], record.position[1], record.position[2]), rot)});
+    }
+  }
+  Vector3d origin(header.origin[0], header.origin[1], header.origin[2]);
+  surfels->clear();
+  surfels->reserve(surfel_records.size());
+  for (const auto &record : surfel_records) {
+    surfels->push_back(DecodeSurfel(record, header.info.start_time, origin, file_header_.position_resolution));
+  }
+  return true;
+}
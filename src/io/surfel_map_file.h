@@ -0,0 +1,188 @@
+#pragma once
+
+#include <Eigen/Geometry>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/spsc_queue.h"
+#include "common/trajectory.h"
+#include "odometry/odometry_commit.h"
+
+/**
+ * @brief Layout of a binary surfel map file
+ *
+ * File layout: [SurfelMapFileHeader][chunk 0][chunk 1]...[chunk n-1][SurfelMapChunkInfo x n][SurfelMapFooter]
+ * Chunk layout: [SurfelMapChunkHeader][SurfelMapPoseRecord x pose_num][SurfelMapSurfelRecord x surfel_num]
+ *
+ * Surfels are stored in the world frame with their final poses applied, the poses of the committed sample
+ * states are stored next to them. The footer locates the chunk index, which holds the time range and the
+ * spatial bounds of every chunk, so chunks can be selected without reading them. Every chunk header repeats
+ * its index entry, a file without footer, e.g. of a crashed run, can still be indexed by scanning the headers.
+ *
+ * All values are little endian.
+ */
+struct SurfelMapFileHeader {
+  static constexpr uint32_t kMagic   = 0x4d534357;  // "WCSM"
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  double   position_resolution;  // in meters
+};
+
+#pragma pack(push, 1)
+struct SurfelMapChunkInfo {
+  uint64_t offset;  // of the chunk header from the file start
+  uint32_t surfel_num;
+  uint32_t pose_num;
+  double   start_time;
+  double   end_time;
+  float    bounds_min[3];  // of the surfel centers
+  float    bounds_max[3];
+};
+
+struct SurfelMapChunkHeader {
+  static constexpr uint32_t kMagic = 0x4b484357;  // "WCHK"
+
+  uint32_t           magic;
+  SurfelMapChunkInfo info;
+  double             origin[3];  // of the quantized positions
+};
+
+struct SurfelMapPoseRecord {
+  double timestamp;
+  double position[3];
+  double orientation[4];  // x, y, z, w
+};
+
+/**
+ * @brief 36 bytes per surfel
+ */
+struct SurfelMapSurfelRecord {
+  float    time_offset;          // from the chunk start time
+  int32_t  center[3];            // (center - origin) / position_resolution
+  int16_t  norm[2];              // octahedral encoding
+  int16_t  covariance[6];        // upper triangle xx, xy, xz, yy, yz, zz in units of resolution^2 / 4 / 32767
+  uint16_t resolution;           // in millimeters
+  uint16_t plane_std_deviation;  // in 10 micrometers
+};
+
+struct SurfelMapFooter {
+  static constexpr uint32_t kMagic = 0x58444e49;  // "INDX"
+
+  uint64_t index_offset;
+  uint32_t chunk_num;
+  uint32_t magic;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SurfelMapSurfelRecord) == 36, "unexpected surfel record padding");
+
+struct SurfelMapWriterOptions {
+  int    queue_capacity      = 64;    // commits, one per sweep
+  int    chunk_surfel_num    = 8192;  // a chunk is written once it holds at least this many surfels
+  double position_resolution = 1e-3;  // in meters
+};
+
+/**
+ * @brief Streams committed surfels and poses to a surfel map file on its own thread
+ *
+ * The caller only copies surfel pointers and poses into a lock-free single producer single consumer queue,
+ * encoding and file io happen on the writer thread. If the writer falls behind, commits are dropped and
+ * counted instead of blocking the caller.
+ */
+class SurfelMapWriter {
+ public:
+  SurfelMapWriter(const std::string &filename, const SurfelMapWriterOptions &options = SurfelMapWriterOptions());
+
+  /**
+   * @brief Write all queued commits, the last chunk and the index
+   */
+  ~SurfelMapWriter();
+
+  SurfelMapWriter(const SurfelMapWriter &)            = delete;
+  SurfelMapWriter &operator=(const SurfelMapWriter &) = delete;
+
+  /**
+   * @brief Queue the surfels and sample state poses of a commit, must always be called from the same thread
+   *
+   * The surfels must not be modified afterwards, which holds for committed surfels.
+   *
+   * @return false if the queue is full, the commit is dropped then
+   */
+  bool AddCommit(const OdometryCommit &commit);
+
+  /**
+   * @brief Number of commits dropped because the queue was full
+   */
+  uint64_t DroppedNum() const { return dropped_num_; }
+
+ private:
+  struct Batch {
+    std::vector<Surfel::Ptr> surfels;
+    std::vector<TimedPose>   poses;
+  };
+
+  void Run();
+
+  void WriteChunk();
+
+ private:
+  SurfelMapWriterOptions options_;
+  std::ofstream          ofs_;
+
+  SpscQueue<Batch>      queue_;
+  std::atomic<uint64_t> dropped_num_{0};
+  std::atomic<bool>     running_{true};
+  std::thread           thread_;
+
+  // owned by the writer thread
+  Batch                           pending_;  // contents of the chunk under construction
+  std::vector<SurfelMapChunkInfo> chunk_infos_;
+};
+
+/**
+ * @brief Lazy reader of a surfel map file, only the index is read when opening
+ */
+class SurfelMapReader {
+ public:
+  /**
+   * @brief Read the index, or rebuild it from the chunk headers if the file has no footer
+   *
+   * @return false if the file can not be read or is no surfel map
+   */
+  bool Open(const std::string &filename);
+
+  int ChunkNum() const { return chunk_infos_.size(); }
+
+  const SurfelMapChunkInfo &ChunkInfo(int chunk_id) const { return chunk_infos_[chunk_id]; }
+
+  /**
+   * @brief Chunks whose bounds intersect the box
+   */
+  std::vector<int> ChunksInBox(const Eigen::AlignedBox3d &box) const;
+
+  /**
+   * @brief Decode one chunk
+   *
+   * @param surfels receives surfels in the world frame with identity poses
+   * @param poses optional, receives the sample state poses of the chunk
+   * @return false on a truncated or corrupted chunk
+   */
+  bool ReadChunk(int chunk_id, std::vector<Surfel::Ptr> *surfels, std::vector<TimedPose> *poses = nullptr);
+
+ private:
+  bool ReadIndex();
+
+  bool ScanChunkHeaders();
+
+ private:
+  std::ifstream                   ifs_;
+  uint64_t                        file_size_ = 0;
+  SurfelMapFileHeader             file_header_;
+  std::vector<SurfelMapChunkInfo> chunk_infos_;
+};
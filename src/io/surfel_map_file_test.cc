@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+
+#include "common/test_utils.h"
+#include "io/surfel_map_file.h"
+
+namespace {
+
+/**
+ * @brief Commit of a sweep at time t, surfels around x = 10 t
+ */
+OdometryCommit MakeCommit(double t, int surfel_num) {
+  OdometryCommit commit;
+  auto           state = std::make_shared<SampleState>();
+  state->timestamp     = t;
+  state->pos           = Vector3d(t, 0, 0);
+  state->rot           = Quaterniond(Eigen::AngleAxisd(t, Vector3d::UnitZ()));
+  commit.sample_states.push_back(state);
+  for (int i = 0; i < surfel_num; ++i) {
+    Vector3d    norm       = Vector3d::Random().normalized();
+    Matrix3d    covariance = Matrix3d::Random() * 0.01;
+    auto        surfel     = std::make_shared<Surfel>(t + i * 1e-3, Vector3d(t * 10, 0, 0) + Vector3d::Random() * 5, covariance * covariance.transpose(), norm, 0.5, 0.01 * (i % 5));
+    Quaterniond rot(Eigen::AngleAxisd(t + i, Vector3d::UnitY()));
+    surfel->UpdatePose(Vector3d(t, 1, 0), rot);
+    commit.surfels.push_back(surfel);
+  }
+  return commit;
+}
+
+}  // namespace
+
+TEST(SurfelMapFile, WriteRead) {
+  std::string              filename = UniqueTestPath("surfel_map.bin");
+  std::vector<Surfel::Ptr> written;
+  {
+    SurfelMapWriterOptions options;
+    options.chunk_surfel_num = 100;
+    SurfelMapWriter writer(filename, options);
+    for (int i = 0; i < 10; ++i) {
+      auto commit = MakeCommit(i, 30);
+      written.insert(written.end(), commit.surfels.begin(), commit.surfels.end());
+      EXPECT_TRUE(writer.AddCommit(commit));
+    }
+    EXPECT_EQ(writer.DroppedNum(), 0);
+  }
+
+  SurfelMapReader reader;
+  ASSERT_TRUE(reader.Open(filename));
+  // 4 commits per chunk, the remaining 2 in the last chunk
+  ASSERT_EQ(reader.ChunkNum(), 3);
+  EXPECT_EQ(reader.ChunkInfo(0).surfel_num, 120);
+  EXPECT_EQ(reader.ChunkInfo(2).surfel_num, 60);
+
+  std::vector<Surfel::Ptr> surfels, all_surfels;
+  std::vector<TimedPose>   poses;
+  for (int i = 0; i < reader.ChunkNum(); ++i) {
+    ASSERT_TRUE(reader.ReadChunk(i, &surfels, &poses));
+    EXPECT_EQ(poses.size(), reader.ChunkInfo(i).pose_num);
+    all_surfels.insert(all_surfels.end(), surfels.begin(), surfels.end());
+  }
+  EXPECT_NEAR(poses.back().timestamp, 9, 1e-9);
+  EXPECT_TRUE(poses.back().pose.translation().isApprox(Vector3d(9, 0, 0)));
+
+  ASSERT_EQ(all_surfels.size(), written.size());
+  for (int i = 0; i < written.size(); ++i) {
+    EXPECT_NEAR(all_surfels[i]->timestamp, written[i]->timestamp, 1e-5);
+    EXPECT_LT((all_surfels[i]->GetCenterInWorld() - written[i]->GetCenterInWorld()).norm(), 1e-3);
+    EXPECT_LT(all_surfels[i]->AngularDistance(*written[i]), 1e-3);
+    EXPECT_LT((all_surfels[i]->GetCovarianceInWorld() - written[i]->GetCovarianceInWorld()).cwiseAbs().maxCoeff(), 1e-5);
+    EXPECT_NEAR(all_surfels[i]->resolution, written[i]->resolution, 1e-3);
+    EXPECT_NEAR(all_surfels[i]->plane_std_deviation, written[i]->plane_std_deviation, 1e-5);
+  }
+
+  // surfels of the first chunk lie in x in [-5, 35]
+  auto chunks = reader.ChunksInBox(Eigen::AlignedBox3d(Vector3d(-10, -10, -10), Vector3d(-1, 10, 10)));
+  ASSERT_EQ(chunks.size(), 1);
+  EXPECT_EQ(chunks[0], 0);
+
+  std::filesystem::remove(filename);
+}
+
+TEST(SurfelMapFile, RecoverWithoutIndex) {
+  std::string filename = UniqueTestPath("surfel_map_recover.bin");
+  {
+    SurfelMapWriterOptions options;
+    options.chunk_surfel_num = 50;
+    SurfelMapWriter writer(filename, options);
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_TRUE(writer.AddCommit(MakeCommit(i, 50)));
+    }
+  }
+  // cut off the index and half of the last chunk, as a crashed run would leave it
+  std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - sizeof(SurfelMapFooter) - 4 * sizeof(SurfelMapChunkInfo) - 25 * sizeof(SurfelMapSurfelRecord));
+
+  SurfelMapReader reader;
+  ASSERT_TRUE(reader.Open(filename));
+  EXPECT_EQ(reader.ChunkNum(), 3);
+  std::vector<Surfel::Ptr> surfels;
+  ASSERT_TRUE(reader.ReadChunk(2, &surfels));
+  EXPECT_EQ(surfels.size(), 50);
+
+  std::filesystem::remove(filename);
+}
+
+TEST(SurfelMapFile, OpenInvalid) {
+  SurfelMapReader reader;
+  EXPECT_FALSE(reader.Open(UniqueTestPath("missing.bin")));
+}
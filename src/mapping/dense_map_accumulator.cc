@@ -0,0 +1,172 @@
+#include "mapping/dense_map_accumulator.h"
+
+#include <glog/logging.h>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+
+#include "common/thread_utils.h"
+#include "odometry/odometry_problem.h"
+
+DenseMapAccumulator::DenseMapAccumulator(const DenseMapOptions &options) : options_(options), queue_(options.queue_capacity) {
+  CHECK(!options_.output_dir.empty());
+  std::filesystem::create_directories(options_.output_dir);
+  thread_ = std::thread(&DenseMapAccumulator::Run, this);
+}
+
+DenseMapAccumulator::~DenseMapAccumulator() {
+  running_ = false;
+  thread_.join();
+  Flush(0, true);
+  LOG_IF(WARNING, dropped_num_ > 0) << "Dense map accumulator dropped " << dropped_num_ << " inputs.";
+  LOG_IF(WARNING, gap_dropped_num_ > 0) << "Dense map accumulator dropped " << gap_dropped_num_ << " sweeps in gaps of the commits.";
+}
+
+bool DenseMapAccumulator::AddSweep(std::vector<hilti_ros::Point> &&sweep) {
+  Input input;
+  input.sweep = std::move(sweep);
+  if (!queue_.TryPush(std::move(input))) {
+    ++dropped_num_;
+    return false;
+  }
+  return true;
+}
+
+bool DenseMapAccumulator::AddCommit(const OdometryCommit &commit) {
+  Input input;
+  input.imu_states = commit.imu_states;
+  if (!queue_.TryPush(std::move(input))) {
+    ++dropped_num_;
+    return false;
+  }
+  return true;
+}
+
+void DenseMapAccumulator::Run() {
+  ConfigureCurrentThread("dense_map");
+  RunPollingLoop(
+      "dense_map", std::chrono::milliseconds(10),
+      [this]() {
+        Input input;
+        if (!queue_.TryPop(&input)) {
+          return false;
+        }
+        if (!input.sweep.empty()) {
+          sweeps_.push_back(std::move(input.sweep));
+        }
+        if (!input.imu_states.empty() && !imu_states_.empty() && input.imu_states.front().timestamp - imu_states_.back().timestamp > options_.max_imu_gap) {
+          DropSweepsInGap(input.imu_states.front().timestamp);
+        }
+        imu_states_.insert(imu_states_.end(), input.imu_states.begin(), input.imu_states.end());
+        FinalizeSweeps();
+        return true;
+      },
+      [this]() { return running_.load(); });
+}
+
+void DenseMapAccumulator::FinalizeSweeps() {
+  while (!sweeps_.empty() && imu_states_.size() >= 2 && imu_states_.back().timestamp >= sweeps_.front().back().time) {
+    auto &sweep = sweeps_.front();
+    // points before the first committed imu state never get a pose, e.g. at the start of the run
+    auto begin = std::upper_bound(sweep.begin(), sweep.end(), imu_states_.front().timestamp, [](double lhs, const hilti_ros::Point &rhs) { return lhs < rhs.time; });
+    std::vector<hilti_ros::Point> sweep_undistorted;
+    UndistortSweep(std::vector<hilti_ros::Point>(begin, sweep.end()), imu_states_, sweep_undistorted);
+    double time = sweep.back().time;
+    sweeps_.pop_front();
+
+    Insert(sweep_undistorted, time);
+    if (time - flush_time_ >= options_.flush_period) {
+      Flush(time, false);
+      flush_time_ = time;
+    }
+
+    // keep the last imu state before the next sweep for interpolation
+    while (imu_states_.size() >= 2 && imu_states_[1].timestamp <= time) {
+      imu_states_.pop_front();
+    }
+  }
+}
+
+void DenseMapAccumulator::DropSweepsInGap(double gap_end) {
+  // waiting sweeps end after the last committed imu state, so the ones starting before the gap end overlap it
+  int dropped_num = 0;
+  while (!sweeps_.empty() && sweeps_.front().front().time < gap_end) {
+    sweeps_.pop_front();
+    ++dropped_num;
+  }
+  LOG(WARNING) << std::fixed << std::setprecision(3) << "Committed imu states jump from " << imu_states_.back().timestamp << " to " << gap_end
+               << ", dropped " << dropped_num << " sweeps without final poses.";
+  gap_dropped_num_ += dropped_num;
+  imu_states_.clear();
+}
+
+void DenseMapAccumulator::Insert(const std::vector<hilti_ros::Point> &points, double time) {
+  for (const auto &point : points) {
+    Vector3d position = point.getVector3fMap().cast<double>();
+    VoxelLoc key(position, options_.tile_size);
+    auto [it, inserted] = tiles_.try_emplace(key);
+    if (inserted) {
+      it->second.part = released_parts_[key];  // revisited tiles go into a new file
+    }
+    auto &tile  = it->second;
+    auto &voxel = tile.voxels[VoxelLoc(position, options_.voxel_size)];
+    if (voxel.size() >= options_.max_points_per_voxel) {
+      continue;
+    }
+    voxel.push_back(point);
+    ++tile.point_num;
+    tile.update_time = time;
+    tile.dirty       = true;
+  }
+}
+
+void DenseMapAccumulator::Flush(double time, bool all) {
+  for (auto it = tiles_.begin(); it != tiles_.end();) {
+    auto &tile = it->second;
+    if (tile.dirty) {
+      WriteTile(it->first, tile);
+      tile.dirty = false;
+    }
+    if (all || time - tile.update_time > options_.tile_idle_duration) {
+      released_parts_[it->first] = tile.part + 1;
+      tiles_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void DenseMapAccumulator::WriteTile(const VoxelLoc &key, const Tile &tile) const {
+  std::string name = "tile_" + std::to_string(key.x) + "_" + std::to_string(key.y) + "_" + std::to_string(key.z);
+  if (tile.part > 0) {
+    name += "." + std::to_string(tile.part);
+  }
+  std::string filename = options_.output_dir + "/" + name + ".ply";
+
+  // write to a temporary file and rename, so readers never see a partial tile
+  std::ofstream ofs(filename + ".tmp", std::ios::binary);
+  ofs << "ply\n"
+      << "format binary_little_endian 1.0\n"
+      << "element vertex " << tile.point_num << "\n"
+      << "property float x\n"
+      << "property float y\n"
+      << "property float z\n"
+      << "property float intensity\n"
+      << "property double timestamp\n"
+      << "end_header\n";
+  for (const auto &voxel : tile.voxels) {
+    for (const auto &point : voxel.second) {
+      ofs.write(reinterpret_cast<const char *>(&point.x), sizeof(float));
+      ofs.write(reinterpret_cast<const char *>(&point.y), sizeof(float));
+      ofs.write(reinterpret_cast<const char *>(&point.z), sizeof(float));
+      ofs.write(reinterpret_cast<const char *>(&point.intensity), sizeof(float));
+      ofs.write(reinterpret_cast<const char *>(&point.time), sizeof(double));
+    }
+  }
+  ofs.close();
+  if (!ofs || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+    LOG(ERROR) << "Failed to write dense map tile " << filename;
+  }
+}
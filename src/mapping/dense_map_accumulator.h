@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/spsc_queue.h"
+#include "odometry/odometry_commit.h"
+#include "odometry/surfel_extraction.h"
+
+struct DenseMapOptions {
+  std::string output_dir;                      // receives tile_<x>_<y>_<z>.ply, and tile_<x>_<y>_<z>.<part>.ply for revisited tiles
+  int         queue_capacity       = 64;       // sweeps and commits
+  double      voxel_size           = 0.1;      // in meters
+  int         max_points_per_voxel = 4;        // further points falling into a full voxel are dropped
+  double      tile_size            = 50.0;     // in meters
+  double      flush_period         = 10.0;     // dirty tiles are rewritten this often, in seconds of sensor time
+  double      tile_idle_duration   = 60.0;     // tiles without new points for this long are written and released, in seconds
+  double      max_imu_gap          = 0.1;      // committed imu states further apart are a gap, e.g. of a dropped commit, in seconds
+};
+
+/**
+ * @brief Dense registered point cloud accumulated on its own thread
+ *
+ * Raw sweeps are kept until the committed imu states cover them, i.e. until their poses are final, then they are
+ * undistorted into the world frame and inserted into voxel hashed tiles with a cap of points per voxel. Tiles are
+ * streamed to binary PLY files periodically and released once the sensor has left them.
+ *
+ * The odometry thread hands over sweeps and commits through a lock-free single producer single consumer queue,
+ * if the accumulator falls behind, inputs are dropped and counted instead of blocking. Sweeps overlapping a gap of
+ * the committed imu states, e.g. after a dropped commit, have no final poses and are dropped with a warning.
+ */
+class DenseMapAccumulator {
+ public:
+  explicit DenseMapAccumulator(const DenseMapOptions &options);
+
+  /**
+   * @brief Process all queued inputs and write all tiles
+   */
+  ~DenseMapAccumulator();
+
+  DenseMapAccumulator(const DenseMapAccumulator &)            = delete;
+  DenseMapAccumulator &operator=(const DenseMapAccumulator &) = delete;
+
+  /**
+   * @brief Hand over a raw sweep in the imu frame, must be called from the same thread as AddCommit
+   *
+   * @return false if the queue is full, the sweep is dropped then
+   */
+  bool AddSweep(std::vector<hilti_ros::Point> &&sweep);
+
+  /**
+   * @brief Hand over the final imu states of a commit
+   *
+   * @return false if the queue is full, the commit is dropped then
+   */
+  bool AddCommit(const OdometryCommit &commit);
+
+  uint64_t DroppedNum() const { return dropped_num_; }
+
+  /**
+   * @brief Sweeps dropped because the committed imu states do not cover them consecutively
+   */
+  uint64_t GapDroppedNum() const { return gap_dropped_num_; }
+
+ private:
+  struct Input {
+    std::vector<hilti_ros::Point> sweep;
+    std::vector<ImuState>         imu_states;
+  };
+
+  struct Tile {
+    absl::flat_hash_map<VoxelLoc, std::vector<hilti_ros::Point>> voxels;
+    int                                                          point_num   = 0;
+    int                                                          part        = 0;
+    double                                                       update_time = 0;
+    bool                                                         dirty       = false;
+  };
+
+  void Run();
+
+  /**
+   * @brief Undistort and insert all sweeps covered by the committed imu states
+   */
+  void FinalizeSweeps();
+
+  /**
+   * @brief Drop the waiting sweeps overlapping the gap before the next committed imu state and restart from it
+   */
+  void DropSweepsInGap(double gap_end);
+
+  void Insert(const std::vector<hilti_ros::Point> &points, double time);
+
+  /**
+   * @brief Write dirty tiles and release idle ones
+   *
+   * @param all write and release all tiles
+   */
+  void Flush(double time, bool all);
+
+  void WriteTile(const VoxelLoc &key, const Tile &tile) const;
+
+ private:
+  DenseMapOptions options_;
+
+  SpscQueue<Input>      queue_;
+  std::atomic<uint64_t> dropped_num_{0};
+  std::atomic<uint64_t> gap_dropped_num_{0};
+  std::atomic<bool>     running_{true};
+  std::thread           thread_;
+
+  // owned by the accumulator thread
+  std::deque<std::vector<hilti_ros::Point>> sweeps_;      // raw sweeps waiting for final poses
+  std::deque<ImuState>                      imu_states_;  // committed imu states
+  absl::flat_hash_map<VoxelLoc, Tile>       tiles_;
+  absl::flat_hash_map<VoxelLoc, int>        released_parts_;  // number of files written for released tiles
+  double                                    flush_time_ = 0;
+};
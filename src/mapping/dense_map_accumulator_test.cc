@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "common/test_utils.h"
+#include "mapping/dense_map_accumulator.h"
+
+namespace {
+
+int ReadPlyVertexNum(const std::string &filename) {
+  std::ifstream ifs(filename, std::ios::binary);
+  std::string   line;
+  while (std::getline(ifs, line) && line != "end_header") {
+    if (line.rfind("element vertex ", 0) == 0) {
+      return std::stoi(line.substr(15));
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+TEST(DenseMapAccumulator, FinalizeAndWriteTiles) {
+  DenseMapOptions options;
+  options.output_dir           = UniqueTestPath("dense_map");
+  options.voxel_size           = 0.5;
+  options.max_points_per_voxel = 2;
+  options.tile_size            = 10;
+  {
+    DenseMapAccumulator accumulator(options);
+
+    // the imu moves along x at 10 m/s, every sweep observes the points (0.1, 0.1, 0.1), (0.2, 0.1, 0.1) and (0.3, 0.1, 0.1) in the imu frame
+    OdometryCommit commit;
+    for (int i = 0; i <= 200; ++i) {
+      ImuState state;
+      state.timestamp = i * 0.01;
+      state.pos       = Vector3d(i * 0.1, 0, 0);
+      state.rot       = Quaterniond::Identity();
+      commit.imu_states.push_back(state);
+    }
+    for (int i = 0; i < 4; ++i) {
+      std::vector<hilti_ros::Point> sweep(3);
+      for (int j = 0; j < 3; ++j) {
+        sweep[j].getVector3fMap() = Eigen::Vector3f(0.1 * (j + 1), 0.1, 0.1);
+        sweep[j].time             = i * 0.5 + 0.1 + j * 0.001;
+      }
+      EXPECT_TRUE(accumulator.AddSweep(std::move(sweep)));
+    }
+    EXPECT_TRUE(accumulator.AddCommit(commit));
+    // not covered by committed imu states, never written
+    std::vector<hilti_ros::Point> sweep(1);
+    sweep[0].time = 10;
+    EXPECT_TRUE(accumulator.AddSweep(std::move(sweep)));
+  }
+
+  // sweeps at x = 1, 6 go into tile 0, x = 11, 16 into tile 1, the points of a sweep share a voxel capped at 2 points
+  EXPECT_EQ(ReadPlyVertexNum(options.output_dir + "/tile_0_0_0.ply"), 4);
+  EXPECT_EQ(ReadPlyVertexNum(options.output_dir + "/tile_1_0_0.ply"), 4);
+  EXPECT_EQ(std::distance(std::filesystem::directory_iterator(options.output_dir), std::filesystem::directory_iterator()), 2);
+  std::filesystem::remove_all(options.output_dir);
+}
+
+TEST(DenseMapAccumulator, DropSweepsInCommitGap) {
+  DenseMapOptions options;
+  options.output_dir           = UniqueTestPath("dense_map_gap");
+  options.voxel_size           = 0.5;
+  options.max_points_per_voxel = 4;
+  options.tile_size            = 10;
+  {
+    DenseMapAccumulator accumulator(options);
+
+    // the imu moves along x at 10 m/s, the states in [1.0, 1.5) are never committed
+    auto make_commit = [](int first, int last) {
+      OdometryCommit commit;
+      for (int i = first; i <= last; ++i) {
+        ImuState state;
+        state.timestamp = i * 0.01;
+        state.pos       = Vector3d(i * 0.1, 0, 0);
+        state.rot       = Quaterniond::Identity();
+        commit.imu_states.push_back(state);
+      }
+      return commit;
+    };
+    auto make_sweep = [](double time) {
+      std::vector<hilti_ros::Point> sweep(2);
+      for (int j = 0; j < 2; ++j) {
+        sweep[j].getVector3fMap() = Eigen::Vector3f(0.1, 0.1, 0.1);
+        sweep[j].time             = time + j * 0.001;
+      }
+      return sweep;
+    };
+    EXPECT_TRUE(accumulator.AddSweep(make_sweep(0.5)));
+    EXPECT_TRUE(accumulator.AddCommit(make_commit(0, 99)));
+    EXPECT_TRUE(accumulator.AddSweep(make_sweep(1.2)));
+    EXPECT_TRUE(accumulator.AddSweep(make_sweep(1.7)));
+    EXPECT_TRUE(accumulator.AddCommit(make_commit(150, 200)));
+    while (accumulator.GapDroppedNum() == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(accumulator.GapDroppedNum(), 1);
+  }
+
+  // the sweep at x = 5 goes into tile 0, the one at x = 17 into tile 1, the one at x = 12 in the gap is dropped
+  EXPECT_EQ(ReadPlyVertexNum(options.output_dir + "/tile_0_0_0.ply"), 2);
+  EXPECT_EQ(ReadPlyVertexNum(options.output_dir + "/tile_1_0_0.ply"), 2);
+  std::filesystem::remove_all(options.output_dir);
+}
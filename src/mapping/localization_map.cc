@@ -0,0 +1,170 @@
+#include "mapping/localization_map.h"
+
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+namespace {
+
+bool KeyLess(const int32_t *a, const int32_t *b) {
+  return std::lexicographical_compare(a, a + 3, b, b + 3);
+}
+
+}  // namespace
+
+bool WriteLocalizationMap(const std::vector<Surfel::Ptr> &surfels, double tile_size, const std::string &filename) {
+  CHECK_GT(tile_size, 0);
+  std::map<std::array<int32_t, 3>, std::vector<int>> buckets;
+  for (int i = 0; i < surfels.size(); ++i) {
+    Vector3d center = surfels[i]->GetCenterInWorld();
+    buckets[{static_cast<int32_t>(std::floor(center.x() / tile_size)),
+             static_cast<int32_t>(std::floor(center.y() / tile_size)),
+             static_cast<int32_t>(std::floor(center.z() / tile_size))}]
+        .push_back(i);
+  }
+
+  LocalizationMapHeader header{};
+  header.magic      = LocalizationMapHeader::kMagic;
+  header.version    = LocalizationMapHeader::kVersion;
+  header.tile_size  = tile_size;
+  header.tile_num   = buckets.size();
+  header.surfel_num = surfels.size();
+
+  std::vector<LocalizationMapTile>   tiles;
+  std::vector<LocalizationMapSurfel> records;
+  tiles.reserve(buckets.size());
+  records.reserve(surfels.size());
+  for (const auto &bucket : buckets) {
+    LocalizationMapTile tile{};
+    std::copy(bucket.first.begin(), bucket.first.end(), tile.key);
+    tile.surfel_num   = bucket.second.size();
+    tile.first_surfel = records.size();
+    tiles.push_back(tile);
+    for (int i : bucket.second) {
+      const auto           &surfel     = surfels[i];
+      Vector3d              center     = surfel->GetCenterInWorld();
+      Vector3d              norm       = surfel->GetNormInWorld();
+      Matrix3d              covariance = surfel->GetCovarianceInWorld();
+      LocalizationMapSurfel record{};
+      int                   k = 0;
+      for (int r = 0; r < 3; ++r) {
+        record.center[r] = center[r];
+        record.norm[r]   = norm[r];
+        for (int c = r; c < 3; ++c) {
+          record.covariance[k++] = covariance(r, c);
+        }
+      }
+      record.resolution          = surfel->resolution;
+      record.plane_std_deviation = surfel->plane_std_deviation;
+      records.push_back(record);
+    }
+  }
+
+  std::ofstream ofs(filename, std::ios::binary);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(tiles.data()), tiles.size() * sizeof(LocalizationMapTile));
+  ofs.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(LocalizationMapSurfel));
+  return static_cast<bool>(ofs);
+}
+
+LocalizationMap::~LocalizationMap() {
+  if (header_) {
+    munmap(const_cast<LocalizationMapHeader *>(header_), mapped_size_);
+  }
+}
+
+bool LocalizationMap::Open(const std::string &filename) {
+  CHECK(!header_) << "Map already opened";
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(LocalizationMapHeader))) {
+    close(fd);
+    return false;
+  }
+  void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  auto header = reinterpret_cast<const LocalizationMapHeader *>(addr);
+  if (header->magic != LocalizationMapHeader::kMagic || header->version != LocalizationMapHeader::kVersion ||
+      sizeof(LocalizationMapHeader) + header->tile_num * sizeof(LocalizationMapTile) + header->surfel_num * sizeof(LocalizationMapSurfel) != static_cast<uint64_t>(st.st_size)) {
+    munmap(addr, st.st_size);
+    return false;
+  }
+  // tiles are accessed by position, not sequentially
+  madvise(addr, st.st_size, MADV_RANDOM);
+
+  header_      = header;
+  mapped_size_ = st.st_size;
+  tiles_       = reinterpret_cast<const LocalizationMapTile *>(header_ + 1);
+  surfels_     = reinterpret_cast<const LocalizationMapSurfel *>(tiles_ + header_->tile_num);
+  return true;
+}
+
+std::vector<LocalizationMap::TileKey> LocalizationMap::TilesInRadius(const Vector3d &position, double radius) const {
+  CHECK(header_) << "Map not opened";
+  double          tile_size = header_->tile_size;
+  Eigen::Vector3i key_min   = ((position - Vector3d::Constant(radius)) / tile_size).array().floor().cast<int>();
+  Eigen::Vector3i key_max   = ((position + Vector3d::Constant(radius)) / tile_size).array().floor().cast<int>();
+
+  std::vector<TileKey> ret;
+  for (int x = key_min.x(); x <= key_max.x(); ++x) {
+    for (int y = key_min.y(); y <= key_max.y(); ++y) {
+      for (int z = key_min.z(); z <= key_max.z(); ++z) {
+        Eigen::AlignedBox3d box(Vector3d(x, y, z) * tile_size, Vector3d(x + 1, y + 1, z + 1) * tile_size);
+        if (box.squaredExteriorDistance(position) <= radius * radius && FindTile({x, y, z})) {
+          ret.push_back({x, y, z});
+        }
+      }
+    }
+  }
+  return ret;
+}
+
+const LocalizationMapTile *LocalizationMap::FindTile(const TileKey &key) const {
+  auto end = tiles_ + header_->tile_num;
+  auto it  = std::lower_bound(tiles_, end, key, [](const LocalizationMapTile &tile, const TileKey &key) { return KeyLess(tile.key, key.data()); });
+  if (it == end || KeyLess(key.data(), it->key)) {
+    return nullptr;
+  }
+  return it;
+}
+
+std::vector<Surfel::Ptr> LocalizationMap::LoadTile(const TileKey &key) const {
+  std::vector<Surfel::Ptr> ret;
+  auto                     tile = FindTile(key);
+  if (!tile) {
+    return ret;
+  }
+  ret.reserve(tile->surfel_num);
+  for (uint64_t i = tile->first_surfel; i < tile->first_surfel + tile->surfel_num; ++i) {
+    const auto &record = surfels_[i];
+    Matrix3d    covariance;
+    int         k = 0;
+    for (int r = 0; r < 3; ++r) {
+      for (int c = r; c < 3; ++c) {
+        covariance(r, c) = covariance(c, r) = record.covariance[k++];
+      }
+    }
+    auto surfel = std::make_shared<Surfel>(std::numeric_limits<double>::lowest(),
+                                           Vector3d(record.center[0], record.center[1], record.center[2]),
+                                           covariance,
+                                           Vector3d(record.norm[0], record.norm[1], record.norm[2]).normalized(),
+                                           record.resolution,
+                                           record.plane_std_deviation);
+    surfel->UpdatePose(Vector3d::Zero(), Quaterniond::Identity());
+    ret.push_back(surfel);
+  }
+  return ret;
+}
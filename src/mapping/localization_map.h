@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "odometry/surfel.h"
+
+/**
+ * @brief Layout of a localization map file, used in place without parsing
+ *
+ * File layout: [LocalizationMapHeader][LocalizationMapTile x tile_num][LocalizationMapSurfel x surfel_num]
+ *
+ * Surfels are bucketed into cubic tiles, the tile table is sorted by key so tiles are found by binary search.
+ * The surfels of a tile are contiguous, so a tile touches only its own pages of the mapping.
+ */
+struct LocalizationMapHeader {
+  static constexpr uint64_t kMagic   = 0x57434154'4c4f434d;  // "WCATLOCM"
+  static constexpr uint32_t kVersion = 1;
+
+  uint64_t magic;
+  uint32_t version;
+  uint32_t reserved;
+  double   tile_size;  // in meters
+  uint64_t tile_num;
+  uint64_t surfel_num;
+};
+
+struct LocalizationMapTile {
+  int32_t  key[3];  // floor(position / tile_size)
+  uint32_t surfel_num;
+  uint64_t first_surfel;
+};
+
+/**
+ * @brief Surfel in the map frame
+ */
+struct LocalizationMapSurfel {
+  double center[3];
+  float  norm[3];
+  float  covariance[6];  // upper triangle xx, xy, xz, yy, yz, zz
+  float  resolution;
+  float  plane_std_deviation;
+  float  reserved;
+};
+
+static_assert(sizeof(LocalizationMapHeader) == 40, "unexpected localization map header padding");
+static_assert(sizeof(LocalizationMapTile) == 24, "unexpected localization map tile padding");
+static_assert(sizeof(LocalizationMapSurfel) == 72, "unexpected localization map surfel padding");
+
+/**
+ * @brief Write surfels in the map frame into a localization map file
+ *
+ * @return false if the file can not be written
+ */
+bool WriteLocalizationMap(const std::vector<Surfel::Ptr> &surfels, double tile_size, const std::string &filename);
+
+/**
+ * @brief Read-only memory mapped localization map
+ *
+ * Opening only maps the file and checks the header. Tile pages are faulted in by the kernel on first access,
+ * residency of materialized tiles is managed by MapTileCache. All methods are const and thread safe.
+ */
+class LocalizationMap {
+ public:
+  using TileKey = std::array<int32_t, 3>;
+
+  LocalizationMap() = default;
+  ~LocalizationMap();
+
+  LocalizationMap(const LocalizationMap &)            = delete;
+  LocalizationMap &operator=(const LocalizationMap &) = delete;
+
+  /**
+   * @return false if the file can not be mapped or is no localization map
+   */
+  bool Open(const std::string &filename);
+
+  uint64_t TileNum() const { return header_->tile_num; }
+
+  uint64_t SurfelNum() const { return header_->surfel_num; }
+
+  /**
+   * @brief Keys of the existing tiles within radius around the position, sorted
+   */
+  std::vector<TileKey> TilesInRadius(const Vector3d &position, double radius) const;
+
+  /**
+   * @brief Surfels of a tile in the map frame, empty if the tile does not exist
+   *
+   * Map surfels have the lowest timestamp, so they are always the first surfel of a correspondence.
+   */
+  std::vector<Surfel::Ptr> LoadTile(const TileKey &key) const;
+
+ private:
+  const LocalizationMapTile *FindTile(const TileKey &key) const;
+
+ private:
+  const LocalizationMapHeader *header_      = nullptr;
+  size_t                       mapped_size_ = 0;
+  const LocalizationMapTile   *tiles_       = nullptr;
+  const LocalizationMapSurfel *surfels_     = nullptr;
+};
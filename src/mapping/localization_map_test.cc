@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+
+#include "common/test_utils.h"
+#include "mapping/localization_map.h"
+
+TEST(LocalizationMap, WriteOpenLoad) {
+  // one surfel every meter along x in [-50, 50)
+  std::vector<Surfel::Ptr> surfels;
+  for (int i = -50; i < 50; ++i) {
+    auto surfel = std::make_shared<Surfel>(i, Vector3d(i + 0.5, 0.5, 0.5), Matrix3d::Identity() * 1e-3, Vector3d::UnitZ(), 0.5, 0.01);
+    surfel->UpdatePose(Vector3d(i, 0, 0), Quaterniond(Eigen::AngleAxisd(i, Vector3d::UnitX())));
+    surfels.push_back(surfel);
+  }
+  std::string filename = UniqueTestPath("localization_map.bin");
+  ASSERT_TRUE(WriteLocalizationMap(surfels, 10, filename));
+
+  LocalizationMap map;
+  ASSERT_TRUE(map.Open(filename));
+  EXPECT_EQ(map.TileNum(), 10);
+  EXPECT_EQ(map.SurfelNum(), 100);
+
+  // tiles [0, 10) and [10, 20) along x
+  auto keys = map.TilesInRadius(Vector3d(10, 0, 0), 5);
+  ASSERT_EQ(keys.size(), 2);
+  EXPECT_EQ(keys[0], (LocalizationMap::TileKey{0, 0, 0}));
+  EXPECT_EQ(keys[1], (LocalizationMap::TileKey{1, 0, 0}));
+  EXPECT_TRUE(map.TilesInRadius(Vector3d(100, 0, 0), 5).empty());
+
+  auto tile = map.LoadTile(keys[1]);
+  ASSERT_EQ(tile.size(), 10);
+  for (auto &surfel : tile) {
+    EXPECT_GE(surfel->GetCenterInWorld().x(), 10);
+    EXPECT_LT(surfel->GetCenterInWorld().x(), 20);
+    EXPECT_NEAR(surfel->GetNormInWorld().z(), 1, 1e-6);
+    EXPECT_NEAR(surfel->GetCovarianceInWorld()(0, 0), 1e-3, 1e-9);
+  }
+  EXPECT_TRUE(map.LoadTile({0, 1, 0}).empty());
+
+  std::filesystem::remove(filename);
+}
+
+TEST(LocalizationMap, OpenInvalid) {
+  LocalizationMap map;
+  EXPECT_FALSE(map.Open(UniqueTestPath("missing.bin")));
+}
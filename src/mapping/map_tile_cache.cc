@@ -0,0 +1,140 @@
+#include "mapping/map_tile_cache.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+#include "common/thread_utils.h"
+
+MapTileCache::MapTileCache(const LocalizationMap &map, const MapTileCacheOptions &options) : map_(map), options_(options) {
+  if (options_.enable_prefetch) {
+    thread_ = std::thread(&MapTileCache::Prefetch, this);
+  }
+}
+
+MapTileCache::~MapTileCache() {
+  {
+    absl::MutexLock lock(&mutex_);
+    running_ = false;
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool MapTileCache::UpdateActiveTiles(const Vector3d &position, const Vector3d &velocity, double radius) {
+  std::vector<TileKey> keys = map_.TilesInRadius(position, radius);
+  std::vector<TileKey> prefetch_keys;
+  if (options_.enable_prefetch && velocity.norm() * options_.prefetch_time > 1e-3) {
+    prefetch_keys = map_.TilesInRadius(position + velocity * options_.prefetch_time, radius);
+  }
+
+  // only tiles entering the active set are looked up, the others are pinned
+  std::vector<TileKey> missing_keys;
+  {
+    absl::MutexLock lock(&mutex_);
+    for (const auto &key : keys) {
+      auto it = entries_.find(key);
+      if (it != entries_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+        if (!pinned_.count(key)) {
+          ++metrics_.hit_num;
+        }
+      } else {
+        missing_keys.push_back(key);
+      }
+    }
+    prefetch_keys_.swap(prefetch_keys);
+  }
+
+  std::vector<TileSurfels> loaded;
+  for (const auto &key : missing_keys) {
+    loaded.push_back(std::make_shared<const std::vector<Surfel::Ptr>>(map_.LoadTile(key)));
+  }
+
+  std::vector<TileSurfels> active;
+  {
+    absl::MutexLock lock(&mutex_);
+    metrics_.miss_num += missing_keys.size();
+    for (int i = 0; i < missing_keys.size(); ++i) {
+      Insert(missing_keys[i], loaded[i]);
+    }
+    pinned_ = std::set<TileKey>(keys.begin(), keys.end());
+    Evict();
+    if (keys != active_keys_) {
+      for (const auto &key : keys) {
+        active.push_back(entries_.at(key).surfels);
+      }
+    }
+  }
+
+  if (keys == active_keys_) {
+    return false;
+  }
+  active_keys_ = keys;
+  active_surfels_.clear();
+  for (const auto &surfels : active) {
+    active_surfels_.insert(active_surfels_.end(), surfels->begin(), surfels->end());
+  }
+  return true;
+}
+
+MapTileCacheMetrics MapTileCache::Metrics() const {
+  absl::MutexLock lock(&mutex_);
+  return metrics_;
+}
+
+void MapTileCache::Prefetch() {
+  ConfigureCurrentThread("map_prefetch");
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !prefetch_keys_.empty() || !running_;
+  };
+  while (true) {
+    TileKey key;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(&predicate));
+      if (!running_) {
+        return;
+      }
+      key = prefetch_keys_.back();
+      prefetch_keys_.pop_back();
+      if (entries_.count(key)) {
+        continue;
+      }
+    }
+    auto surfels = std::make_shared<const std::vector<Surfel::Ptr>>(map_.LoadTile(key));
+
+    absl::MutexLock lock(&mutex_);
+    if (!entries_.count(key)) {
+      Insert(key, surfels);
+      ++metrics_.prefetch_num;
+      Evict();
+    }
+  }
+}
+
+void MapTileCache::Insert(const TileKey &key, const TileSurfels &surfels) {
+  if (entries_.count(key)) {
+    return;  // loaded by the other thread in the meantime
+  }
+  lru_.push_front(key);
+  entries_[key] = {surfels, lru_.begin()};
+  ++metrics_.resident_tile_num;
+  metrics_.resident_surfel_num += surfels->size();
+}
+
+void MapTileCache::Evict() {
+  auto it = lru_.end();
+  while (metrics_.resident_surfel_num > options_.capacity_surfel_num && it != lru_.begin()) {
+    --it;
+    if (pinned_.count(*it)) {
+      continue;
+    }
+    auto entry = entries_.find(*it);
+    metrics_.resident_surfel_num -= entry->second.surfels->size();
+    --metrics_.resident_tile_num;
+    ++metrics_.eviction_num;
+    entries_.erase(entry);
+    it = lru_.erase(it);
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mapping/localization_map.h"
+
+struct MapTileCacheOptions {
+  uint64_t capacity_surfel_num = 2'000'000;  // resident surfels, tiles in use are never evicted
+  double   prefetch_time       = 5.0;        // tiles reached within this time at the current velocity are loaded ahead, in seconds
+  bool     enable_prefetch     = true;
+};
+
+struct MapTileCacheMetrics {
+  uint64_t hit_num             = 0;  // tiles entering the active set that were resident
+  uint64_t miss_num            = 0;  // tiles entering the active set that had to be loaded synchronously
+  uint64_t prefetch_num        = 0;  // tiles loaded by the prefetch thread
+  uint64_t eviction_num        = 0;
+  uint64_t resident_tile_num   = 0;
+  uint64_t resident_surfel_num = 0;
+
+  double HitRate() const { return hit_num + miss_num > 0 ? static_cast<double>(hit_num) / (hit_num + miss_num) : 0; }
+};
+
+/**
+ * @brief LRU cache of materialized localization map tiles
+ *
+ * The tiles within the active radius of the current pose are pinned. Tiles leaving the active set stay resident
+ * until the surfel budget is exceeded, then the least recently used ones are evicted. An I/O thread loads the tiles
+ * around the position predicted by the current velocity ahead of time, so the odometry thread rarely loads tiles.
+ */
+class MapTileCache {
+ public:
+  explicit MapTileCache(const LocalizationMap &map, const MapTileCacheOptions &options = MapTileCacheOptions());
+  ~MapTileCache();
+
+  MapTileCache(const MapTileCache &)            = delete;
+  MapTileCache &operator=(const MapTileCache &) = delete;
+
+  /**
+   * @brief Make the tiles within radius around the position active and schedule prefetching along the velocity
+   *
+   * Must always be called from the same thread.
+   *
+   * @return true if the set of active tiles changed
+   */
+  bool UpdateActiveTiles(const Vector3d &position, const Vector3d &velocity, double radius) LOCKS_EXCLUDED(mutex_);
+
+  /**
+   * @brief Surfels of all active tiles
+   */
+  const std::deque<Surfel::Ptr> &ActiveSurfels() const { return active_surfels_; }
+
+  MapTileCacheMetrics Metrics() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  using TileKey     = LocalizationMap::TileKey;
+  using TileSurfels = std::shared_ptr<const std::vector<Surfel::Ptr>>;
+
+  struct Entry {
+    TileSurfels                  surfels;
+    std::list<TileKey>::iterator lru_it;
+  };
+
+  void Prefetch();
+
+  void Insert(const TileKey &key, const TileSurfels &surfels) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void Evict() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+ private:
+  const LocalizationMap &map_;
+  MapTileCacheOptions    options_;
+
+  // owned by the caller thread
+  std::vector<TileKey>    active_keys_;
+  std::deque<Surfel::Ptr> active_surfels_;
+
+  mutable absl::Mutex      mutex_;
+  std::map<TileKey, Entry> entries_ GUARDED_BY(mutex_);
+  std::list<TileKey>       lru_ GUARDED_BY(mutex_);     // most recently used first
+  std::set<TileKey>        pinned_ GUARDED_BY(mutex_);  // active tiles
+  std::vector<TileKey>     prefetch_keys_ GUARDED_BY(mutex_);
+  bool                     running_ GUARDED_BY(mutex_) = true;
+  MapTileCacheMetrics      metrics_ GUARDED_BY(mutex_);
+
+  std::thread thread_;
+};
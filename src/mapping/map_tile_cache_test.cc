@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#include "common/test_utils.h"
+#include "mapping/map_tile_cache.h"
+
+namespace {
+
+/**
+ * @brief Map of 10 m tiles along x in [0, 1000), 10 surfels per tile
+ */
+class MapTileCacheTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    std::vector<Surfel::Ptr> surfels;
+    for (int i = 0; i < 1000; ++i) {
+      auto surfel = std::make_shared<Surfel>(i, Vector3d(i + 0.5, 0.5, 0.5), Matrix3d::Identity() * 1e-3, Vector3d::UnitZ(), 0.5, 0.01);
+      surfel->UpdatePose(Vector3d::Zero(), Quaterniond::Identity());
+      surfels.push_back(surfel);
+    }
+    filename_ = UniqueTestPath("tile_cache.bin");
+    ASSERT_TRUE(WriteLocalizationMap(surfels, 10, filename_));
+    ASSERT_TRUE(map_.Open(filename_));
+  }
+
+  void TearDown() override { std::filesystem::remove(filename_); }
+
+  std::string     filename_;
+  LocalizationMap map_;
+};
+
+}  // namespace
+
+TEST_F(MapTileCacheTest, LruEviction) {
+  MapTileCacheOptions options;
+  options.capacity_surfel_num = 40;
+  options.enable_prefetch     = false;
+  MapTileCache cache(map_, options);
+
+  // tiles 0 and 1
+  EXPECT_TRUE(cache.UpdateActiveTiles(Vector3d(10, 0, 0), Vector3d::Zero(), 5));
+  EXPECT_EQ(cache.ActiveSurfels().size(), 20);
+  EXPECT_FALSE(cache.UpdateActiveTiles(Vector3d(11, 0, 0), Vector3d::Zero(), 5));
+
+  // tiles 2 and 3, 0 and 1 stay resident
+  EXPECT_TRUE(cache.UpdateActiveTiles(Vector3d(30, 0, 0), Vector3d::Zero(), 5));
+  auto metrics = cache.Metrics();
+  EXPECT_EQ(metrics.miss_num, 4);
+  EXPECT_EQ(metrics.hit_num, 0);
+  EXPECT_EQ(metrics.resident_tile_num, 4);
+  EXPECT_EQ(metrics.eviction_num, 0);
+
+  // back to tile 1 is a hit, tile 4 evicts the least recently used tile 0
+  EXPECT_TRUE(cache.UpdateActiveTiles(Vector3d(15, 0, 0), Vector3d::Zero(), 4));
+  EXPECT_TRUE(cache.UpdateActiveTiles(Vector3d(45, 0, 0), Vector3d::Zero(), 4));
+  metrics = cache.Metrics();
+  EXPECT_EQ(metrics.hit_num, 1);
+  EXPECT_EQ(metrics.miss_num, 5);
+  EXPECT_EQ(metrics.eviction_num, 1);
+  EXPECT_EQ(metrics.resident_surfel_num, 40);
+  EXPECT_TRUE(cache.UpdateActiveTiles(Vector3d(5, 0, 0), Vector3d::Zero(), 4));
+  EXPECT_EQ(cache.Metrics().miss_num, 6);
+}
+
+TEST_F(MapTileCacheTest, Prefetch) {
+  MapTileCache cache(map_);
+
+  // at 10 m/s, the tiles around x = 100 are prefetched
+  cache.UpdateActiveTiles(Vector3d(50, 0, 0), Vector3d(10, 0, 0), 5);
+  for (int i = 0; i < 1000 && cache.Metrics().prefetch_num < 2; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(cache.Metrics().prefetch_num, 2);
+
+  cache.UpdateActiveTiles(Vector3d(100, 0, 0), Vector3d(10, 0, 0), 5);
+  auto metrics = cache.Metrics();
+  EXPECT_EQ(metrics.hit_num, 2);
+  EXPECT_EQ(metrics.miss_num, 2);
+  EXPECT_EQ(metrics.HitRate(), 0.5);
+  EXPECT_EQ(cache.ActiveSurfels().size(), 20);
+}
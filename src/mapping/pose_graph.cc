@@ -0,0 +1,57 @@
+#include "mapping/pose_graph.h"
+
+#include <glog/logging.h>
+
+int PoseGraph::AddNode(const Rigid3d &pose) {
+  nodes_.emplace_back();
+  nodes_.back().rot = pose.rotation();
+  nodes_.back().pos = pose.translation();
+  return nodes_.size() - 1;
+}
+
+void PoseGraph::AddEdge(const PoseGraphEdge &edge) {
+  CHECK_GE(edge.i, 0);
+  CHECK_LT(edge.i, nodes_.size());
+  CHECK_GE(edge.j, 0);
+  CHECK_LT(edge.j, nodes_.size());
+  CHECK_NE(edge.i, edge.j);
+  edges_.push_back(edge);
+}
+
+double PoseGraph::Optimize(int max_num_iterations) {
+  if (edges_.empty()) {
+    return 0;
+  }
+  ceres::Problem problem;
+  for (auto &edge : edges_) {
+    auto &node_i = nodes_[edge.i];
+    auto &node_j = nodes_[edge.j];
+    problem.AddResidualBlock(
+        new RelativePoseFactor(node_i, node_j, edge),
+        edge.is_loop ? static_cast<ceres::LossFunction *>(new ceres::CauchyLoss(1.0)) : new ceres::TrivialLoss(),
+        node_i.data_cor,
+        node_j.data_cor);
+  }
+  problem.SetParameterBlockConstant(nodes_.front().data_cor);
+
+  ceres::Solver::Options option;
+  option.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+  option.max_num_iterations = max_num_iterations;
+  ceres::Solver::Summary summary;
+  ceres::Solve(option, &problem, &summary);
+  LOG(INFO) << "Pose graph with nodes_" << nodes_.size() << " edges_" << edges_.size() << ": " << summary.BriefReport();
+
+  for (auto &node : nodes_) {
+    node.rot = Exp(node.rot_cor) * node.rot;
+    node.pos = node.pos + node.pos_cor;
+    node.rot_cor.setZero();
+    node.pos_cor.setZero();
+  }
+  return summary.final_cost;
+}
+
+Rigid3d PoseGraph::NodePose(int id) const {
+  CHECK_GE(id, 0);
+  CHECK_LT(id, nodes_.size());
+  return Rigid3d(nodes_[id].pos, nodes_[id].rot);
+}
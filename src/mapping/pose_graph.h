@@ -0,0 +1,119 @@
+#pragma once
+
+#include <ceres/ceres.h>
+#include <deque>
+#include <vector>
+
+#include "common/rigid_transform.h"
+#include "common/utils.h"
+
+/**
+ * @brief A pose in the pose graph, optimized by corrections in the same way as SampleState
+ *
+ * pose = (Exp(rot_cor) * rot, pos + pos_cor)
+ */
+struct PoseGraphNode {
+  Quaterniond rot;
+  Vector3d    pos;
+
+  double               data_cor[6] = {0};  // q, t
+  Eigen::Map<Vector3d> rot_cor{data_cor + 0};
+  Eigen::Map<Vector3d> pos_cor{data_cor + 3};
+};
+
+struct PoseGraphEdge {
+  int     i;
+  int     j;
+  Rigid3d relative_pose;  // pose of node j in node i
+  double  rot_weight;     // 1 / standard deviation in radians
+  double  pos_weight;     // 1 / standard deviation in meters
+  bool    is_loop;
+};
+
+/**
+ * @brief Relative pose error between two pose graph nodes
+ *
+ * r_rot = w_rot * Log(R_ij^T * R_i^T * R_j)
+ * r_pos = w_pos * (R_i^T * (p_j - p_i) - p_ij)
+ *
+ */
+struct RelativePoseFactor : public ceres::SizedCostFunction<6, 6, 6> {
+  RelativePoseFactor(const PoseGraphNode &node_i, const PoseGraphNode &node_j, const PoseGraphEdge &edge) : rot_i_(node_i.rot), pos_i_(node_i.pos), rot_j_(node_j.rot), pos_j_(node_j.pos), edge_(edge) {
+  }
+
+  virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const {
+    Eigen::Map<const Vector3d> r_cor_i{&parameters[0][0]};
+    Eigen::Map<const Vector3d> t_cor_i{&parameters[0][3]};
+    Eigen::Map<const Vector3d> r_cor_j{&parameters[1][0]};
+    Eigen::Map<const Vector3d> t_cor_j{&parameters[1][3]};
+
+    Quaterniond rot_i = Exp(r_cor_i) * rot_i_;
+    Quaterniond rot_j = Exp(r_cor_j) * rot_j_;
+    Vector3d    dpos  = pos_j_ + t_cor_j - pos_i_ - t_cor_i;
+
+    Eigen::Map<Eigen::Matrix<double, 6, 1>> residual{residuals};
+    Vector3d                                r_rot = Log(edge_.relative_pose.rotation().conjugate() * rot_i.conjugate() * rot_j);
+    residual.head<3>()                            = edge_.rot_weight * r_rot;
+    residual.tail<3>()                            = edge_.pos_weight * (rot_i.conjugate() * dpos - edge_.relative_pose.translation());
+
+    if (jacobians) {
+      Matrix3d rot_i_t = rot_i.conjugate().matrix();
+      Matrix3d rot_j_t = rot_j.conjugate().matrix();
+      if (jacobians[0]) {
+        Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_i{jacobians[0]};
+        jacobian_i.setZero();
+        jacobian_i.block<3, 3>(0, 0) = -edge_.rot_weight * Jr_inv(r_rot) * rot_j_t * Jl(r_cor_i);
+        jacobian_i.block<3, 3>(3, 0) = edge_.pos_weight * rot_i_t * Hat(dpos) * Jl(r_cor_i);
+        jacobian_i.block<3, 3>(3, 3) = -edge_.pos_weight * rot_i_t;
+      }
+      if (jacobians[1]) {
+        Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>> jacobian_j{jacobians[1]};
+        jacobian_j.setZero();
+        jacobian_j.block<3, 3>(0, 0) = edge_.rot_weight * Jr_inv(r_rot) * rot_j_t * Jl(r_cor_j);
+        jacobian_j.block<3, 3>(3, 3) = edge_.pos_weight * rot_i_t;
+      }
+    }
+    return true;
+  }
+
+ private:
+  Quaterniond   rot_i_;
+  Vector3d      pos_i_;
+  Quaterniond   rot_j_;
+  Vector3d      pos_j_;
+  PoseGraphEdge edge_;
+};
+
+/**
+ * @brief Pose graph with the first node as gauge
+ *
+ * Odometry edges use a trivial loss, loop edges a cauchy loss to bound the effect of false loops.
+ */
+class PoseGraph {
+ public:
+  /**
+   * @brief Add a node
+   *
+   * @return node id, consecutive starting from 0
+   */
+  int AddNode(const Rigid3d &pose);
+
+  void AddEdge(const PoseGraphEdge &edge);
+
+  /**
+   * @brief Optimize all nodes
+   *
+   * @return final cost
+   */
+  double Optimize(int max_num_iterations);
+
+  Rigid3d NodePose(int id) const;
+
+  int NodeNum() const { return nodes_.size(); }
+
+  const std::vector<PoseGraphEdge> &Edges() const { return edges_; }
+
+ private:
+  std::deque<PoseGraphNode>  nodes_;  // deque keeps the parameter blocks in place
+  std::vector<PoseGraphEdge> edges_;
+};
@@ -0,0 +1,153 @@
+#include "mapping/pose_graph_backend.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+
+#include "common/thread_utils.h"
+
+PoseGraphBackend::PoseGraphBackend(const PoseGraphBackendOptions &options) : options_(options), queue_(options.queue_capacity), scan_context_(options.scan_context) {
+  thread_ = std::thread(&PoseGraphBackend::Run, this);
+}
+
+PoseGraphBackend::~PoseGraphBackend() {
+  running_ = false;
+  thread_.join();
+}
+
+bool PoseGraphBackend::AddCommit(OdometryCommit &&commit) {
+  return queue_.TryPush(std::move(commit));
+}
+
+Rigid3d PoseGraphBackend::MapToWorld() const {
+  absl::MutexLock lock(&mutex_);
+  return map_to_world_;
+}
+
+int PoseGraphBackend::LoopNum() const {
+  absl::MutexLock lock(&mutex_);
+  return loop_num_;
+}
+
+void PoseGraphBackend::Run() {
+  ConfigureCurrentThread("backend");
+  RunPollingLoop(
+      "backend", std::chrono::milliseconds(10),
+      [this]() {
+        OdometryCommit commit;
+        if (!queue_.TryPop(&commit)) {
+          return false;
+        }
+        ProcessCommit(commit);
+        return true;
+      },
+      [this]() { return running_.load(); });
+}
+
+void PoseGraphBackend::ProcessCommit(const OdometryCommit &commit) {
+  pending_.sample_states.insert(pending_.sample_states.end(), commit.sample_states.begin(), commit.sample_states.end());
+  pending_.surfels.insert(pending_.surfels.end(), commit.surfels.begin(), commit.surfels.end());
+  if (!pending_.sample_states.empty() &&
+      pending_.sample_states.back()->timestamp - pending_.sample_states.front()->timestamp >= options_.submap_duration) {
+    FinishSubmap();
+  }
+}
+
+void PoseGraphBackend::FinishSubmap() {
+  const auto &origin = pending_.sample_states.front();
+
+  std::unique_ptr<Submap> submap(new Submap);
+  submap->id         = submaps_.size();
+  submap->start_time = origin->timestamp;
+  submap->end_time   = pending_.sample_states.back()->timestamp;
+  submap->local_pose = Rigid3d(origin->pos, origin->rot);
+  submap->level_pose = Rigid3d(origin->pos, Quaterniond::FromTwoVectors(Vector3d::UnitZ(), -origin->grav));
+
+  Rigid3d world_to_submap = submap->local_pose.inverse();
+  for (auto &surfel : pending_.surfels) {
+    submap->surfels.push_back(TransformSurfel(world_to_submap, surfel));
+  }
+  pending_ = OdometryCommit();
+
+  // odometry edge to the previous submap
+  if (submaps_.empty()) {
+    pose_graph_.AddNode(submap->local_pose);
+  } else {
+    const auto &previous = submaps_.back();
+    Rigid3d     relative = previous->local_pose.inverse() * submap->local_pose;
+    pose_graph_.AddNode(pose_graph_.NodePose(previous->id) * relative);
+    pose_graph_.AddEdge({previous->id, submap->id, relative, options_.odometry_rot_weight, options_.odometry_pos_weight, false});
+  }
+  int id = submap->id;
+  submaps_.push_back(std::move(submap));
+
+  if (SearchLoops(id) > 0) {
+    pose_graph_.Optimize(options_.optimize_iter_num_max);
+  }
+
+  absl::MutexLock lock(&mutex_);
+  map_to_world_ = pose_graph_.NodePose(id) * submaps_[id]->local_pose.inverse();
+}
+
+std::vector<LoopCandidate> PoseGraphBackend::FindLoopCandidates(int submap_id) {
+  const auto                &submap = submaps_[submap_id];
+  std::vector<LoopCandidate> ret;
+
+  if (options_.enable_scan_context) {
+    // descriptors are built in the level frame of the submap from the surfel centers, the index itself excludes the latest submaps
+    Rigid3d               submap_to_level = submap->level_pose.inverse() * submap->local_pose;
+    std::vector<Vector3d> points;
+    points.reserve(submap->surfels.size());
+    for (auto &surfel : submap->surfels) {
+      points.push_back(submap_to_level * surfel->GetCenterInWorld());
+    }
+    auto             descriptor = ComputeScanContext(points, options_.scan_context);
+    ScanContextMatch match;
+    if (scan_context_.Query(descriptor, &match) && match.id + options_.loop_min_submap_gap <= submap_id) {
+      const auto &candidate = submaps_[match.id];
+      Rigid3d     yaw_rot   = Rigid3d::Rotation(Quaterniond(Eigen::AngleAxisd(-match.yaw, Vector3d::UnitZ())));
+      Rigid3d     relative  = candidate->local_pose.inverse() * candidate->level_pose * yaw_rot * submap->level_pose.inverse() * submap->local_pose;
+      ret.push_back({match.id, relative, true});
+    }
+    CHECK_EQ(scan_context_.Add(descriptor), submap_id);
+  }
+
+  Vector3d                            position = pose_graph_.NodePose(submap_id).translation();
+  std::vector<std::pair<double, int>> candidates;
+  for (int i = 0; i + options_.loop_min_submap_gap <= submap_id; ++i) {
+    double distance = (pose_graph_.NodePose(i).translation() - position).norm();
+    if (distance < options_.loop_search_radius && (ret.empty() || ret.front().id != i)) {
+      candidates.push_back({distance, i});
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  for (int i = 0; i < candidates.size() && ret.size() < options_.loop_candidates_num_max; ++i) {
+    int id = candidates[i].second;
+    ret.push_back({id, pose_graph_.NodePose(id).inverse() * pose_graph_.NodePose(submap_id), false});
+  }
+  return ret;
+}
+
+int PoseGraphBackend::SearchLoops(int submap_id) {
+  int loop_num = 0;
+  for (const auto &candidate : FindLoopCandidates(submap_id)) {
+    int                       candidate_id = candidate.id;
+    Rigid3d                   relative     = candidate.relative;
+    SurfelRegistrationSummary summary;
+    if (candidate.coarse && !RegisterSurfels(submaps_[candidate_id]->surfels, submaps_[submap_id]->surfels, options_.coarse_registration, &relative, &summary)) {
+      continue;
+    }
+    if (!RegisterSurfels(submaps_[candidate_id]->surfels, submaps_[submap_id]->surfels, options_.registration, &relative, &summary) ||
+        !summary.converged || summary.correspondence_num < options_.loop_min_correspondence_num) {
+      continue;
+    }
+    LOG(INFO) << "Loop between submap " << candidate_id << " and " << submap_id << " with corrs_" << summary.correspondence_num << ": " << relative;
+    pose_graph_.AddEdge({candidate_id, submap_id, relative, options_.loop_rot_weight, options_.loop_pos_weight, true});
+    ++loop_num;
+  }
+  if (loop_num > 0) {
+    absl::MutexLock lock(&mutex_);
+    loop_num_ += loop_num;
+  }
+  return loop_num;
+}
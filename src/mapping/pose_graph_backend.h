@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "common/spsc_queue.h"
+#include "mapping/pose_graph.h"
+#include "mapping/scan_context.h"
+#include "odometry/odometry_commit.h"
+#include "odometry/surfel_registration.h"
+
+struct PoseGraphBackendOptions {
+  int    queue_capacity              = 256;   // commits, one per sweep
+  double submap_duration             = 10.0;  // in seconds
+  int    loop_min_submap_gap         = 3;     // submaps closer in sequence are connected by odometry already
+  double loop_search_radius          = 15.0;  // in meters
+  int    loop_candidates_num_max     = 3;
+  int    loop_min_correspondence_num = 200;
+  double odometry_rot_weight         = 1 / 0.01;   // 1 / rad
+  double odometry_pos_weight         = 1 / 0.1;    // 1 / m
+  double loop_rot_weight             = 1 / 0.005;  // 1 / rad
+  double loop_pos_weight             = 1 / 0.05;   // 1 / m
+  int    optimize_iter_num_max       = 50;
+  bool   enable_scan_context         = true;  // also retrieve candidates by appearance, finds loops beyond the drifted search radius
+
+  SurfelRegistrationOptions registration;
+  SurfelRegistrationOptions coarse_registration = CoarseRegistrationOptions();  // refines scan context guesses before registration
+  ScanContextOptions        scan_context;
+
+  static SurfelRegistrationOptions CoarseRegistrationOptions() {
+    SurfelRegistrationOptions options;
+    options.max_center_distance = 3.0;
+    options.max_plane_distance  = 0.5;
+    return options;
+  }
+};
+
+/**
+ * @brief Committed odometry states of a time interval
+ */
+struct Submap {
+  int                      id;
+  double                   start_time;
+  double                   end_time;
+  Rigid3d                  local_pose;  // origin in the odometry world frame, the pose of the first sample state
+  Rigid3d                  level_pose;  // gravity aligned frame at the origin, in the odometry world frame
+  std::vector<Surfel::Ptr> surfels;     // in the submap frame
+};
+
+struct LoopCandidate {
+  int     id;
+  Rigid3d relative;  // initial guess of the submap in the candidate frame
+  bool    coarse;    // the guess is rough, register coarsely first
+};
+
+/**
+ * @brief Drift correction on its own thread
+ *
+ * Committed states are grouped into submaps. Every new submap is connected to the previous one by an odometry
+ * edge and registered against nearby older submaps and against older submaps retrieved by scan context, successful
+ * registrations become loop edges. The pose graph is optimized after every new loop edge.
+ *
+ * The odometry thread hands over commits through a lock-free single producer single consumer queue, it never
+ * waits on the backend. The result is the transform from the odometry world frame to the map frame.
+ */
+class PoseGraphBackend {
+ public:
+  explicit PoseGraphBackend(const PoseGraphBackendOptions &options = PoseGraphBackendOptions());
+
+  /**
+   * @brief Process all queued commits and stop the backend thread
+   */
+  ~PoseGraphBackend();
+
+  PoseGraphBackend(const PoseGraphBackend &)            = delete;
+  PoseGraphBackend &operator=(const PoseGraphBackend &) = delete;
+
+  /**
+   * @brief Hand over a commit, must always be called from the same thread
+   *
+   * @return false if the queue is full, the commit is dropped then
+   */
+  bool AddCommit(OdometryCommit &&commit);
+
+  /**
+   * @brief Pose of the odometry world frame in the map frame
+   */
+  Rigid3d MapToWorld() const LOCKS_EXCLUDED(mutex_);
+
+  int LoopNum() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  void Run();
+
+  void ProcessCommit(const OdometryCommit &commit);
+
+  void FinishSubmap();
+
+  /**
+   * @brief Older submaps that may overlap with the submap
+   *
+   * Scan context matches first, then submaps within the search radius, closest first.
+   */
+  std::vector<LoopCandidate> FindLoopCandidates(int submap_id);
+
+  /**
+   * @brief Register the submap against loop candidates and add loop edges
+   *
+   * @return number of loop edges added
+   */
+  int SearchLoops(int submap_id);
+
+ private:
+  PoseGraphBackendOptions options_;
+
+  SpscQueue<OdometryCommit> queue_;
+  std::atomic<bool>         running_{true};
+  std::thread               thread_;
+
+  // owned by the backend thread
+  std::vector<std::unique_ptr<Submap>> submaps_;
+  PoseGraph                            pose_graph_;
+  ScanContextIndex                     scan_context_;
+  OdometryCommit                       pending_;  // states of the submap under construction
+
+  mutable absl::Mutex mutex_;
+  Rigid3d             map_to_world_ GUARDED_BY(mutex_);
+  int                 loop_num_ GUARDED_BY(mutex_) = 0;
+};
@@ -0,0 +1,47 @@
+#include "mapping/pose_graph.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+PoseGraphNode RandomNode() {
+  PoseGraphNode node;
+  node.rot = Exp(Vector3d::Random());
+  node.pos = Vector3d::Random() * 10;
+  return node;
+}
+
+}  // namespace
+
+TEST(RelativePoseFactor, Jacobian) {
+  PoseGraphNode node_i = RandomNode();
+  PoseGraphNode node_j = RandomNode();
+  PoseGraphEdge edge{0, 1, Rigid3d(Vector3d::Random(), Exp(Vector3d::Random() * 0.1)), 100, 10, false};
+
+  RelativePoseFactor factor(node_i, node_j, edge);
+
+  Eigen::Matrix<double, 6, 1> x_i = Eigen::Matrix<double, 6, 1>::Random() * 0.1;
+  Eigen::Matrix<double, 6, 1> x_j = Eigen::Matrix<double, 6, 1>::Random() * 0.1;
+
+  Eigen::Matrix<double, 6, 6, Eigen::RowMajor> jacobian_i, jacobian_j;
+  Eigen::Matrix<double, 6, 1>                  residual;
+  const double                                *parameters[2] = {x_i.data(), x_j.data()};
+  double                                      *jacobians[2]  = {jacobian_i.data(), jacobian_j.data()};
+  ASSERT_TRUE(factor.Evaluate(parameters, residual.data(), jacobians));
+
+  constexpr double kDelta = 1e-6;
+  for (int k = 0; k < 2; ++k) {
+    auto &x        = k == 0 ? x_i : x_j;
+    auto &jacobian = k == 0 ? jacobian_i : jacobian_j;
+    for (int c = 0; c < 6; ++c) {
+      Eigen::Matrix<double, 6, 1> residual_delta;
+      x[c] += kDelta;
+      factor.Evaluate(parameters, residual_delta.data(), nullptr);
+      x[c] -= kDelta;
+      Eigen::Matrix<double, 6, 1> numeric = (residual_delta - residual) / kDelta;
+      EXPECT_LT((numeric - jacobian.col(c)).norm(), 1e-3 * std::max(1.0, numeric.norm())) << "block " << k << " column " << c << "\n"
+                                                                                          << numeric.transpose() << "\n"
+                                                                                          << jacobian.col(c).transpose();
+    }
+  }
+}
@@ -0,0 +1,132 @@
+#include "mapping/scan_context.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cmath>
+
+ScanContextDescriptor ComputeScanContext(const std::vector<Vector3d> &points, const ScanContextOptions &options) {
+  ScanContextDescriptor descriptor;
+  descriptor.grid.setZero(options.ring_num, options.sector_num);
+  for (auto &point : points) {
+    double radius = point.head<2>().norm();
+    if (radius < 1e-3 || radius >= options.max_radius) {
+      continue;
+    }
+    int    ring   = std::min(int(radius / options.max_radius * options.ring_num), options.ring_num - 1);
+    double angle  = std::atan2(point.y(), point.x()) + M_PI;  // [0, 2pi]
+    int    sector = int(angle / (2 * M_PI) * options.sector_num) % options.sector_num;
+    float  height = std::max(0.0, point.z() + options.height_offset);
+
+    descriptor.grid(ring, sector) = std::max(descriptor.grid(ring, sector), height);
+  }
+  descriptor.ring_key = descriptor.grid.rowwise().mean();
+  return descriptor;
+}
+
+double ScanContextDistance(const ScanContextDescriptor &query, const ScanContextDescriptor &candidate, double *yaw) {
+  CHECK_EQ(query.grid.rows(), candidate.grid.rows());
+  CHECK_EQ(query.grid.cols(), candidate.grid.cols());
+  int             sector_num      = query.grid.cols();
+  Eigen::VectorXf query_norms     = query.grid.colwise().norm();
+  Eigen::VectorXf candidate_norms = candidate.grid.colwise().norm();
+
+  double min_distance = 1.0;
+  int    min_shift    = 0;
+  for (int shift = 0; shift < sector_num; ++shift) {
+    double similarity = 0;
+    int    column_num = 0;
+    for (int j = 0; j < sector_num; ++j) {
+      int k = (j - shift + sector_num) % sector_num;  // query column j sees what candidate column k sees
+      if (query_norms[j] == 0 || candidate_norms[k] == 0) {
+        continue;
+      }
+      similarity += query.grid.col(j).dot(candidate.grid.col(k)) / (query_norms[j] * candidate_norms[k]);
+      ++column_num;
+    }
+    if (column_num == 0) {
+      continue;
+    }
+    double distance = 1.0 - similarity / column_num;
+    if (distance < min_distance) {
+      min_distance = distance;
+      min_shift    = shift;
+    }
+  }
+  if (yaw) {
+    *yaw = min_shift * 2 * M_PI / sector_num;
+    if (*yaw > M_PI) {
+      *yaw -= 2 * M_PI;
+    }
+  }
+  return min_distance;
+}
+
+ScanContextIndex::ScanContextIndex(const ScanContextOptions &options) : options_(options) {
+}
+
+int ScanContextIndex::Add(const ScanContextDescriptor &descriptor) {
+  CHECK_EQ(descriptor.grid.rows(), options_.ring_num);
+  CHECK_EQ(descriptor.grid.cols(), options_.sector_num);
+  descriptors_.push_back(descriptor);
+  return descriptors_.size() - 1;
+}
+
+void ScanContextIndex::UpdateIndex() {
+  int num = int(descriptors_.size()) - options_.exclude_recent_num - indexed_num_;
+  if (num <= 0) {
+    return;
+  }
+  int dim = options_.ring_num;
+  ring_keys_.emplace_back(new float[num * dim]);
+  float *ring_keys = ring_keys_.back().get();
+  for (int i = 0; i < num; ++i) {
+    std::copy_n(descriptors_[indexed_num_ + i].ring_key.data(), dim, ring_keys + i * dim);
+  }
+  flann::Matrix<float> points(ring_keys, num, dim);
+  if (!index_) {
+    index_.reset(new FLANNIndex(points, flann::KDTreeIndexParams(4)));
+    index_->buildIndex();
+  } else {
+    index_->addPoints(points);
+  }
+  indexed_num_ += num;
+}
+
+std::vector<ScanContextMatch> ScanContextIndex::QueryAll(const ScanContextDescriptor &descriptor) {
+  UpdateIndex();
+  std::vector<ScanContextMatch> matches;
+  if (indexed_num_ == 0) {
+    return matches;
+  }
+
+  int                  k = std::min(options_.ring_key_candidate_num, indexed_num_);
+  std::vector<float>   query(descriptor.ring_key.data(), descriptor.ring_key.data() + descriptor.ring_key.size());
+  std::vector<int>     k_indices(k);
+  std::vector<float>   k_distances(k);
+  flann::Matrix<int>   k_indices_mat(k_indices.data(), 1, k);
+  flann::Matrix<float> k_distances_mat(k_distances.data(), 1, k);
+  index_->knnSearch(flann::Matrix<float>(query.data(), 1, query.size()), k_indices_mat, k_distances_mat, k, flann::SearchParams(32));
+
+  for (int id : k_indices) {
+    if (id < 0 || id >= indexed_num_) {
+      continue;
+    }
+    ScanContextMatch match;
+    match.id       = id;
+    match.distance = ScanContextDistance(descriptor, descriptors_[id], &match.yaw);
+    if (match.distance < options_.distance_threshold) {
+      matches.push_back(match);
+    }
+  }
+  std::sort(matches.begin(), matches.end(), [](const ScanContextMatch &a, const ScanContextMatch &b) { return a.distance < b.distance; });
+  return matches;
+}
+
+bool ScanContextIndex::Query(const ScanContextDescriptor &descriptor, ScanContextMatch *match) {
+  auto matches = QueryAll(descriptor);
+  if (matches.empty()) {
+    return false;
+  }
+  *match = matches.front();
+  return true;
+}
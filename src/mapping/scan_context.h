@@ -0,0 +1,96 @@
+#pragma once
+
+#include <flann/flann.hpp>
+#include <Eigen/Dense>
+#include <memory>
+#include <vector>
+
+#include "common/common.h"
+
+struct ScanContextOptions {
+  int    ring_num               = 20;
+  int    sector_num             = 60;
+  double max_radius             = 80.0;  // in meters
+  double height_offset          = 2.0;   // added to heights so that the ground is above 0, empty bins are 0
+  int    exclude_recent_num     = 3;     // the latest descriptors are never loop candidates
+  int    ring_key_candidate_num = 10;    // candidates retrieved by ring key before verification
+  double distance_threshold     = 0.3;   // maximum column-shifted cosine distance of a match
+};
+
+/**
+ * @brief Polar max height grid around a keyframe origin
+ *
+ * Rows are rings of equal radial width, columns sectors of equal angle. The ring key, the mean height of
+ * every ring, is invariant to the yaw of the keyframe.
+ */
+struct ScanContextDescriptor {
+  Eigen::MatrixXf grid;      // ring_num x sector_num
+  Eigen::VectorXf ring_key;  // ring_num
+};
+
+struct ScanContextMatch {
+  int    id       = -1;
+  double distance = 1.0;
+  double yaw      = 0;  // query points = Rz(yaw) * candidate points
+};
+
+/**
+ * @brief Build a descriptor from points in a gravity aligned frame centered at the keyframe origin
+ *
+ * @param points e.g. undistorted sweep points or surfel centers, z pointing up
+ */
+ScanContextDescriptor ComputeScanContext(const std::vector<Vector3d> &points, const ScanContextOptions &options);
+
+/**
+ * @brief Minimum cosine distance over all column shifts
+ *
+ * @param yaw optional, rotation of the query relative to the candidate at the minimum
+ */
+double ScanContextDistance(const ScanContextDescriptor &query, const ScanContextDescriptor &candidate, double *yaw = nullptr);
+
+/**
+ * @brief Place recognition by scan context
+ *
+ * Ring keys are kept in an incremental kd-tree, so retrieval is sublinear in the number of keyframes. Retrieved
+ * candidates are verified by the yaw invariant column-shifted distance.
+ */
+class ScanContextIndex {
+ public:
+  explicit ScanContextIndex(const ScanContextOptions &options = ScanContextOptions());
+
+  /**
+   * @brief Add the descriptor of a new keyframe
+   *
+   * @return keyframe id, consecutive starting from 0
+   */
+  int Add(const ScanContextDescriptor &descriptor);
+
+  /**
+   * @brief Find the best matching older keyframe, excluding the latest exclude_recent_num ones
+   *
+   * @return false if no candidate passes verification
+   */
+  bool Query(const ScanContextDescriptor &descriptor, ScanContextMatch *match);
+
+  /**
+   * @brief All verified candidates sorted by distance
+   */
+  std::vector<ScanContextMatch> QueryAll(const ScanContextDescriptor &descriptor);
+
+  int Size() const { return descriptors_.size(); }
+
+ private:
+  /**
+   * @brief Move descriptors out of the exclusion window into the kd-tree
+   */
+  void UpdateIndex();
+
+ private:
+  using FLANNIndex = flann::Index<flann::L2<float>>;
+
+  ScanContextOptions                    options_;
+  std::vector<ScanContextDescriptor>    descriptors_;
+  std::vector<std::unique_ptr<float[]>> ring_keys_;  // flann keeps pointers to the added points
+  std::unique_ptr<FLANNIndex>           index_;
+  int                                   indexed_num_ = 0;
+};
@@ -0,0 +1,245 @@
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "common/utils.h"
+#include "io/surfel_map_file.h"
+#include "mapping/scan_context.h"
+
+namespace {
+
+struct Keyframe {
+  Rigid3d               pose;    // gravity aligned keyframe frame in world
+  std::vector<Vector3d> points;  // in the keyframe frame
+};
+
+/**
+ * @brief Keyframes in driving order, with the ground truth of which ones revisit an earlier place
+ */
+class RevisitSequence {
+ public:
+  const std::vector<Keyframe> &Keyframes() const { return keyframes_; }
+
+  bool IsRevisit(int i) const { return is_revisit_[i]; }
+
+ protected:
+  std::vector<Keyframe> keyframes_;
+  std::vector<bool>     is_revisit_;
+};
+
+/**
+ * @brief Simulated revisit sequence: two laps around a 300m x 200m block of random buildings
+ *
+ * The second lap is driven with a lateral offset and in the opposite direction, keyframes every 5m.
+ */
+class SimulatedSequence : public RevisitSequence {
+ public:
+  SimulatedSequence() {
+    int first_lap_size = 0;
+    std::srand(0);
+    std::vector<Vector3d> world_points;
+    for (int box = 0; box < 200; ++box) {
+      Vector3d center = Vector3d::Random().cwiseProduct(Vector3d(250, 200, 0));
+      Vector3d size   = (Vector3d::Random() + Vector3d::Constant(1.5)).cwiseProduct(Vector3d(8, 8, 6));
+      center.z()      = size.z() / 2;
+      if (std::abs(std::abs(center.x()) - 150) < size.x() + 5 || std::abs(std::abs(center.y()) - 100) < size.y() + 5) {
+        continue;  // keep the road free
+      }
+      for (int i = 0; i < 300; ++i) {
+        world_points.push_back(center + size.cwiseProduct(Vector3d::Random()) / 2);
+      }
+    }
+
+    std::vector<Vector3d> corners = {{-150, -100, 0}, {150, -100, 0}, {150, 100, 0}, {-150, 100, 0}};
+    for (int lap = 0; lap < 2; ++lap) {
+      for (int c = 0; c < 4; ++c) {
+        Vector3d from = corners[lap == 0 ? c : (4 - c) % 4];
+        Vector3d to   = corners[lap == 0 ? (c + 1) % 4 : (3 - c + 4) % 4];
+        Vector3d dir  = (to - from).normalized();
+        double   yaw  = std::atan2(dir.y(), dir.x());
+        Vector3d side = Vector3d(-dir.y(), dir.x(), 0) * (lap == 0 ? 0 : 1.5);
+        for (double s = 0; s < (to - from).norm(); s += 5.0) {
+          Keyframe keyframe;
+          keyframe.pose     = Rigid3d(from + dir * s + side, Quaterniond(Eigen::AngleAxisd(yaw, Vector3d::UnitZ())));
+          Rigid3d world2key = keyframe.pose.inverse();
+          for (auto &point : world_points) {
+            if ((point - keyframe.pose.translation()).head<2>().norm() < 80) {
+              keyframe.points.push_back(world2key * point);
+            }
+          }
+          keyframes_.push_back(keyframe);
+        }
+      }
+      if (lap == 0) {
+        first_lap_size = keyframes_.size();
+      }
+    }
+
+    // ground truth: any first lap keyframe within 5m
+    for (int i = 0; i < keyframes_.size(); ++i) {
+      bool is_revisit = false;
+      for (int j = 0; i >= first_lap_size && j < first_lap_size; ++j) {
+        is_revisit |= (keyframes_[j].pose.translation() - keyframes_[i].pose.translation()).norm() < 5.0;
+      }
+      is_revisit_.push_back(is_revisit);
+    }
+  }
+};
+
+/**
+ * @brief Revisit sequence of a recorded run, from a surfel map file streamed by the odometry
+ *
+ * A keyframe is taken every 5m along the sample state poses. Its points are the centers of the surfels finalized
+ * within 5s of it, so that a revisit sees a new scan of the place and not the map of the first visit. Ground truth
+ * is any keyframe within 5m that is older than the exclude_recent_num ones before it. The poses are the odometry
+ * poses, so revisits after a drift of more than 5m are missed, use short runs or a refined trajectory.
+ */
+class RecordedSequence : public RevisitSequence {
+ public:
+  explicit RecordedSequence(const std::string &surfel_map_filename) {
+    SurfelMapReader reader;
+    CHECK(reader.Open(surfel_map_filename)) << "Failed to open surfel map " << surfel_map_filename;
+    std::vector<Surfel::Ptr> surfels, chunk_surfels;
+    std::vector<TimedPose>   poses, chunk_poses;
+    for (int i = 0; i < reader.ChunkNum(); ++i) {
+      CHECK(reader.ReadChunk(i, &chunk_surfels, &chunk_poses)) << "Failed to read chunk " << i << " of " << surfel_map_filename;
+      surfels.insert(surfels.end(), chunk_surfels.begin(), chunk_surfels.end());
+      poses.insert(poses.end(), chunk_poses.begin(), chunk_poses.end());
+    }
+    std::sort(surfels.begin(), surfels.end(), [](const Surfel::Ptr &lhs, const Surfel::Ptr &rhs) { return lhs->timestamp < rhs->timestamp; });
+
+    ScanContextOptions options;
+    Vector3d           last_position = Vector3d::Zero();
+    for (int i = 0; i < poses.size(); ++i) {
+      if (i > 0 && (poses[i].pose.translation() - last_position).norm() < 5.0) {
+        continue;
+      }
+      last_position = poses[i].pose.translation();
+
+      // gravity aligned keyframe frame, the world z of the odometry points up
+      Vector3d forward = poses[i].pose.rotation() * Vector3d::UnitX();
+      Keyframe keyframe;
+      keyframe.pose     = Rigid3d(poses[i].pose.translation(), Quaterniond(Eigen::AngleAxisd(std::atan2(forward.y(), forward.x()), Vector3d::UnitZ())));
+      Rigid3d world2key = keyframe.pose.inverse();
+      auto    first     = std::lower_bound(surfels.begin(), surfels.end(), poses[i].timestamp - 5.0, [](const Surfel::Ptr &surfel, double timestamp) { return surfel->timestamp < timestamp; });
+      for (auto it = first; it != surfels.end() && (*it)->timestamp <= poses[i].timestamp + 5.0; ++it) {
+        Vector3d point = (*it)->GetCenterInWorld();
+        if ((point - keyframe.pose.translation()).head<2>().norm() < options.max_radius) {
+          keyframe.points.push_back(world2key * point);
+        }
+      }
+      keyframes_.push_back(keyframe);
+    }
+
+    for (int i = 0; i < keyframes_.size(); ++i) {
+      bool is_revisit = false;
+      for (int j = 0; j < i - options.exclude_recent_num; ++j) {
+        is_revisit |= (keyframes_[j].pose.translation() - keyframes_[i].pose.translation()).norm() < 5.0;
+      }
+      is_revisit_.push_back(is_revisit);
+    }
+    LOG(INFO) << "Recorded sequence of keyframes_" << keyframes_.size() << " from poses_" << poses.size() << " surfels_" << surfels.size();
+  }
+};
+
+const RevisitSequence &GetRevisitSequence() {
+  static const SimulatedSequence sequence;
+  return sequence;
+}
+
+}  // namespace
+
+static void BM_ComputeScanContext(benchmark::State &state) {
+  const auto        &keyframe = GetRevisitSequence().Keyframes().front();
+  ScanContextOptions options;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ComputeScanContext(keyframe.points, options));
+  }
+  state.counters["points"] = keyframe.points.size();
+}
+BENCHMARK(BM_ComputeScanContext);
+
+static void BM_Query(benchmark::State &state) {
+  const auto        &keyframes = GetRevisitSequence().Keyframes();
+  ScanContextOptions options;
+
+  std::vector<ScanContextDescriptor> descriptors;
+  for (auto &keyframe : keyframes) {
+    descriptors.push_back(ComputeScanContext(keyframe.points, options));
+  }
+  // grow the database to the requested size by repeating the sequence
+  ScanContextIndex index(options);
+  for (int i = 0; i < state.range(0); ++i) {
+    index.Add(descriptors[i % descriptors.size()]);
+  }
+  int i = 0;
+  for (auto _ : state) {
+    ScanContextMatch match;
+    benchmark::DoNotOptimize(index.Query(descriptors[i++ % descriptors.size()], &match));
+  }
+}
+BENCHMARK(BM_Query)->Arg(100)->Arg(1000)->Arg(10000)->Arg(100000);
+
+/**
+ * @brief Recall and precision of the best match of every keyframe against all earlier ones
+ */
+static void RevisitRecall(benchmark::State &state, const RevisitSequence &sequence) {
+  const auto        &keyframes = sequence.Keyframes();
+  ScanContextOptions options;
+  int                true_positive = 0, false_positive = 0, revisit_num = 0;
+  for (auto _ : state) {
+    true_positive = false_positive = revisit_num = 0;
+    ScanContextIndex index(options);
+    for (int i = 0; i < keyframes.size(); ++i) {
+      auto descriptor = ComputeScanContext(keyframes[i].points, options);
+      revisit_num += sequence.IsRevisit(i);
+
+      ScanContextMatch match;
+      if (index.Query(descriptor, &match)) {
+        if ((keyframes[match.id].pose.translation() - keyframes[i].pose.translation()).norm() < 10.0) {
+          ++true_positive;
+        } else {
+          ++false_positive;
+        }
+      }
+      index.Add(descriptor);
+    }
+  }
+  state.counters["keyframes"] = keyframes.size();
+  state.counters["revisits"]  = revisit_num;
+  state.counters["recall"]    = revisit_num ? double(true_positive) / revisit_num : 0;
+  state.counters["precision"] = true_positive + false_positive ? double(true_positive) / (true_positive + false_positive) : 0;
+}
+
+static void BM_RevisitRecall(benchmark::State &state) {
+  RevisitRecall(state, GetRevisitSequence());
+}
+BENCHMARK(BM_RevisitRecall)->Unit(benchmark::kMillisecond);
+
+/**
+ * @brief Scores the simulated sequence, and with --surfel_map_filename=<file> a recorded run as well, e.g. the
+ * surfel map written by wildcat_slam_node or wildcat_slam_batch --write_surfel_map on a run with revisits
+ */
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  const char *prefix  = "--surfel_map_filename=";
+  int         arg_num = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], prefix, std::strlen(prefix)) != 0) {
+      argv[arg_num++] = argv[i];
+      continue;
+    }
+    std::string filename = argv[i] + std::strlen(prefix);
+    benchmark::RegisterBenchmark("BM_RecordedRevisitRecall", [filename](benchmark::State &state) {
+      static const RecordedSequence sequence(filename);
+      RevisitRecall(state, sequence);
+    })->Unit(benchmark::kMillisecond);
+  }
+  if (benchmark::ReportUnrecognizedArguments(arg_num, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
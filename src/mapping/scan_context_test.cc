@@ -0,0 +1,65 @@
+#include "mapping/scan_context.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+/**
+ * @brief Points on the walls of random boxes around the origin
+ */
+std::vector<Vector3d> RandomScene(int seed) {
+  std::srand(seed);
+  std::vector<Vector3d> points;
+  for (int box = 0; box < 30; ++box) {
+    Vector3d center = Vector3d::Random() * 60;
+    Vector3d size   = (Vector3d::Random() + Vector3d::Constant(1.5)) * 4;
+    center.z()      = size.z() / 2;
+    for (int i = 0; i < 200; ++i) {
+      Vector3d point = center + size.cwiseProduct(Vector3d::Random()) / 2;
+      points.push_back(point);
+    }
+  }
+  return points;
+}
+
+std::vector<Vector3d> Transform(const std::vector<Vector3d> &points, const Rigid3d &transform) {
+  std::vector<Vector3d> ret;
+  for (auto &point : points) {
+    ret.push_back(transform * point);
+  }
+  return ret;
+}
+
+}  // namespace
+
+TEST(ScanContext, YawInvariantDistance) {
+  ScanContextOptions options;
+  auto               points    = RandomScene(1);
+  auto               candidate = ComputeScanContext(points, options);
+
+  double yaw_gt = 1.0;
+  auto   query  = ComputeScanContext(Transform(points, Rigid3d::Rotation(Quaterniond(Eigen::AngleAxisd(yaw_gt, Vector3d::UnitZ())))), options);
+  double yaw;
+  double distance = ScanContextDistance(query, candidate, &yaw);
+  EXPECT_LT(distance, 0.2);
+  EXPECT_NEAR(yaw, yaw_gt, 2 * M_PI / options.sector_num);
+
+  auto other = ComputeScanContext(RandomScene(2), options);
+  EXPECT_GT(ScanContextDistance(other, candidate), distance);
+}
+
+TEST(ScanContext, IndexQuery) {
+  ScanContextOptions options;
+  ScanContextIndex   index(options);
+  for (int i = 0; i < 50; ++i) {
+    index.Add(ComputeScanContext(RandomScene(i), options));
+  }
+
+  // revisit of keyframe 7 with a different heading and a small offset
+  auto points = Transform(RandomScene(7), Rigid3d(Vector3d(0.5, -0.3, 0), Quaterniond(Eigen::AngleAxisd(-2.0, Vector3d::UnitZ()))));
+
+  ScanContextMatch match;
+  ASSERT_TRUE(index.Query(ComputeScanContext(points, options), &match));
+  EXPECT_EQ(match.id, 7);
+  EXPECT_NEAR(match.yaw, -2.0, 2 * 2 * M_PI / options.sector_num);
+}
@@ -0,0 +1,332 @@
+#include "odometry/checkpoint.h"
+
+#include <glog/logging.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+#include "common/thread_utils.h"
+
+namespace {
+
+constexpr char     kCheckpointMagic[8] = {'W', 'C', 'A', 'T', 'C', 'K', 'P', 'T'};
+constexpr uint32_t kCheckpointVersion  = 2;
+
+class Writer {
+ public:
+  explicit Writer(std::ofstream &ofs) : ofs_(ofs) {}
+
+  template <typename T>
+  void Write(const T &value) {
+    if constexpr (std::is_base_of_v<Eigen::DenseBase<T>, T>) {
+      ofs_.write(reinterpret_cast<const char *>(value.data()), sizeof(typename T::Scalar) * value.size());
+    } else {
+      static_assert(std::is_trivially_copyable_v<T>);
+      ofs_.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+  }
+
+  void Write(const Quaterniond &value) { Write(value.coeffs()); }
+
+ private:
+  std::ofstream &ofs_;
+};
+
+class Reader {
+ public:
+  explicit Reader(std::ifstream &ifs) : ifs_(ifs) {}
+
+  template <typename T>
+  void Read(T *value) {
+    if constexpr (std::is_base_of_v<Eigen::DenseBase<T>, T>) {
+      ifs_.read(reinterpret_cast<char *>(value->data()), sizeof(typename T::Scalar) * value->size());
+    } else {
+      static_assert(std::is_trivially_copyable_v<T>);
+      ifs_.read(reinterpret_cast<char *>(value), sizeof(T));
+    }
+  }
+
+  void Read(Quaterniond *value) { Read(&value->coeffs()); }
+
+  /**
+   * @brief Read a count and check it against the remaining file size, so a corrupted count fails instead of allocating
+   */
+  bool ReadCount(uint64_t *count, size_t element_size) {
+    Read(count);
+    if (!ifs_) {
+      return false;
+    }
+    auto position = ifs_.tellg();
+    ifs_.seekg(0, std::ios::end);
+    auto remaining = static_cast<uint64_t>(ifs_.tellg() - position);
+    ifs_.seekg(position);
+    return *count <= remaining / element_size;
+  }
+
+ private:
+  std::ifstream &ifs_;
+};
+
+// sizes on disk, used to bound counts
+constexpr size_t kSampleStateSize = sizeof(double) * (1 + 12 + 3 + 4 + 3);
+constexpr size_t kImuStateSize    = sizeof(double) * (1 + 3 + 4 + 3 + 3);
+constexpr size_t kSurfelSize      = sizeof(double) * (3 + 4 + 3 + 3 + 3 + 9) + sizeof(int32_t);
+constexpr size_t kImuDataSize     = sizeof(double) * (1 + 3 + 3);
+constexpr size_t kPointSize       = sizeof(float) * 4 + sizeof(double) + sizeof(uint16_t);
+
+void WriteSurfels(const std::vector<Surfel::Ptr> &surfels, Writer &writer) {
+  writer.Write<uint64_t>(surfels.size());
+  for (const auto &surfel : surfels) {
+    writer.Write(surfel->timestamp);
+    writer.Write(surfel->resolution);
+    writer.Write(surfel->plane_std_deviation);
+    writer.Write<int32_t>(surfel->fused_num);
+    writer.Write(surfel->rot);
+    writer.Write(surfel->pos);
+    // world frame values are converted back to the body frame by UpdatePose on restore
+    writer.Write<Vector3d>(surfel->GetCenterInWorld());
+    writer.Write<Vector3d>(surfel->GetNormInWorld());
+    writer.Write<Matrix3d>(surfel->GetCovarianceInWorld());
+  }
+}
+
+bool ReadSurfels(Reader &reader, std::vector<Surfel::Ptr> *surfels) {
+  uint64_t num;
+  if (!reader.ReadCount(&num, kSurfelSize)) {
+    return false;
+  }
+  surfels->resize(num);
+  for (auto &surfel : *surfels) {
+    double      timestamp, resolution, plane_std_deviation;
+    int32_t     fused_num;
+    Quaterniond rot;
+    Vector3d    pos, center, norm;
+    Matrix3d    covariance;
+    reader.Read(&timestamp);
+    reader.Read(&resolution);
+    reader.Read(&plane_std_deviation);
+    reader.Read(&fused_num);
+    reader.Read(&rot);
+    reader.Read(&pos);
+    reader.Read(&center);
+    reader.Read(&norm);
+    reader.Read(&covariance);
+    surfel            = std::make_shared<Surfel>(timestamp, center, covariance, norm, resolution, plane_std_deviation);
+    surfel->fused_num = fused_num;
+    surfel->UpdatePose(pos, rot);
+  }
+  return true;
+}
+
+}  // namespace
+
+SampleState::Ptr CopySampleState(const SampleState &state) {
+  auto copy       = std::make_shared<SampleState>();
+  copy->timestamp = state.timestamp;
+  std::copy(state.data_cor, state.data_cor + 12, copy->data_cor);
+  copy->grav = state.grav;
+  copy->rot  = state.rot;
+  copy->pos  = state.pos;
+  return copy;
+}
+
+bool WriteCheckpoint(const OdometrySnapshot &snapshot, const std::string &filename) {
+  // write to a temporary file and rename, so a crash while writing keeps the previous checkpoint
+  std::ofstream ofs(filename + ".tmp", std::ios::binary);
+  if (!ofs) {
+    LOG(ERROR) << "Failed to open checkpoint " << filename << ".tmp";
+    return false;
+  }
+  Writer writer(ofs);
+  ofs.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+  writer.Write(kCheckpointVersion);
+
+  writer.Write<uint8_t>(snapshot.sync_done);
+  writer.Write<uint8_t>(snapshot.init_sld_win);
+  writer.Write<int32_t>(snapshot.sweep_id);
+  writer.Write<int32_t>(snapshot.first_sample_state_index);
+
+  writer.Write<uint64_t>(snapshot.sample_states.size());
+  for (const auto &state : snapshot.sample_states) {
+    writer.Write(state->timestamp);
+    writer.Write(state->data_cor);
+    writer.Write(state->grav);
+    writer.Write(state->rot);
+    writer.Write(state->pos);
+  }
+
+  writer.Write<uint64_t>(snapshot.imu_states.size());
+  for (const auto &state : snapshot.imu_states) {
+    writer.Write(state.timestamp);
+    writer.Write(state.pos);
+    writer.Write(state.rot);
+    writer.Write(state.acc);
+    writer.Write(state.gyr);
+  }
+
+  WriteSurfels(snapshot.surfels_sld_win, writer);
+  WriteSurfels(snapshot.surfels_fix_win, writer);
+
+  writer.Write<uint64_t>(snapshot.imu_buff.size());
+  for (const auto &data : snapshot.imu_buff) {
+    writer.Write(data.timestamp);
+    writer.Write(data.linear_acceleration);
+    writer.Write(data.angular_velocity);
+  }
+
+  writer.Write<uint64_t>(snapshot.points_buff.size());
+  for (const auto &point : snapshot.points_buff) {
+    writer.Write(point.x);
+    writer.Write(point.y);
+    writer.Write(point.z);
+    writer.Write(point.intensity);
+    writer.Write(point.time);
+    writer.Write(point.ring);
+  }
+
+  ofs.close();
+  if (!ofs || std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0) {
+    LOG(ERROR) << "Failed to write checkpoint " << filename;
+    return false;
+  }
+  return true;
+}
+
+bool ReadCheckpoint(const std::string &filename, OdometrySnapshot *snapshot) {
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    LOG(ERROR) << "Failed to open checkpoint " << filename;
+    return false;
+  }
+  Reader   reader(ifs);
+  char     magic[sizeof(kCheckpointMagic)];
+  uint32_t version = 0;
+  ifs.read(magic, sizeof(magic));
+  reader.Read(&version);
+  if (!ifs || std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0 || version != kCheckpointVersion) {
+    LOG(ERROR) << filename << " is no checkpoint of version " << kCheckpointVersion;
+    return false;
+  }
+
+  uint8_t sync_done, init_sld_win;
+  int32_t sweep_id, first_sample_state_index;
+  reader.Read(&sync_done);
+  reader.Read(&init_sld_win);
+  reader.Read(&sweep_id);
+  reader.Read(&first_sample_state_index);
+  snapshot->sync_done                = sync_done;
+  snapshot->init_sld_win             = init_sld_win;
+  snapshot->sweep_id                 = sweep_id;
+  snapshot->first_sample_state_index = first_sample_state_index;
+
+  uint64_t num;
+  if (!reader.ReadCount(&num, kSampleStateSize)) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+  snapshot->sample_states.resize(num);
+  for (auto &state : snapshot->sample_states) {
+    state = std::make_shared<SampleState>();
+    reader.Read(&state->timestamp);
+    reader.Read(&state->data_cor);
+    reader.Read(&state->grav);
+    reader.Read(&state->rot);
+    reader.Read(&state->pos);
+  }
+
+  if (!reader.ReadCount(&num, kImuStateSize)) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+  snapshot->imu_states.resize(num);
+  for (auto &state : snapshot->imu_states) {
+    reader.Read(&state.timestamp);
+    reader.Read(&state.pos);
+    reader.Read(&state.rot);
+    reader.Read(&state.acc);
+    reader.Read(&state.gyr);
+  }
+
+  if (!ReadSurfels(reader, &snapshot->surfels_sld_win) || !ReadSurfels(reader, &snapshot->surfels_fix_win)) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+
+  if (!reader.ReadCount(&num, kImuDataSize)) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+  snapshot->imu_buff.resize(num);
+  for (auto &data : snapshot->imu_buff) {
+    reader.Read(&data.timestamp);
+    reader.Read(&data.linear_acceleration);
+    reader.Read(&data.angular_velocity);
+  }
+
+  if (!reader.ReadCount(&num, kPointSize)) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+  snapshot->points_buff.resize(num);
+  for (auto &point : snapshot->points_buff) {
+    reader.Read(&point.x);
+    reader.Read(&point.y);
+    reader.Read(&point.z);
+    reader.Read(&point.intensity);
+    reader.Read(&point.time);
+    reader.Read(&point.ring);
+    point.data[3] = 1.0f;
+  }
+
+  if (!ifs || first_sample_state_index >= static_cast<int>(snapshot->sample_states.size())) {
+    LOG(ERROR) << "Corrupted checkpoint " << filename;
+    return false;
+  }
+  return true;
+}
+
+CheckpointWriter::CheckpointWriter() {
+  thread_ = std::thread(&CheckpointWriter::Run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  {
+    absl::MutexLock lock(&mutex_);
+    running_ = false;
+  }
+  thread_.join();
+}
+
+void CheckpointWriter::Write(std::unique_ptr<OdometrySnapshot> snapshot, const std::string &filename) {
+  absl::MutexLock lock(&mutex_);
+  LOG_IF(WARNING, pending_) << "Checkpoint writer fell behind, replacing the pending snapshot of sweep " << pending_->sweep_id;
+  pending_  = std::move(snapshot);
+  filename_ = filename;
+}
+
+void CheckpointWriter::Run() {
+  ConfigureCurrentThread("checkpoint");
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return pending_ != nullptr || !running_;
+  };
+  while (true) {
+    std::unique_ptr<OdometrySnapshot> snapshot;
+    std::string                       filename;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(&predicate));
+      if (!pending_) {
+        return;  // stopped and nothing left to write
+      }
+      snapshot = std::move(pending_);
+      filename = filename_;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (WriteCheckpoint(*snapshot, filename)) {
+      LOG(INFO) << "Wrote checkpoint of sweep " << snapshot->sweep_id << " to " << filename << " in "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+    }
+  }
+}
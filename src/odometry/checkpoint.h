@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "common/common.h"
+#include "odometry/surfel.h"
+
+/**
+ * @brief Full state of LidarOdometry between two sweeps
+ *
+ * States that are still modified by the odometry are deep copies, the fixed window surfels are never modified
+ * and only shared, so taking a snapshot is cheap and the odometry can go on while it is written.
+ */
+struct OdometrySnapshot {
+  std::vector<SampleState::Ptr> sample_states;                  // deep copies
+  int                           first_sample_state_index = -1;  // in sample_states, -1 if it left the sliding window
+  std::vector<ImuState>         imu_states;
+  std::vector<Surfel::Ptr>      surfels_sld_win;  // deep copies
+  std::vector<Surfel::Ptr>      surfels_fix_win;  // shared with the odometry, empty in localization mode
+  std::vector<ImuData>          imu_buff;
+  std::vector<hilti_ros::Point> points_buff;
+  bool                          sync_done    = false;
+  bool                          init_sld_win = false;
+  int                           sweep_id     = 0;
+};
+
+/**
+ * @brief Deep copy of a sample state, SampleState itself can not be copied as its maps would alias the source
+ */
+SampleState::Ptr CopySampleState(const SampleState &state);
+
+/**
+ * @brief Write a snapshot to a binary checkpoint, atomically replacing an existing one
+ *
+ * @return false if the file can not be written
+ */
+bool WriteCheckpoint(const OdometrySnapshot &snapshot, const std::string &filename);
+
+/**
+ * @return false if the file can not be read or is no checkpoint
+ */
+bool ReadCheckpoint(const std::string &filename, OdometrySnapshot *snapshot);
+
+/**
+ * @brief Writes snapshots on its own thread
+ *
+ * Only the latest snapshot is kept, a snapshot that has not been written yet is replaced by a newer one.
+ */
+class CheckpointWriter {
+ public:
+  CheckpointWriter();
+
+  /**
+   * @brief Write the pending snapshot and stop the writer thread
+   */
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter &)            = delete;
+  CheckpointWriter &operator=(const CheckpointWriter &) = delete;
+
+  void Write(std::unique_ptr<OdometrySnapshot> snapshot, const std::string &filename) LOCKS_EXCLUDED(mutex_);
+
+ private:
+  void Run();
+
+ private:
+  absl::Mutex                       mutex_;
+  std::unique_ptr<OdometrySnapshot> pending_ GUARDED_BY(mutex_);
+  std::string                       filename_ GUARDED_BY(mutex_);
+  bool                              running_ GUARDED_BY(mutex_) = true;
+  std::thread                       thread_;
+};
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+
+#include "common/test_utils.h"
+#include "odometry/checkpoint.h"
+
+namespace {
+
+Surfel::Ptr MakeSurfel(double t) {
+  Matrix3d covariance = Matrix3d::Random() * 0.01;
+  auto     surfel     = std::make_shared<Surfel>(t, Vector3d::Random() * 10, covariance * covariance.transpose(), Vector3d::Random().normalized(), 0.5, 0.01);
+  surfel->UpdatePose(Vector3d(t, 1, 0), Quaterniond(Eigen::AngleAxisd(t, Vector3d::UnitY())));
+  return surfel;
+}
+
+OdometrySnapshot MakeSnapshot() {
+  OdometrySnapshot snapshot;
+  for (int i = 0; i < 4; ++i) {
+    auto state       = std::make_shared<SampleState>();
+    state->timestamp = i * 0.05;
+    state->rot_cor   = Vector3d::Random();
+    state->ba        = Vector3d::Random();
+    state->grav      = Vector3d(0, 0, -9.81);
+    state->rot       = Quaterniond(Eigen::AngleAxisd(i, Vector3d::UnitZ()));
+    state->pos       = Vector3d(i, 0, 0);
+    snapshot.sample_states.push_back(state);
+
+    ImuState imu_state;
+    imu_state.timestamp = i * 0.05;
+    imu_state.pos       = Vector3d(i, 0, 0);
+    imu_state.rot       = state->rot;
+    imu_state.acc       = Vector3d::Random();
+    imu_state.gyr       = Vector3d::Random();
+    snapshot.imu_states.push_back(imu_state);
+
+    snapshot.surfels_sld_win.push_back(MakeSurfel(i));
+    snapshot.surfels_fix_win.push_back(MakeSurfel(-i));
+    snapshot.surfels_fix_win.back()->fused_num = i + 1;
+    snapshot.imu_buff.push_back({0.2 + i * 0.005, Vector3d::Random(), Vector3d::Random()});
+
+    hilti_ros::Point point;
+    point.getVector3fMap() = Eigen::Vector3f::Random();
+    point.intensity        = i;
+    point.time             = 0.2 + i * 1e-3;
+    point.ring             = i;
+    snapshot.points_buff.push_back(point);
+  }
+  snapshot.first_sample_state_index = 0;
+  snapshot.sync_done                = true;
+  snapshot.init_sld_win             = true;
+  snapshot.sweep_id                 = 42;
+  return snapshot;
+}
+
+}  // namespace
+
+TEST(Checkpoint, WriteRead) {
+  std::string      filename = UniqueTestPath("checkpoint.ckpt");
+  OdometrySnapshot written  = MakeSnapshot();
+  ASSERT_TRUE(WriteCheckpoint(written, filename));
+
+  OdometrySnapshot read;
+  ASSERT_TRUE(ReadCheckpoint(filename, &read));
+  EXPECT_TRUE(read.sync_done);
+  EXPECT_TRUE(read.init_sld_win);
+  EXPECT_EQ(read.sweep_id, 42);
+  EXPECT_EQ(read.first_sample_state_index, 0);
+
+  ASSERT_EQ(read.sample_states.size(), written.sample_states.size());
+  for (int i = 0; i < written.sample_states.size(); ++i) {
+    EXPECT_EQ(read.sample_states[i]->timestamp, written.sample_states[i]->timestamp);
+    EXPECT_EQ(read.sample_states[i]->rot_cor, written.sample_states[i]->rot_cor);
+    EXPECT_EQ(read.sample_states[i]->ba, written.sample_states[i]->ba);
+    EXPECT_EQ(read.sample_states[i]->rot.coeffs(), written.sample_states[i]->rot.coeffs());
+    EXPECT_EQ(read.sample_states[i]->pos, written.sample_states[i]->pos);
+  }
+  ASSERT_EQ(read.imu_states.size(), written.imu_states.size());
+  EXPECT_EQ(read.imu_states.back().gyr, written.imu_states.back().gyr);
+
+  ASSERT_EQ(read.surfels_sld_win.size(), written.surfels_sld_win.size());
+  ASSERT_EQ(read.surfels_fix_win.size(), written.surfels_fix_win.size());
+  for (int i = 0; i < written.surfels_sld_win.size(); ++i) {
+    const auto &lhs = *read.surfels_sld_win[i];
+    const auto &rhs = *written.surfels_sld_win[i];
+    EXPECT_EQ(lhs.timestamp, rhs.timestamp);
+    EXPECT_TRUE(lhs.CenterInBody().isApprox(rhs.CenterInBody(), 1e-12));
+    EXPECT_TRUE(lhs.GetNormInWorld().isApprox(rhs.GetNormInWorld(), 1e-12));
+    EXPECT_TRUE(lhs.GetCovarianceInWorld().isApprox(rhs.GetCovarianceInWorld(), 1e-12));
+  }
+  for (int i = 0; i < written.surfels_fix_win.size(); ++i) {
+    EXPECT_EQ(read.surfels_fix_win[i]->fused_num, written.surfels_fix_win[i]->fused_num);
+  }
+
+  ASSERT_EQ(read.imu_buff.size(), written.imu_buff.size());
+  EXPECT_EQ(read.imu_buff.back().angular_velocity, written.imu_buff.back().angular_velocity);
+  ASSERT_EQ(read.points_buff.size(), written.points_buff.size());
+  EXPECT_EQ(read.points_buff.back().getVector3fMap(), written.points_buff.back().getVector3fMap());
+  EXPECT_EQ(read.points_buff.back().time, written.points_buff.back().time);
+  EXPECT_EQ(read.points_buff.back().ring, written.points_buff.back().ring);
+
+  // a truncated checkpoint is rejected
+  std::filesystem::resize_file(filename, std::filesystem::file_size(filename) / 2);
+  EXPECT_FALSE(ReadCheckpoint(filename, &read));
+
+  std::filesystem::remove(filename);
+}
+
+TEST(Checkpoint, WriterKeepsLatest) {
+  std::string filename = UniqueTestPath("checkpoint_writer.ckpt");
+  {
+    CheckpointWriter writer;
+    for (int i = 0; i < 10; ++i) {
+      auto snapshot      = std::make_unique<OdometrySnapshot>(MakeSnapshot());
+      snapshot->sweep_id = i;
+      writer.Write(std::move(snapshot), filename);
+    }
+  }
+
+  OdometrySnapshot read;
+  ASSERT_TRUE(ReadCheckpoint(filename, &read));
+  EXPECT_EQ(read.sweep_id, 9);
+  EXPECT_FALSE(std::filesystem::exists(filename + ".tmp"));
+
+  std::filesystem::remove(filename);
+}
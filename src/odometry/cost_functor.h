@@ -3,6 +3,7 @@
 #include <ceres/ceres.h>
 #include <iomanip>
 
+#include "common/check.h"
 #include "common/utils.h"
 #include "odometry/surfel.h"
 
@@ -12,46 +13,58 @@
  * 1. Timestamp order: s1 < sp2l <= s2 < sp2r
  * 2. s1 s2 are not in adjacent sampled intervals
  *
+ * Scalar is the precision of the evaluation. The constructor reduces the surfels in double to vectors of the size of
+ * the lidar range and the interpolation factor, so that float keeps the residual at the precision of the points. Ceres
+ * still accumulates the normal equations in double.
  */
+template <typename Scalar = double>
 struct SurfelMatchUnaryFactor : public ceres::SizedCostFunction<1, 12, 12> {
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+
   SurfelMatchUnaryFactor(
       std::shared_ptr<Surfel>      s1,
       std::shared_ptr<Surfel>      s2,
       std::shared_ptr<SampleState> sp2l,
-      std::shared_ptr<SampleState> sp2r) : s1_(s1), sp2l_(sp2l), sp2r_(sp2r), s2_(s2) {
-    Matrix3d                                cov = s1_->GetCovarianceInWorld() + s2_->GetCovarianceInWorld();
+      std::shared_ptr<SampleState> sp2r) {
+    Matrix3d                                cov = s1->GetCovarianceInWorld() + s2->GetCovarianceInWorld();
     Eigen::SelfAdjointEigenSolver<Matrix3d> es(cov);
     weight_ = 1 / sqrt(pow(0.05 / 6, 2) + es.eigenvalues()[0]);
-    norm_   = es.eigenvectors().col(0);
+    norm_   = es.eigenvectors().col(0).cast<Scalar>();
+
+    double factor2 = (s2->timestamp - sp2l->timestamp) / (sp2r->timestamp - sp2l->timestamp);
+    DEBUG_CHECK_GE(factor2, 0);
+    DEBUG_CHECK_LE(factor2, 1);
+    factor2_ = factor2;
+    center2_ = (s2->rot * s2->CenterInBody()).cast<Scalar>();
+    offset_  = (s1->GetCenterInWorld() - s2->pos).cast<Scalar>();
   }
 
   virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp2l{&parameters[0][0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp2l{&parameters[0][3]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp2r{&parameters[1][0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp2r{&parameters[1][3]};
-    double                                        factor2 = (s2_->timestamp - sp2l_->timestamp) / (sp2r_->timestamp - sp2l_->timestamp);
-    Eigen::Matrix<double, 3, 1>                   r_s2    = (1 - factor2) * r_sp2l + factor2 * r_sp2r;
-    Eigen::Matrix<double, 3, 1>                   t_s2    = (1 - factor2) * t_sp2l + factor2 * t_sp2r;
-    CHECK_GE(factor2, 0);
-    CHECK_LE(factor2, 1);
-
-    residuals[0] = weight_ * norm_.dot(s1_->GetCenterInWorld() - Exp(r_s2) * s2_->rot * s2_->CenterInBody() - t_s2 - s2_->pos);
+    Vector3 r_sp2l = Eigen::Map<const Vector3d>{&parameters[0][0]}.cast<Scalar>();
+    Vector3 t_sp2l = Eigen::Map<const Vector3d>{&parameters[0][3]}.cast<Scalar>();
+    Vector3 r_sp2r = Eigen::Map<const Vector3d>{&parameters[1][0]}.cast<Scalar>();
+    Vector3 t_sp2r = Eigen::Map<const Vector3d>{&parameters[1][3]}.cast<Scalar>();
+    Vector3 r_s2   = (1 - factor2_) * r_sp2l + factor2_ * r_sp2r;
+    Vector3 t_s2   = (1 - factor2_) * t_sp2l + factor2_ * t_sp2r;
+
+    Eigen::Quaternion<Scalar> rot_s2 = TypedExp(r_s2);
+    residuals[0]                     = weight_ * norm_.dot(offset_ - rot_s2 * center2_ - t_s2);
+    PARANOID_CHECK(std::isfinite(residuals[0]));
 
     if (jacobians) {
-      Eigen::Matrix<double, 1, 12> jacobian_s2;
+      Eigen::Matrix<Scalar, 1, 12> jacobian_s2;
       jacobian_s2.setZero();
-      jacobian_s2.block<1, 3>(0, 0) = weight_ * norm_.transpose() * Exp(r_s2).matrix() * Hat(s2_->rot * s2_->CenterInBody()) * Jr(r_s2);
-      jacobian_s2.block<1, 3>(0, 3) = -weight_ * norm_.transpose();
+      jacobian_s2.template block<1, 3>(0, 0) = weight_ * norm_.transpose() * rot_s2.matrix() * Hat(center2_) * Jr(r_s2);
+      jacobian_s2.template block<1, 3>(0, 3) = -weight_ * norm_.transpose();
 
       if (jacobians[0]) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp2l{jacobians[0]};
-        jacobian_sp2l = jacobian_s2 * (1 - factor2);
+        jacobian_sp2l = (jacobian_s2 * (1 - factor2_)).template cast<double>();
       }
 
       if (jacobians[1]) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp2r{jacobians[1]};
-        jacobian_sp2r = jacobian_s2 * factor2;
+        jacobian_sp2r = (jacobian_s2 * factor2_).template cast<double>();
       }
     }
 
@@ -59,13 +72,11 @@ struct SurfelMatchUnaryFactor : public ceres::SizedCostFunction<1, 12, 12> {
   }
 
  private:
-  std::shared_ptr<Surfel>      s1_;
-  std::shared_ptr<SampleState> sp2l_;
-  std::shared_ptr<SampleState> sp2r_;
-  std::shared_ptr<Surfel>      s2_;
-
-  Vector3d norm_;
-  double   weight_;
+  Vector3 norm_;
+  Scalar  weight_;
+  Scalar  factor2_;
+  Vector3 center2_;  // s2 center in body frame, rotated to world
+  Vector3 offset_;   // s1 center in world minus s2 body position
 };
 
 template <int Mode>
@@ -96,82 +107,94 @@ struct SurfelMatchBinaryModeTraits<2> {
  *   c. Mode 2: sp1l = sp2l <= s1 < s2 < sp1r = sp2r
  * 2. s1 s2 are not in adjacent sampled intervals
  *
+ * Scalar is the precision of the evaluation, see SurfelMatchUnaryFactor.
  */
-template <int Mode, typename TMode = typename SurfelMatchBinaryModeTraits<Mode>::type>
+template <int Mode, typename Scalar = double, typename TMode = typename SurfelMatchBinaryModeTraits<Mode>::type>
 struct SurfelMatchBinaryFactor : public TMode {
+  using Vector3 = Eigen::Matrix<Scalar, 3, 1>;
+
   SurfelMatchBinaryFactor(
       std::shared_ptr<Surfel>      s1,
       std::shared_ptr<SampleState> sp1l,
       std::shared_ptr<SampleState> sp1r,
       std::shared_ptr<Surfel>      s2,
       std::shared_ptr<SampleState> sp2l,
-      std::shared_ptr<SampleState> sp2r) : s1_(s1), sp1l_(sp1l), sp1r_(sp1r), s2_(s2), sp2l_(sp2l), sp2r_(sp2r) {
-    ValidateTimestamps();
-    Matrix3d                                cov = s1_->GetCovarianceInWorld() + s2_->GetCovarianceInWorld();
+      std::shared_ptr<SampleState> sp2r) {
+    ValidateTimestamps(*s1, *sp1l, *sp1r, *s2, *sp2l, *sp2r);
+    Matrix3d                                cov = s1->GetCovarianceInWorld() + s2->GetCovarianceInWorld();
     Eigen::SelfAdjointEigenSolver<Matrix3d> es(cov);
     weight_ = 1 / sqrt(pow(0.05 / 6, 2) + es.eigenvalues()[0]);
-    norm_   = es.eigenvectors().col(0);
+    norm_   = es.eigenvectors().col(0).cast<Scalar>();
+
+    double factor1 = (s1->timestamp - sp1l->timestamp) / (sp1r->timestamp - sp1l->timestamp);
+    double factor2 = (s2->timestamp - sp2l->timestamp) / (sp2r->timestamp - sp2l->timestamp);
+    DEBUG_CHECK_GE(factor1, 0);
+    DEBUG_CHECK_LE(factor1, 1);
+    DEBUG_CHECK_GE(factor2, 0);
+    DEBUG_CHECK_LE(factor2, 1);
+    factor1_ = factor1;
+    factor2_ = factor2;
+    center1_ = (s1->rot * s1->CenterInBody()).cast<Scalar>();
+    center2_ = (s2->rot * s2->CenterInBody()).cast<Scalar>();
+    offset_  = (s1->pos - s2->pos).cast<Scalar>();
   }
 
   virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
     const double *sp1l_ptr, *sp1r_ptr, *sp2l_ptr, *sp2r_ptr;
     DispatchPtr(parameters, sp1l_ptr, sp1r_ptr, sp2l_ptr, sp2r_ptr);
 
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp1l{&sp1l_ptr[0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp1l{&sp1l_ptr[3]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp1r{&sp1r_ptr[0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp1r{&sp1r_ptr[3]};
-    double                                        factor1 = (s1_->timestamp - sp1l_->timestamp) / (sp1r_->timestamp - sp1l_->timestamp);
-    Eigen::Matrix<double, 3, 1>                   r_s1    = (1 - factor1) * r_sp1l + factor1 * r_sp1r;
-    Eigen::Matrix<double, 3, 1>                   t_s1    = (1 - factor1) * t_sp1l + factor1 * t_sp1r;
-    CHECK_GE(factor1, 0);
-    CHECK_LE(factor1, 1);
-
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp2l{&sp2l_ptr[0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp2l{&sp2l_ptr[3]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r_sp2r{&sp2r_ptr[0]};
-    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t_sp2r{&sp2r_ptr[3]};
-    double                                        factor2 = (s2_->timestamp - sp2l_->timestamp) / (sp2r_->timestamp - sp2l_->timestamp);
-    Eigen::Matrix<double, 3, 1>                   r_s2    = (1 - factor2) * r_sp2l + factor2 * r_sp2r;
-    Eigen::Matrix<double, 3, 1>                   t_s2    = (1 - factor2) * t_sp2l + factor2 * t_sp2r;
-    CHECK_GE(factor2, 0);
-    CHECK_LE(factor2, 1);
-
-    residuals[0] = weight_ * norm_.dot(Exp(r_s1) * s1_->rot * s1_->CenterInBody() + t_s1 + s1_->pos - Exp(r_s2) * s2_->rot * s2_->CenterInBody() - t_s2 - s2_->pos);
+    Vector3 r_sp1l = Eigen::Map<const Vector3d>{&sp1l_ptr[0]}.cast<Scalar>();
+    Vector3 t_sp1l = Eigen::Map<const Vector3d>{&sp1l_ptr[3]}.cast<Scalar>();
+    Vector3 r_sp1r = Eigen::Map<const Vector3d>{&sp1r_ptr[0]}.cast<Scalar>();
+    Vector3 t_sp1r = Eigen::Map<const Vector3d>{&sp1r_ptr[3]}.cast<Scalar>();
+    Vector3 r_s1   = (1 - factor1_) * r_sp1l + factor1_ * r_sp1r;
+    Vector3 t_s1   = (1 - factor1_) * t_sp1l + factor1_ * t_sp1r;
+
+    Vector3 r_sp2l = Eigen::Map<const Vector3d>{&sp2l_ptr[0]}.cast<Scalar>();
+    Vector3 t_sp2l = Eigen::Map<const Vector3d>{&sp2l_ptr[3]}.cast<Scalar>();
+    Vector3 r_sp2r = Eigen::Map<const Vector3d>{&sp2r_ptr[0]}.cast<Scalar>();
+    Vector3 t_sp2r = Eigen::Map<const Vector3d>{&sp2r_ptr[3]}.cast<Scalar>();
+    Vector3 r_s2   = (1 - factor2_) * r_sp2l + factor2_ * r_sp2r;
+    Vector3 t_s2   = (1 - factor2_) * t_sp2l + factor2_ * t_sp2r;
+
+    Eigen::Quaternion<Scalar> rot_s1 = TypedExp(r_s1);
+    Eigen::Quaternion<Scalar> rot_s2 = TypedExp(r_s2);
+    residuals[0]                     = weight_ * norm_.dot(rot_s1 * center1_ + t_s1 + offset_ - rot_s2 * center2_ - t_s2);
+    PARANOID_CHECK(std::isfinite(residuals[0]));
 
     if (jacobians) {
       InitJacobians(jacobians);
       double *sp1l_jacobian_ptr, *sp1r_jacobian_ptr, *sp2l_jacobian_ptr, *sp2r_jacobian_ptr;
       DispatchPtr(jacobians, sp1l_jacobian_ptr, sp1r_jacobian_ptr, sp2l_jacobian_ptr, sp2r_jacobian_ptr);
 
-      Eigen::Matrix<double, 1, 12> jacobian_s1;
+      Eigen::Matrix<Scalar, 1, 12> jacobian_s1;
       jacobian_s1.setZero();
-      jacobian_s1.block<1, 3>(0, 0) = -weight_ * norm_.transpose() * Exp(r_s1).matrix() * Hat(s1_->rot * s1_->CenterInBody()) * Jr(r_s1);
-      jacobian_s1.block<1, 3>(0, 3) = weight_ * norm_.transpose();
+      jacobian_s1.template block<1, 3>(0, 0) = -weight_ * norm_.transpose() * rot_s1.matrix() * Hat(center1_) * Jr(r_s1);
+      jacobian_s1.template block<1, 3>(0, 3) = weight_ * norm_.transpose();
 
       if (sp1l_jacobian_ptr) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp1l{sp1l_jacobian_ptr};
-        jacobian_sp1l = jacobian_s1 * (1 - factor1);
+        jacobian_sp1l += (jacobian_s1 * (1 - factor1_)).template cast<double>();
       }
 
       if (sp1r_jacobian_ptr) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp1r{sp1r_jacobian_ptr};
-        jacobian_sp1r = jacobian_s1 * factor1;
+        jacobian_sp1r += (jacobian_s1 * factor1_).template cast<double>();
       }
 
-      Eigen::Matrix<double, 1, 12> jacobian_s2;
+      Eigen::Matrix<Scalar, 1, 12> jacobian_s2;
       jacobian_s2.setZero();
-      jacobian_s2.block<1, 3>(0, 0) = weight_ * norm_.transpose() * Exp(r_s2).matrix() * Hat(s2_->rot * s2_->CenterInBody()) * Jr(r_s2);
-      jacobian_s2.block<1, 3>(0, 3) = -weight_ * norm_.transpose();
+      jacobian_s2.template block<1, 3>(0, 0) = weight_ * norm_.transpose() * rot_s2.matrix() * Hat(center2_) * Jr(r_s2);
+      jacobian_s2.template block<1, 3>(0, 3) = -weight_ * norm_.transpose();
 
       if (sp2l_jacobian_ptr) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp2l{sp2l_jacobian_ptr};
-        jacobian_sp2l = jacobian_s2 * (1 - factor2);
+        jacobian_sp2l += (jacobian_s2 * (1 - factor2_)).template cast<double>();
       }
 
       if (sp2r_jacobian_ptr) {
         Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>> jacobian_sp2r{sp2r_jacobian_ptr};
-        jacobian_sp2r = jacobian_s2 * factor2;
+        jacobian_sp2r += (jacobian_s2 * factor2_).template cast<double>();
       }
     }
 
@@ -179,25 +202,26 @@ struct SurfelMatchBinaryFactor : public TMode {
   }
 
  private:
-  void ValidateTimestamps() const {
-    CHECK_LT(s1_->timestamp, s2_->timestamp);
+  static void ValidateTimestamps(const Surfel& s1, const SampleState& sp1l, const SampleState& sp1r, const Surfel& s2, const SampleState& sp2l, const SampleState& sp2r) {
+    CHECK_LT(s1.timestamp, s2.timestamp);
     if constexpr (Mode == 0) {
-      CHECK_LT(sp1r_->timestamp, sp2l_->timestamp);
+      CHECK_LT(sp1r.timestamp, sp2l.timestamp);
     } else if constexpr (Mode == 1) {
-      CHECK_EQ(sp1r_->timestamp, sp2l_->timestamp);
+      CHECK_EQ(sp1r.timestamp, sp2l.timestamp);
     } else {
-      CHECK_EQ(sp1l_->timestamp, sp2l_->timestamp);
-      CHECK_EQ(sp1r_->timestamp, sp2r_->timestamp);
+      CHECK_EQ(sp1l.timestamp, sp2l.timestamp);
+      CHECK_EQ(sp1r.timestamp, sp2r.timestamp);
     }
   }
 
+  // blocks shared by s1 and s2 accumulate both contributions, so every requested jacobian starts from zero
   void InitJacobians(double** jacobians) const {
     if (!jacobians) {
       return;
     }
 
 #define SET_JACOBIAN_TO_ZERO(dim)                                                        \
-  if (!jacobians[dim]) {                                                                 \
+  if (jacobians[dim]) {                                                                  \
     Eigen::Map<Eigen::Matrix<double, 1, 12, Eigen::RowMajor>>{jacobians[dim]}.setZero(); \
   }
 
@@ -229,15 +253,13 @@ struct SurfelMatchBinaryFactor : public TMode {
   }
 
  private:
-  std::shared_ptr<Surfel>      s1_;
-  std::shared_ptr<SampleState> sp1l_;
-  std::shared_ptr<SampleState> sp1r_;
-  std::shared_ptr<Surfel>      s2_;
-  std::shared_ptr<SampleState> sp2l_;
-  std::shared_ptr<SampleState> sp2r_;
-
-  Vector3d norm_;
-  double   weight_;
+  Vector3 norm_;
+  Scalar  weight_;
+  Scalar  factor1_;
+  Scalar  factor2_;
+  Vector3 center1_;  // s1 center in body frame, rotated to world
+  Vector3 center2_;  // s2 center in body frame, rotated to world
+  Vector3 offset_;   // s1 body position minus s2 body position
 };
 
 template <int Mode>
@@ -300,7 +322,7 @@ struct ImuFactor : public TMode {
     if (jacobians) {
       Eigen::Matrix<double, 12, 12> jacobian_tau;
       jacobian_tau.setZero();
-      jacobian_tau.block<3, 3>(0, 0) = weight_gyr_ * (1 / dt_) * F(i1_.rot.conjugate(), Exp(r_i2_cor) * i2_.rot, r_i1_cor);
+      jacobian_tau.block<3, 3>(0, 0) = weight_gyr_ * (1 / dt_) * F(i1_.rot.conjugate(), Exp(r_i2_cor) * i2_.rot, -r_i1_cor);
       jacobian_tau.block<3, 3>(0, 6) = -weight_gyr_ * Matrix3d::Identity();
       jacobian_tau.block<3, 3>(3, 0) = -weight_acc_ * (Exp(r_i1_cor).matrix() * Hat(i1_.rot * (i1_.acc - ba_i1)) * Jr(r_i1_cor));
       jacobian_tau.block<3, 3>(3, 3) = -weight_acc_ * (1 / dt_ / dt_) * Matrix3d::Identity();
@@ -311,7 +333,6 @@ struct ImuFactor : public TMode {
       Eigen::Matrix<double, 12, 12> jacobian_tau1;
       jacobian_tau1.setZero();
       jacobian_tau1.block<3, 3>(0, 0) = -weight_gyr_ * (1 / dt_) * F((Exp(r_i1_cor) * i1_.rot).conjugate(), i2_.rot, r_i2_cor);
-      jacobian_tau1.block<3, 3>(0, 6) = -weight_gyr_ * Matrix3d::Identity();
       jacobian_tau1.block<3, 3>(3, 3) = weight_acc_ * (2 / dt_ / dt_) * Matrix3d::Identity();
       jacobian_tau1.block<3, 3>(6, 6) = -weight_bg_ * Matrix3d::Identity();
       jacobian_tau1.block<3, 3>(9, 9) = -weight_ba_ * Matrix3d::Identity();
@@ -320,14 +341,17 @@ struct ImuFactor : public TMode {
       jacobian_tau2.setZero();
       jacobian_tau2.block<3, 3>(3, 3) = -weight_acc_ * (1 / dt_ / dt_) * Matrix3d::Identity();
 
-      if constexpr (Mode == 0) {
-        if (!jacobians[0] || !jacobians[1] || !jacobians[2]) {
-          LOG(FATAL) << "unimplemented";
-        }
+      // jacobians not requested, as of constant blocks, are dispatched to scratch
+      double  scratch[3][144];
+      double* jacobian_ptrs[3];
+      for (int i = 0; i < (Mode == 0 ? 3 : 2); ++i) {
+        jacobian_ptrs[i] = jacobians[i] ? jacobians[i] : scratch[i];
+      }
 
-        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1{jacobians[0]};
-        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2{jacobians[1]};
-        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp3{jacobians[2]};
+      if constexpr (Mode == 0) {
+        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1{jacobian_ptrs[0]};
+        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2{jacobian_ptrs[1]};
+        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp3{jacobian_ptrs[2]};
         jacobian_sp1.setZero();
         jacobian_sp2.setZero();
         jacobian_sp3.setZero();
@@ -336,12 +360,8 @@ struct ImuFactor : public TMode {
         DispatchJacobians(jacobian_tau1, i2_.timestamp, sp1_timestamp_, sp2_timestamp_, sp3_timestamp_, jacobian_sp1, jacobian_sp2, jacobian_sp3);
         DispatchJacobians(jacobian_tau2, i3_.timestamp, sp1_timestamp_, sp2_timestamp_, sp3_timestamp_, jacobian_sp1, jacobian_sp2, jacobian_sp3);
       } else {
-        if (!jacobians[0] || !jacobians[1]) {
-          LOG(FATAL) << "unimplemented";
-        }
-
-        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1{jacobians[0]};
-        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2{jacobians[1]};
+        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1{jacobian_ptrs[0]};
+        Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2{jacobian_ptrs[1]};
         jacobian_sp1.setZero();
         jacobian_sp2.setZero();
 
@@ -364,7 +384,7 @@ struct ImuFactor : public TMode {
       Vector3d&          t_cor,
       Vector3d&          bg,
       Vector3d&          ba) const {
-    CHECK((timestamp >= sp1.timestamp && timestamp < sp2.timestamp) || (timestamp >= sp2.timestamp && timestamp <= sp3.timestamp))
+    DEBUG_CHECK((timestamp >= sp1.timestamp && timestamp < sp2.timestamp) || (timestamp >= sp2.timestamp && timestamp <= sp3.timestamp))
         << std::fixed << std::setprecision(6) << "timestamp: " << timestamp << " sp1: " << sp1.timestamp << " sp2: " << sp2.timestamp << " sp3: " << sp3.timestamp;
 
     bool between_sp1_sp2 = (timestamp >= sp1.timestamp && timestamp < sp2.timestamp);
@@ -387,7 +407,7 @@ struct ImuFactor : public TMode {
       Vector3d&          t_cor,
       Vector3d&          bg,
       Vector3d&          ba) const {
-    CHECK(timestamp >= sp1.timestamp && timestamp <= sp2.timestamp) << std::fixed << std::setprecision(6) << "Timestamp order: " << timestamp << " sp1: " << sp1.timestamp << " sp2: " << sp2.timestamp;
+    DEBUG_CHECK(timestamp >= sp1.timestamp && timestamp <= sp2.timestamp) << std::fixed << std::setprecision(6) << "Timestamp order: " << timestamp << " sp1: " << sp1.timestamp << " sp2: " << sp2.timestamp;
 
     const SampleState& spl = sp1;
     const SampleState& spr = sp2;
@@ -408,7 +428,7 @@ struct ImuFactor : public TMode {
       Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1,
       Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2,
       Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp3) const {
-    CHECK((timestamp >= timestamp_sp1 && timestamp < timestamp_sp2) || (timestamp >= timestamp_sp2 && timestamp <= timestamp_sp3));
+    DEBUG_CHECK((timestamp >= timestamp_sp1 && timestamp < timestamp_sp2) || (timestamp >= timestamp_sp2 && timestamp <= timestamp_sp3));
 
     bool between_sp1_sp2 = (timestamp >= timestamp_sp1 && timestamp < timestamp_sp2);
 
@@ -430,7 +450,7 @@ struct ImuFactor : public TMode {
       double                                                     timestamp_sp2,
       Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp1,
       Eigen::Map<Eigen::Matrix<double, 12, 12, Eigen::RowMajor>> jacobian_sp2) const {
-    CHECK(timestamp >= timestamp_sp1 && timestamp <= timestamp_sp2);
+    DEBUG_CHECK(timestamp >= timestamp_sp1 && timestamp <= timestamp_sp2);
 
     auto timestamp_spl = timestamp_sp1;
     auto timestamp_spr = timestamp_sp2;
@@ -470,3 +490,44 @@ struct ImuFactor : public TMode {
 
   Vector3d gravity_;
 };
+
+/**
+ * @brief Point-to-plane distance between two corresponding surfels of different maps
+ *
+ * Parameter block: [r, t] rigid correction applied on the left of s2's world pose, i.e. s2 moves to Exp(r) * s2 + t.
+ * s1 is fixed.
+ *
+ */
+struct SurfelAlignmentFactor : public ceres::SizedCostFunction<1, 6> {
+  SurfelAlignmentFactor(
+      std::shared_ptr<Surfel> s1,
+      std::shared_ptr<Surfel> s2) : s1_(s1), s2_(s2) {
+    Matrix3d                                cov = s1_->GetCovarianceInWorld() + s2_->GetCovarianceInWorld();
+    Eigen::SelfAdjointEigenSolver<Matrix3d> es(cov);
+    weight_ = 1 / sqrt(pow(0.05 / 6, 2) + es.eigenvalues()[0]);
+    norm_   = es.eigenvectors().col(0);
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+    Eigen::Map<const Eigen::Matrix<double, 3, 1>> r{&parameters[0][0]};
+    Eigen::Map<const Eigen::Matrix<double, 3, 1>> t{&parameters[0][3]};
+    Vector3d                                      center2 = s2_->GetCenterInWorld();
+
+    residuals[0] = weight_ * norm_.dot(s1_->GetCenterInWorld() - Exp(r) * center2 - t);
+
+    if (jacobians && jacobians[0]) {
+      Eigen::Map<Eigen::Matrix<double, 1, 6, Eigen::RowMajor>> jacobian{jacobians[0]};
+      jacobian.block<1, 3>(0, 0) = weight_ * norm_.transpose() * Exp(r).matrix() * Hat(center2) * Jr(r);
+      jacobian.block<1, 3>(0, 3) = -weight_ * norm_.transpose();
+    }
+
+    return true;
+  }
+
+ private:
+  std::shared_ptr<Surfel> s1_;
+  std::shared_ptr<Surfel> s2_;
+
+  Vector3d norm_;
+  double   weight_;
+};
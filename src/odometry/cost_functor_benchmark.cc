@@ -0,0 +1,182 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+#include "odometry/cost_functor.h"
+#include "odometry/cost_functor_reference.h"
+
+namespace {
+
+constexpr double kStartTime = 1.7e9;
+constexpr double kImuDt     = 0.005;
+
+/**
+ * @brief Four sample states 0.1s apart, a surfel in the first interval and one in each later interval
+ */
+class FactorInputs {
+ public:
+  FactorInputs() {
+    std::mt19937                           rng(0);
+    std::uniform_real_distribution<double> dist(-1, 1);
+    auto                                   random_vector = [&]() { return Vector3d(dist(rng), dist(rng), dist(rng)); };
+
+    for (int i = 0; i < 4; ++i) {
+      auto sample_state       = std::make_shared<SampleState>();
+      sample_state->timestamp = kStartTime + 0.1 * i;
+      sample_state->rot_cor   = 0.01 * random_vector();
+      sample_state->pos_cor   = 0.05 * random_vector();
+      sample_states_.push_back(sample_state);
+    }
+    for (double offset : {0.05, 0.07, 0.15, 0.25}) {
+      Vector3d norm   = Vector3d(dist(rng), dist(rng), 1).normalized();
+      Matrix3d cov    = Matrix3d::Identity() * 0.01 - norm * norm.transpose() * (0.01 - 1e-5);
+      auto     surfel = std::make_shared<Surfel>(kStartTime + offset, Vector3d(500, -300, 20) + 30 * random_vector(), cov, norm, 1.0, 0.003);
+      surfel->UpdatePose(Vector3d(500, -300, 20) + random_vector(), Exp(random_vector()));
+      surfels_.push_back(surfel);
+    }
+    for (int i = 0; i < 3; ++i) {
+      ImuState imu_state;
+      imu_state.timestamp = kStartTime + 0.1 - kImuDt + kImuDt * i;
+      imu_state.pos       = Vector3d(500, -300, 20) + 0.01 * i * Vector3d::UnitX();
+      imu_state.rot       = Exp(random_vector());
+      imu_state.acc       = Vector3d(0, 0, 9.81) + random_vector();
+      imu_state.gyr       = random_vector();
+      imu_states_.push_back(imu_state);
+    }
+  }
+
+  const SampleState::Ptr &SampleStateAt(int i) const { return sample_states_[i]; }
+
+  // s1 of every mode
+  const Surfel::Ptr &S1() const { return surfels_[0]; }
+
+  // s2 of binary mode 0, 1 or 2, the unary factor uses the one of mode 0
+  const Surfel::Ptr &S2(int mode) const { return surfels_[mode == 0 ? 3 : mode == 1 ? 2 : 1]; }
+
+  const std::vector<ImuState> &ImuStates() const { return imu_states_; }
+
+ private:
+  std::vector<SampleState::Ptr> sample_states_;
+  std::vector<Surfel::Ptr>      surfels_;
+  std::vector<ImuState>         imu_states_;
+};
+
+const FactorInputs &GetFactorInputs() {
+  static const FactorInputs inputs;
+  return inputs;
+}
+
+/**
+ * @brief Time the evaluation of the residuals and all jacobians of a factor
+ */
+void EvaluateFactor(benchmark::State &state, std::unique_ptr<ceres::CostFunction> factor, const std::vector<SampleState::Ptr> &blocks, int residual_num) {
+  std::vector<const double *>      parameters;
+  std::vector<std::vector<double>> jacobian_buffers;
+  std::vector<double *>            jacobians;
+  std::vector<double>              residuals(residual_num);
+  for (auto &block : blocks) {
+    parameters.push_back(block->data_cor);
+    jacobian_buffers.emplace_back(residual_num * 12);
+  }
+  for (auto &buffer : jacobian_buffers) {
+    jacobians.push_back(buffer.data());
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(factor->Evaluate(parameters.data(), residuals.data(), jacobians.data()));
+    benchmark::ClobberMemory();
+  }
+}
+
+/**
+ * @brief Parameter blocks of SurfelMatchBinaryFactor<Mode> for the surfels of FactorInputs
+ */
+std::vector<SampleState::Ptr> BinaryBlocks(int mode) {
+  const auto &inputs = GetFactorInputs();
+  if (mode == 0) {
+    return {inputs.SampleStateAt(0), inputs.SampleStateAt(1), inputs.SampleStateAt(2), inputs.SampleStateAt(3)};
+  } else if (mode == 1) {
+    return {inputs.SampleStateAt(0), inputs.SampleStateAt(1), inputs.SampleStateAt(2)};
+  }
+  return {inputs.SampleStateAt(0), inputs.SampleStateAt(1)};
+}
+
+template <int Mode, typename Factory>
+std::unique_ptr<ceres::CostFunction> NewBinary(Factory factory) {
+  const auto &inputs = GetFactorInputs();
+  auto        blocks = BinaryBlocks(Mode);
+  auto        sp2l   = Mode == 0 ? blocks[2] : Mode == 1 ? blocks[1] : blocks[0];
+  auto        sp2r   = blocks.back();
+  return std::unique_ptr<ceres::CostFunction>(factory(inputs.S1(), blocks[0], blocks[1], inputs.S2(Mode), sp2l, sp2r));
+}
+
+/**
+ * @brief Parameter blocks of ImuFactor<Mode>, the imu states of FactorInputs straddle the second sample state
+ */
+std::vector<SampleState::Ptr> ImuBlocks(int mode) {
+  const auto &inputs = GetFactorInputs();
+  if (mode == 0) {
+    return {inputs.SampleStateAt(0), inputs.SampleStateAt(1), inputs.SampleStateAt(2)};
+  }
+  return {inputs.SampleStateAt(0), inputs.SampleStateAt(2)};
+}
+
+template <int Mode, typename Factory>
+std::unique_ptr<ceres::CostFunction> NewImu(Factory factory) {
+  const auto &imu_states = GetFactorInputs().ImuStates();
+  auto        blocks     = ImuBlocks(Mode);
+  double      sp3_time   = Mode == 0 ? blocks[2]->timestamp : 0;
+  return std::unique_ptr<ceres::CostFunction>(factory(imu_states[0], imu_states[1], imu_states[2], blocks[0]->timestamp, blocks[1]->timestamp, sp3_time, 10, 1, 100, 100, kImuDt, Vector3d(0, 0, -9.81)));
+}
+
+}  // namespace
+
+template <typename Scalar>
+static void BM_SurfelMatchUnaryFactor(benchmark::State &state) {
+  const auto &inputs = GetFactorInputs();
+  EvaluateFactor(state, std::make_unique<SurfelMatchUnaryFactor<Scalar>>(inputs.S1(), inputs.S2(0), inputs.SampleStateAt(2), inputs.SampleStateAt(3)), {inputs.SampleStateAt(2), inputs.SampleStateAt(3)}, 1);
+}
+BENCHMARK_TEMPLATE(BM_SurfelMatchUnaryFactor, double);
+BENCHMARK_TEMPLATE(BM_SurfelMatchUnaryFactor, float);
+
+static void BM_SurfelMatchUnaryReference(benchmark::State &state) {
+  const auto &inputs = GetFactorInputs();
+  EvaluateFactor(state, std::unique_ptr<ceres::CostFunction>(SurfelMatchUnaryReference::Create(inputs.S1(), inputs.S2(0), inputs.SampleStateAt(2), inputs.SampleStateAt(3))), {inputs.SampleStateAt(2), inputs.SampleStateAt(3)}, 1);
+}
+BENCHMARK(BM_SurfelMatchUnaryReference);
+
+template <int Mode, typename Scalar>
+static void BM_SurfelMatchBinaryFactor(benchmark::State &state) {
+  auto factor = NewBinary<Mode>([](auto... args) { return new SurfelMatchBinaryFactor<Mode, Scalar>(args...); });
+  EvaluateFactor(state, std::move(factor), BinaryBlocks(Mode), 1);
+}
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryFactor, 0, double);
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryFactor, 0, float);
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryFactor, 1, double);
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryFactor, 2, double);
+
+template <int Mode>
+static void BM_SurfelMatchBinaryReference(benchmark::State &state) {
+  auto factor = NewBinary<Mode>([](auto... args) { return SurfelMatchBinaryReference<Mode>::Create(args...); });
+  EvaluateFactor(state, std::move(factor), BinaryBlocks(Mode), 1);
+}
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryReference, 0);
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryReference, 1);
+BENCHMARK_TEMPLATE(BM_SurfelMatchBinaryReference, 2);
+
+template <int Mode>
+static void BM_ImuFactor(benchmark::State &state) {
+  auto factor = NewImu<Mode>([](auto &&...args) { return new ImuFactor<Mode>(args...); });
+  EvaluateFactor(state, std::move(factor), ImuBlocks(Mode), 12);
+}
+BENCHMARK_TEMPLATE(BM_ImuFactor, 0);
+BENCHMARK_TEMPLATE(BM_ImuFactor, 1);
+
+template <int Mode>
+static void BM_ImuReference(benchmark::State &state) {
+  auto factor = NewImu<Mode>([](auto &&...args) { return ImuReference<Mode>::Create(args...); });
+  EvaluateFactor(state, std::move(factor), ImuBlocks(Mode), 12);
+}
+BENCHMARK_TEMPLATE(BM_ImuReference, 0);
+BENCHMARK_TEMPLATE(BM_ImuReference, 1);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <ceres/ceres.h>
+#include <ceres/rotation.h>
+
+#include "odometry/surfel.h"
+
+/**
+ * @brief Autodiff references of the factors of cost_functor.h
+ *
+ * They follow the residual definitions literally, with neither the precomputation nor the hand written jacobians of
+ * the factors, and are far slower. cost_functor_test.cc checks the analytic jacobians against them and
+ * cost_functor_benchmark.cc times both, so that a rewritten kernel can be compared with a known good baseline. Not
+ * meant for the solver.
+ */
+
+namespace internal {
+
+template <typename T>
+void ToCeresQuaternion(const Quaterniond &q, T *quaternion) {
+  quaternion[0] = T(q.w());
+  quaternion[1] = T(q.x());
+  quaternion[2] = T(q.y());
+  quaternion[3] = T(q.z());
+}
+
+/**
+ * @brief Linear interpolation of the 12 corrections of two sample states, factor 0 at the left one
+ */
+template <typename T>
+void InterpolateCorrection(const T *spl, const T *spr, double factor, T *correction) {
+  for (int i = 0; i < 12; ++i) {
+    correction[i] = (1 - factor) * spl[i] + factor * spr[i];
+  }
+}
+
+/**
+ * @brief Rotation Exp(r_cor) * rot of a state with correction [r_cor, t_cor, ...], as [w, x, y, z]
+ */
+template <typename T>
+void CorrectedRotation(const T *correction, const Quaterniond &rot, T *quaternion) {
+  T exp_r[4], q[4];
+  ceres::AngleAxisToQuaternion(correction, exp_r);
+  ToCeresQuaternion(rot, q);
+  ceres::QuaternionProduct(exp_r, q, quaternion);
+}
+
+/**
+ * @brief Surfel center in world after the correction of its body pose
+ */
+template <typename T>
+void CorrectedCenterInWorld(const Surfel &surfel, const T *correction, T *center) {
+  T rot[4], center_in_body[3];
+  CorrectedRotation(correction, surfel.rot, rot);
+  Vector3d c = surfel.CenterInBody();
+  for (int i = 0; i < 3; ++i) {
+    center_in_body[i] = T(c[i]);
+  }
+  ceres::UnitQuaternionRotatePoint(rot, center_in_body, center);
+  for (int i = 0; i < 3; ++i) {
+    center[i] += correction[3 + i] + surfel.pos[i];
+  }
+}
+
+inline void SurfelMatchWeight(const Surfel &s1, const Surfel &s2, double *weight, Vector3d *norm) {
+  Matrix3d                                cov = s1.GetCovarianceInWorld() + s2.GetCovarianceInWorld();
+  Eigen::SelfAdjointEigenSolver<Matrix3d> es(cov);
+  *weight = 1 / sqrt(pow(0.05 / 6, 2) + es.eigenvalues()[0]);
+  *norm   = es.eigenvectors().col(0);
+}
+
+}  // namespace internal
+
+/**
+ * @brief Reference of SurfelMatchUnaryFactor, parameter blocks sp2l, sp2r
+ */
+struct SurfelMatchUnaryReference {
+  SurfelMatchUnaryReference(
+      std::shared_ptr<Surfel>      s1,
+      std::shared_ptr<Surfel>      s2,
+      std::shared_ptr<SampleState> sp2l,
+      std::shared_ptr<SampleState> sp2r) : s1_(s1), s2_(s2) {
+    internal::SurfelMatchWeight(*s1, *s2, &weight_, &norm_);
+    factor2_ = (s2->timestamp - sp2l->timestamp) / (sp2r->timestamp - sp2l->timestamp);
+  }
+
+  template <typename T>
+  bool operator()(const T *sp2l, const T *sp2r, T *residual) const {
+    T correction2[12], center2[3];
+    internal::InterpolateCorrection(sp2l, sp2r, factor2_, correction2);
+    internal::CorrectedCenterInWorld(*s2_, correction2, center2);
+
+    Vector3d center1 = s1_->GetCenterInWorld();
+    residual[0]      = T(0);
+    for (int i = 0; i < 3; ++i) {
+      residual[0] += norm_[i] * (center1[i] - center2[i]);
+    }
+    residual[0] *= weight_;
+    return true;
+  }
+
+  static ceres::CostFunction *Create(
+      std::shared_ptr<Surfel>      s1,
+      std::shared_ptr<Surfel>      s2,
+      std::shared_ptr<SampleState> sp2l,
+      std::shared_ptr<SampleState> sp2r) {
+    return new ceres::AutoDiffCostFunction<SurfelMatchUnaryReference, 1, 12, 12>(new SurfelMatchUnaryReference(s1, s2, sp2l, sp2r));
+  }
+
+ private:
+  std::shared_ptr<Surfel> s1_;
+  std::shared_ptr<Surfel> s2_;
+
+  Vector3d norm_;
+  double   weight_;
+  double   factor2_;
+};
+
+/**
+ * @brief Reference of SurfelMatchBinaryFactor<Mode>, with the same parameter blocks
+ *
+ * Blocks shared by s1 and s2 are passed once, so autodiff sums their contributions.
+ */
+template <int Mode>
+struct SurfelMatchBinaryReference {
+  SurfelMatchBinaryReference(
+      std::shared_ptr<Surfel>      s1,
+      std::shared_ptr<SampleState> sp1l,
+      std::shared_ptr<SampleState> sp1r,
+      std::shared_ptr<Surfel>      s2,
+      std::shared_ptr<SampleState> sp2l,
+      std::shared_ptr<SampleState> sp2r) : s1_(s1), s2_(s2) {
+    internal::SurfelMatchWeight(*s1, *s2, &weight_, &norm_);
+    factor1_ = (s1->timestamp - sp1l->timestamp) / (sp1r->timestamp - sp1l->timestamp);
+    factor2_ = (s2->timestamp - sp2l->timestamp) / (sp2r->timestamp - sp2l->timestamp);
+  }
+
+  // Mode 0
+  template <typename T>
+  bool operator()(const T *sp1l, const T *sp1r, const T *sp2l, const T *sp2r, T *residual) const {
+    T correction1[12], correction2[12], center1[3], center2[3];
+    internal::InterpolateCorrection(sp1l, sp1r, factor1_, correction1);
+    internal::InterpolateCorrection(sp2l, sp2r, factor2_, correction2);
+    internal::CorrectedCenterInWorld(*s1_, correction1, center1);
+    internal::CorrectedCenterInWorld(*s2_, correction2, center2);
+
+    residual[0] = T(0);
+    for (int i = 0; i < 3; ++i) {
+      residual[0] += norm_[i] * (center1[i] - center2[i]);
+    }
+    residual[0] *= weight_;
+    return true;
+  }
+
+  // Mode 1, sp1r = sp2l
+  template <typename T>
+  bool operator()(const T *sp1l, const T *sp1r, const T *sp2r, T *residual) const {
+    return (*this)(sp1l, sp1r, sp1r, sp2r, residual);
+  }
+
+  // Mode 2, sp1l = sp2l and sp1r = sp2r
+  template <typename T>
+  bool operator()(const T *sp1l, const T *sp1r, T *residual) const {
+    return (*this)(sp1l, sp1r, sp1l, sp1r, residual);
+  }
+
+  static ceres::CostFunction *Create(
+      std::shared_ptr<Surfel>      s1,
+      std::shared_ptr<SampleState> sp1l,
+      std::shared_ptr<SampleState> sp1r,
+      std::shared_ptr<Surfel>      s2,
+      std::shared_ptr<SampleState> sp2l,
+      std::shared_ptr<SampleState> sp2r) {
+    auto functor = new SurfelMatchBinaryReference(s1, sp1l, sp1r, s2, sp2l, sp2r);
+    if constexpr (Mode == 0) {
+      return new ceres::AutoDiffCostFunction<SurfelMatchBinaryReference, 1, 12, 12, 12, 12>(functor);
+    } else if constexpr (Mode == 1) {
+      return new ceres::AutoDiffCostFunction<SurfelMatchBinaryReference, 1, 12, 12, 12>(functor);
+    } else {
+      return new ceres::AutoDiffCostFunction<SurfelMatchBinaryReference, 1, 12, 12>(functor);
+    }
+  }
+
+ private:
+  std::shared_ptr<Surfel> s1_;
+  std::shared_ptr<Surfel> s2_;
+
+  Vector3d norm_;
+  double   weight_;
+  double   factor1_;
+  double   factor2_;
+};
+
+/**
+ * @brief Reference of ImuFactor<Mode>, parameter blocks sp1, sp2 and in mode 0 sp3
+ */
+template <int Mode>
+struct ImuReference {
+  ImuReference(const ImuState &i1, const ImuState &i2, const ImuState &i3,
+               double sp1_timestamp, double sp2_timestamp, double sp3_timestamp,
+               double weight_gyr, double weight_acc, double weight_bg, double weight_ba,
+               double dt, const Vector3d &gravity) : i1_(i1), i2_(i2), i3_(i3), sp1_timestamp_(sp1_timestamp), sp2_timestamp_(sp2_timestamp), sp3_timestamp_(sp3_timestamp), weight_gyr_(weight_gyr), weight_acc_(weight_acc), weight_bg_(weight_bg), weight_ba_(weight_ba), dt_(dt), gravity_(gravity) {
+  }
+
+  // Mode 0
+  template <typename T>
+  bool operator()(const T *sp1, const T *sp2, const T *sp3, T *residual) const {
+    T correction1[12], correction2[12], correction3[12];
+    CorrectionAt(i1_.timestamp, sp1, sp2, sp3, correction1);
+    CorrectionAt(i2_.timestamp, sp1, sp2, sp3, correction2);
+    CorrectionAt(i3_.timestamp, sp1, sp2, sp3, correction3);
+
+    T rot1[4], rot2[4], rot1_inv[4], delta[4], gyr_est[3];
+    internal::CorrectedRotation(correction1, i1_.rot, rot1);
+    internal::CorrectedRotation(correction2, i2_.rot, rot2);
+    rot1_inv[0] = rot1[0];
+    for (int i = 1; i < 4; ++i) {
+      rot1_inv[i] = -rot1[i];
+    }
+    ceres::QuaternionProduct(rot1_inv, rot2, delta);
+    ceres::QuaternionToAngleAxis(delta, gyr_est);
+
+    T acc_in_body[3], acc_in_world[3];
+    for (int i = 0; i < 3; ++i) {
+      acc_in_body[i] = i1_.acc[i] - correction1[9 + i];
+    }
+    ceres::UnitQuaternionRotatePoint(rot1, acc_in_body, acc_in_world);
+
+    for (int i = 0; i < 3; ++i) {
+      T pos1    = correction1[3 + i] + i1_.pos[i];
+      T pos2    = correction2[3 + i] + i2_.pos[i];
+      T pos3    = correction3[3 + i] + i3_.pos[i];
+      T acc_est = (pos3 + pos1 - 2.0 * pos2) / (dt_ * dt_);
+
+      residual[i]     = weight_gyr_ * ((i1_.gyr[i] + i2_.gyr[i]) / 2 - gyr_est[i] / dt_ - correction1[6 + i]);
+      residual[3 + i] = weight_acc_ * (acc_in_world[i] - acc_est + gravity_[i]);
+      residual[6 + i] = weight_bg_ * (correction1[6 + i] - correction2[6 + i]);
+      residual[9 + i] = weight_ba_ * (correction1[9 + i] - correction2[9 + i]);
+    }
+    return true;
+  }
+
+  // Mode 1
+  template <typename T>
+  bool operator()(const T *sp1, const T *sp2, T *residual) const {
+    return (*this)(sp1, sp2, sp2, residual);
+  }
+
+  static ceres::CostFunction *Create(const ImuState &i1, const ImuState &i2, const ImuState &i3,
+                                     double sp1_timestamp, double sp2_timestamp, double sp3_timestamp,
+                                     double weight_gyr, double weight_acc, double weight_bg, double weight_ba,
+                                     double dt, const Vector3d &gravity) {
+    auto functor = new ImuReference(i1, i2, i3, sp1_timestamp, sp2_timestamp, sp3_timestamp, weight_gyr, weight_acc, weight_bg, weight_ba, dt, gravity);
+    if constexpr (Mode == 0) {
+      return new ceres::AutoDiffCostFunction<ImuReference, 12, 12, 12, 12>(functor);
+    } else {
+      return new ceres::AutoDiffCostFunction<ImuReference, 12, 12, 12>(functor);
+    }
+  }
+
+ private:
+  /**
+   * @brief Correction at timestamp, interpolated in [sp1, sp2), or in [sp2, sp3] in mode 0
+   */
+  template <typename T>
+  void CorrectionAt(double timestamp, const T *sp1, const T *sp2, const T *sp3, T *correction) const {
+    if (Mode == 1 || timestamp < sp2_timestamp_) {
+      internal::InterpolateCorrection(sp1, sp2, (timestamp - sp1_timestamp_) / (sp2_timestamp_ - sp1_timestamp_), correction);
+    } else {
+      internal::InterpolateCorrection(sp2, sp3, (timestamp - sp2_timestamp_) / (sp3_timestamp_ - sp2_timestamp_), correction);
+    }
+  }
+
+  ImuState i1_, i2_, i3_;
+  double   sp1_timestamp_, sp2_timestamp_, sp3_timestamp_;
+
+  double weight_gyr_;
+  double weight_acc_;
+  double weight_bg_;
+  double weight_ba_;
+
+  double dt_;
+
+  Vector3d gravity_;
+};
@@ -0,0 +1,224 @@
+#include "odometry/cost_functor.h"
+
+#include "odometry/cost_functor_reference.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace {
+
+constexpr double kStartTime = 1.7e9;  // absolute timestamps as in the bags, far from the origin of float
+
+/**
+ * @brief Surfel of a plane about 30m from its body pose, which is about 500m from the world origin
+ */
+Surfel::Ptr RandomSurfel(double timestamp, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> dist(-1, 1);
+  Vector3d                               pos    = Vector3d(500, -300, 20) + 10 * Vector3d(dist(rng), dist(rng), dist(rng));
+  Quaterniond                            rot    = Exp(Vector3d(dist(rng), dist(rng), dist(rng)));
+  Vector3d                               norm   = Vector3d(dist(rng), dist(rng), 1).normalized();
+  Vector3d                               center = pos + 30 * Vector3d(dist(rng), dist(rng), dist(rng));
+  Matrix3d                               cov    = Matrix3d::Identity() * 0.01 - norm * norm.transpose() * (0.01 - 1e-5);
+  auto                                   surfel = std::make_shared<Surfel>(timestamp, center, cov, norm, 1.0, 0.003);
+  surfel->UpdatePose(pos, rot);
+  return surfel;
+}
+
+SampleState::Ptr RandomSampleState(double timestamp, std::mt19937 &rng) {
+  std::normal_distribution<double> dist(0, 1);
+  auto                             sample_state = std::make_shared<SampleState>();
+  sample_state->timestamp                       = timestamp;
+  for (int i = 0; i < 3; ++i) {
+    sample_state->data_cor[i]     = 0.01 * dist(rng);
+    sample_state->data_cor[i + 3] = 0.05 * dist(rng);
+  }
+  return sample_state;
+}
+
+using Jacobian = Eigen::Matrix<double, Eigen::Dynamic, 12, Eigen::RowMajor>;
+
+/**
+ * @brief Residuals and jacobians of a factor, one residual_num x 12 jacobian per parameter block
+ *
+ * @param null_block block whose jacobian is not requested, as for a constant block, -1 for none
+ */
+void Evaluate(const ceres::CostFunction &factor, const std::vector<SampleState::Ptr> &blocks, int residual_num, Eigen::VectorXd *residuals, std::vector<Jacobian> *jacobians, int null_block = -1) {
+  std::vector<const double *> parameters;
+  std::vector<double *>       jacobian_ptrs;
+  residuals->resize(residual_num);
+  jacobians->assign(blocks.size(), Jacobian::Constant(residual_num, 12, NAN));
+  for (int i = 0; i < blocks.size(); ++i) {
+    parameters.push_back(blocks[i]->data_cor);
+    jacobian_ptrs.push_back(i == null_block ? nullptr : (*jacobians)[i].data());
+  }
+  ASSERT_TRUE(factor.Evaluate(parameters.data(), residuals->data(), jacobian_ptrs.data()));
+}
+
+void ExpectSamePrecision(const ceres::CostFunction &factor_double, const ceres::CostFunction &factor_float, const std::vector<SampleState::Ptr> &blocks) {
+  Eigen::VectorXd       residual_double, residual_float;
+  std::vector<Jacobian> jacobians_double, jacobians_float;
+  Evaluate(factor_double, blocks, 1, &residual_double, &jacobians_double);
+  Evaluate(factor_float, blocks, 1, &residual_float, &jacobians_float);
+
+  // the weight is about 100 per meter, so 1e-3 of the residual is 10 micrometers
+  EXPECT_NEAR(residual_float[0], residual_double[0], 1e-3);
+  for (int i = 0; i < blocks.size(); ++i) {
+    EXPECT_LT((jacobians_float[i] - jacobians_double[i]).norm(), 1e-4 * std::max(1.0, jacobians_double[i].norm())) << "block " << i;
+  }
+}
+
+/**
+ * @brief Compare the analytic residuals and jacobians of a factor with its autodiff reference
+ *
+ * Every block is also left out once, the others must not change.
+ */
+void ExpectSameAsReference(const ceres::CostFunction &factor, const ceres::CostFunction &reference, const std::vector<SampleState::Ptr> &blocks, int residual_num) {
+  Eigen::VectorXd       residuals_reference;
+  std::vector<Jacobian> jacobians_reference;
+  Evaluate(reference, blocks, residual_num, &residuals_reference, &jacobians_reference);
+
+  for (int null_block = -1; null_block < int(blocks.size()); ++null_block) {
+    Eigen::VectorXd       residuals;
+    std::vector<Jacobian> jacobians;
+    Evaluate(factor, blocks, residual_num, &residuals, &jacobians, null_block);
+    EXPECT_LT((residuals - residuals_reference).norm(), 1e-8 * std::max(1.0, residuals_reference.norm()));
+    for (int i = 0; i < blocks.size(); ++i) {
+      if (i != null_block) {
+        EXPECT_LT((jacobians[i] - jacobians_reference[i]).norm(), 1e-6 * std::max(1.0, jacobians_reference[i].norm()))
+            << "block " << i << " without block " << null_block << "\nanalytic:\n"
+            << jacobians[i] << "\nautodiff:\n"
+            << jacobians_reference[i];
+      }
+    }
+  }
+}
+
+ImuState RandomImuState(double timestamp, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> dist(-1, 1);
+  ImuState                               imu_state;
+  imu_state.timestamp = timestamp;
+  imu_state.pos       = Vector3d(500, -300, 20) + Vector3d(dist(rng), dist(rng), dist(rng));
+  imu_state.rot       = Exp(3 * Vector3d(dist(rng), dist(rng), dist(rng)));
+  imu_state.acc       = Vector3d(0, 0, 9.81) + 3 * Vector3d(dist(rng), dist(rng), dist(rng));
+  imu_state.gyr       = Vector3d(dist(rng), dist(rng), dist(rng));
+  return imu_state;
+}
+
+/**
+ * @brief Three consecutive imu states from i1_timestamp, integrated from random measurements
+ */
+std::vector<ImuState> RandomImuStates(double i1_timestamp, double dt, std::mt19937 &rng) {
+  std::vector<ImuState> imu_states = {RandomImuState(i1_timestamp, rng), RandomImuState(i1_timestamp + dt, rng), RandomImuState(i1_timestamp + 2 * dt, rng)};
+  for (int i = 1; i < 3; ++i) {
+    imu_states[i].rot = imu_states[i - 1].rot * Exp(imu_states[i - 1].gyr * dt);
+    imu_states[i].pos = imu_states[i - 1].pos + 0.01 * imu_states[i].pos.normalized();
+  }
+  return imu_states;
+}
+
+}  // namespace
+
+TEST(CostFunctor, FloatUnaryFactorMatchesDouble) {
+  std::mt19937 rng(0);
+  for (int i = 0; i < 100; ++i) {
+    auto s1   = RandomSurfel(kStartTime, rng);
+    auto sp2l = RandomSampleState(kStartTime + 1.0, rng);
+    auto sp2r = RandomSampleState(kStartTime + 1.1, rng);
+    auto s2   = RandomSurfel(kStartTime + 1.0 + 0.1 * i / 100, rng);
+
+    SurfelMatchUnaryFactor<>      factor_double(s1, s2, sp2l, sp2r);
+    SurfelMatchUnaryFactor<float> factor_float(s1, s2, sp2l, sp2r);
+    ExpectSamePrecision(factor_double, factor_float, {sp2l, sp2r});
+  }
+}
+
+TEST(CostFunctor, FloatBinaryFactorMatchesDouble) {
+  std::mt19937 rng(0);
+  for (int i = 0; i < 100; ++i) {
+    auto sp1l = RandomSampleState(kStartTime, rng);
+    auto sp1r = RandomSampleState(kStartTime + 0.1, rng);
+    auto sp2r = RandomSampleState(kStartTime + 0.2, rng);
+    auto sp3r = RandomSampleState(kStartTime + 0.3, rng);
+    auto s1   = RandomSurfel(kStartTime + 0.001 * i, rng);
+    auto s2   = RandomSurfel(kStartTime + 0.2 + 0.001 * i, rng);
+
+    SurfelMatchBinaryFactor<0>        factor_double(s1, sp1l, sp1r, s2, sp2r, sp3r);
+    SurfelMatchBinaryFactor<0, float> factor_float(s1, sp1l, sp1r, s2, sp2r, sp3r);
+    ExpectSamePrecision(factor_double, factor_float, {sp1l, sp1r, sp2r, sp3r});
+  }
+}
+
+TEST(CostFunctor, UnaryFactorMatchesReference) {
+  std::mt19937 rng(0);
+  for (int i = 0; i < 20; ++i) {
+    auto s1   = RandomSurfel(kStartTime, rng);
+    auto sp2l = RandomSampleState(kStartTime + 1.0, rng);
+    auto sp2r = RandomSampleState(kStartTime + 1.1, rng);
+    auto s2   = RandomSurfel(kStartTime + 1.0 + 0.1 * i / 20, rng);
+
+    SurfelMatchUnaryFactor<>                   factor(s1, s2, sp2l, sp2r);
+    std::unique_ptr<ceres::CostFunction> reference(SurfelMatchUnaryReference::Create(s1, s2, sp2l, sp2r));
+    ExpectSameAsReference(factor, *reference, {sp2l, sp2r}, 1);
+  }
+}
+
+TEST(CostFunctor, BinaryFactorMatchesReference) {
+  std::mt19937 rng(0);
+  for (int i = 0; i < 20; ++i) {
+    std::vector<SampleState::Ptr> sample_states;
+    for (int j = 0; j < 4; ++j) {
+      sample_states.push_back(RandomSampleState(kStartTime + 0.1 * j, rng));
+    }
+    auto &sp0 = sample_states[0], &sp1 = sample_states[1], &sp2 = sample_states[2], &sp3 = sample_states[3];
+    {
+      auto                                 s1 = RandomSurfel(kStartTime + 0.005 * i, rng);
+      auto                                 s2 = RandomSurfel(kStartTime + 0.2 + 0.005 * i, rng);
+      SurfelMatchBinaryFactor<0>           factor(s1, sp0, sp1, s2, sp2, sp3);
+      std::unique_ptr<ceres::CostFunction> reference(SurfelMatchBinaryReference<0>::Create(s1, sp0, sp1, s2, sp2, sp3));
+      ExpectSameAsReference(factor, *reference, {sp0, sp1, sp2, sp3}, 1);
+    }
+    {
+      auto                                 s1 = RandomSurfel(kStartTime + 0.005 * i, rng);
+      auto                                 s2 = RandomSurfel(kStartTime + 0.1 + 0.005 * i, rng);
+      SurfelMatchBinaryFactor<1>           factor(s1, sp0, sp1, s2, sp1, sp2);
+      std::unique_ptr<ceres::CostFunction> reference(SurfelMatchBinaryReference<1>::Create(s1, sp0, sp1, s2, sp1, sp2));
+      ExpectSameAsReference(factor, *reference, {sp0, sp1, sp2}, 1);
+    }
+    {
+      auto                                 s1 = RandomSurfel(kStartTime + 0.002 * i, rng);
+      auto                                 s2 = RandomSurfel(kStartTime + 0.05 + 0.002 * i, rng);
+      SurfelMatchBinaryFactor<2>           factor(s1, sp0, sp1, s2, sp0, sp1);
+      std::unique_ptr<ceres::CostFunction> reference(SurfelMatchBinaryReference<2>::Create(s1, sp0, sp1, s2, sp0, sp1));
+      ExpectSameAsReference(factor, *reference, {sp0, sp1}, 1);
+    }
+  }
+}
+
+TEST(CostFunctor, ImuFactorMatchesReference) {
+  constexpr double kDt = 0.005;
+  std::mt19937     rng(0);
+  for (int i = 0; i < 20; ++i) {
+    std::vector<SampleState::Ptr> sample_states;
+    for (int j = 0; j < 3; ++j) {
+      sample_states.push_back(RandomSampleState(kStartTime + 0.1 * j, rng));
+      for (int k = 6; k < 12; ++k) {
+        sample_states[j]->data_cor[k] = 0.01 * (k - 8);  // biases
+      }
+    }
+    auto &sp1 = sample_states[0], &sp2 = sample_states[1], &sp3 = sample_states[2];
+    {
+      // i1 < sp2 <= i3, the states straddle sp2
+      auto                                 imu_states = RandomImuStates(kStartTime + 0.1 - kDt * (1 + i % 2), kDt, rng);
+      ImuFactor<0>                         factor(imu_states[0], imu_states[1], imu_states[2], sp1->timestamp, sp2->timestamp, sp3->timestamp, 10, 1, 100, 100, kDt, Vector3d(0, 0, -9.81));
+      std::unique_ptr<ceres::CostFunction> reference(ImuReference<0>::Create(imu_states[0], imu_states[1], imu_states[2], sp1->timestamp, sp2->timestamp, sp3->timestamp, 10, 1, 100, 100, kDt, Vector3d(0, 0, -9.81)));
+      ExpectSameAsReference(factor, *reference, {sp1, sp2, sp3}, 12);
+    }
+    {
+      auto                                 imu_states = RandomImuStates(kStartTime + 0.004 * i, kDt, rng);
+      ImuFactor<1>                         factor(imu_states[0], imu_states[1], imu_states[2], sp1->timestamp, sp2->timestamp, 0, 10, 1, 100, 100, kDt, Vector3d(0, 0, -9.81));
+      std::unique_ptr<ceres::CostFunction> reference(ImuReference<1>::Create(imu_states[0], imu_states[1], imu_states[2], sp1->timestamp, sp2->timestamp, 0, 10, 1, 100, 100, kDt, Vector3d(0, 0, -9.81)));
+      ExpectSameAsReference(factor, *reference, {sp1, sp2}, 12);
+    }
+  }
+}
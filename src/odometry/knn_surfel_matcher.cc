@@ -1,5 +1,15 @@
 #include "knn_surfel_matcher.h"
 
+KnnSurfelMatcherOptions KnnSurfelMatcherOptionsFromConfig(const LioConfig &config) {
+  KnnSurfelMatcherOptions options;
+  options.center_dist_threshold         = config.match_center_dist_threshold;
+  options.angular_dist_threshold        = config.match_angular_dist_threshold;
+  options.surfel_dist_threshold         = config.match_surfel_dist_threshold;
+  options.nearest_surfel_candidates_num = config.match_nearest_surfel_candidates_num;
+  options.time_diff_threshold           = config.match_time_diff_threshold;
+  return options;
+}
+
 void KnnSurfelMatcher::BuildIndex(const std::deque<Surfel::Ptr> &surfels) {
   if (surfels.empty()) {
     return;
@@ -21,15 +31,15 @@ void KnnSurfelMatcher::Match(std::deque<Surfel::Ptr> &surfels, std::vector<Surfe
   std::set<std::pair<Surfel::Ptr, Surfel::Ptr>> surfel_pairs;
   for (auto &surfel : surfels) {
     std::vector<Surfel::Ptr> k_nearest_surfels;
-    this->KNearestSearch(surfel, kNearestSurfelCandidatesNum, k_nearest_surfels);
+    this->KNearestSearch(surfel, options_.nearest_surfel_candidates_num, k_nearest_surfels);
     for (auto &nearest_surfel : k_nearest_surfels) {
-      if (std::abs(nearest_surfel->timestamp - surfel->timestamp) < kTimeDiffThreshold) {
+      if (std::abs(nearest_surfel->timestamp - surfel->timestamp) < options_.time_diff_threshold) {
         continue;
       }
-      if (surfel->AngularDistance(*nearest_surfel) > kAngularDistThreshold) {
+      if (surfel->AngularDistance(*nearest_surfel) > options_.angular_dist_threshold) {
         continue;
       }
-      if (std::abs(surfel->GetNormInWorld().dot(surfel->GetCenterInWorld() - nearest_surfel->GetCenterInWorld())) > kSurfelDistThreshold) {
+      if (std::abs(surfel->GetNormInWorld().dot(surfel->GetCenterInWorld() - nearest_surfel->GetCenterInWorld())) > options_.surfel_dist_threshold) {
         continue;
       }
       if (surfel_pairs.find({surfel, nearest_surfel}) != surfel_pairs.end() ||
@@ -92,7 +102,7 @@ std::vector<KnnSurfelMatcher::FloatType> KnnSurfelMatcher::ToVector(const Surfel
   // todo use resolution
   auto     center         = surfel->GetCenterInWorld();
   auto     norm           = surfel->GetNormInWorld();
-  Vector3d center_uniform = center / kCenterDistThreshold;
-  Vector3d norm_uniform   = norm / kAngularDistThreshold;
+  Vector3d center_uniform = center / options_.center_dist_threshold;
+  Vector3d norm_uniform   = norm / options_.angular_dist_threshold;
   return {center_uniform.x(), center_uniform.y(), center_uniform.z(), norm_uniform.x(), norm_uniform.y(), norm_uniform.z()};
 }
@@ -5,8 +5,23 @@
 #include <flann/flann.hpp>
 #include <vector>
 
+#include "odometry/lio_config.h"
 #include "surfel.h"
 
+struct KnnSurfelMatcherOptions {
+  double center_dist_threshold         = 1.0;                 // center distance weighted like the angular threshold in the knn search, in meters
+  double angular_dist_threshold        = 5.0 * M_PI / 180.0;  // in radians
+  double surfel_dist_threshold         = 0.1;                 // max distance of the target center to the query plane, in meters
+  int    nearest_surfel_candidates_num = 10;                  // nearest surfels checked per query
+  double time_diff_threshold           = 0.06;                // surfels closer in time are never matched, in seconds
+};
+
+/**
+ * @brief Matcher options of the match_* fields of a config, shared by the odometry, the batch refinement and the
+ * surfel registration
+ */
+KnnSurfelMatcherOptions KnnSurfelMatcherOptionsFromConfig(const LioConfig &config);
+
 class KnnSurfelMatcher {
   FRIEND_TEST(KnnSurfelMatcher, KNearestSearch);
 
@@ -14,6 +29,8 @@ class KnnSurfelMatcher {
   using FloatType  = double;
   using FLANNIndex = flann::Index<flann::L2_Simple<FloatType>>;
 
+  explicit KnnSurfelMatcher(const KnnSurfelMatcherOptions &options = KnnSurfelMatcherOptions()) : options_(options) {}
+
   void BuildIndex(const std::deque<Surfel::Ptr> &surfels);
 
   void Match(std::deque<Surfel::Ptr> &surfels, std::vector<SurfelCorrespondence> &surfels_corrs);
@@ -28,15 +45,11 @@ class KnnSurfelMatcher {
   std::vector<FloatType> ToVector(const Surfel::Ptr &surfel);
 
  private:
+  KnnSurfelMatcherOptions options_;
+
   std::deque<Surfel::Ptr> target_surfels_;
 
   std::vector<FloatType>      cloud_;
   std::shared_ptr<FLANNIndex> index_;
   int                         dim_ = 6;
-
-  static constexpr double kCenterDistThreshold        = 1.0;
-  static constexpr double kAngularDistThreshold       = 5.0 * M_PI / 180.0;
-  static constexpr double kSurfelDistThreshold        = 0.1;
-  static constexpr int    kNearestSurfelCandidatesNum = 10;
-  static constexpr double kTimeDiffThreshold          = 0.06;
 };
@@ -0,0 +1,180 @@
+#include "odometry/lidar_merger.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+
+#include "common/radix_sort.h"
+#include "common/check.h"
+#include "common/thread_utils.h"
+
+int64_t MergeIntoReorderWindow(std::vector<hilti_ros::Point>::const_iterator first, std::vector<hilti_ros::Point>::const_iterator last,
+                               double reorder_window, std::deque<hilti_ros::Point> *buff) {
+  auto    time_less   = [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; };
+  int64_t dropped_num = 0;
+  if (!buff->empty()) {
+    hilti_ros::Point oldest;
+    oldest.time   = buff->back().time - reorder_window;
+    auto accepted = std::lower_bound(first, last, oldest, time_less);
+    dropped_num   = accepted - first;
+    first         = accepted;
+  }
+  if (first == last) {
+    return dropped_num;
+  }
+
+  if (buff->empty() || first->time >= buff->back().time) {
+    buff->insert(buff->end(), first, last);
+    return dropped_num;
+  }
+  // take out the buffered points newer than the first new one and merge both in order, buffered points first on ties
+  auto                          tail_begin = std::upper_bound(buff->begin(), buff->end(), *first, time_less);
+  std::vector<hilti_ros::Point> tail(tail_begin, buff->end());
+  buff->erase(tail_begin, buff->end());
+  std::merge(tail.begin(), tail.end(), first, last, std::back_inserter(*buff), time_less);
+  PARANOID_CHECK(std::is_sorted(buff->begin(), buff->end(), time_less));
+  return dropped_num;
+}
+
+LidarMerger::LidarMerger(const std::vector<LidarSensorConfig> &lidars, double min_range, double max_range, double max_lookahead)
+    : min_range_(min_range), max_range_(max_range), max_lookahead_(max_lookahead) {
+  CHECK(!lidars.empty());
+  {
+    absl::MutexLock lock(&mutex_);
+    for (const auto &config : lidars) {
+      lidars_.push_back(std::make_unique<Lidar>());
+      lidars_.back()->config = config;
+    }
+  }
+  for (int i = 0; i < lidars.size(); ++i) {
+    threads_.emplace_back(&LidarMerger::Filter, this, i);
+  }
+}
+
+LidarMerger::~LidarMerger() {
+  {
+    absl::MutexLock lock(&mutex_);
+    running_ = false;
+  }
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void LidarMerger::AddScan(int lidar_id, const pcl::PointCloud<hilti_ros::Point>::Ptr &scan) {
+  if (scan->empty()) {
+    return;
+  }
+  double scan_time = std::max_element(scan->begin(), scan->end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; })->time;
+
+  absl::MutexLock lock(&mutex_);
+  CHECK(lidar_id >= 0 && lidar_id < lidars_.size()) << "Unknown lidar " << lidar_id;
+  auto &lidar = *lidars_[lidar_id];
+  lidar.scans.push_back({scan, released_time_});
+  ++lidar.pending_scan_num;
+  lidar.queued_time = std::max(lidar.queued_time, scan_time);
+}
+
+void LidarMerger::PopMergedPoints(std::vector<hilti_ros::Point> *points) {
+  absl::MutexLock lock(&mutex_);
+  double          newest_time = std::numeric_limits<double>::lowest();
+  for (const auto &lidar : lidars_) {
+    newest_time = std::max(newest_time, lidar->queued_time);
+  }
+  // points up to the frontier can not be preceded by points of any lidar still waited for
+  double frontier = std::numeric_limits<double>::max();
+  for (const auto &lidar : lidars_) {
+    if (lidar->pending_scan_num == 0 && lidar->queued_time < newest_time - max_lookahead_) {
+      continue;
+    }
+    frontier = std::min(frontier, lidar->filtered_time);
+  }
+
+  while (true) {
+    // release the run of the earliest lidar up to the next point of any other lidar
+    Lidar *earliest = nullptr;
+    double limit    = frontier;
+    for (const auto &lidar : lidars_) {
+      if (lidar->points.empty()) {
+        continue;
+      }
+      if (!earliest || lidar->points.front().time < earliest->points.front().time) {
+        if (earliest) {
+          limit = std::min(limit, earliest->points.front().time);
+        }
+        earliest = lidar.get();
+      } else {
+        limit = std::min(limit, lidar->points.front().time);
+      }
+    }
+    if (!earliest || earliest->points.front().time > limit) {
+      break;
+    }
+    while (!earliest->points.empty() && earliest->points.front().time <= limit) {
+      points->push_back(earliest->points.front());
+      earliest->points.pop_front();
+    }
+    released_time_ = points->back().time;
+  }
+}
+
+void LidarMerger::WaitIdle() {
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return std::all_of(lidars_.begin(), lidars_.end(), [](const std::unique_ptr<Lidar> &lidar) { return lidar->pending_scan_num == 0; });
+  };
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(&predicate));
+}
+
+int64_t LidarMerger::LatePointNum() const {
+  absl::MutexLock lock(&mutex_);
+  return late_point_num_;
+}
+
+void LidarMerger::Filter(int lidar_id) {
+  ConfigureCurrentThread("lidar_filter");
+  LidarSensorConfig config;
+  {
+    absl::MutexLock lock(&mutex_);
+    config = lidars_[lidar_id]->config;
+  }
+
+  const auto predicate = [this, lidar_id]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !lidars_[lidar_id]->scans.empty() || !running_;
+  };
+  std::vector<hilti_ros::Point> points;
+  while (true) {
+    QueuedScan queued;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(&predicate));
+      if (!running_) {
+        return;
+      }
+      queued = std::move(lidars_[lidar_id]->scans.front());
+      lidars_[lidar_id]->scans.pop_front();
+    }
+
+    points.clear();
+    double scan_time = std::numeric_limits<double>::lowest();
+    for (auto point : *queued.scan) {
+      scan_time = std::max<double>(scan_time, point.time);
+      if (PreprocessLidarPoint(config, min_range_, max_range_, &point)) {
+        points.push_back(point);
+      }
+    }
+    SortPointsByTime(points);
+
+    absl::MutexLock lock(&mutex_);
+    auto           &lidar = *lidars_[lidar_id];
+    for (const auto &point : points) {
+      if (point.time < std::max(queued.drop_before, lidar.last_point_time)) {
+        ++late_point_num_;
+        continue;
+      }
+      lidar.points.push_back(point);
+      lidar.last_point_time = point.time;
+    }
+    lidar.filtered_time = std::max(lidar.filtered_time, scan_time);
+    --lidar.pending_scan_num;
+  }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <pcl/point_cloud.h>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "common/common.h"
+#include "odometry/lio_config.h"
+
+/**
+ * @brief Transform a raw point to imu_link and check it against the range limits and the blind box of its lidar
+ *
+ * @return false if the point is filtered out
+ */
+inline bool PreprocessLidarPoint(const LidarSensorConfig &lidar, double min_range, double max_range, hilti_ros::Point *point) {
+  point->getVector3fMap() = (lidar.ext_lidar2imu * point->getVector3fMap().cast<double>()).cast<float>();
+  double range            = point->getVector3fMap().norm();
+  return range >= min_range && range <= max_range && !lidar.blind_bounding_box.contains(point->getVector3fMap().cast<double>());
+}
+
+/**
+ * @brief Merge the time sorted points [first, last) into a time sorted buffer. Points older than the newest buffered
+ * one by less than reorder_window are put in order, older ones are dropped, as they may belong to a sweep built already.
+ *
+ * @return number of dropped points
+ */
+int64_t MergeIntoReorderWindow(std::vector<hilti_ros::Point>::const_iterator first, std::vector<hilti_ros::Point>::const_iterator last,
+                               double reorder_window, std::deque<hilti_ros::Point> *buff);
+
+/**
+ * @brief Merge the scans of several lidars into one time ordered point stream
+ *
+ * Every lidar has its own thread transforming and filtering its scans. Filtered points are released by a k-way merge
+ * once every lidar has delivered points up to their time, so the merged stream is independent of thread timing. A
+ * lidar whose latest scan lags behind the newest scan of any lidar by more than max_lookahead, and has nothing in
+ * flight, is not waited for. Its points older than the released ones are dropped when they arrive.
+ */
+class LidarMerger {
+ public:
+  LidarMerger(const std::vector<LidarSensorConfig> &lidars, double min_range, double max_range, double max_lookahead);
+  ~LidarMerger();
+
+  LidarMerger(const LidarMerger &)            = delete;
+  LidarMerger &operator=(const LidarMerger &) = delete;
+
+  /**
+   * @brief Queue a raw scan of a lidar for filtering, the points of one lidar must not go back in time across scans
+   */
+  void AddScan(int lidar_id, const pcl::PointCloud<hilti_ros::Point>::Ptr &scan) LOCKS_EXCLUDED(mutex_);
+
+  /**
+   * @brief Append the points released so far, in time order
+   */
+  void PopMergedPoints(std::vector<hilti_ros::Point> *points) LOCKS_EXCLUDED(mutex_);
+
+  /**
+   * @brief Block until all queued scans are filtered
+   */
+  void WaitIdle() LOCKS_EXCLUDED(mutex_);
+
+  /**
+   * @return number of points dropped because they arrived after later points were released
+   */
+  int64_t LatePointNum() const LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct QueuedScan {
+    pcl::PointCloud<hilti_ros::Point>::Ptr scan;
+    double                                 drop_before;  // released time when the scan was queued
+  };
+
+  struct Lidar {
+    LidarSensorConfig            config;
+    std::deque<QueuedScan>       scans;                                                    // waiting for the filter thread
+    int                          pending_scan_num = 0;                                     // queued and not filtered yet
+    std::deque<hilti_ros::Point> points;                                                   // filtered and not released yet, sorted by time
+    double                       queued_time      = std::numeric_limits<double>::lowest();  // latest raw point time of the queued scans
+    double                       filtered_time    = std::numeric_limits<double>::lowest();  // latest raw point time of the filtered scans
+    double                       last_point_time  = std::numeric_limits<double>::lowest();  // of the latest filtered point kept
+  };
+
+  void Filter(int lidar_id);
+
+ private:
+  double min_range_;
+  double max_range_;
+  double max_lookahead_;
+
+  mutable absl::Mutex                 mutex_;
+  std::vector<std::unique_ptr<Lidar>> lidars_ GUARDED_BY(mutex_);
+  double                              released_time_ GUARDED_BY(mutex_)  = std::numeric_limits<double>::lowest();
+  int64_t                             late_point_num_ GUARDED_BY(mutex_) = 0;
+  bool                                running_ GUARDED_BY(mutex_)        = true;
+  std::vector<std::thread>            threads_;
+};
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+
+#include "odometry/lidar_merger.h"
+
+namespace {
+
+/**
+ * @brief Scan with one point 10 m ahead every dt seconds in [start_time, end_time)
+ */
+pcl::PointCloud<hilti_ros::Point>::Ptr MakeScan(double start_time, double end_time, double dt) {
+  pcl::PointCloud<hilti_ros::Point>::Ptr scan(new pcl::PointCloud<hilti_ros::Point>);
+  for (double time = start_time; time < end_time - 1e-9; time += dt) {
+    hilti_ros::Point point;
+    point.x    = 10;
+    point.y    = 0;
+    point.z    = 0;
+    point.time = time;
+    scan->push_back(point);
+  }
+  return scan;
+}
+
+}  // namespace
+
+TEST(LidarMerger, MergesInTimeOrder) {
+  LidarSensorConfig second;
+  second.ext_lidar2imu = Rigid3d(Eigen::Vector3d(0, 0, 1), Eigen::Quaterniond::Identity());
+  LidarMerger merger({LidarSensorConfig(), second}, 0.3, 120, 1.0);
+
+  std::vector<hilti_ros::Point> merged;
+  for (int i = 0; i < 5; ++i) {
+    merger.AddScan(0, MakeScan(i * 0.1, (i + 1) * 0.1, 0.01));
+    merger.AddScan(1, MakeScan(i * 0.1 + 0.005, (i + 1) * 0.1 + 0.005, 0.01));
+    merger.WaitIdle();
+    merger.PopMergedPoints(&merged);
+  }
+
+  // the second lidar has delivered points up to 0.495, the first one only up to 0.49
+  ASSERT_EQ(merged.size(), 99);
+  for (int i = 0; i < merged.size(); ++i) {
+    EXPECT_NEAR(merged[i].time, i * 0.005, 1e-9);
+    EXPECT_EQ(merged[i].z, i % 2 == 0 ? 0 : 1);
+  }
+  EXPECT_EQ(merger.LatePointNum(), 0);
+}
+
+TEST(LidarMerger, DoesNotWaitForLaggingLidar) {
+  LidarMerger merger({LidarSensorConfig(), LidarSensorConfig()}, 0.3, 120, 0.2);
+
+  std::vector<hilti_ros::Point> merged;
+  merger.AddScan(1, MakeScan(0.0, 0.1, 0.01));
+  for (int i = 0; i < 5; ++i) {
+    merger.AddScan(0, MakeScan(i * 0.1, (i + 1) * 0.1, 0.01));
+  }
+  merger.WaitIdle();
+  merger.PopMergedPoints(&merged);
+  EXPECT_EQ(merged.size(), 60);
+  EXPECT_NEAR(merged.back().time, 0.49, 1e-9);
+
+  // points of the lagging lidar older than the released ones are dropped
+  merger.AddScan(1, MakeScan(0.105, 0.605, 0.01));
+  merger.WaitIdle();
+  EXPECT_EQ(merger.LatePointNum(), 39);
+  merger.PopMergedPoints(&merged);
+  EXPECT_TRUE(std::is_sorted(merged.begin(), merged.end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; }));
+}
+
+TEST(LidarMerger, ReorderWindowSortsOutOfOrderPacketsOfSingleLidar) {
+  // packets of one lidar, the second and the fourth arrive late
+  std::vector<std::pair<double, double>> packets = {{0.00, 0.01}, {0.02, 0.03}, {0.01, 0.02}, {0.03, 0.04}, {0.05, 0.06}, {0.04, 0.05}, {0.12, 0.13}, {0.06, 0.07}};
+
+  std::deque<hilti_ros::Point> buff;
+  int64_t                      dropped_num = 0;
+  for (auto &packet : packets) {
+    auto                          scan = MakeScan(packet.first, packet.second, 0.001);
+    std::vector<hilti_ros::Point> points(scan->begin(), scan->end());
+    dropped_num += MergeIntoReorderWindow(points.begin(), points.end(), 0.05, &buff);
+  }
+
+  // the last packet is older than the newest point by more than the window
+  EXPECT_EQ(dropped_num, 10);
+  ASSERT_EQ(buff.size(), 70);
+  for (int i = 0; i < 60; ++i) {
+    EXPECT_NEAR(buff[i].time, i * 0.001, 1e-9);
+  }
+  EXPECT_NEAR(buff[60].time, 0.12, 1e-9);
+}
+
+TEST(LidarMerger, ZeroReorderWindowDropsOutOfOrderPackets) {
+  std::deque<hilti_ros::Point> buff;
+  int64_t                      dropped_num = 0;
+  for (auto &packet : std::vector<std::pair<double, double>>{{0.00, 0.01}, {0.02, 0.03}, {0.01, 0.02}, {0.03, 0.04}}) {
+    auto                          scan = MakeScan(packet.first, packet.second, 0.001);
+    std::vector<hilti_ros::Point> points(scan->begin(), scan->end());
+    dropped_num += MergeIntoReorderWindow(points.begin(), points.end(), 0, &buff);
+  }
+  EXPECT_EQ(dropped_num, 10);
+  ASSERT_EQ(buff.size(), 30);
+  EXPECT_TRUE(std::is_sorted(buff.begin(), buff.end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; }));
+}
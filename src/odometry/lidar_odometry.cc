@@ -1,96 +1,63 @@
 
 #define EIGEN_DEFAULT_IO_FORMAT Eigen::IOFormat(6, 0, " ", "\n", "", "")
-#define _GLIBCXX_ASSERTIONS
 
 #include <absl/container/flat_hash_map.h>
 #include <ceres/ceres.h>
 #include <glog/logging.h>
 #include <pcl/io/ply_io.h>
 #include <pcl_conversions/pcl_conversions.h>
-#include <tf/transform_broadcaster.h>
+#include <chrono>
 
+#include "common/check.h"
 #include "common/histogram.h"
+#include "common/radix_sort.h"
 #include "common/utils.h"
 #include "knn_surfel_matcher.h"
 #include "odometry/cost_functor.h"
 #include "odometry/lidar_odometry.h"
-#include "odometry/spline_interpolation.h"
+#include "odometry/odometry_problem.h"
 #include "surfel_extraction.h"
 
 namespace {
 
-class CubicBSplineSampleCorrector {
- public:
-  CubicBSplineSampleCorrector(const std::deque<SampleState::Ptr> &sample_states) {
-    std::vector<double>   sample_timestamps;
-    std::vector<Vector3d> sample_rot;
-    std::vector<Vector3d> sample_pos;
-    for (auto &sample_state : sample_states) {
-      sample_timestamps.push_back(sample_state->timestamp);
-      sample_rot.push_back(sample_state->rot_cor);
-      sample_pos.push_back(sample_state->pos_cor);
-    }
-    rot_interp_.reset(new CubicBSplineInterpolator(sample_timestamps, sample_rot));
-    pos_interp_.reset(new CubicBSplineInterpolator(sample_timestamps, sample_pos));
-  }
-
-  bool GetCorr(double timestamp, Vector3d &rot_cor, Vector3d &pos_cor) {
-    CHECK(rot_interp_ && pos_interp_) << "Interpolator not initialized";
-    auto rot_cor_ptr = rot_interp_->Interp(timestamp);
-    auto pos_cor_ptr = pos_interp_->Interp(timestamp);
-    CHECK((rot_cor_ptr && pos_cor_ptr) || (!rot_cor_ptr && !pos_cor_ptr)) << "Interpolation failed";
-    if (rot_cor_ptr) {
-      rot_cor = *rot_cor_ptr;
-      pos_cor = *pos_cor_ptr;
-      return true;
-    } else {
-      return false;
-    }
-  }
-
- private:
-  std::shared_ptr<CubicBSplineInterpolator> rot_interp_;
-  std::shared_ptr<CubicBSplineInterpolator> pos_interp_;
-};
-
-void PrintSurfelResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem, const std::string &window_type) {
-  if (residual_ids.empty()) {
-    return;
-  }
-  std::vector<double>             residuals;
-  double                          cost;
+/**
+ * @brief Covariance of the pose correction of a sample state
+ *
+ * Computed from the Gauss-Newton information of the residual blocks connected to the state,
+ * i.e. conditioned on all other states in the window. The full marginal is not computed here
+ * because the window has no fixed gauge once the first sample state left it.
+ *
+ * @param problem solved problem
+ * @param sample_state
+ * @param covariance row major 6x6 covariance of [rotation, position]
+ * @return false if the information matrix is singular
+ */
+bool ComputePoseCovariance(ceres::Problem &problem, const SampleState::Ptr &sample_state, double *covariance) {
   ceres::Problem::EvaluateOptions options;
   options.apply_loss_function = true;
-  options.residual_blocks     = residual_ids;
-  problem.Evaluate(options, &cost, &residuals, nullptr, nullptr);
-  Histogram hist;
-  for (auto &e : residuals) {
-    hist.Add(e);
+  options.parameter_blocks    = {sample_state->data_cor};
+  problem.GetResidualBlocksForParameterBlock(sample_state->data_cor, &options.residual_blocks);
+  if (options.residual_blocks.empty()) {
+    return false;
   }
-  LOG(INFO) << window_type << " Surfel residuals, cost: " << cost << ", dist: " << hist.ToString(10);
-}
+  ceres::CRSMatrix jacobian;
+  problem.Evaluate(options, nullptr, nullptr, nullptr, &jacobian);
 
-void PrintImuResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem) {
-  if (residual_ids.empty()) {
-    return;
-  }
-  std::vector<double>             residuals;
-  double                          cost;
-  ceres::Problem::EvaluateOptions options;
-  options.apply_loss_function = true;
-  options.residual_blocks     = residual_ids;
-  problem.Evaluate(options, &cost, &residuals, nullptr, nullptr);
-  Histogram                hist[4];
-  std::vector<std::string> residual_types = {"gyro", "acc", "gyro_bias", "acc_bias"};
-  for (int i = 0; i < residuals.size(); i += 12) {
-    for (int j = 0; j < 4; ++j) {
-      auto residuals_part = Vector3d{residuals[i + j * 3], residuals[i + j * 3 + 1], residuals[i + j * 3 + 2]};
-      hist[j].Add(residuals_part.norm());
+  Eigen::Matrix<double, 12, 12> information = Eigen::Matrix<double, 12, 12>::Zero();
+  for (int row = 0; row < jacobian.num_rows; ++row) {
+    Eigen::Matrix<double, 12, 1> j = Eigen::Matrix<double, 12, 1>::Zero();
+    for (int idx = jacobian.rows[row]; idx < jacobian.rows[row + 1]; ++idx) {
+      j[jacobian.cols[idx]] = jacobian.values[idx];
     }
+    information += j * j.transpose();
   }
-  for (int j = 0; j < 4; ++j) {
-    LOG(INFO) << "Imu residuals with type " << residual_types[j] << ", cost: " << cost << ", dist: " << hist[j].ToString(10);
+
+  Eigen::FullPivLU<Eigen::Matrix<double, 12, 12>> lu(information);
+  if (!lu.isInvertible()) {
+    return false;
   }
+  Eigen::Map<Eigen::Matrix<double, 6, 6, Eigen::RowMajor>>{covariance} = lu.inverse().block<6, 6>(0, 0);
+  return true;
 }
 
 void PrintSampleStates(const std::deque<SampleState::Ptr> &states) {
@@ -140,67 +107,17 @@ void BuildSweep(std::deque<hilti_ros::Point> &points_buff, double sweep_endtime,
   }
 }
 
-void UndistortSweep(const std::vector<hilti_ros::Point> &sweep_in,
-                    const std::deque<ImuState>          &imu_states,
-                    std::vector<hilti_ros::Point>       &sweep_out) {
-  sweep_out.clear();
-  for (auto &pt : sweep_in) {
-    auto it  = std::lower_bound(imu_states.begin(), imu_states.end(), pt.time, [](const ImuState &a, auto b) { return a.timestamp < b; });
-    auto idx = it - imu_states.begin();
-    CHECK(idx >= 1 && idx < imu_states.size()) << idx;
-    double      factor      = (pt.time - imu_states[idx - 1].timestamp) / (imu_states[idx].timestamp - imu_states[idx - 1].timestamp);
-    Vector3d    pos         = imu_states[idx - 1].pos * (1 - factor) + imu_states[idx].pos * factor;
-    Quaterniond rot         = imu_states[idx - 1].rot.slerp(factor, imu_states[idx].rot);
-    auto        new_pt      = pt;
-    new_pt.getVector3fMap() = (rot * new_pt.getVector3fMap().cast<double>() + pos).cast<float>();
-    sweep_out.push_back(new_pt);
-  }
-}
-
-void UpdateSurfelPoses(const std::deque<ImuState> &imu_states, std::deque<Surfel::Ptr> &surfels) {
-  for (auto &surfel : surfels) {
-    auto it  = std::lower_bound(imu_states.begin(), imu_states.end(), surfel->timestamp, [](const ImuState &a, auto b) { return a.timestamp < b; });
-    auto idx = it - imu_states.begin();
-    CHECK(idx != 0 && idx != imu_states.size()) << idx;
-    double      factor = (surfel->timestamp - imu_states[idx - 1].timestamp) / (imu_states[idx].timestamp - imu_states[idx - 1].timestamp);
-    Vector3d    pos    = imu_states[idx - 1].pos * (1 - factor) + imu_states[idx].pos * factor;
-    Quaterniond rot    = imu_states[idx - 1].rot.slerp(factor, imu_states[idx].rot);
-    surfel->UpdatePose(pos, rot);
-  }
-}
-
-void UpdateSamplePoses(std::deque<SampleState::Ptr> &sample_states) {
-  for (auto &sample_state : sample_states) {
-    sample_state->rot = Exp(sample_state->rot_cor) * sample_state->rot;
-    sample_state->pos = sample_state->pos_cor + sample_state->pos;
-    sample_state->rot_cor.setZero();
-    sample_state->pos_cor.setZero();
-  }
-}
-
 /**
- * @brief Update imu poses by sample state corrections
+ * @brief Update imu poses by sample state corrections and predict the newest imu pose
+ *
+ * The newest imu state is past the last sample state, so it is out of the interpolation range.
  *
  * @param sample_states
  * @param imu_states
  */
-void UpdateImuPoses(const std::deque<SampleState::Ptr> &sample_states,
-                    std::deque<ImuState>               &imu_states) {
-  int                         corrected_first_idx = -1, corrected_last_idx = -1;
-  CubicBSplineSampleCorrector corrector(sample_states);
-  // update imu poses by sample state corrections
-  for (int i = 0; i < imu_states.size(); ++i) {
-    auto    &imu_state = imu_states[i];
-    Vector3d rot_cor, pos_cor;
-    bool     interp_ok = corrector.GetCorr(imu_state.timestamp, rot_cor, pos_cor);
-    if (interp_ok) {
-      imu_state.rot = Exp(rot_cor) * imu_state.rot;
-      imu_state.pos = pos_cor + imu_state.pos;
-
-      if (corrected_first_idx == -1) corrected_first_idx = i;
-      corrected_last_idx = i;
-    }
-  }
+void UpdateSlidingWindowImuPoses(const std::deque<SampleState::Ptr> &sample_states,
+                                 std::deque<ImuState>               &imu_states) {
+  auto [corrected_first_idx, corrected_last_idx] = UpdateImuPoses(sample_states, imu_states);
   // update heading and tailing imu poses
   if (corrected_first_idx != -1) {
     LOG(INFO) << "Correct extra imu poses in ("
@@ -224,150 +141,55 @@ void UpdateImuPoses(const std::deque<SampleState::Ptr> &sample_states,
  * @param surfels_sld_win
  * @param surfels_fix_win
  * @param window_duration
+ * @param update_fix_win false if the fixed window is a prebuilt map, surfels leaving the sliding window are not added then
+ * @param fusion_options fuse the surfels added to the fixed window with its co-planar ones, null to keep them individually
+ * @param commit receives the states leaving the sliding window, its surfels are never fused
  */
 void ShrinkToFit(std::deque<SampleState::Ptr> &sample_states,
                  std::deque<ImuState>         &imu_states,
                  std::deque<Surfel::Ptr>      &surfels_sld_win,
                  std::deque<Surfel::Ptr>      &surfels_fix_win,
                  double                        sld_win_duration,
-                 double                        fix_win_duration) {
+                 double                        fix_win_duration,
+                 bool                          update_fix_win,
+                 const SurfelFusionOptions    *fusion_options,
+                 OdometryCommit               &commit) {
   if (sample_states.empty() || sample_states.back()->timestamp - sample_states.front()->timestamp <= sld_win_duration) {
     return;
   }
   while (sample_states.back()->timestamp - sample_states.front()->timestamp > sld_win_duration) {
+    commit.sample_states.push_back(sample_states.front());
     sample_states.pop_front();
   }
   while (imu_states.front().timestamp < sample_states.front()->timestamp) {
+    commit.imu_states.push_back(imu_states.front());
     imu_states.pop_front();
   }
   while (surfels_sld_win.front()->timestamp < imu_states.front().timestamp) {
-    surfels_fix_win.push_front(surfels_sld_win.front());
+    if (update_fix_win) {
+      surfels_fix_win.push_front(surfels_sld_win.front());
+    }
+    commit.surfels.push_back(surfels_sld_win.front());
     surfels_sld_win.pop_front();
   }
-  while (surfels_fix_win.back()->timestamp - surfels_fix_win.back()->timestamp > fix_win_duration) {
+  if (update_fix_win && fusion_options && !commit.surfels.empty()) {
+    int fused_away_num = FuseSurfels(surfels_fix_win, commit.surfels.size(), *fusion_options);
+    LOG(INFO) << "Fused " << fused_away_num << " of " << commit.surfels.size() << " surfels entering the fixed window of " << surfels_fix_win.size();
+  }
+  while (update_fix_win && !surfels_fix_win.empty() && surfels_fix_win.front()->timestamp - surfels_fix_win.back()->timestamp > fix_win_duration) {
     surfels_fix_win.pop_back();
   }
 }
 
 }  // namespace
 
-void LidarOdometry::BuildSldWinLidarResiduals(const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids) {
-  for (const auto &surfel_corr : surfel_corrs) {
-    CHECK_LT(surfel_corr.s1->timestamp, surfel_corr.s2->timestamp) << std::fixed << std::setprecision(6) << surfel_corr.s1->timestamp << " " << surfel_corr.s2->timestamp;  // bug: disorder happens
-
-    auto sp1r_it = std::upper_bound(sample_states_sld_win_.begin(), sample_states_sld_win_.end(), surfel_corr.s1->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
-    CHECK(sp1r_it != sample_states_sld_win_.begin());
-    CHECK(sp1r_it != sample_states_sld_win_.end());
-
-    auto sp1l    = *(sp1r_it - 1);
-    auto sp1r    = *(sp1r_it);
-    auto sp2r_it = std::upper_bound(sample_states_sld_win_.begin(), sample_states_sld_win_.end(), surfel_corr.s2->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
-    CHECK(sp2r_it != sample_states_sld_win_.begin());
-    CHECK(sp2r_it != sample_states_sld_win_.end());
-    auto sp2l = *(sp2r_it - 1);
-    auto sp2r = *(sp2r_it);
-
-    auto loss_function = new ceres::CauchyLoss(0.4);  // todo set cauchy loss param
-    if (sp1r->timestamp < sp2l->timestamp) {
-      auto residual_id = problem.AddResidualBlock(
-          new SurfelMatchBinaryFactor<0>(surfel_corr.s1, sp1l, sp1r, surfel_corr.s2, sp2l, sp2r),
-          loss_function,
-          sp1l->data_cor,
-          sp1r->data_cor,
-          sp2l->data_cor,
-          sp2r->data_cor);
-      residual_ids.push_back(residual_id);
-    } else if (sp1r == sp2l) {
-      auto residual_id = problem.AddResidualBlock(
-          new SurfelMatchBinaryFactor<1>(surfel_corr.s1, sp1l, sp1r, surfel_corr.s2, sp2l, sp2r),
-          loss_function,
-          sp1l->data_cor,
-          sp1r->data_cor,
-          sp2r->data_cor);
-      residual_ids.push_back(residual_id);
-    } else {
-      auto residual_id = problem.AddResidualBlock(
-          new SurfelMatchBinaryFactor<2>(surfel_corr.s1, sp1l, sp1r, surfel_corr.s2, sp2l, sp2r),
-          loss_function,
-          sp1l->data_cor,
-          sp1r->data_cor);
-      residual_ids.push_back(residual_id);
-    }
-  }
-}
-
-void LidarOdometry::BuildFixWinLidarResiduals(const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids) {
-  for (const auto &surfel_corr : surfel_corrs) {
-    CHECK_LT(surfel_corr.s1->timestamp, surfel_corr.s2->timestamp) << std::fixed << std::setprecision(6) << surfel_corr.s1->timestamp << " " << surfel_corr.s2->timestamp;  // bug: disorder happens
-
-    auto sp2r_it = std::upper_bound(sample_states_sld_win_.begin(), sample_states_sld_win_.end(), surfel_corr.s2->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
-    CHECK(sp2r_it != sample_states_sld_win_.begin());
-    CHECK(sp2r_it != sample_states_sld_win_.end());
-    auto sp2l = *(sp2r_it - 1);
-    auto sp2r = *(sp2r_it);
-
-    auto loss_function = new ceres::CauchyLoss(0.4);  // todo set cauchy loss param
-    auto residual_id   = problem.AddResidualBlock(
-        new SurfelMatchUnaryFactor(surfel_corr.s1, surfel_corr.s2, sp2l, sp2r),
-        loss_function,
-        sp2l->data_cor,
-        sp2r->data_cor);
-    residual_ids.push_back(residual_id);
-  }
-}
-
-void LidarOdometry::BuildImuResiduals(const std::deque<ImuState> &imu_states, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids) {
-  for (int i = 0; i < imu_states.size() - 2; ++i) {
-    auto &i1 = imu_states[i];
-    auto &i2 = imu_states[i + 1];
-    auto &i3 = imu_states[i + 2];
-    if (i1.timestamp < sample_states_sld_win_.front()->timestamp) {
-      continue;
-    }
-    if (i3.timestamp > sample_states_sld_win_.back()->timestamp) {
-      break;
-    }
-    auto sp2_it = std::upper_bound(sample_states_sld_win_.begin(), sample_states_sld_win_.end(), i1.timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
-    auto sp1    = *(sp2_it - 1);
-    auto sp2    = *(sp2_it);
-    if (sp2_it == sample_states_sld_win_.end() - 1) {
-      auto residual_id = problem.AddResidualBlock(
-          new ImuFactor<1>(i1, i2, i3,
-                           sp1->timestamp, sp2->timestamp, DBL_MAX,
-                           config_.gyroscope_noise_density_cost_weight,
-                           config_.accelerometer_noise_density_cost_weight,
-                           config_.gyroscope_random_walk_cost_weight,
-                           config_.accelerometer_random_walk_cost_weight,
-                           1 / config_.imu_rate, sample_states_sld_win_.back()->grav),
-          new ceres::TrivialLoss(),  // todo use loss function
-          sp1->data_cor,
-          sp2->data_cor);
-      residual_ids.push_back(residual_id);
-    } else {
-      auto sp3         = *(sp2_it + 1);
-      auto residual_id = problem.AddResidualBlock(
-          new ImuFactor<0>(i1, i2, i3,
-                           sp1->timestamp, sp2->timestamp, sp3->timestamp,
-                           config_.gyroscope_noise_density_cost_weight,
-                           config_.accelerometer_noise_density_cost_weight,
-                           config_.gyroscope_random_walk_cost_weight,
-                           config_.accelerometer_random_walk_cost_weight,
-                           1 / config_.imu_rate, sample_states_sld_win_.back()->grav),
-          new ceres::TrivialLoss(),
-          sp1->data_cor,
-          sp2->data_cor,
-          sp3->data_cor);
-      residual_ids.push_back(residual_id);
-    }
-  }
-}
-
 void LidarOdometry::PredictImuStatesAndSampleStates(double end_time) {
   // 1. try to initialize imu states and sample states
   CHECK_GE(imu_buff_.size(), 2);
-  auto        dt           = 1 / config_.imu_rate;
-  static bool init_sld_win = false;
-  if (!init_sld_win) {
+  auto dt = 1 / config_.imu_rate;
+  if (!init_sld_win_) {
+    // the world frame is the first imu frame, or the map frame in localization mode
+    Rigid3d initial_pose = localization_map_ ? config_.localization_initial_pose : Rigid3d();
     for (int i = 0; i < 2; ++i) {
       auto imu_msg = imu_buff_.front();
       imu_buff_.pop_front();
@@ -376,11 +198,11 @@ void LidarOdometry::PredictImuStatesAndSampleStates(double end_time) {
       imu_state.timestamp = imu_msg.timestamp;
       imu_state.acc       = imu_msg.linear_acceleration;
       imu_state.gyr       = imu_msg.angular_velocity;
-      imu_state.pos       = Vector3d::Zero();
+      imu_state.pos       = initial_pose.translation();
       if (i == 0) {
-        imu_state.rot = Quaterniond::Identity();
+        imu_state.rot = initial_pose.rotation();
       } else {
-        imu_state.rot = Exp((imu_states_sld_win_.back().gyr + imu_state.gyr) / 2 * dt);
+        imu_state.rot = initial_pose.rotation() * Exp((imu_states_sld_win_.back().gyr + imu_state.gyr) / 2 * dt);
       }
       imu_states_sld_win_.push_back(imu_state);
     }
@@ -389,12 +211,13 @@ void LidarOdometry::PredictImuStatesAndSampleStates(double end_time) {
     ss->timestamp = imu_states_sld_win_.front().timestamp;
     ss->ba.setZero();
     ss->bg.setZero();
-    ss->grav = -config_.gravity_norm * imu_states_sld_win_.front().acc.normalized();
+    ss->grav = -config_.gravity_norm * (imu_states_sld_win_.front().rot * imu_states_sld_win_.front().acc.normalized());
     ss->rot  = imu_states_sld_win_.front().rot;
     ss->pos  = imu_states_sld_win_.front().pos;
     sample_states_sld_win_.push_back(ss);
 
-    init_sld_win = true;
+    first_sample_state_ = ss;
+    init_sld_win_       = true;
   }
 
   auto   sample_states_old_size     = sample_states_sld_win_.size();
@@ -455,8 +278,7 @@ void LidarOdometry::PredictImuStatesAndSampleStates(double end_time) {
 }
 
 bool LidarOdometry::SyncHeadingMsgs() {
-  static bool sync_done = false;
-  if (sync_done) {
+  if (sync_done_) {
     return true;
   }
 
@@ -479,21 +301,46 @@ bool LidarOdometry::SyncHeadingMsgs() {
     CHECK(!points_buff_.empty());
   }
 
-  sync_done = true;
+  sync_done_ = true;
 
   return true;
 }
 
-void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &msg) {
-  // transform points from lidar frame to imu frame
-  for (auto pt : *msg) {
-    pt.getVector3fMap() = (this->config_.ext_lidar2imu * pt.getVector3fMap().cast<double>()).cast<float>();
-    CHECK(points_buff_.empty() || pt.time >= points_buff_.back().time);
-    if (pt.getVector3fMap().norm() < config_.min_range || pt.getVector3fMap().norm() > config_.max_range || config_.blind_bounding_box.contains(pt.getVector3fMap().cast<double>())) {
-      continue;
+void LidarOdometry::MergeIntoPointsBuff(const std::vector<hilti_ros::Point> &points) {
+  auto first = std::find_if(points.begin(), points.end(), [this](const hilti_ros::Point &pt) { return pt.time > resume_point_time_; });
+  // sweeps are built only up to the newest point minus the window, older points may belong to a built sweep
+  int64_t dropped_num = MergeIntoReorderWindow(first, points.end(), config_.point_reorder_window, &points_buff_);
+  if (dropped_num > 0) {
+    LOG(WARNING) << "Dropped " << dropped_num << " points older than the reorder window of " << config_.point_reorder_window << "s.";
+    reorder_late_point_num_ += dropped_num;
+  }
+}
+
+void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &msg, int lidar_id) {
+  std::vector<hilti_ros::Point> points;
+  if (lidar_merger_) {
+    lidar_merger_->AddScan(lidar_id, msg);
+    if (config_.deterministic) {
+      // what is released and what is dropped as late then depends on the scans only, not on the filter threads
+      lidar_merger_->WaitIdle();
+    }
+    lidar_merger_->PopMergedPoints(&points);
+    if (lidar_merger_->LatePointNum() > late_point_num_) {
+      LOG(WARNING) << "Dropped " << lidar_merger_->LatePointNum() - late_point_num_ << " points of lidars lagging behind by more than " << config_.lidar_merge_max_lookahead << "s.";
+      late_point_num_ = lidar_merger_->LatePointNum();
+    }
+  } else {
+    CHECK_EQ(lidar_id, 0) << "Scan of lidar " << lidar_id << " without extra_lidars configured.";
+    // transform points from lidar frame to imu frame
+    points.reserve(msg->size());
+    for (auto pt : *msg) {
+      if (PreprocessLidarPoint(lidar_, config_.min_range, config_.max_range, &pt)) {
+        points.push_back(pt);
+      }
     }
-    points_buff_.push_back(pt);
+    SortPointsByTime(points);
   }
+  MergeIntoPointsBuff(points);
 
   if (!SyncHeadingMsgs()) {
     return;
@@ -502,7 +349,7 @@ void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &m
   // 1. collect scan to sweep
   std::vector<hilti_ros::Point> sweep;
   auto                          sweep_endtime = points_buff_.front().time + config_.sweep_duration;
-  if (points_buff_.back().time < sweep_endtime || imu_buff_.empty() ||
+  if (points_buff_.back().time < sweep_endtime + config_.point_reorder_window || imu_buff_.empty() ||
       imu_buff_.back().timestamp < sweep_endtime) {
     // LOG(INFO) << "Waiting to construct a sweep: " << points_buff_.back().time - points_buff_.front().time;
     return;
@@ -522,27 +369,50 @@ void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &m
   // 4. extract surfels and add to windows, the first time surfels will be add to global map
   std::deque<Surfel::Ptr> surfels_sweep;
   GlobalMap               map;
-  BuildSurfels(sweep_undistorted, surfels_sweep, map);
+  BuildSurfels(sweep_undistorted, surfels_sweep, map, surfel_extraction_options_);
   surfels_sld_win_.insert(surfels_sld_win_.end(), surfels_sweep.begin(), surfels_sweep.end());
   UpdateSurfelPoses(imu_states_sld_win_, surfels_sld_win_);
 
+  // in localization mode the fixed window holds the map tiles around the latest pose, its index is only rebuilt when they change
+  if (localization_map_) {
+    const auto &latest   = sample_states_sld_win_.back();
+    const auto &previous = sample_states_sld_win_[std::max<int>(sample_states_sld_win_.size() - 2, 0)];
+    Vector3d    velocity = latest == previous ? Vector3d::Zero() : Vector3d((latest->pos - previous->pos) / (latest->timestamp - previous->timestamp));
+    if (localization_map_cache_->UpdateActiveTiles(latest->pos, velocity, config_.localization_map_radius)) {
+      surfels_fix_win_          = localization_map_cache_->ActiveSurfels();
+      localization_map_matcher_ = KnnSurfelMatcher(surfel_matcher_options_);
+      localization_map_matcher_.BuildIndex(surfels_fix_win_);
+
+      auto metrics = localization_map_cache_->Metrics();
+      LOG(INFO) << "Localization map surfels_" << surfels_fix_win_.size() << " active, tiles_" << metrics.resident_tile_num
+                << " surfels_" << metrics.resident_surfel_num << " resident, hit rate " << metrics.HitRate()
+                << ", prefetched " << metrics.prefetch_num << ", evicted " << metrics.eviction_num;
+    }
+  }
+
+  double pose_covariance[36];
+  bool   pose_covariance_valid = false;
   for (int iter_num = 0; iter_num < config_.outer_iter_num_max; ++iter_num) {
     std::vector<SurfelCorrespondence> surfel_corrs_sld, surfel_corrs_fix;
 
-    KnnSurfelMatcher surfel_matcher_sld_win;
+    KnnSurfelMatcher surfel_matcher_sld_win(surfel_matcher_options_);
     surfel_matcher_sld_win.BuildIndex(surfels_sld_win_);
     surfel_matcher_sld_win.Match(surfels_sld_win_, surfel_corrs_sld);
 
-    KnnSurfelMatcher surfel_matcher_fix_win;
-    surfel_matcher_fix_win.BuildIndex(surfels_fix_win_);
-    surfel_matcher_fix_win.Match(surfels_sld_win_, surfel_corrs_fix);
+    if (localization_map_) {
+      localization_map_matcher_.Match(surfels_sld_win_, surfel_corrs_fix);
+    } else {
+      KnnSurfelMatcher surfel_matcher_fix_win(surfel_matcher_options_);
+      surfel_matcher_fix_win.BuildIndex(surfels_fix_win_);
+      surfel_matcher_fix_win.Match(surfels_sld_win_, surfel_corrs_fix);
+    }
 
     // 5. sovle poses in windows
     ceres::Problem                      problem;
     std::vector<ceres::ResidualBlockId> surfel_sld_win_residual_ids, surfel_fix_win_residual_ids, imu_residual_ids;
-    BuildSldWinLidarResiduals(surfel_corrs_sld, problem, surfel_sld_win_residual_ids);
-    BuildFixWinLidarResiduals(surfel_corrs_fix, problem, surfel_fix_win_residual_ids);
-    BuildImuResiduals(imu_states_sld_win_, problem, imu_residual_ids);
+    BuildBinaryLidarResiduals(sample_states_sld_win_, surfel_corrs_sld, problem, surfel_sld_win_residual_ids, config_.lidar_loss_scale, config_.float_lidar_residuals);
+    BuildUnaryLidarResiduals(sample_states_sld_win_, surfel_corrs_fix, problem, surfel_fix_win_residual_ids, config_.lidar_loss_scale, config_.float_lidar_residuals);
+    BuildImuResiduals(sample_states_sld_win_, imu_states_sld_win_, config_, problem, imu_residual_ids);
 
     PrintSurfelResiduals(surfel_sld_win_residual_ids, problem, "Sliding Window");
     PrintSurfelResiduals(surfel_fix_win_residual_ids, problem, "Fixed Window");
@@ -552,16 +422,21 @@ void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &m
     option.minimizer_progress_to_stdout = true;
     option.linear_solver_type           = ceres::SPARSE_NORMAL_CHOLESKY;
     option.max_num_iterations           = config_.inner_iter_num_max;
+    // the reductions of ceres depend on the number of threads
+    option.num_threads = config_.deterministic ? 1 : config_.solver_num_threads;
     ceres::Solver::Summary summary;
-    static auto            g_first_sample_state = sample_states_sld_win_[0];
-    if (sample_states_sld_win_[0] == g_first_sample_state) {
+    if (sample_states_sld_win_[0] == first_sample_state_ && !localization_map_) {
       LOG(INFO) << "Optimize with fixing position of the first sample state.";
       problem.SetParameterization(sample_states_sld_win_[0]->data_cor, new ceres::SubsetParameterization(12, {3, 4, 5}));
     }
     ceres::Solve(option, &problem, &summary);
     LOG(INFO) << summary.BriefReport();
 
-    UpdateImuPoses(sample_states_sld_win_, imu_states_sld_win_);
+    if (shm_writer_ && iter_num + 1 == config_.outer_iter_num_max) {
+      pose_covariance_valid = ComputePoseCovariance(problem, sample_states_sld_win_.back(), pose_covariance);
+    }
+
+    UpdateSlidingWindowImuPoses(sample_states_sld_win_, imu_states_sld_win_);
     UpdateSurfelPoses(imu_states_sld_win_, surfels_sld_win_);
     UpdateSamplePoses(sample_states_sld_win_);
 
@@ -571,46 +446,285 @@ void LidarOdometry::AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &m
     PrintSampleStates(sample_states_sld_win_);
   }
 
+  OdometryCommit commit;
   ShrinkToFit(
       sample_states_sld_win_,
       imu_states_sld_win_,
       surfels_sld_win_,
       surfels_fix_win_,
       config_.sliding_window_duration,
-      config_.fixed_window_duration);
+      config_.fixed_window_duration,
+      !localization_map_,
+      config_.fuse_fixed_window_surfels ? &surfel_fusion_options_ : nullptr,
+      commit);
+
+  const auto &latest_state = sample_states_sld_win_.back();
+  if (pose_callback_) {
+    pose_callback_(latest_state->timestamp, Rigid3d(latest_state->pos, latest_state->rot));
+  }
+  HandOverCommit(std::move(commit));
 
-  PubSurfels(surfels_sld_win_, pub_plane_map_);
-  {
+  if (nh_ || shm_writer_) {
     std::vector<hilti_ros::Point> sweep_undistorted_final;
     UndistortSweep(sweep, imu_states_sld_win_, sweep_undistorted_final);
-    sensor_msgs::PointCloud2          msg;
-    pcl::PointCloud<hilti_ros::Point> cloud;
-    for (auto &e : sweep_undistorted_final) {
-      cloud.push_back(e);
+    if (nh_) {
+      PubSurfels(surfels_sld_win_, world_frame_, pub_plane_map_);
+
+      sensor_msgs::PointCloud2          msg;
+      pcl::PointCloud<hilti_ros::Point> cloud;
+      for (auto &e : sweep_undistorted_final) {
+        cloud.push_back(e);
+      }
+      pcl::toROSMsg(cloud, msg);
+      msg.header.stamp.fromSec(cloud.points[0].time);
+      msg.header.frame_id = world_frame_;
+      pub_scan_in_imu_frame_.publish(msg);
+
+      tf::Transform transform;
+      transform.setOrigin(tf::Vector3(latest_state->pos[0], latest_state->pos[1], latest_state->pos[2]));
+      transform.setRotation(tf::Quaternion(latest_state->rot.x(), latest_state->rot.y(), latest_state->rot.z(), latest_state->rot.w()));
+      tf_broadcaster_->sendTransform(tf::StampedTransform(transform, ros::Time().fromSec(latest_state->timestamp), world_frame_, imu_frame_));
+
+      if (backend_) {
+        Rigid3d map_to_world = backend_->MapToWorld();
+        transform.setOrigin(tf::Vector3(map_to_world.translation().x(), map_to_world.translation().y(), map_to_world.translation().z()));
+        transform.setRotation(tf::Quaternion(map_to_world.rotation().x(), map_to_world.rotation().y(), map_to_world.rotation().z(), map_to_world.rotation().w()));
+        tf_broadcaster_->sendTransform(tf::StampedTransform(transform, ros::Time().fromSec(latest_state->timestamp), map_frame_, world_frame_));
+      }
+    }
+
+    if (shm_writer_) {
+      WriteShmOutput(pose_covariance_valid ? pose_covariance : nullptr, sweep_undistorted_final);
     }
-    pcl::toROSMsg(cloud, msg);
-    msg.header.stamp.fromSec(cloud.points[0].time);
-    msg.header.frame_id = "world";
-    pub_scan_in_imu_frame_.publish(msg);
   }
-  {
-    static tf::TransformBroadcaster br;
-    tf::Transform                   transform;
-    transform.setOrigin(tf::Vector3(sample_states_sld_win_.back()->pos[0], sample_states_sld_win_.back()->pos[1], sample_states_sld_win_.back()->pos[2]));
-    transform.setRotation(tf::Quaternion(sample_states_sld_win_.back()->rot.x(), sample_states_sld_win_.back()->rot.y(), sample_states_sld_win_.back()->rot.z(), sample_states_sld_win_.back()->rot.w()));
-    br.sendTransform(tf::StampedTransform(transform, ros::Time().fromSec(sample_states_sld_win_.back()->timestamp), "world", "imu_link"));
+
+  // the raw sweep is not used anymore, the dense map undistorts it once its poses are committed
+  if (dense_map_ && !dense_map_->AddSweep(std::move(sweep))) {
+    LOG(WARNING) << "Dense map queue is full, sweep " << sweep_id_ << " dropped.";
   }
 
   ++sweep_id_;
+
+  if (!config_.checkpoint_filename.empty() && latest_state->timestamp - checkpoint_time_ >= config_.checkpoint_period) {
+    SaveCheckpoint(config_.checkpoint_filename);
+    checkpoint_time_ = latest_state->timestamp;
+  }
 }
 
 void LidarOdometry::AddImuData(const ImuData &msg) {
+  if (msg.timestamp <= resume_imu_time_) {
+    return;
+  }
   auto msg_new = msg;
   // msg_new.angular_velocity += Vector3d::Constant(0.02);
   this->imu_buff_.push_back(msg_new);
 }
 
-LidarOdometry::LidarOdometry() {
-  pub_plane_map_         = nh_.advertise<visualization_msgs::MarkerArray>("/current_planes", 10);
-  pub_scan_in_imu_frame_ = nh_.advertise<sensor_msgs::PointCloud2>("/scan_in_imu_frame", 10);
+void LidarOdometry::WriteShmOutput(const double *pose_covariance, const std::vector<hilti_ros::Point> &sweep_undistorted) {
+  const auto   &state = sample_states_sld_win_.back();
+  ShmPoseRecord pose;
+  pose.timestamp      = state->timestamp;
+  pose.position[0]    = state->pos.x();
+  pose.position[1]    = state->pos.y();
+  pose.position[2]    = state->pos.z();
+  pose.orientation[0] = state->rot.x();
+  pose.orientation[1] = state->rot.y();
+  pose.orientation[2] = state->rot.z();
+  pose.orientation[3] = state->rot.w();
+  pose.sweep_id       = sweep_id_;
+  pose.flags          = 0;
+  if (pose_covariance) {
+    std::copy(pose_covariance, pose_covariance + 36, pose.covariance);
+    pose.flags |= ShmPoseRecord::kCovarianceValid;
+  } else {
+    std::fill(pose.covariance, pose.covariance + 36, 0.0);
+  }
+  shm_writer_->WritePose(pose);
+
+  if (!sweep_undistorted.empty()) {
+    shm_writer_->WriteSweep(sweep_undistorted.front().time, sweep_id_, sweep_undistorted);
+  }
+}
+
+void LidarOdometry::SetPoseCallback(PoseCallback callback) {
+  pose_callback_ = std::move(callback);
+}
+
+void LidarOdometry::SetCommitCallback(CommitCallback callback) {
+  commit_callback_ = std::move(callback);
+}
+
+void LidarOdometry::Finish() {
+  OdometryCommit commit;
+  commit.sample_states.assign(sample_states_sld_win_.begin(), sample_states_sld_win_.end());
+  commit.imu_states.assign(imu_states_sld_win_.begin(), imu_states_sld_win_.end());
+  commit.surfels.assign(surfels_sld_win_.begin(), surfels_sld_win_.end());
+  sample_states_sld_win_.clear();
+  imu_states_sld_win_.clear();
+  surfels_sld_win_.clear();
+  HandOverCommit(std::move(commit));
+}
+
+void LidarOdometry::HandOverCommit(OdometryCommit &&commit) {
+  if (commit.sample_states.empty()) {
+    return;
+  }
+  if (commit_callback_) {
+    commit_callback_(commit);
+  }
+  if (surfel_map_writer_ && !surfel_map_writer_->AddCommit(commit)) {
+    LOG(WARNING) << "Surfel map queue is full, commit of sweep " << sweep_id_ << " dropped.";
+  }
+  if (dense_map_ && !dense_map_->AddCommit(commit)) {
+    LOG(WARNING) << "Dense map queue is full, commit of sweep " << sweep_id_ << " dropped.";
+  }
+  if (backend_ && !backend_->AddCommit(std::move(commit))) {
+    LOG(WARNING) << "Backend queue is full, commit of sweep " << sweep_id_ << " dropped.";
+  }
+}
+
+std::unique_ptr<OdometrySnapshot> LidarOdometry::TakeSnapshot() const {
+  auto snapshot = std::make_unique<OdometrySnapshot>();
+  for (int i = 0; i < sample_states_sld_win_.size(); ++i) {
+    snapshot->sample_states.push_back(CopySampleState(*sample_states_sld_win_[i]));
+    if (sample_states_sld_win_[i] == first_sample_state_) {
+      snapshot->first_sample_state_index = i;
+    }
+  }
+  snapshot->imu_states.assign(imu_states_sld_win_.begin(), imu_states_sld_win_.end());
+  for (const auto &surfel : surfels_sld_win_) {
+    snapshot->surfels_sld_win.push_back(std::make_shared<Surfel>(*surfel));
+  }
+  // the localization map surfels are reloaded from the map instead
+  if (!localization_map_) {
+    snapshot->surfels_fix_win.assign(surfels_fix_win_.begin(), surfels_fix_win_.end());
+  }
+  snapshot->imu_buff.assign(imu_buff_.begin(), imu_buff_.end());
+  snapshot->points_buff.assign(points_buff_.begin(), points_buff_.end());
+  snapshot->sync_done    = sync_done_;
+  snapshot->init_sld_win = init_sld_win_;
+  snapshot->sweep_id     = sweep_id_;
+  return snapshot;
+}
+
+void LidarOdometry::SaveCheckpoint(const std::string &filename) {
+  if (!checkpoint_writer_) {
+    checkpoint_writer_.reset(new CheckpointWriter);
+  }
+  checkpoint_writer_->Write(TakeSnapshot(), filename);
+}
+
+bool LidarOdometry::RestoreCheckpoint(const std::string &filename) {
+  CHECK(!init_sld_win_ && imu_buff_.empty() && points_buff_.empty()) << "Restore a checkpoint before adding any data.";
+
+  auto             start = std::chrono::steady_clock::now();
+  OdometrySnapshot snapshot;
+  if (!ReadCheckpoint(filename, &snapshot)) {
+    return false;
+  }
+
+  sample_states_sld_win_.assign(snapshot.sample_states.begin(), snapshot.sample_states.end());
+  first_sample_state_ = snapshot.first_sample_state_index >= 0 ? snapshot.sample_states[snapshot.first_sample_state_index] : nullptr;
+  imu_states_sld_win_.assign(snapshot.imu_states.begin(), snapshot.imu_states.end());
+  surfels_sld_win_.assign(snapshot.surfels_sld_win.begin(), snapshot.surfels_sld_win.end());
+  surfels_fix_win_.assign(snapshot.surfels_fix_win.begin(), snapshot.surfels_fix_win.end());
+  imu_buff_.assign(snapshot.imu_buff.begin(), snapshot.imu_buff.end());
+  points_buff_.assign(snapshot.points_buff.begin(), snapshot.points_buff.end());
+  sync_done_    = snapshot.sync_done;
+  init_sld_win_ = snapshot.init_sld_win;
+  sweep_id_     = snapshot.sweep_id;
+
+  if (!imu_states_sld_win_.empty()) {
+    resume_imu_time_ = imu_states_sld_win_.back().timestamp;
+  }
+  if (!imu_buff_.empty()) {
+    resume_imu_time_ = std::max(resume_imu_time_, imu_buff_.back().timestamp);
+  }
+  if (!sample_states_sld_win_.empty()) {
+    resume_point_time_ = checkpoint_time_ = sample_states_sld_win_.back()->timestamp;
+  }
+  if (!points_buff_.empty()) {
+    resume_point_time_ = std::max(resume_point_time_, points_buff_.back().time);
+  }
+
+  LOG(INFO) << "Restored checkpoint " << filename << " at sweep " << sweep_id_ << " with sample_states_" << sample_states_sld_win_.size()
+            << " surfels_" << surfels_sld_win_.size() << "+" << surfels_fix_win_.size() << " in "
+            << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+  return true;
+}
+
+LidarOdometry::LidarOdometry(const LioConfig &config) : config_(config) {
+  std::string topic_prefix = config_.instance_name.empty() ? "" : "/" + config_.instance_name;
+  std::string frame_prefix = config_.instance_name.empty() ? "" : config_.instance_name + "/";
+  map_frame_               = frame_prefix + "map";
+  world_frame_             = frame_prefix + "world";
+  imu_frame_               = frame_prefix + "imu_link";
+
+  surfel_extraction_options_.voxel_size            = config_.surfel_voxel_size;
+  surfel_extraction_options_.max_layer             = config_.surfel_max_layer;
+  surfel_extraction_options_.layer_point_size      = config_.surfel_layer_point_size;
+  surfel_extraction_options_.planer_threshold      = config_.surfel_planer_threshold;
+  surfel_extraction_options_.min_plane_likeness    = config_.surfel_min_plane_likeness;
+  surfel_extraction_options_.cluster_time_gap      = config_.surfel_cluster_time_gap;
+  surfel_extraction_options_.cluster_point_num_min = config_.surfel_cluster_point_num_min;
+  surfel_extraction_options_.deterministic         = config_.deterministic;
+
+  surfel_matcher_options_ = KnnSurfelMatcherOptionsFromConfig(config_);
+
+  surfel_fusion_options_.center_dist_factor     = config_.fusion_center_dist_factor;
+  surfel_fusion_options_.angular_dist_threshold = config_.fusion_angular_dist_threshold;
+  surfel_fusion_options_.surfel_dist_threshold  = config_.fusion_surfel_dist_threshold;
+  surfel_fusion_options_.max_fused_num          = config_.fusion_max_fused_num;
+  CHECK_GT(surfel_fusion_options_.center_dist_factor, 0);
+  CHECK_GT(surfel_extraction_options_.layer_point_size.size(), surfel_extraction_options_.max_layer) << "One surfel_layer_point_size per layer is required.";
+
+  lidar_.ext_lidar2imu      = config_.ext_lidar2imu;
+  lidar_.blind_bounding_box = config_.blind_bounding_box;
+  if (!config_.extra_lidars.empty()) {
+    std::vector<LidarSensorConfig> lidars = {lidar_};
+    lidars.insert(lidars.end(), config_.extra_lidars.begin(), config_.extra_lidars.end());
+    lidar_merger_.reset(new LidarMerger(lidars, config_.min_range, config_.max_range, config_.lidar_merge_max_lookahead));
+    LOG(INFO) << "Merging scans of " << lidars.size() << " lidars.";
+  }
+  if (config_.enable_ros_output) {
+    nh_.reset(new ros::NodeHandle);
+    tf_broadcaster_.reset(new tf::TransformBroadcaster);
+    pub_plane_map_         = nh_->advertise<visualization_msgs::MarkerArray>(topic_prefix + "/current_planes", 10);
+    pub_scan_in_imu_frame_ = nh_->advertise<sensor_msgs::PointCloud2>(topic_prefix + "/scan_in_imu_frame", 10);
+  }
+
+  if (config_.enable_backend) {
+    PoseGraphBackendOptions backend_options;
+    backend_options.registration.loss_scale        = config_.lidar_loss_scale;
+    backend_options.registration.matcher           = surfel_matcher_options_;
+    backend_options.coarse_registration.loss_scale = config_.lidar_loss_scale;
+    backend_options.coarse_registration.matcher    = surfel_matcher_options_;
+    backend_.reset(new PoseGraphBackend(backend_options));
+  }
+
+  if (!config_.dense_map_dir.empty()) {
+    DenseMapOptions dense_map_options;
+    dense_map_options.output_dir = config_.dense_map_dir;
+    dense_map_options.voxel_size = config_.dense_map_voxel_size;
+    dense_map_.reset(new DenseMapAccumulator(dense_map_options));
+  }
+
+  if (!config_.localization_map_filename.empty()) {
+    localization_map_.reset(new LocalizationMap);
+    CHECK(localization_map_->Open(config_.localization_map_filename)) << "Failed to open localization map " << config_.localization_map_filename;
+    LOG(INFO) << "Localizing against map with tiles_" << localization_map_->TileNum() << " surfels_" << localization_map_->SurfelNum();
+
+    MapTileCacheOptions cache_options;
+    cache_options.capacity_surfel_num = config_.localization_map_cache_surfel_num;
+    cache_options.prefetch_time       = config_.localization_map_prefetch_time;
+    localization_map_cache_.reset(new MapTileCache(*localization_map_, cache_options));
+  }
+
+  if (!config_.surfel_map_filename.empty()) {
+    surfel_map_writer_.reset(new SurfelMapWriter(config_.surfel_map_filename));
+  }
+
+  if (config_.enable_shm_output) {
+    shm_writer_.reset(new ShmOdometryWriter(config_.shm_channel_name, config_.shm_pose_slot_num, config_.shm_sweep_slot_num, config_.shm_sweep_max_points));
+  }
 }
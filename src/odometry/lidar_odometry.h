@@ -3,14 +3,51 @@
 #include <ceres/ceres.h>
 #include <ros/node_handle.h>
 #include <sensor_msgs/PointCloud2.h>
+#include <tf/transform_broadcaster.h>
 #include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
 
+#include "io/shm_odometry_channel.h"
+#include "io/surfel_map_file.h"
+#include "mapping/dense_map_accumulator.h"
+#include "mapping/map_tile_cache.h"
+#include "mapping/pose_graph_backend.h"
+#include "odometry/checkpoint.h"
+#include "odometry/knn_surfel_matcher.h"
+#include "odometry/lidar_merger.h"
 #include "odometry/lio_config.h"
+#include "odometry/odometry_commit.h"
+#include "odometry/surfel_fusion.h"
 #include "surfel_extraction.h"
 
 class LidarOdometry {
  public:
-  LidarOdometry();
+  using PoseCallback   = std::function<void(double timestamp, const Rigid3d &pose)>;
+  using CommitCallback = std::function<void(const OdometryCommit &commit)>;
+
+  explicit LidarOdometry(const LioConfig &config = LioConfig());
+
+  /**
+   * @brief Set a callback invoked with the pose of the latest sample state after every sweep
+   *
+   */
+  void SetPoseCallback(PoseCallback callback);
+
+  /**
+   * @brief Set a callback invoked with the states leaving the sliding window after every sweep
+   *
+   * Surfels are still referenced by the fixed window, the callback must not modify them while the odometry runs.
+   */
+  void SetCommitCallback(CommitCallback callback);
+
+  /**
+   * @brief Commit everything left in the sliding window, call once after the last scan
+   *
+   */
+  void Finish();
 
   /**
    * @brief Add raw imu measurements to queue
@@ -21,8 +58,27 @@ class LidarOdometry {
   /**
    * @brief Add raw lidar points with timestamp
    *
+   * @param lidar_id 0 for the lidar of ext_lidar2imu, i for extra_lidars[i - 1]. Scans of several lidars are merged
+   * by point time on background threads, a single lidar is processed in place. Points older than the newest one by
+   * less than point_reorder_window are put in order, older ones are dropped.
    */
-  void AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &msg);
+  void AddLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &msg, int lidar_id = 0);
+
+  /**
+   * @brief Snapshot the current state and write it to a checkpoint on a background thread
+   *
+   */
+  void SaveCheckpoint(const std::string &filename);
+
+  /**
+   * @brief Continue from a checkpoint, call before adding any data
+   *
+   * Imu measurements and points not newer than the ones in the checkpoint are skipped afterwards, so a replay can
+   * start before the checkpoint. The backend and map outputs start empty.
+   *
+   * @return false if the checkpoint can not be read
+   */
+  bool RestoreCheckpoint(const std::string &filename);
 
  private:
   /**
@@ -44,14 +100,34 @@ class LidarOdometry {
    */
   bool SyncHeadingMsgs();
 
-  void BuildSldWinLidarResiduals(const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids);
+  /**
+   * @brief Merge time sorted points into points_buff, dropping the ones older than the reorder window
+   */
+  void MergeIntoPointsBuff(const std::vector<hilti_ros::Point> &points);
 
-  void BuildFixWinLidarResiduals(const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids);
+  /**
+   * @brief Write the latest pose and the undistorted sweep to shared memory
+   *
+   * @param pose_covariance row major 6x6 covariance of [rotation, position], or nullptr if unavailable
+   * @param sweep_undistorted
+   */
+  void WriteShmOutput(const double *pose_covariance, const std::vector<hilti_ros::Point> &sweep_undistorted);
 
-  void BuildImuResiduals(const std::deque<ImuState> &imu_states, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids);
+  /**
+   * @brief Pass a commit to the commit callback, the surfel map writer, the dense map and the backend
+   */
+  void HandOverCommit(OdometryCommit &&commit);
+
+  /**
+   * @brief Copy the state, the fixed window surfels are shared as the odometry never modifies them
+   */
+  std::unique_ptr<OdometrySnapshot> TakeSnapshot() const;
 
  private:
-  LioConfig config_;
+  LioConfig               config_;
+  SurfelExtractionOptions surfel_extraction_options_;
+  KnnSurfelMatcherOptions surfel_matcher_options_;
+  SurfelFusionOptions     surfel_fusion_options_;  // used if fuse_fixed_window_surfels
 
   std::deque<Surfel::Ptr>      surfels_sld_win_;
   std::deque<Surfel::Ptr>      surfels_fix_win_;
@@ -60,10 +136,37 @@ class LidarOdometry {
 
   std::deque<ImuData>          imu_buff_;
   std::deque<hilti_ros::Point> points_buff_;
+  LidarSensorConfig            lidar_;                       // of ext_lidar2imu
+  std::unique_ptr<LidarMerger> lidar_merger_;                // null for a single lidar
+  int64_t                      late_point_num_         = 0;  // dropped by lidar_merger
+  int64_t                      reorder_late_point_num_ = 0;  // dropped for being older than point_reorder_window
+
+  std::unique_ptr<ros::NodeHandle>          nh_;  // null if ros output is disabled
+  ros::Publisher                            pub_plane_map_;
+  ros::Publisher                            pub_scan_in_imu_frame_;
+  std::unique_ptr<tf::TransformBroadcaster> tf_broadcaster_;
+  std::string                               map_frame_;
+  std::string                               world_frame_;
+  std::string                               imu_frame_;
+  PoseCallback                              pose_callback_;
+  CommitCallback                            commit_callback_;
 
-  ros::NodeHandle nh_;
-  ros::Publisher  pub_plane_map_;
-  ros::Publisher  pub_scan_in_imu_frame_;
+  std::unique_ptr<ShmOdometryWriter>   shm_writer_;
+  std::unique_ptr<PoseGraphBackend>    backend_;
+  std::unique_ptr<SurfelMapWriter>     surfel_map_writer_;
+  std::unique_ptr<DenseMapAccumulator> dense_map_;
+  std::unique_ptr<LocalizationMap>     localization_map_;  // null unless in localization mode
+  std::unique_ptr<MapTileCache>        localization_map_cache_;
+  KnnSurfelMatcher                     localization_map_matcher_;
+  std::unique_ptr<CheckpointWriter>    checkpoint_writer_;
+
+  bool             sync_done_    = false;
+  bool             init_sld_win_ = false;
+  SampleState::Ptr first_sample_state_;  // the only sample state whose position is fixed in the optimization
 
   int sweep_id_ = 0;
+
+  double checkpoint_time_   = std::numeric_limits<double>::lowest();  // sensor time of the last periodic checkpoint
+  double resume_imu_time_   = std::numeric_limits<double>::lowest();  // older data was restored from a checkpoint
+  double resume_point_time_ = std::numeric_limits<double>::lowest();
 };
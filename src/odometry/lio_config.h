@@ -2,18 +2,29 @@
 
 #include <Eigen/Eigen>
 #include <cmath>
+#include <string>
+#include <vector>
 
 #include "common/rigid_transform.h"
+#include "common/thread_utils.h"
+
+/**
+ * @brief Mounting of an additional lidar
+ */
+struct LidarSensorConfig {
+  Rigid3d                      ext_lidar2imu;
+  Eigen::AlignedBox<double, 3> blind_bounding_box;       // in imu_link, empty by default
+  std::string                  point_layout = "hesai";  // see lidar_point_layout
+};
 
 struct LioConfig {
- private:
+  ///////////////////// Imu noise parameters, call UpdateImuCostWeights after changing them or imu_rate //////////////////////
   double gyroscope_noise_density     = 0.00015198973532354657;
   double accelerometer_noise_density = 0.006308226052016165;
   double gyroscope_random_walk       = 0.00011673723527962174;
   double accelerometer_random_walk   = 2.664506559330434e-06;
   double imu_factor_weight           = 0.01;  // a weight factor between imu factor and lidar factor
 
- public:
   ///////////////////// Preprocess parameters //////////////////////
   double                       max_range = 120;
   double                       min_range = 0.3;
@@ -27,6 +38,10 @@ struct LioConfig {
            -1, -5.32125e-08, -0,
            0, 0, -1)
               .finished())};
+  std::string                    lidar_point_layout        = "hesai";  // PointCloud2 layout of the driver: hesai, ouster, velodyne or livox
+  std::vector<LidarSensorConfig> extra_lidars;                          // lidars 1, 2, ..., the one above is lidar 0
+  double                         lidar_merge_max_lookahead = 0.3;       // a lidar lagging behind the others by more is not waited for, in seconds
+  double                         point_reorder_window      = 0;         // points up to this much older than the newest one are put in order, older ones are dropped, in seconds. Adds its latency to every sweep, set it for lidars sending packets out of order
 
   ///////////////////// Sliding window preprocess parameters //////////////////////
   double imu_rate                = 200;   // imu rate in Hz
@@ -43,4 +58,81 @@ struct LioConfig {
   double accelerometer_noise_density_cost_weight = 1 / (accelerometer_noise_density * sqrt(imu_rate)) * imu_factor_weight;
   double gyroscope_random_walk_cost_weight       = 1 / (gyroscope_random_walk / sqrt(imu_rate)) * imu_factor_weight;
   double accelerometer_random_walk_cost_weight   = 1 / (accelerometer_random_walk / sqrt(imu_rate)) * imu_factor_weight;
+  double lidar_loss_scale                        = 0.4;    // scale of the Cauchy loss of surfel residuals, in meters
+  int    solver_num_threads                      = 1;      // ceres threads of the window optimization
+  bool   float_lidar_residuals                   = false;  // evaluate surfel residuals and jacobians in float, ceres still solves in double
+
+  ///////////////////// Surfel extraction parameters //////////////////////
+  double           surfel_voxel_size            = 0.8;  // root voxel size of the octo trees, in meters
+  int              surfel_max_layer             = 2;
+  std::vector<int> surfel_layer_point_size      = {20, 20, 20, 20};  // min points to fit a plane, per layer up to surfel_max_layer
+  double           surfel_planer_threshold      = 0.01;              // max smallest eigen value of a plane
+  double           surfel_min_plane_likeness    = 0.1;
+  double           surfel_cluster_time_gap      = 0.05;  // plane points further apart in time start a new surfel, in seconds
+  int              surfel_cluster_point_num_min = 20;
+
+  ///////////////////// Surfel matching parameters //////////////////////
+  double match_center_dist_threshold         = 1.0;                 // center distance weighted like the angular threshold in the knn search, in meters
+  double match_angular_dist_threshold        = 5.0 * M_PI / 180.0;  // in radians
+  double match_surfel_dist_threshold         = 0.1;                 // max distance of the target center to the query plane, in meters
+  int    match_nearest_surfel_candidates_num = 10;                  // nearest surfels checked per query
+  double match_time_diff_threshold           = 0.06;                // surfels closer in time are never matched, in seconds
+
+  ///////////////////// Fixed window surfel fusion parameters //////////////////////
+  bool   fuse_fixed_window_surfels     = false;               // fuse co-planar, co-located surfels entering the fixed window into one
+  double fusion_center_dist_factor     = 0.5;                 // max center distance of fused surfels, in multiples of their resolution
+  double fusion_angular_dist_threshold = 5.0 * M_PI / 180.0;  // in radians
+  double fusion_surfel_dist_threshold  = 0.05;                // max distance of either center to the other plane, in meters
+  int    fusion_max_fused_num          = 20;                  // surfels fused into one at most
+
+  ///////////////////// Backend parameters //////////////////////
+  bool enable_backend = false;  // correct drift by a submap pose graph on a separate thread, published as map -> world
+
+  ///////////////////// Localization parameters //////////////////////
+  std::string localization_map_filename         = "";         // if set, localize against this prebuilt map, which replaces the fixed window
+  Rigid3d     localization_initial_pose;                      // imu pose in the map frame at start
+  double      localization_map_radius           = 60.0;       // map tiles within this radius of the latest pose are active, in meters
+  uint64_t    localization_map_cache_surfel_num = 2'000'000;  // resident map surfels, least recently used tiles are evicted beyond
+  double      localization_map_prefetch_time    = 5.0;        // tiles reached within this time are loaded ahead on an I/O thread, in seconds
+
+  ///////////////////// Output parameters //////////////////////
+  bool        enable_ros_output    = true;   // publish topics and tf, requires a running ros master
+  std::string instance_name        = "";     // if set, topics are published under /<instance_name>/ and tf frames are prefixed with <instance_name>/
+  bool        enable_shm_output    = false;  // publish poses and undistorted sweeps to shared memory for same-host readers
+  std::string shm_channel_name     = "/wildcat_slam";
+  int         shm_pose_slot_num    = 256;
+  int         shm_sweep_slot_num   = 8;
+  int         shm_sweep_max_points = 300000;
+  std::string surfel_map_filename  = "";  // if set, committed surfels and poses are streamed to this binary surfel map file
+  std::string dense_map_dir        = "";  // if set, finalized undistorted sweeps are accumulated into voxel deduplicated PLY tiles in this directory
+  double      dense_map_voxel_size = 0.1;
+
+  ///////////////////// Checkpoint parameters //////////////////////
+  std::string checkpoint_filename = "";    // if set, the odometry state is written to this file periodically on a background thread
+  double      checkpoint_period   = 10.0;  // in seconds of sensor time
+
+  ///////////////////// Thread parameters //////////////////////
+  std::vector<ThreadConfig> threads;              // by name: odometry, lidar_filter, backend, checkpoint, surfel_writer, dense_map, map_prefetch, dataset_prefetch
+  bool                      lock_memory = false;  // mlockall the process on start, so that page faults do not stall the threads
+
+  ///////////////////// Reproducibility parameters //////////////////////
+  // Bit-identical reruns at any thread count, every stage whose result could depend on thread count or timing is fixed:
+  // - surfel extraction: surfels in voxel key order, not in the order of the hash map, whose seed changes per process
+  // - lidar filter threads: merged scans are released only after every filter thread is idle, the k-way merge by
+  //   point time then sees the same points whatever the thread timing
+  // - bag reader threads: chunks are merged in index order through a reorder buffer keyed by record time and merge
+  //   sequence, so the message order does not depend on which thread decompressed a chunk
+  // - window solve and batch refinement: ceres sums costs and gradients per thread and then across threads, in an
+  //   order set by its thread count, which cannot be fixed from outside. Both run single threaded, ignoring
+  //   solver_num_threads and BatchRefinementOptions::num_threads. Residual blocks are added in surfel order, so the
+  //   serial sums are stable
+  // - backend, surfel writer, dense map and checkpoint threads only consume commits, nothing flows back into the odometry
+  bool deterministic = false;
+
+  void UpdateImuCostWeights() {
+    gyroscope_noise_density_cost_weight     = 1 / (gyroscope_noise_density * sqrt(imu_rate)) * imu_factor_weight;
+    accelerometer_noise_density_cost_weight = 1 / (accelerometer_noise_density * sqrt(imu_rate)) * imu_factor_weight;
+    gyroscope_random_walk_cost_weight       = 1 / (gyroscope_random_walk / sqrt(imu_rate)) * imu_factor_weight;
+    accelerometer_random_walk_cost_weight   = 1 / (accelerometer_random_walk / sqrt(imu_rate)) * imu_factor_weight;
+  }
 };
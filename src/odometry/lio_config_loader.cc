@@ -0,0 +1,259 @@
+#include "odometry/lio_config_loader.h"
+
+#include <glog/logging.h>
+#include <google/protobuf/text_format.h>
+#include <fstream>
+#include <sstream>
+
+#include "proto/lio_config.pb.h"
+#include "sensor/point_cloud_decoder.h"
+
+// fields with the same name and a scalar type in LioConfig and the proto
+#define LIO_CONFIG_SCALAR_FIELDS(X)          \
+  X(gyroscope_noise_density)                 \
+  X(accelerometer_noise_density)             \
+  X(gyroscope_random_walk)                   \
+  X(accelerometer_random_walk)               \
+  X(imu_factor_weight)                       \
+  X(max_range)                               \
+  X(min_range)                               \
+  X(lidar_merge_max_lookahead)               \
+  X(lidar_point_layout)                      \
+  X(point_reorder_window)                    \
+  X(imu_rate)                                \
+  X(sample_dt)                               \
+  X(fixed_window_duration)                   \
+  X(sliding_window_duration)                 \
+  X(sweep_duration)                          \
+  X(gravity_norm)                            \
+  X(outer_iter_num_max)                      \
+  X(inner_iter_num_max)                      \
+  X(lidar_loss_scale)                        \
+  X(solver_num_threads)                      \
+  X(float_lidar_residuals)                   \
+  X(surfel_voxel_size)                       \
+  X(surfel_max_layer)                        \
+  X(surfel_planer_threshold)                 \
+  X(surfel_min_plane_likeness)               \
+  X(surfel_cluster_time_gap)                 \
+  X(surfel_cluster_point_num_min)            \
+  X(match_center_dist_threshold)             \
+  X(match_angular_dist_threshold)            \
+  X(match_surfel_dist_threshold)             \
+  X(match_nearest_surfel_candidates_num)     \
+  X(match_time_diff_threshold)               \
+  X(fuse_fixed_window_surfels)               \
+  X(fusion_center_dist_factor)               \
+  X(fusion_angular_dist_threshold)           \
+  X(fusion_surfel_dist_threshold)            \
+  X(fusion_max_fused_num)                    \
+  X(enable_backend)                          \
+  X(localization_map_filename)               \
+  X(localization_map_radius)                 \
+  X(localization_map_cache_surfel_num)       \
+  X(localization_map_prefetch_time)          \
+  X(enable_ros_output)                       \
+  X(instance_name)                           \
+  X(enable_shm_output)                       \
+  X(shm_channel_name)                        \
+  X(shm_pose_slot_num)                       \
+  X(shm_sweep_slot_num)                      \
+  X(shm_sweep_max_points)                    \
+  X(surfel_map_filename)                     \
+  X(dense_map_dir)                           \
+  X(dense_map_voxel_size)                    \
+  X(checkpoint_filename)                     \
+  X(checkpoint_period)                       \
+  X(lock_memory)                             \
+  X(deterministic)
+
+namespace {
+
+Eigen::Vector3d FromProto(const wildcat_slam::proto::Vector3 &proto) {
+  return Eigen::Vector3d(proto.x(), proto.y(), proto.z());
+}
+
+Eigen::Quaterniond FromProto(const wildcat_slam::proto::Quaternion &proto) {
+  return Eigen::Quaterniond(proto.w(), proto.x(), proto.y(), proto.z()).normalized();
+}
+
+Rigid3d FromProto(const wildcat_slam::proto::Rigid3 &proto) {
+  return Rigid3d(FromProto(proto.translation()), FromProto(proto.rotation()));
+}
+
+Eigen::AlignedBox3d FromProto(const wildcat_slam::proto::AlignedBox3 &proto) {
+  return Eigen::AlignedBox3d(FromProto(proto.min()), FromProto(proto.max()));
+}
+
+void ToProto(const Eigen::Vector3d &value, wildcat_slam::proto::Vector3 *proto) {
+  proto->set_x(value.x());
+  proto->set_y(value.y());
+  proto->set_z(value.z());
+}
+
+void ToProto(const Eigen::Quaterniond &value, wildcat_slam::proto::Quaternion *proto) {
+  proto->set_w(value.w());
+  proto->set_x(value.x());
+  proto->set_y(value.y());
+  proto->set_z(value.z());
+}
+
+void ToProto(const Rigid3d &value, wildcat_slam::proto::Rigid3 *proto) {
+  ToProto(value.translation(), proto->mutable_translation());
+  ToProto(value.rotation(), proto->mutable_rotation());
+}
+
+void ToProto(const Eigen::AlignedBox3d &value, wildcat_slam::proto::AlignedBox3 *proto) {
+  ToProto(value.min(), proto->mutable_min());
+  ToProto(value.max(), proto->mutable_max());
+}
+
+}  // namespace
+
+std::vector<std::string> LioConfigPresetNames() {
+  return {"low_power", "balanced", "max_accuracy"};
+}
+
+bool ApplyLioConfigPreset(const std::string &preset, LioConfig *config) {
+  if (preset == "low_power") {
+    config->sample_dt                           = 0.1;
+    config->fixed_window_duration               = 10.0;
+    config->sliding_window_duration             = 4.0;
+    config->inner_iter_num_max                  = 20;
+    config->surfel_voxel_size                   = 1.2;
+    config->surfel_max_layer                    = 1;
+    config->match_nearest_surfel_candidates_num = 5;
+  } else if (preset == "balanced") {
+    // the compiled-in defaults
+  } else if (preset == "max_accuracy") {
+    config->sample_dt                           = 0.05;
+    config->fixed_window_duration               = 30.0;
+    config->outer_iter_num_max                  = 2;
+    config->inner_iter_num_max                  = 200;
+    config->surfel_voxel_size                   = 0.6;
+    config->surfel_max_layer                    = 3;
+    config->match_nearest_surfel_candidates_num = 15;
+  } else {
+    LOG(ERROR) << "Unknown config preset " << preset;
+    return false;
+  }
+  return true;
+}
+
+bool ParseLioConfig(const std::string &text, LioConfig *config) {
+  wildcat_slam::proto::LioConfig proto;
+  if (!google::protobuf::TextFormat::ParseFromString(text, &proto)) {
+    return false;
+  }
+  if (proto.has_preset() && !ApplyLioConfigPreset(proto.preset(), config)) {
+    return false;
+  }
+
+#define LIO_CONFIG_FROM_PROTO(name) \
+  if (proto.has_##name()) {         \
+    config->name = proto.name();    \
+  }
+  LIO_CONFIG_SCALAR_FIELDS(LIO_CONFIG_FROM_PROTO)
+#undef LIO_CONFIG_FROM_PROTO
+
+  if (proto.surfel_layer_point_size_size() > 0) {
+    config->surfel_layer_point_size.assign(proto.surfel_layer_point_size().begin(), proto.surfel_layer_point_size().end());
+  }
+  if (proto.has_blind_bounding_box()) {
+    config->blind_bounding_box = FromProto(proto.blind_bounding_box());
+  }
+  if (proto.has_ext_lidar2imu()) {
+    config->ext_lidar2imu = FromProto(proto.ext_lidar2imu());
+  }
+  if (proto.extra_lidars_size() > 0) {
+    config->extra_lidars.clear();
+    for (const auto &lidar_proto : proto.extra_lidars()) {
+      LidarSensorConfig lidar;
+      lidar.ext_lidar2imu = FromProto(lidar_proto.ext_lidar2imu());
+      if (lidar_proto.has_blind_bounding_box()) {
+        lidar.blind_bounding_box = FromProto(lidar_proto.blind_bounding_box());
+      }
+      if (lidar_proto.has_point_layout()) {
+        lidar.point_layout = lidar_proto.point_layout();
+      }
+      config->extra_lidars.push_back(lidar);
+    }
+  }
+  if (proto.has_localization_initial_pose()) {
+    config->localization_initial_pose = FromProto(proto.localization_initial_pose());
+  }
+  if (proto.threads_size() > 0) {
+    config->threads.clear();
+    for (const auto &thread_proto : proto.threads()) {
+      config->threads.push_back({thread_proto.name(), thread_proto.cpu_list(), thread_proto.fifo_priority()});
+    }
+  }
+  LidarPointLayout layout;
+  if (!ParseLidarPointLayout(config->lidar_point_layout, &layout)) {
+    LOG(ERROR) << "Unknown lidar point layout " << config->lidar_point_layout;
+    return false;
+  }
+  for (const auto &lidar : config->extra_lidars) {
+    if (!ParseLidarPointLayout(lidar.point_layout, &layout)) {
+      LOG(ERROR) << "Unknown lidar point layout " << lidar.point_layout;
+      return false;
+    }
+  }
+  for (const auto &thread : config->threads) {
+    std::vector<int> cpus;
+    if (!ParseCpuList(thread.cpu_list, &cpus) || thread.fifo_priority < 0 || thread.fifo_priority > 99) {
+      LOG(ERROR) << "Invalid cpu list " << thread.cpu_list << " or priority " << thread.fifo_priority << " of thread " << thread.name;
+      return false;
+    }
+  }
+  config->UpdateImuCostWeights();
+  return true;
+}
+
+bool LoadLioConfig(const std::string &filename, LioConfig *config) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    LOG(ERROR) << "Failed to open config " << filename;
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  if (!ParseLioConfig(buffer.str(), config)) {
+    LOG(ERROR) << "Failed to parse config " << filename;
+    return false;
+  }
+  return true;
+}
+
+std::string LioConfigToString(const LioConfig &config) {
+  wildcat_slam::proto::LioConfig proto;
+
+#define LIO_CONFIG_TO_PROTO(name) proto.set_##name(config.name);
+  LIO_CONFIG_SCALAR_FIELDS(LIO_CONFIG_TO_PROTO)
+#undef LIO_CONFIG_TO_PROTO
+
+  for (int point_size : config.surfel_layer_point_size) {
+    proto.add_surfel_layer_point_size(point_size);
+  }
+  ToProto(config.blind_bounding_box, proto.mutable_blind_bounding_box());
+  ToProto(config.ext_lidar2imu, proto.mutable_ext_lidar2imu());
+  for (const auto &lidar : config.extra_lidars) {
+    auto *lidar_proto = proto.add_extra_lidars();
+    ToProto(lidar.ext_lidar2imu, lidar_proto->mutable_ext_lidar2imu());
+    lidar_proto->set_point_layout(lidar.point_layout);
+    if (!lidar.blind_bounding_box.isEmpty()) {
+      ToProto(lidar.blind_bounding_box, lidar_proto->mutable_blind_bounding_box());
+    }
+  }
+  ToProto(config.localization_initial_pose, proto.mutable_localization_initial_pose());
+  for (const auto &thread : config.threads) {
+    auto *thread_proto = proto.add_threads();
+    thread_proto->set_name(thread.name);
+    thread_proto->set_cpu_list(thread.cpu_list);
+    thread_proto->set_fifo_priority(thread.fifo_priority);
+  }
+
+  std::string text;
+  google::protobuf::TextFormat::PrintToString(proto, &text);
+  return text;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "odometry/lio_config.h"
+
+/**
+ * @brief Names of the built-in presets, trading speed against accuracy
+ *
+ *   low_power:    coarser surfels, a shorter window and fewer iterations, for embedded cpus
+ *   balanced:     the compiled-in defaults
+ *   max_accuracy: finer surfels, denser sample states and a second outer iteration
+ */
+std::vector<std::string> LioConfigPresetNames();
+
+/**
+ * @brief Apply a preset on top of the current values
+ *
+ * @return false if the preset is unknown
+ */
+bool ApplyLioConfigPreset(const std::string &preset, LioConfig *config);
+
+/**
+ * @brief Parse a text format wildcat_slam.proto.LioConfig, see proto/lio_config.proto
+ *
+ * The preset field is applied first, then all other fields that are set. Fields that are not set keep their values.
+ *
+ * @return false on parse errors or an unknown preset
+ */
+bool ParseLioConfig(const std::string &text, LioConfig *config);
+
+/**
+ * @return false if the file can not be read or parsed
+ */
+bool LoadLioConfig(const std::string &filename, LioConfig *config);
+
+/**
+ * @brief All fields in text format, e.g. to log the effective configuration
+ */
+std::string LioConfigToString(const LioConfig &config);
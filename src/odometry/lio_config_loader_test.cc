@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include "odometry/lio_config_loader.h"
+
+TEST(LioConfigLoader, PresetAndOverrides) {
+  LioConfig config;
+  ASSERT_TRUE(ParseLioConfig(R"(
+      preset: "low_power"
+      surfel_voxel_size: 1.0
+      surfel_layer_point_size: [10, 15]
+      gyroscope_noise_density: 0.001
+      ext_lidar2imu { translation { x: 0.1 } rotation { w: 0 z: 1 } }
+  )",
+                             &config));
+  EXPECT_EQ(config.surfel_voxel_size, 1.0);  // field wins over preset
+  EXPECT_EQ(config.surfel_max_layer, 1);     // preset
+  EXPECT_EQ(config.sweep_duration, 0.5);     // default
+  EXPECT_EQ(config.surfel_layer_point_size, std::vector<int>({10, 15}));
+  EXPECT_TRUE(config.ext_lidar2imu.translation().isApprox(Eigen::Vector3d(0.1, 0, 0)));
+  EXPECT_NEAR(config.ext_lidar2imu.rotation().angularDistance(Eigen::Quaterniond(0, 0, 0, 1)), 0, 1e-9);
+  EXPECT_NEAR(config.gyroscope_noise_density_cost_weight, 1 / (0.001 * sqrt(config.imu_rate)) * config.imu_factor_weight, 1e-9);
+}
+
+TEST(LioConfigLoader, Invalid) {
+  LioConfig config;
+  EXPECT_FALSE(ParseLioConfig("preset: \"fastest\"", &config));
+  EXPECT_FALSE(ParseLioConfig("no_such_field: 1", &config));
+  EXPECT_FALSE(ParseLioConfig("threads { name: \"odometry\" cpu_list: \"3-1\" }", &config));
+  EXPECT_FALSE(LoadLioConfig("/nonexistent/config.pbtxt", &config));
+}
+
+TEST(LioConfigLoader, ToStringRoundTrip) {
+  for (const auto &preset : LioConfigPresetNames()) {
+    LioConfig config;
+    ASSERT_TRUE(ApplyLioConfigPreset(preset, &config));
+    config.localization_initial_pose = Rigid3d(Eigen::Vector3d(1, 2, 3), Eigen::Quaterniond(0, 0, 0, 1));
+    config.extra_lidars.resize(2);
+    config.extra_lidars[0].ext_lidar2imu      = Rigid3d(Eigen::Vector3d(0, 1, 0), Eigen::Quaterniond::Identity());
+    config.extra_lidars[0].blind_bounding_box = Eigen::AlignedBox3d(Eigen::Vector3d(-1, -1, -1), Eigen::Vector3d(1, 1, 1));
+    config.threads                            = {{"odometry", "2-3", 80}, {"backend", "4", 0}};
+
+    LioConfig parsed;
+    ASSERT_TRUE(ParseLioConfig(LioConfigToString(config), &parsed));
+    EXPECT_EQ(LioConfigToString(parsed), LioConfigToString(config));
+  }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+#include "odometry/surfel.h"
+
+/**
+ * @brief States leaving the sliding window after a sweep
+ *
+ * They are not optimized by the odometry anymore, so their poses are final. Timestamps are consecutive
+ * across commits, i.e. concatenating all commits of a run yields all states of the run.
+ */
+struct OdometryCommit {
+  std::vector<SampleState::Ptr> sample_states;
+  std::vector<ImuState>         imu_states;
+  std::vector<Surfel::Ptr>      surfels;
+};
@@ -0,0 +1,249 @@
+#include "odometry/odometry_problem.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <cfloat>
+#include <iomanip>
+
+#include "common/check.h"
+#include "common/histogram.h"
+#include "common/utils.h"
+#include "odometry/cost_functor.h"
+
+void PrintSurfelResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem, const std::string &window_type) {
+  if (residual_ids.empty()) {
+    return;
+  }
+  std::vector<double>             residuals;
+  double                          cost;
+  ceres::Problem::EvaluateOptions options;
+  options.apply_loss_function = true;
+  options.residual_blocks     = residual_ids;
+  problem.Evaluate(options, &cost, &residuals, nullptr, nullptr);
+  Histogram hist;
+  for (auto &e : residuals) {
+    hist.Add(e);
+  }
+  LOG(INFO) << window_type << " Surfel residuals, cost: " << cost << ", dist: " << hist.ToString(10);
+}
+
+void PrintImuResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem) {
+  if (residual_ids.empty()) {
+    return;
+  }
+  std::vector<double>             residuals;
+  double                          cost;
+  ceres::Problem::EvaluateOptions options;
+  options.apply_loss_function = true;
+  options.residual_blocks     = residual_ids;
+  problem.Evaluate(options, &cost, &residuals, nullptr, nullptr);
+  Histogram                hist[4];
+  std::vector<std::string> residual_types = {"gyro", "acc", "gyro_bias", "acc_bias"};
+  for (int i = 0; i < residuals.size(); i += 12) {
+    for (int j = 0; j < 4; ++j) {
+      auto residuals_part = Vector3d{residuals[i + j * 3], residuals[i + j * 3 + 1], residuals[i + j * 3 + 2]};
+      hist[j].Add(residuals_part.norm());
+    }
+  }
+  for (int j = 0; j < 4; ++j) {
+    LOG(INFO) << "Imu residuals with type " << residual_types[j] << ", cost: " << cost << ", dist: " << hist[j].ToString(10);
+  }
+}
+
+std::pair<int, int> UpdateImuPoses(const std::deque<SampleState::Ptr> &sample_states, std::deque<ImuState> &imu_states) {
+  std::pair<int, int>         corrected_range(-1, -1);
+  CubicBSplineSampleCorrector corrector(sample_states);
+  for (int i = 0; i < imu_states.size(); ++i) {
+    auto    &imu_state = imu_states[i];
+    Vector3d rot_cor, pos_cor;
+    if (corrector.GetCorr(imu_state.timestamp, rot_cor, pos_cor)) {
+      imu_state.rot = Exp(rot_cor) * imu_state.rot;
+      imu_state.pos = pos_cor + imu_state.pos;
+
+      if (corrected_range.first == -1) corrected_range.first = i;
+      corrected_range.second = i;
+    }
+  }
+  return corrected_range;
+}
+
+void UpdateSurfelPoses(const std::deque<ImuState> &imu_states, std::deque<Surfel::Ptr> &surfels) {
+  if (surfels.empty()) {
+    return;
+  }
+  // one cheap check per call, the surfels are not sorted by timestamp
+  auto [min_it, max_it] = std::minmax_element(surfels.begin(), surfels.end(), [](const Surfel::Ptr &a, const Surfel::Ptr &b) { return a->timestamp < b->timestamp; });
+  CHECK(imu_states.size() >= 2 && imu_states.front().timestamp < (*min_it)->timestamp && (*max_it)->timestamp <= imu_states.back().timestamp)
+      << std::fixed << std::setprecision(6) << "Surfels in [" << (*min_it)->timestamp << "," << (*max_it)->timestamp << "] are not covered by the imu states";
+  for (auto &surfel : surfels) {
+    auto it  = std::lower_bound(imu_states.begin(), imu_states.end(), surfel->timestamp, [](const ImuState &a, auto b) { return a.timestamp < b; });
+    auto idx = it - imu_states.begin();
+    DEBUG_CHECK(idx != 0 && idx != imu_states.size()) << idx;
+    double      factor = (surfel->timestamp - imu_states[idx - 1].timestamp) / (imu_states[idx].timestamp - imu_states[idx - 1].timestamp);
+    Vector3d    pos    = imu_states[idx - 1].pos * (1 - factor) + imu_states[idx].pos * factor;
+    Quaterniond rot    = imu_states[idx - 1].rot.slerp(factor, imu_states[idx].rot);
+    surfel->UpdatePose(pos, rot);
+  }
+}
+
+void UndistortSweep(const std::vector<hilti_ros::Point> &sweep_in,
+                    const std::deque<ImuState>          &imu_states,
+                    std::vector<hilti_ros::Point>       &sweep_out) {
+  sweep_out.clear();
+  if (sweep_in.empty()) {
+    return;
+  }
+  // one cheap check per call, the points are sorted by time
+  CHECK(imu_states.size() >= 2 && imu_states.front().timestamp < sweep_in.front().time && sweep_in.back().time <= imu_states.back().timestamp)
+      << std::fixed << std::setprecision(6) << "Sweep in [" << sweep_in.front().time << "," << sweep_in.back().time << "] is not covered by the imu states";
+  for (auto &pt : sweep_in) {
+    auto it  = std::lower_bound(imu_states.begin(), imu_states.end(), pt.time, [](const ImuState &a, auto b) { return a.timestamp < b; });
+    auto idx = it - imu_states.begin();
+    DEBUG_CHECK(idx >= 1 && idx < imu_states.size()) << idx;
+    double      factor      = (pt.time - imu_states[idx - 1].timestamp) / (imu_states[idx].timestamp - imu_states[idx - 1].timestamp);
+    Vector3d    pos         = imu_states[idx - 1].pos * (1 - factor) + imu_states[idx].pos * factor;
+    Quaterniond rot         = imu_states[idx - 1].rot.slerp(factor, imu_states[idx].rot);
+    auto        new_pt      = pt;
+    new_pt.getVector3fMap() = (rot * new_pt.getVector3fMap().cast<double>() + pos).cast<float>();
+    sweep_out.push_back(new_pt);
+  }
+}
+
+void UpdateSamplePoses(std::deque<SampleState::Ptr> &sample_states) {
+  for (auto &sample_state : sample_states) {
+    sample_state->rot = Exp(sample_state->rot_cor) * sample_state->rot;
+    sample_state->pos = sample_state->pos_cor + sample_state->pos;
+    sample_state->rot_cor.setZero();
+    sample_state->pos_cor.setZero();
+  }
+}
+
+namespace {
+
+template <int Mode>
+ceres::CostFunction *NewSurfelMatchBinaryFactor(const SurfelCorrespondence &surfel_corr, const SampleState::Ptr &sp1l, const SampleState::Ptr &sp1r, const SampleState::Ptr &sp2l, const SampleState::Ptr &sp2r, bool float_residuals) {
+  if (float_residuals) {
+    return new SurfelMatchBinaryFactor<Mode, float>(surfel_corr.s1, sp1l, sp1r, surfel_corr.s2, sp2l, sp2r);
+  }
+  return new SurfelMatchBinaryFactor<Mode>(surfel_corr.s1, sp1l, sp1r, surfel_corr.s2, sp2l, sp2r);
+}
+
+ceres::CostFunction *NewSurfelMatchUnaryFactor(const SurfelCorrespondence &surfel_corr, const SampleState::Ptr &sp2l, const SampleState::Ptr &sp2r, bool float_residuals) {
+  if (float_residuals) {
+    return new SurfelMatchUnaryFactor<float>(surfel_corr.s1, surfel_corr.s2, sp2l, sp2r);
+  }
+  return new SurfelMatchUnaryFactor<>(surfel_corr.s1, surfel_corr.s2, sp2l, sp2r);
+}
+
+}  // namespace
+
+void BuildBinaryLidarResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids, double loss_scale, bool float_residuals) {
+  for (const auto &surfel_corr : surfel_corrs) {
+    CHECK_LT(surfel_corr.s1->timestamp, surfel_corr.s2->timestamp) << std::fixed << std::setprecision(6) << surfel_corr.s1->timestamp << " " << surfel_corr.s2->timestamp;  // bug: disorder happens
+
+    auto sp1r_it = std::upper_bound(sample_states.begin(), sample_states.end(), surfel_corr.s1->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
+    CHECK(sp1r_it != sample_states.begin());
+    CHECK(sp1r_it != sample_states.end());
+
+    auto sp1l    = *(sp1r_it - 1);
+    auto sp1r    = *(sp1r_it);
+    auto sp2r_it = std::upper_bound(sample_states.begin(), sample_states.end(), surfel_corr.s2->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
+    CHECK(sp2r_it != sample_states.begin());
+    CHECK(sp2r_it != sample_states.end());
+    auto sp2l = *(sp2r_it - 1);
+    auto sp2r = *(sp2r_it);
+
+    auto loss_function = new ceres::CauchyLoss(loss_scale);
+    if (sp1r->timestamp < sp2l->timestamp) {
+      auto residual_id = problem.AddResidualBlock(
+          NewSurfelMatchBinaryFactor<0>(surfel_corr, sp1l, sp1r, sp2l, sp2r, float_residuals),
+          loss_function,
+          sp1l->data_cor,
+          sp1r->data_cor,
+          sp2l->data_cor,
+          sp2r->data_cor);
+      residual_ids.push_back(residual_id);
+    } else if (sp1r == sp2l) {
+      auto residual_id = problem.AddResidualBlock(
+          NewSurfelMatchBinaryFactor<1>(surfel_corr, sp1l, sp1r, sp2l, sp2r, float_residuals),
+          loss_function,
+          sp1l->data_cor,
+          sp1r->data_cor,
+          sp2r->data_cor);
+      residual_ids.push_back(residual_id);
+    } else {
+      auto residual_id = problem.AddResidualBlock(
+          NewSurfelMatchBinaryFactor<2>(surfel_corr, sp1l, sp1r, sp2l, sp2r, float_residuals),
+          loss_function,
+          sp1l->data_cor,
+          sp1r->data_cor);
+      residual_ids.push_back(residual_id);
+    }
+  }
+}
+
+void BuildUnaryLidarResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids, double loss_scale, bool float_residuals) {
+  for (const auto &surfel_corr : surfel_corrs) {
+    CHECK_LT(surfel_corr.s1->timestamp, surfel_corr.s2->timestamp) << std::fixed << std::setprecision(6) << surfel_corr.s1->timestamp << " " << surfel_corr.s2->timestamp;  // bug: disorder happens
+
+    auto sp2r_it = std::upper_bound(sample_states.begin(), sample_states.end(), surfel_corr.s2->timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
+    CHECK(sp2r_it != sample_states.begin());
+    CHECK(sp2r_it != sample_states.end());
+    auto sp2l = *(sp2r_it - 1);
+    auto sp2r = *(sp2r_it);
+
+    auto loss_function = new ceres::CauchyLoss(loss_scale);
+    auto residual_id   = problem.AddResidualBlock(
+        NewSurfelMatchUnaryFactor(surfel_corr, sp2l, sp2r, float_residuals),
+        loss_function,
+        sp2l->data_cor,
+        sp2r->data_cor);
+    residual_ids.push_back(residual_id);
+  }
+}
+
+void BuildImuResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::deque<ImuState> &imu_states, const LioConfig &config, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids) {
+  for (int i = 0; i < imu_states.size() - 2; ++i) {
+    auto &i1 = imu_states[i];
+    auto &i2 = imu_states[i + 1];
+    auto &i3 = imu_states[i + 2];
+    if (i1.timestamp < sample_states.front()->timestamp) {
+      continue;
+    }
+    if (i3.timestamp > sample_states.back()->timestamp) {
+      break;
+    }
+    auto sp2_it = std::upper_bound(sample_states.begin(), sample_states.end(), i1.timestamp, [](double lhs, const SampleState::Ptr &rhs) { return lhs < rhs->timestamp; });
+    auto sp1    = *(sp2_it - 1);
+    auto sp2    = *(sp2_it);
+    if (sp2_it == sample_states.end() - 1) {
+      auto residual_id = problem.AddResidualBlock(
+          new ImuFactor<1>(i1, i2, i3,
+                           sp1->timestamp, sp2->timestamp, DBL_MAX,
+                           config.gyroscope_noise_density_cost_weight,
+                           config.accelerometer_noise_density_cost_weight,
+                           config.gyroscope_random_walk_cost_weight,
+                           config.accelerometer_random_walk_cost_weight,
+                           1 / config.imu_rate, sample_states.back()->grav),
+          new ceres::TrivialLoss(),  // todo use loss function
+          sp1->data_cor,
+          sp2->data_cor);
+      residual_ids.push_back(residual_id);
+    } else {
+      auto sp3         = *(sp2_it + 1);
+      auto residual_id = problem.AddResidualBlock(
+          new ImuFactor<0>(i1, i2, i3,
+                           sp1->timestamp, sp2->timestamp, sp3->timestamp,
+                           config.gyroscope_noise_density_cost_weight,
+                           config.accelerometer_noise_density_cost_weight,
+                           config.gyroscope_random_walk_cost_weight,
+                           config.accelerometer_random_walk_cost_weight,
+                           1 / config.imu_rate, sample_states.back()->grav),
+          new ceres::TrivialLoss(),
+          sp1->data_cor,
+          sp2->data_cor,
+          sp3->data_cor);
+      residual_ids.push_back(residual_id);
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <ceres/ceres.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "odometry/lio_config.h"
+#include "odometry/spline_interpolation.h"
+#include "odometry/surfel.h"
+
+/**
+ * @brief Building blocks of the continuous-time lidar-inertial problem, shared by the sliding window
+ * odometry and the offline batch refinement
+ *
+ * Sample states are sorted by timestamp, every surfel and imu state referenced by a residual must lie
+ * inside the time range of the sample states.
+ */
+
+/**
+ * @brief Interpolate sample state corrections at arbitrary timestamps
+ *
+ */
+class CubicBSplineSampleCorrector {
+ public:
+  CubicBSplineSampleCorrector(const std::deque<SampleState::Ptr> &sample_states) {
+    std::vector<double>   sample_timestamps;
+    std::vector<Vector3d> sample_rot;
+    std::vector<Vector3d> sample_pos;
+    for (auto &sample_state : sample_states) {
+      sample_timestamps.push_back(sample_state->timestamp);
+      sample_rot.push_back(sample_state->rot_cor);
+      sample_pos.push_back(sample_state->pos_cor);
+    }
+    rot_interp_.reset(new CubicBSplineInterpolator(sample_timestamps, sample_rot));
+    pos_interp_.reset(new CubicBSplineInterpolator(sample_timestamps, sample_pos));
+  }
+
+  bool GetCorr(double timestamp, Vector3d &rot_cor, Vector3d &pos_cor) {
+    CHECK(rot_interp_ && pos_interp_) << "Interpolator not initialized";
+    auto rot_cor_ptr = rot_interp_->Interp(timestamp);
+    auto pos_cor_ptr = pos_interp_->Interp(timestamp);
+    CHECK((rot_cor_ptr && pos_cor_ptr) || (!rot_cor_ptr && !pos_cor_ptr)) << "Interpolation failed";
+    if (rot_cor_ptr) {
+      rot_cor = *rot_cor_ptr;
+      pos_cor = *pos_cor_ptr;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+ private:
+  std::shared_ptr<CubicBSplineInterpolator> rot_interp_;
+  std::shared_ptr<CubicBSplineInterpolator> pos_interp_;
+};
+
+void PrintSurfelResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem, const std::string &window_type);
+
+void PrintImuResiduals(const std::vector<ceres::ResidualBlockId> &residual_ids, ceres::Problem &problem);
+
+/**
+ * @brief Update imu poses by sample state corrections, imu states out of the interpolation range are kept
+ *
+ * @return index range [first, last] of the corrected imu states, {-1, -1} if none
+ */
+std::pair<int, int> UpdateImuPoses(const std::deque<SampleState::Ptr> &sample_states, std::deque<ImuState> &imu_states);
+
+/**
+ * @brief Update surfel poses by interpolating imu poses
+ *
+ */
+void UpdateSurfelPoses(const std::deque<ImuState> &imu_states, std::deque<Surfel::Ptr> &surfels);
+
+/**
+ * @brief Transform sweep points from the imu frame at their timestamps to the world frame
+ *
+ * The imu states must cover the timestamps of all points.
+ */
+void UndistortSweep(const std::vector<hilti_ros::Point> &sweep_in, const std::deque<ImuState> &imu_states, std::vector<hilti_ros::Point> &sweep_out);
+
+/**
+ * @brief Apply the corrections to the sample state poses and reset them
+ *
+ */
+void UpdateSamplePoses(std::deque<SampleState::Ptr> &sample_states);
+
+/**
+ * @brief Residuals between two surfels whose poses are both optimized
+ *
+ * Timestamp order of every correspondence: s1 < s2
+ *
+ * @param loss_scale scale of the Cauchy loss, in meters
+ * @param float_residuals evaluate the residuals in float, see SurfelMatchBinaryFactor
+ */
+void BuildBinaryLidarResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids, double loss_scale = 0.4, bool float_residuals = false);
+
+/**
+ * @brief Residuals between a fixed surfel s1 and an optimized surfel s2
+ *
+ * Timestamp order of every correspondence: s1 < s2
+ *
+ * @param loss_scale scale of the Cauchy loss, in meters
+ * @param float_residuals evaluate the residuals in float, see SurfelMatchUnaryFactor
+ */
+void BuildUnaryLidarResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::vector<SurfelCorrespondence> &surfel_corrs, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids, double loss_scale = 0.4, bool float_residuals = false);
+
+/**
+ * @brief Imu residuals of all consecutive imu state triples inside the time range of the sample states
+ *
+ */
+void BuildImuResiduals(const std::deque<SampleState::Ptr> &sample_states, const std::deque<ImuState> &imu_states, const LioConfig &config, ceres::Problem &problem, std::vector<ceres::ResidualBlockId> &residual_ids);
@@ -110,6 +110,7 @@ struct Surfel {
   double timestamp;
   double resolution;
   double plane_std_deviation;
+  int    fused_num = 1;  // surfels fused into this one by FuseSurfels, the weight of its moments
 
   Quaterniond rot{1, 0, 0, 0};  // body frame to world frame
   Vector3d    pos{0, 0, 0};     // body frame to world frame
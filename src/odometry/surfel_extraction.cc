@@ -1,4 +1,5 @@
 #include <pcl/io/ply_io.h>
+#include <random>
 
 #include "absl/container/flat_hash_map.h"
 #include "ros/publisher.h"
@@ -7,7 +8,19 @@
 
 namespace {
 
-int g_plane_id = 0;
+/**
+ * @brief Entries of a voxel hash map sorted by voxel, the iteration order of the map itself depends on the hash seed
+ */
+template <typename Map>
+std::vector<const typename Map::value_type *> SortedVoxels(const Map &map) {
+  std::vector<const typename Map::value_type *> voxels;
+  voxels.reserve(map.size());
+  for (const auto &voxel : map) {
+    voxels.push_back(&voxel);
+  }
+  std::sort(voxels.begin(), voxels.end(), [](const auto *lhs, const auto *rhs) { return lhs->first < rhs->first; });
+  return voxels;
+}
 
 void ClusterSurfels(
     const std::vector<PointWithCov> &points,
@@ -15,13 +28,14 @@ void ClusterSurfels(
     const Vector3d                  &view_point,
     double                           planer_threshold,
     double                           min_plane_likeness,
+    double                           cluster_time_gap,
+    int                              cluster_point_num_min,
     std::deque<Surfel::Ptr>         &surfels) {
   // 1. cluster points
   std::vector<std::vector<PointWithCov>> cluster_points;
   cluster_points.push_back({points[0]});
   for (auto i = 1; i < points.size(); ++i) {
-    // todo magic number
-    if (points[i].timestamp - cluster_points.back().back().timestamp > 0.05) {
+    if (points[i].timestamp - cluster_points.back().back().timestamp > cluster_time_gap) {
       cluster_points.push_back({points[i]});
     } else {
       cluster_points.back().push_back(points[i]);
@@ -30,7 +44,7 @@ void ClusterSurfels(
 
   // 2. extract surfels from cluster
   for (auto &cluster : cluster_points) {
-    if (cluster.size() < 20) {
+    if (cluster.size() < cluster_point_num_min) {
       continue;
     }
     Vector3d center      = Vector3d::Zero();
@@ -67,8 +81,8 @@ void ClusterSurfels(
 }  // namespace
 
 OctoTree::OctoTree(int max_layer, int layer, std::vector<int> layer_point_size,
-                   float planer_threshold, double min_plane_likeness, const Vector3d &view_point)
-    : max_layer_(max_layer), layer_(layer), layer_point_size_(layer_point_size), planer_threshold_(planer_threshold), min_plane_likeness_(min_plane_likeness), view_point_(view_point) {
+                   float planer_threshold, double min_plane_likeness, const Vector3d &view_point, int *plane_id_counter)
+    : max_layer_(max_layer), layer_(layer), layer_point_size_(layer_point_size), planer_threshold_(planer_threshold), min_plane_likeness_(min_plane_likeness), view_point_(view_point), plane_id_counter_(plane_id_counter) {
   temp_points_.clear();
   octo_state_                       = 0;
   layer_point_size_plane_threshold_ = layer_point_size_[layer_];
@@ -122,7 +136,7 @@ void OctoTree::InitPlane(const std::vector<PointWithCov> &points, Plane *plane)
   plane->radius          = sqrt(evals(evalsMax));
   plane->d               = -plane->normal.dot(plane->center);
 
-  plane->id = g_plane_id++;
+  plane->id = (*plane_id_counter_)++;
 }
 
 void OctoTree::InitOctoTree() {
@@ -159,7 +173,7 @@ void OctoTree::CutOctoTree() {
     if (leaves_[leafnum] == nullptr) {
       leaves_[leafnum] = new OctoTree(
           max_layer_, layer_ + 1, layer_point_size_,
-          planer_threshold_, min_plane_likeness_, view_point_);
+          planer_threshold_, min_plane_likeness_, view_point_, plane_id_counter_);
       leaves_[leafnum]->voxel_center_[0] = voxel_center_[0] + (2 * xyz[0] - 1) * quarter_length_;
       leaves_[leafnum]->voxel_center_[1] = voxel_center_[1] + (2 * xyz[1] - 1) * quarter_length_;
       leaves_[leafnum]->voxel_center_[2] = voxel_center_[2] + (2 * xyz[2] - 1) * quarter_length_;
@@ -190,8 +204,9 @@ void BuildVoxelMap(const std::vector<PointWithCov>           &input_points,
                    const std::vector<int>                    &layer_point_size,
                    const float                                planer_threshold,
                    double                                     min_plane_likeness,
-                   absl::flat_hash_map<VoxelLoc, OctoTree *> &feat_map) {
-  uint plsize = input_points.size();
+                   GlobalMap                                 &map) {
+  auto &feat_map = map.feat_map;
+  uint  plsize   = input_points.size();
   for (uint i = 0; i < plsize; i++) {
     const PointWithCov p_v = input_points[i];
     // 1. compute voxel position
@@ -203,7 +218,7 @@ void BuildVoxelMap(const std::vector<PointWithCov>           &input_points,
     } else {
       OctoTree *octo_tree =
           new OctoTree(max_layer, 0, layer_point_size,
-                       planer_threshold, min_plane_likeness, view_point);
+                       planer_threshold, min_plane_likeness, view_point, &map.plane_id_counter);
       feat_map[position]                   = octo_tree;
       feat_map[position]->quarter_length_  = voxel_size / 4;
       feat_map[position]->voxel_center_[0] = (0.5 + position.x) * voxel_size;
@@ -286,9 +301,12 @@ void DownSamplingVoxelRandom(const pcl::PointCloud<PointType> &cloud_in,
   cloud_out.clear();
   cloud_out.resize(feat_map.size());
 
-  uint i = 0;
-  for (auto iter = feat_map.begin(); iter != feat_map.end(); ++iter) {
-    cloud_out[i].getVector3fMap() = iter->second.points.at(rand() % iter->second.points.size()).cast<float>();
+  // a fixed seed and the voxel order make the choice reproducible
+  std::mt19937 rng(0);
+  uint         i = 0;
+  for (const auto *voxel : SortedVoxels(feat_map)) {
+    const auto &points            = voxel->second.points;
+    cloud_out[i].getVector3fMap() = points[std::uniform_int_distribution<size_t>(0, points.size() - 1)(rng)].cast<float>();
     i++;
   }
 }
@@ -301,19 +319,19 @@ template void DownSamplingVoxelRandom<PointType>(const pcl::PointCloud<PointType
                                                  pcl::PointCloud<PointType>       &cloud_out,
                                                  double                            voxel_size);
 
-void OctoTree::ExtractSurfelInfo(std::deque<Surfel::Ptr> &surfels, int cur_layer) {
+void OctoTree::ExtractSurfelInfo(std::deque<Surfel::Ptr> &surfels, const SurfelExtractionOptions &options, int cur_layer) {
   if (this->plane_ptr_ && this->plane_ptr_->is_plane) {
     CHECK(!this->temp_points_.empty());
-    ClusterSurfels(this->temp_points_, this->quarter_length_ * 4, view_point_, planer_threshold_, min_plane_likeness_, surfels);
+    ClusterSurfels(this->temp_points_, this->quarter_length_ * 4, view_point_, planer_threshold_, min_plane_likeness_, options.cluster_time_gap, options.cluster_point_num_min, surfels);
   }
   for (auto &leaf : this->leaves_) {
     if (leaf) {
-      leaf->ExtractSurfelInfo(surfels, cur_layer + 1);
+      leaf->ExtractSurfelInfo(surfels, options, cur_layer + 1);
     }
   }
 }
 
-void BuildSurfels(const std::vector<hilti_ros::Point> &cloud, std::deque<Surfel::Ptr> &surfels, GlobalMap &map) {
+void BuildSurfels(const std::vector<hilti_ros::Point> &cloud, std::deque<Surfel::Ptr> &surfels, GlobalMap &map, const SurfelExtractionOptions &options) {
   std::vector<PointWithCov> points;
 
   for (auto &e : cloud) {
@@ -323,16 +341,21 @@ void BuildSurfels(const std::vector<hilti_ros::Point> &cloud, std::deque<Surfel:
     points.push_back(np);
   }
 
-  // todo magic number
-  BuildVoxelMap(points, Vector3d::Zero(), 0.8, 2, {20, 20, 20, 20}, 0.01, 0.1, map.feat_map);
+  BuildVoxelMap(points, Vector3d::Zero(), options.voxel_size, options.max_layer, options.layer_point_size, options.planer_threshold, options.min_plane_likeness, map);
 
   std::vector<pcl::PointCloud<PointType>> cloud_surfel_multi_layers(4);
-  for (auto &e : map.feat_map) {
-    e.second->ExtractSurfelInfo(surfels);
+  if (options.deterministic) {
+    for (const auto *voxel : SortedVoxels(map.feat_map)) {
+      voxel->second->ExtractSurfelInfo(surfels, options);
+    }
+    std::stable_sort(surfels.begin(), surfels.end(), [](const auto &a, const auto &b) { return a->timestamp < b->timestamp; });
+  } else {
+    for (auto &e : map.feat_map) {
+      e.second->ExtractSurfelInfo(surfels, options);
+    }
+    std::sort(surfels.begin(), surfels.end(), [](const auto &a, const auto &b) { return a->timestamp< b->timestamp; });
   }
 
-  std::sort(surfels.begin(), surfels.end(), [](const auto &a, const auto &b) { return a->timestamp< b->timestamp; });
-
   LOG(INFO) << "Surfel Extraction done, surfel count = " << surfels.size();
 }
 
@@ -358,8 +381,10 @@ void makeRightHanded(Matrix3d &eigenvectors, Vector3d &eigenvalues) {
 }
 
 void PubSurfels(std::deque<Surfel::Ptr> surfels,
+                const std::string      &frame_id,
                 const ros::Publisher   &plane_map_pub) {
   visualization_msgs::MarkerArray voxel_planes;
+  int                             id = 0;  // all markers are deleted before publishing, so ids restart per call
 
   for (auto &surfel : surfels) {
     Vector3d eigenvalues(Vector3d::Identity());
@@ -391,9 +416,8 @@ void PubSurfels(std::deque<Surfel::Ptr> surfels,
     auto center = surfel->GetCenterInWorld();
     auto norm   = surfel->GetNormInWorld();
 
-    static int                 id = 0;
     visualization_msgs::Marker plane;
-    plane.header.frame_id = "world";
+    plane.header.frame_id = frame_id;
     plane.header.stamp    = ros::Time();
     plane.ns              = "plane";
     plane.id              = ++id;
@@ -421,11 +445,12 @@ void PubSurfels(std::deque<Surfel::Ptr> surfels,
 
   {
     // delete all history markers
-    auto marker_array_msg = visualization_msgs::MarkerArray();
-    auto marker           = visualization_msgs::Marker();
-    marker.id             = 0;
-    marker.ns             = "plane";
-    marker.action         = visualization_msgs::Marker::DELETEALL;
+    auto marker_array_msg  = visualization_msgs::MarkerArray();
+    auto marker            = visualization_msgs::Marker();
+    marker.header.frame_id = frame_id;
+    marker.id              = 0;
+    marker.ns              = "plane";
+    marker.action          = visualization_msgs::Marker::DELETEALL;
     marker_array_msg.markers.push_back(marker);
     plane_map_pub.publish(marker_array_msg);
   }
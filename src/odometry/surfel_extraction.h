@@ -11,6 +11,7 @@
 #include <Eigen/Core>
 #include <Eigen/Dense>
 #include <Eigen/StdVector>
+#include <tuple>
 
 #include "common/common.h"
 #include "odometry/surfel.h"
@@ -18,6 +19,17 @@
 #define HASH_P 116101
 #define MAX_N 10000000000
 
+struct SurfelExtractionOptions {
+  double           voxel_size            = 0.8;  // root voxel size of the octo trees, in meters
+  int              max_layer             = 2;
+  std::vector<int> layer_point_size      = {20, 20, 20, 20};  // min points to fit a plane, per layer
+  double           planer_threshold      = 0.01;              // max smallest eigen value of a plane
+  double           min_plane_likeness    = 0.1;
+  double           cluster_time_gap      = 0.05;  // plane points further apart in time start a new surfel, in seconds
+  int              cluster_point_num_min = 20;
+  bool             deterministic         = false;  // extract voxels in key order, so that the surfel order does not depend on the hash seed of the process
+};
+
 // 3D point with covariance
 struct PointWithCov {
   double   timestamp;
@@ -66,6 +78,10 @@ class VoxelLoc {
   bool operator==(const VoxelLoc &other) const {
     return (x == other.x && y == other.y && z == other.z);
   }
+
+  bool operator<(const VoxelLoc &other) const {
+    return std::tie(x, y, z) < std::tie(other.x, other.y, other.z);
+  }
 };
 
 // Hash value
@@ -98,9 +114,11 @@ class OctoTree {
   std::vector<int> layer_point_size_;
   int              max_layer_;
 
+  int *plane_id_counter_;  // owned by the GlobalMap this tree belongs to
+
   OctoTree(int max_layer, int layer, std::vector<int> layer_point_size,
            float planer_threshold, double min_plane_likeness,
-           const Vector3d &view_point);
+           const Vector3d &view_point, int *plane_id_counter);
 
   ~OctoTree() {
     delete plane_ptr_;
@@ -119,12 +137,13 @@ class OctoTree {
 
   void CutOctoTree();
 
-  void ExtractSurfelInfo(std::deque<Surfel::Ptr> &surfels, int cur_layer = 0);
+  void ExtractSurfelInfo(std::deque<Surfel::Ptr> &surfels, const SurfelExtractionOptions &options, int cur_layer = 0);
 };
 
 class GlobalMap {
  public:
   absl::flat_hash_map<VoxelLoc, OctoTree *> feat_map;
+  int                                       plane_id_counter = 0;
 
   ~GlobalMap() {
     for (auto &e : feat_map) {
@@ -140,16 +159,18 @@ void BuildVoxelMap(const std::vector<PointWithCov>           &input_points,
                    const std::vector<int>                    &layer_point_size,
                    const float                                planer_threshold,
                    double                                     min_plane_likeness,
-                   absl::flat_hash_map<VoxelLoc, OctoTree *> &feat_map);
+                   GlobalMap                                 &map);
 
 void BuildSurfels(const std::vector<hilti_ros::Point> &cloud,
                   std::deque<Surfel::Ptr>             &surfels,
-                  GlobalMap                           &map);
+                  GlobalMap                           &map,
+                  const SurfelExtractionOptions       &options = SurfelExtractionOptions());
 
 void PubPlaneMap(const absl::flat_hash_map<VoxelLoc, OctoTree *> &feat_map,
                  const ros::Publisher                            &plane_map_pub);
 
 void PubSurfels(std::deque<Surfel::Ptr> surfels,
+                const std::string      &frame_id,
                 const ros::Publisher   &plane_map_pub);
 
 #endif
\ No newline at end of file
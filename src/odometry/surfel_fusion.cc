@@ -0,0 +1,129 @@
+#include "odometry/surfel_fusion.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+using FusionVoxel = std::tuple<int64_t, int64_t, int64_t, double>;  // center voxel and resolution
+
+/**
+ * @brief Voxel of the center, a voxel is as large as the max center distance, so candidates are in the 27 around
+ */
+FusionVoxel ToFusionVoxel(const Surfel &surfel, const SurfelFusionOptions &options) {
+  double   voxel_size = options.center_dist_factor * surfel.resolution;
+  Vector3d center     = surfel.GetCenterInWorld();
+  return {static_cast<int64_t>(std::floor(center.x() / voxel_size)),
+          static_cast<int64_t>(std::floor(center.y() / voxel_size)),
+          static_cast<int64_t>(std::floor(center.z() / voxel_size)),
+          surfel.resolution};
+}
+
+/**
+ * @brief Distance of the center of s2 to the plane of s1, or infinity if the two can not be fused
+ */
+double FusionDistance(const Surfel &s1, const Surfel &s2, const SurfelFusionOptions &options) {
+  constexpr double kInf = std::numeric_limits<double>::infinity();
+  if (s1.resolution != s2.resolution || s1.fused_num + s2.fused_num > options.max_fused_num) {
+    return kInf;
+  }
+  Vector3d diff = s2.GetCenterInWorld() - s1.GetCenterInWorld();
+  if (diff.norm() > options.center_dist_factor * s1.resolution) {
+    return kInf;
+  }
+  // normals point away from the sensor, opposite ones are the two sides of a thin wall
+  Vector3d norm1 = s1.GetNormInWorld(), norm2 = s2.GetNormInWorld();
+  if (norm1.dot(norm2) < std::cos(options.angular_dist_threshold)) {
+    return kInf;
+  }
+  double distance = std::abs(norm1.dot(diff));
+  if (distance > options.surfel_dist_threshold || std::abs(norm2.dot(diff)) > options.surfel_dist_threshold) {
+    return kInf;
+  }
+  return distance;
+}
+
+}  // namespace
+
+Surfel::Ptr FuseSurfelPair(const Surfel &s1, const Surfel &s2) {
+  CHECK_EQ(s1.resolution, s2.resolution);
+  const Surfel &newer = s1.timestamp >= s2.timestamp ? s1 : s2;
+
+  double   w1     = s1.fused_num, w2 = s2.fused_num, w = w1 + w2;
+  Vector3d diff   = s2.GetCenterInWorld() - s1.GetCenterInWorld();
+  Vector3d center = s1.GetCenterInWorld() + w2 / w * diff;
+  // second moments of both about the fused center
+  Matrix3d covariance = (w1 * s1.GetCovarianceInWorld() + w2 * s2.GetCovarianceInWorld()) / w + w1 * w2 / (w * w) * diff * diff.transpose();
+
+  Eigen::SelfAdjointEigenSolver<Matrix3d> es(covariance);
+  Vector3d                                norm = es.eigenvectors().col(0);
+  if (norm.dot(newer.GetNormInWorld()) < 0) {
+    norm = -norm;
+  }
+
+  auto fused       = std::make_shared<Surfel>(newer.timestamp, center, covariance, norm, s1.resolution, std::sqrt(std::max(es.eigenvalues()(0), 0.0)));
+  fused->fused_num = s1.fused_num + s2.fused_num;
+  fused->UpdatePose(newer.pos, newer.rot);
+  return fused;
+}
+
+int FuseSurfels(std::deque<Surfel::Ptr> &surfels_fix_win, int new_surfel_num, const SurfelFusionOptions &options) {
+  CHECK_LE(new_surfel_num, surfels_fix_win.size());
+  if (new_surfel_num == 0) {
+    return 0;
+  }
+
+  // oldest first, so that every surfel is newer than the ones it is fused into, fused away ones become null
+  std::vector<Surfel::Ptr>                           surfels(surfels_fix_win.rbegin(), surfels_fix_win.rend());
+  int                                                old_surfel_num = surfels.size() - new_surfel_num;
+  absl::flat_hash_map<FusionVoxel, std::vector<int>> voxels;
+  for (int i = 0; i < old_surfel_num; ++i) {
+    voxels[ToFusionVoxel(*surfels[i], options)].push_back(i);
+  }
+
+  int fused_away_num = 0;
+  for (int i = old_surfel_num; i < surfels.size(); ++i) {
+    auto   [x, y, z, resolution] = ToFusionVoxel(*surfels[i], options);
+    int    best_index            = -1;
+    double best_distance         = std::numeric_limits<double>::infinity();
+    for (int dx = -1; dx <= 1; ++dx) {
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dz = -1; dz <= 1; ++dz) {
+          auto it = voxels.find(FusionVoxel(x + dx, y + dy, z + dz, resolution));
+          if (it == voxels.end()) {
+            continue;
+          }
+          for (int j : it->second) {
+            if (!surfels[j]) {
+              continue;
+            }
+            double distance = FusionDistance(*surfels[j], *surfels[i], options);
+            if (distance < best_distance) {
+              best_index    = j;
+              best_distance = distance;
+            }
+          }
+        }
+      }
+    }
+    if (best_index != -1) {
+      surfels[i]          = FuseSurfelPair(*surfels[best_index], *surfels[i]);
+      surfels[best_index] = nullptr;
+      ++fused_away_num;
+    }
+    voxels[ToFusionVoxel(*surfels[i], options)].push_back(i);
+  }
+
+  if (fused_away_num > 0) {
+    surfels_fix_win.clear();
+    for (auto it = surfels.rbegin(); it != surfels.rend(); ++it) {
+      if (*it) {
+        surfels_fix_win.push_back(*it);
+      }
+    }
+  }
+  return fused_away_num;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <deque>
+
+#include "odometry/surfel.h"
+
+struct SurfelFusionOptions {
+  double center_dist_factor     = 0.5;                 // max center distance of fused surfels, in multiples of their resolution
+  double angular_dist_threshold = 5.0 * M_PI / 180.0;  // in radians
+  double surfel_dist_threshold  = 0.05;                // max distance of either center to the other plane, in meters
+  int    max_fused_num          = 20;                  // full surfels take no more, so that they leave the fixed window in time
+};
+
+/**
+ * @brief Fuse two surfels of the same resolution by their moments
+ *
+ * Each surfel weighs its fused_num, as the point numbers are not kept. The result takes the timestamp and the pose of
+ * the newer surfel, its normal and plane_std_deviation are refit to the fused covariance.
+ *
+ * @return a new surfel, the inputs are left untouched
+ */
+Surfel::Ptr FuseSurfelPair(const Surfel &s1, const Surfel &s2);
+
+/**
+ * @brief Fuse the surfels just pushed to the front of the fixed window into co-planar, co-located ones
+ *
+ * Surfels of the fixed window are shared with commits and snapshots, so fused surfels replace their members instead of
+ * modifying them. The window stays ordered newest first.
+ *
+ * @param surfels_fix_win newest first
+ * @param new_surfel_num number of surfels at the front added since the last call
+ * @param options
+ * @return number of surfels fused away
+ */
+int FuseSurfels(std::deque<Surfel::Ptr> &surfels_fix_win, int new_surfel_num, const SurfelFusionOptions &options);
@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include "odometry/surfel_fusion.h"
+
+namespace {
+
+/**
+ * @brief Surfel of points spread uniformly over a square of side length 2 * half_size, normal to the z axis by default
+ */
+Surfel::Ptr MakeSurfel(double timestamp, const Vector3d &center, double half_size, double resolution = 0.4, const Vector3d &norm = Vector3d::UnitZ()) {
+  Matrix3d covariance = Vector3d(half_size * half_size / 3, half_size * half_size / 3, 1e-6).asDiagonal();
+  auto     surfel     = std::make_shared<Surfel>(timestamp, center, covariance, norm, resolution, 1e-3);
+  surfel->UpdatePose(Vector3d(timestamp, 0, 1), Quaterniond(Eigen::AngleAxisd(timestamp, Vector3d::UnitZ())));
+  return surfel;
+}
+
+}  // namespace
+
+TEST(SurfelFusion, FuseSurfelPairMatchesMoments) {
+  // two adjacent squares of side 0.2 make a rectangle of 0.4 x 0.2
+  auto s1 = MakeSurfel(1, Vector3d(-0.1, 0, 0), 0.1);
+  auto s2 = MakeSurfel(2, Vector3d(0.1, 0, 0), 0.1);
+
+  auto fused = FuseSurfelPair(*s1, *s2);
+  EXPECT_EQ(fused->timestamp, 2);
+  EXPECT_EQ(fused->fused_num, 2);
+  EXPECT_TRUE(fused->pos.isApprox(s2->pos));
+  EXPECT_TRUE(fused->GetCenterInWorld().isZero(1e-12));
+  EXPECT_TRUE(fused->GetCovarianceInWorld().isApprox(Vector3d(0.2 * 0.2 / 3, 0.1 * 0.1 / 3, 1e-6).asDiagonal().toDenseMatrix(), 1e-9));
+  EXPECT_TRUE(fused->GetNormInWorld().isApprox(Vector3d::UnitZ(), 1e-9));
+  EXPECT_NEAR(fused->plane_std_deviation, 1e-3, 1e-9);
+
+  // the inputs are shared with commits and stay untouched
+  EXPECT_EQ(s1->fused_num, 1);
+  EXPECT_TRUE(s1->GetCenterInWorld().isApprox(Vector3d(-0.1, 0, 0)));
+}
+
+TEST(SurfelFusion, FuseSurfelsOnlyCoPlanar) {
+  std::deque<Surfel::Ptr> surfels_fix_win = {MakeSurfel(1, Vector3d(10, 0, 0), 0.1), MakeSurfel(0, Vector3d(0, 0, 0), 0.1)};
+  // newest first: the same plane, a parallel one, another resolution, a tilted one and one too far away
+  std::deque<Surfel::Ptr> new_surfels = {MakeSurfel(2.5, Vector3d(0.1, 0.05, 0.01), 0.1),
+                                         MakeSurfel(2.4, Vector3d(0, 0, 0.2), 0.1),
+                                         MakeSurfel(2.3, Vector3d(0, 0, 0), 0.1, 0.8),
+                                         MakeSurfel(2.2, Vector3d(0.05, 0, 0), 0.1, 0.4, Vector3d(0, 0.2, 1).normalized()),
+                                         MakeSurfel(2.1, Vector3d(1, 0, 0), 0.1)};
+  surfels_fix_win.insert(surfels_fix_win.begin(), new_surfels.begin(), new_surfels.end());
+
+  EXPECT_EQ(FuseSurfels(surfels_fix_win, new_surfels.size(), SurfelFusionOptions()), 1);
+  ASSERT_EQ(surfels_fix_win.size(), 6);
+  EXPECT_EQ(surfels_fix_win.front()->fused_num, 2);
+  EXPECT_EQ(surfels_fix_win.front()->timestamp, 2.5);
+  for (int i = 1; i < surfels_fix_win.size(); ++i) {
+    EXPECT_LE(surfels_fix_win[i]->timestamp, surfels_fix_win[i - 1]->timestamp);
+    EXPECT_EQ(surfels_fix_win[i]->fused_num, 1);
+  }
+}
+
+TEST(SurfelFusion, FuseSurfelsUpToMaxFusedNum) {
+  SurfelFusionOptions options;
+  options.max_fused_num = 3;
+
+  std::deque<Surfel::Ptr> surfels_fix_win;
+  for (int i = 0; i < 7; ++i) {
+    surfels_fix_win.push_front(MakeSurfel(i, Vector3d(0.01 * i, 0, 0), 0.1));
+    FuseSurfels(surfels_fix_win, 1, options);
+  }
+  ASSERT_EQ(surfels_fix_win.size(), 3);
+  EXPECT_EQ(surfels_fix_win[0]->fused_num, 1);
+  EXPECT_EQ(surfels_fix_win[1]->fused_num, 3);
+  EXPECT_EQ(surfels_fix_win[2]->fused_num, 3);
+}
@@ -0,0 +1,89 @@
+#include "odometry/surfel_registration.h"
+
+#include <ceres/ceres.h>
+#include <glog/logging.h>
+#include <deque>
+
+#include "common/utils.h"
+#include "odometry/cost_functor.h"
+
+Surfel::Ptr TransformSurfel(const Rigid3d &transform, const Surfel::Ptr &surfel) {
+  auto transformed = std::make_shared<Surfel>(*surfel);
+  transformed->rot = transform.rotation() * surfel->rot;
+  transformed->pos = transform.rotation() * surfel->pos + transform.translation();
+  return transformed;
+}
+
+bool RegisterSurfels(const std::vector<Surfel::Ptr>  &target,
+                     const std::vector<Surfel::Ptr>  &source,
+                     const SurfelRegistrationOptions &options,
+                     Rigid3d                         *source_to_target,
+                     SurfelRegistrationSummary       *summary) {
+  CHECK(source_to_target);
+  SurfelRegistrationSummary summary_local;
+  if (!summary) {
+    summary = &summary_local;
+  }
+  *summary = SurfelRegistrationSummary();
+  if (target.size() < options.min_correspondence_num || source.size() < options.min_correspondence_num) {
+    LOG(WARNING) << "Too few surfels to register: target_" << target.size() << " source_" << source.size();
+    return false;
+  }
+
+  KnnSurfelMatcher matcher(options.matcher);
+  matcher.BuildIndex(std::deque<Surfel::Ptr>(target.begin(), target.end()));
+  int k = std::min<int>(options.nearest_candidates_num, target.size());
+
+  for (int iter_num = 0; iter_num < options.iter_num_max; ++iter_num) {
+    summary->iter_num = iter_num + 1;
+
+    // 1. match transformed source surfels to target surfels
+    std::vector<SurfelCorrespondence> surfel_corrs;
+    for (auto &surfel : source) {
+      auto                     surfel_transformed = TransformSurfel(*source_to_target, surfel);
+      std::vector<Surfel::Ptr> k_nearest_surfels;
+      matcher.KNearestSearch(surfel_transformed, k, k_nearest_surfels);
+      for (auto &nearest_surfel : k_nearest_surfels) {
+        if ((surfel_transformed->GetCenterInWorld() - nearest_surfel->GetCenterInWorld()).norm() > options.max_center_distance) {
+          continue;
+        }
+        if (surfel_transformed->AngularDistance(*nearest_surfel) > options.max_angular_distance) {
+          continue;
+        }
+        if (std::abs(nearest_surfel->GetNormInWorld().dot(surfel_transformed->GetCenterInWorld() - nearest_surfel->GetCenterInWorld())) > options.max_plane_distance) {
+          continue;
+        }
+        surfel_corrs.push_back({nearest_surfel, surfel_transformed});
+        break;
+      }
+    }
+    summary->correspondence_num = surfel_corrs.size();
+    if (surfel_corrs.size() < options.min_correspondence_num) {
+      LOG(WARNING) << "Too few surfel correspondences to register: " << surfel_corrs.size();
+      return false;
+    }
+
+    // 2. solve the correction of the source pose
+    double         correction[6] = {0};
+    ceres::Problem problem;
+    for (auto &surfel_corr : surfel_corrs) {
+      problem.AddResidualBlock(new SurfelAlignmentFactor(surfel_corr.s1, surfel_corr.s2), new ceres::CauchyLoss(options.loss_scale), correction);
+    }
+    ceres::Solver::Options option;
+    option.linear_solver_type = ceres::DENSE_QR;
+    option.max_num_iterations = options.inner_iter_num_max;
+    ceres::Solver::Summary solver_summary;
+    ceres::Solve(option, &problem, &solver_summary);
+
+    Eigen::Map<const Vector3d> rot_cor{correction + 0};
+    Eigen::Map<const Vector3d> pos_cor{correction + 3};
+    *source_to_target = Rigid3d(pos_cor, Exp(rot_cor)) * *source_to_target;
+    VLOG(1) << "Registration iteration " << iter_num << " corrs_" << surfel_corrs.size() << " " << solver_summary.BriefReport();
+
+    if (rot_cor.norm() < options.rotation_convergence && pos_cor.norm() < options.translation_convergence) {
+      summary->converged = true;
+      break;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "common/rigid_transform.h"
+#include "odometry/knn_surfel_matcher.h"
+#include "odometry/surfel.h"
+
+struct SurfelRegistrationOptions {
+  int    iter_num_max            = 20;
+  int    inner_iter_num_max      = 10;
+  int    min_correspondence_num  = 50;
+  int    nearest_candidates_num  = 5;
+  double max_center_distance     = 1.0;                  // in meters
+  double max_angular_distance    = 5.0 * M_PI / 180.0;  // in radians
+  double max_plane_distance      = 0.2;                  // in meters
+  double rotation_convergence    = 1e-5;                 // in radians
+  double translation_convergence = 1e-4;                 // in meters
+  double loss_scale              = 0.4;                  // scale of the Cauchy loss, in meters, usually LioConfig::lidar_loss_scale
+
+  KnnSurfelMatcherOptions matcher;  // weights of the nearest candidate search, usually KnnSurfelMatcherOptionsFromConfig
+};
+
+struct SurfelRegistrationSummary {
+  int  iter_num           = 0;
+  int  correspondence_num = 0;  // of the last iteration
+  bool converged          = false;
+};
+
+/**
+ * @brief Transform a surfel by a rigid transform on the left of its world pose
+ *
+ * The surfel is copied, the original stays untouched.
+ */
+Surfel::Ptr TransformSurfel(const Rigid3d &transform, const Surfel::Ptr &surfel);
+
+/**
+ * @brief Align two surfel maps by point-to-plane ICP on surfel correspondences
+ *
+ * Unlike the sliding window matching, surfels are matched regardless of their timestamps, so the two maps
+ * may have been built from the same sweeps, e.g. by two odometry runs over an overlapping time range.
+ *
+ * @param target surfels in the target frame
+ * @param source surfels in the source frame
+ * @param options
+ * @param source_to_target initial guess as input, result as output
+ * @param summary optional
+ * @return true if enough correspondences were found in every iteration
+ */
+bool RegisterSurfels(const std::vector<Surfel::Ptr>  &target,
+                     const std::vector<Surfel::Ptr>  &source,
+                     const SurfelRegistrationOptions &options,
+                     Rigid3d                         *source_to_target,
+                     SurfelRegistrationSummary       *summary = nullptr);
@@ -0,0 +1,49 @@
+#include "odometry/surfel_registration.h"
+
+#include <gtest/gtest.h>
+
+#include "common/utils.h"
+
+namespace {
+
+/**
+ * @brief Surfels on the walls, floor and ceiling of a 10m x 10m x 10m room
+ */
+std::vector<Surfel::Ptr> RoomSurfels() {
+  std::vector<Surfel::Ptr> surfels;
+  for (int axis = 0; axis < 3; ++axis) {
+    Vector3d norm = Vector3d::Unit(axis);
+    Matrix3d cov  = Matrix3d::Identity() * 0.01 - norm * norm.transpose() * (0.01 - 1e-6);
+    for (double offset : {-5.0, 5.0}) {
+      for (int u = -4; u <= 4; ++u) {
+        for (int v = -4; v <= 4; ++v) {
+          Vector3d center;
+          center[axis]           = offset;
+          center[(axis + 1) % 3] = u;
+          center[(axis + 2) % 3] = v;
+          surfels.push_back(std::make_shared<Surfel>(0, center, cov, norm, 1.0, 0.001));
+        }
+      }
+    }
+  }
+  return surfels;
+}
+
+}  // namespace
+
+TEST(SurfelRegistration, RecoverTransform) {
+  auto    target = RoomSurfels();
+  Rigid3d source_to_target_gt(Vector3d(0.15, -0.1, 0.05), Exp(Vector3d(0.01, -0.02, 0.03)));
+
+  std::vector<Surfel::Ptr> source;
+  for (auto &surfel : target) {
+    source.push_back(TransformSurfel(source_to_target_gt.inverse(), surfel));
+  }
+
+  Rigid3d                   source_to_target;
+  SurfelRegistrationSummary summary;
+  ASSERT_TRUE(RegisterSurfels(target, source, SurfelRegistrationOptions(), &source_to_target, &summary));
+  EXPECT_TRUE(summary.converged);
+  EXPECT_LT((source_to_target.translation() - source_to_target_gt.translation()).norm(), 1e-3);
+  EXPECT_LT(source_to_target.rotation().angularDistance(source_to_target_gt.rotation()), 1e-3);
+}
@@ -0,0 +1,294 @@
+#include "offline/bag_reader.h"
+
+#include <bzlib.h>
+#include <glog/logging.h>
+#include <roslz4/lz4s.h>
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace {
+
+constexpr std::string_view kBagMagic = "#ROSBAG V2.0\n";
+
+enum RecordOp : uint8_t {
+  kMessageData = 0x02,
+  kBagHeader   = 0x03,
+  kChunk       = 0x05,
+  kChunkInfo   = 0x06,
+  kConnection  = 0x07,
+};
+
+/**
+ * @brief A record is a header of name=value fields followed by data, both prefixed by their length
+ */
+struct Record {
+  const uint8_t *header      = nullptr;
+  uint32_t       header_size = 0;
+  const uint8_t *data        = nullptr;
+  uint32_t       data_size   = 0;
+};
+
+/**
+ * @brief Read the record at pos and advance pos past it
+ *
+ * @return false if the record is truncated
+ */
+bool ReadRecord(const uint8_t *&pos, const uint8_t *end, Record *record) {
+  uint32_t size;
+  if (end - pos < 4) {
+    return false;
+  }
+  memcpy(&size, pos, 4);
+  if (end - pos - 4 < size) {
+    return false;
+  }
+  record->header      = pos + 4;
+  record->header_size = size;
+  pos += 4 + size;
+
+  if (end - pos < 4) {
+    return false;
+  }
+  memcpy(&size, pos, 4);
+  if (end - pos - 4 < size) {
+    return false;
+  }
+  record->data      = pos + 4;
+  record->data_size = size;
+  pos += 4 + size;
+  return true;
+}
+
+/**
+ * @brief Find a field in a record header or a connection header
+ */
+bool FindField(const uint8_t *header, uint32_t size, std::string_view name, std::string_view *value) {
+  const uint8_t *pos = header, *end = header + size;
+  while (end - pos >= 4) {
+    uint32_t field_size;
+    memcpy(&field_size, pos, 4);
+    pos += 4;
+    if (end - pos < field_size) {
+      return false;
+    }
+    std::string_view field(reinterpret_cast<const char *>(pos), field_size);
+    pos += field_size;
+    auto separator = field.find('=');
+    if (separator != std::string_view::npos && field.substr(0, separator) == name) {
+      *value = field.substr(separator + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T>
+bool FindField(const Record &record, std::string_view name, T *value) {
+  std::string_view field;
+  if (!FindField(record.header, record.header_size, name, &field) || field.size() != sizeof(T)) {
+    return false;
+  }
+  memcpy(value, field.data(), sizeof(T));
+  return true;
+}
+
+/**
+ * @brief Find a time field, stored as 32 bit seconds and nanoseconds
+ */
+bool FindTimeField(const Record &record, std::string_view name, double *time) {
+  uint32_t sec_nsec[2];
+  if (!FindField(record, name, &sec_nsec)) {
+    return false;
+  }
+  *time = sec_nsec[0] + sec_nsec[1] * 1e-9;
+  return true;
+}
+
+bool Decompress(std::string_view compression, const uint8_t *data, uint32_t size, std::vector<uint8_t> *output) {
+  if (compression == "none") {
+    if (size != output->size()) {
+      return false;
+    }
+    memcpy(output->data(), data, size);
+    return true;
+  }
+  unsigned int output_size = output->size();
+  if (compression == "bz2") {
+    return BZ2_bzBuffToBuffDecompress(reinterpret_cast<char *>(output->data()), &output_size, const_cast<char *>(reinterpret_cast<const char *>(data)), size, 0, 0) == BZ_OK && output_size == output->size();
+  }
+  if (compression == "lz4") {
+    return roslz4_buffToBuffDecompress(const_cast<char *>(reinterpret_cast<const char *>(data)), size, reinterpret_cast<char *>(output->data()), &output_size) == ROSLZ4_OK && output_size == output->size();
+  }
+  return false;
+}
+
+}  // namespace
+
+BagReader::BagReader(const std::string &filename, const BagReaderOptions &options) : filename_(filename), options_(options) {
+  CHECK_GT(options_.thread_num, 0);
+  CHECK_GT(options_.max_pending_chunk, 0);
+  CHECK(file_.Open(filename_, MappedFile::Access::kRandom)) << "Failed to open bag " << filename_;
+  ReadIndex();
+  thread_pool_ = std::make_unique<ThreadPool>(options_.thread_num);
+}
+
+BagReader::~BagReader() {
+  thread_pool_.reset();
+}
+
+void BagReader::ReadIndex() {
+  const uint8_t *begin = reinterpret_cast<const uint8_t *>(file_.Data());
+  const uint8_t *end   = begin + file_.Size();
+  CHECK(file_.Size() >= kBagMagic.size() && std::string_view(file_.Data(), kBagMagic.size()) == kBagMagic) << filename_ << " is not a version 2.0 bag.";
+
+  const uint8_t *pos = begin + kBagMagic.size();
+  Record         record;
+  uint8_t        op;
+  uint64_t       index_position;
+  CHECK(ReadRecord(pos, end, &record) && FindField(record, "op", &op) && op == kBagHeader && FindField(record, "index_pos", &index_position)) << "Corrupt bag header in " << filename_;
+  CHECK(index_position > 0 && index_position < file_.Size()) << filename_ << " has no index, run rosbag reindex on it first.";
+
+  struct IndexedChunk {
+    ChunkInfo             info;
+    std::vector<uint32_t> connection_ids;
+  };
+  std::vector<IndexedChunk> indexed_chunks;
+  pos = begin + index_position;
+  while (pos < end) {
+    CHECK(ReadRecord(pos, end, &record) && FindField(record, "op", &op)) << "Corrupt index in " << filename_;
+    if (op == kConnection) {
+      BagConnection    connection;
+      std::string_view field;
+      CHECK(FindField(record, "conn", &connection.id) && FindField(record.header, record.header_size, "topic", &field)) << "Corrupt connection in " << filename_;
+      connection.topic = field;
+      if (FindField(record.data, record.data_size, "type", &field)) {
+        connection.type = field;
+      }
+      if (FindField(record.data, record.data_size, "md5sum", &field)) {
+        connection.md5sum = field;
+      }
+      bool wanted = options_.types.empty() || std::find(options_.types.begin(), options_.types.end(), connection.type) != options_.types.end();
+      if (connection.id >= connection_index_.size()) {
+        connection_index_.resize(connection.id + 1, -1);
+      }
+      connection_index_[connection.id] = wanted ? connections_.size() : -1;
+      connections_.push_back(connection);
+    } else if (op == kChunkInfo) {
+      IndexedChunk chunk;
+      uint32_t     connection_num;
+      CHECK(FindField(record, "chunk_pos", &chunk.info.position) && FindTimeField(record, "start_time", &chunk.info.start_time) && FindTimeField(record, "end_time", &chunk.info.end_time) && FindField(record, "count", &connection_num) && record.data_size >= connection_num * 8) << "Corrupt chunk info in " << filename_;
+      for (uint32_t i = 0; i < connection_num; ++i) {
+        uint32_t id;
+        memcpy(&id, record.data + 8 * i, 4);
+        chunk.connection_ids.push_back(id);
+      }
+      indexed_chunks.push_back(std::move(chunk));
+    }
+  }
+
+  for (int i = 0; i < indexed_chunks.size(); ++i) {
+    start_time_ = i == 0 ? indexed_chunks[i].info.start_time : std::min(start_time_, indexed_chunks[i].info.start_time);
+    end_time_   = i == 0 ? indexed_chunks[i].info.end_time : std::max(end_time_, indexed_chunks[i].info.end_time);
+  }
+  if (options_.time_from_bag_start) {
+    options_.start_time          = options_.start_time > 0 ? start_time_ + options_.start_time : 0;
+    options_.end_time            = options_.end_time > 0 ? start_time_ + options_.end_time : 0;
+    options_.time_from_bag_start = false;
+  }
+
+  for (const auto &chunk : indexed_chunks) {
+    if ((options_.start_time > 0 && chunk.info.end_time < options_.start_time) || (options_.end_time > 0 && chunk.info.start_time > options_.end_time)) {
+      continue;
+    }
+    bool has_wanted = std::any_of(chunk.connection_ids.begin(), chunk.connection_ids.end(), [this](uint32_t id) { return id < connection_index_.size() && connection_index_[id] >= 0; });
+    if (has_wanted) {
+      chunks_.push_back(chunk.info);
+    }
+  }
+  std::stable_sort(chunks_.begin(), chunks_.end(), [](const ChunkInfo &lhs, const ChunkInfo &rhs) { return lhs.start_time < rhs.start_time; });
+  LOG(INFO) << "Found " << connections_.size() << " connections and " << indexed_chunks.size() << " chunks in " << filename_ << ", " << chunks_.size() << " chunks to read.";
+}
+
+bool BagReader::Next(BagMessage *message) {
+  while (true) {
+    ScheduleChunks();
+    if (!pending_chunks_.empty()) {
+      // a message is final once it is earlier than every message of the chunks not merged yet
+      const double merged_until = chunks_[next_chunk_ - pending_chunks_.size()].start_time;
+      if (reorder_buffer_.empty() || reorder_buffer_.top().first.time >= merged_until) {
+        {
+          PendingChunk   *pending = pending_chunks_.front().get();
+          absl::MutexLock lock(&pending->mutex);
+          pending->mutex.Await(absl::Condition(&pending->done));
+          for (auto &pending_message : pending->messages) {
+            reorder_buffer_.emplace(std::move(pending_message), merged_num_++);
+          }
+        }
+        pending_chunks_.pop();
+        continue;
+      }
+    }
+    if (reorder_buffer_.empty()) {
+      return false;
+    }
+    *message = reorder_buffer_.top().first;
+    reorder_buffer_.pop();
+    return true;
+  }
+}
+
+void BagReader::ScheduleChunks() {
+  while (next_chunk_ < chunks_.size() && pending_chunks_.size() < options_.max_pending_chunk) {
+    auto *pending = new PendingChunk;
+    pending_chunks_.emplace(pending);
+    thread_pool_->Schedule([this, chunk = chunks_[next_chunk_], pending]() {
+      auto            messages = ReadChunk(chunk);
+      absl::MutexLock lock(&pending->mutex);
+      pending->messages = std::move(messages);
+      pending->done     = true;
+    });
+    ++next_chunk_;
+  }
+}
+
+std::vector<BagMessage> BagReader::ReadChunk(const ChunkInfo &chunk) const {
+  const uint8_t   *pos = reinterpret_cast<const uint8_t *>(file_.Data()) + chunk.position;
+  const uint8_t   *end = reinterpret_cast<const uint8_t *>(file_.Data()) + file_.Size();
+  Record           record;
+  uint8_t          op;
+  uint32_t         size;
+  std::string_view compression;
+  if (!ReadRecord(pos, end, &record) || !FindField(record, "op", &op) || op != kChunk || !FindField(record, "size", &size) || !FindField(record.header, record.header_size, "compression", &compression)) {
+    LOG(ERROR) << "Corrupt chunk at " << chunk.position << " in " << filename_ << ", skipped.";
+    return {};
+  }
+  auto decompressed = std::make_shared<std::vector<uint8_t>>(size);
+  if (!Decompress(compression, record.data, record.data_size, decompressed.get())) {
+    LOG(ERROR) << "Failed to decompress " << compression << " chunk at " << chunk.position << " in " << filename_ << ", skipped.";
+    return {};
+  }
+
+  std::vector<BagMessage> messages;
+  pos = decompressed->data();
+  end = decompressed->data() + decompressed->size();
+  while (pos < end && ReadRecord(pos, end, &record)) {
+    BagMessage message;
+    uint32_t   id;
+    if (!FindField(record, "op", &op) || op != kMessageData || !FindField(record, "conn", &id) || !FindTimeField(record, "time", &message.time)) {
+      continue;  // connection records are repeated in chunks
+    }
+    if (id >= connection_index_.size() || connection_index_[id] < 0) {
+      continue;
+    }
+    if ((options_.start_time > 0 && message.time < options_.start_time) || (options_.end_time > 0 && message.time > options_.end_time)) {
+      continue;
+    }
+    message.connection = &connections_[connection_index_[id]];
+    message.data       = record.data;
+    message.size       = record.data_size;
+    message.chunk      = decompressed;
+    messages.push_back(std::move(message));
+  }
+  return messages;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "common/thread_pool.h"
+#include "io/mapped_file.h"
+
+/**
+ * @brief A connection of a bag, i.e. one topic with one message type
+ */
+struct BagConnection {
+  uint32_t    id = 0;
+  std::string topic;
+  std::string type;    // e.g. sensor_msgs/Imu
+  std::string md5sum;  // of the message definition
+};
+
+/**
+ * @brief One serialized message of a bag
+ */
+struct BagMessage {
+  const BagConnection *connection = nullptr;
+  double               time       = 0;  // record time in seconds, not the header stamp
+  const uint8_t       *data       = nullptr;
+  uint32_t             size       = 0;
+
+  std::shared_ptr<const std::vector<uint8_t>> chunk;  // keeps data alive
+};
+
+struct BagReaderOptions {
+  std::vector<std::string> types;                          // message types to read, empty to read all
+  double                   start_time          = 0;      // record time in seconds, 0 for the beginning of the bag
+  double                   end_time            = 0;      // record time in seconds, 0 for the end of the bag
+  bool                     time_from_bag_start = false;  // start_time and end_time count from the first message of the bag
+  int                      thread_num          = 4;      // chunk decompression threads
+  int                      max_pending_chunk   = 16;     // chunks decompressed ahead of the consumer
+};
+
+/**
+ * @brief Reader of ROS bag format 2.0 files that decompresses chunks in parallel
+ *
+ * The chunk index at the end of the bag is parsed on open, so a time range is read without touching the chunks
+ * before it. Chunks with messages of the wanted types are
+ * decompressed and split into messages on a thread pool, up to max_pending_chunk ahead of the consumer. Chunks
+ * may overlap in time, so messages go through a reorder buffer and are released once no later chunk can hold an
+ * earlier message. The result is the record time order of rosbag::View. Supports uncompressed, bz2 and lz4
+ * chunks. Does not need a ros master.
+ */
+class BagReader {
+ public:
+  explicit BagReader(const std::string &filename, const BagReaderOptions &options = BagReaderOptions());
+  ~BagReader();
+
+  BagReader(const BagReader &)            = delete;
+  BagReader &operator=(const BagReader &) = delete;
+
+  /**
+   * @return false at the end of the bag
+   */
+  bool Next(BagMessage *message);
+
+  const std::vector<BagConnection> &Connections() const { return connections_; }
+
+  /**
+   * @brief Record time range of all messages in the bag, regardless of the options
+   */
+  double StartTime() const { return start_time_; }
+
+  double EndTime() const { return end_time_; }
+
+ private:
+  struct ChunkInfo {
+    uint64_t position;
+    double   start_time;
+    double   end_time;
+  };
+
+  struct PendingChunk {
+    absl::Mutex             mutex;
+    bool                    done GUARDED_BY(mutex) = false;
+    std::vector<BagMessage> messages GUARDED_BY(mutex);
+  };
+
+  using OrderedMessage = std::pair<BagMessage, uint64_t>;  // with the merge sequence number, which breaks time ties
+
+  struct LaterMessage {
+    bool operator()(const OrderedMessage &lhs, const OrderedMessage &rhs) const {
+      return lhs.first.time != rhs.first.time ? lhs.first.time > rhs.first.time : lhs.second > rhs.second;
+    }
+  };
+
+  void ReadIndex();
+
+  void ScheduleChunks();
+
+  /**
+   * @brief Decompress one chunk and collect its wanted messages in bag order, runs on the thread pool
+   *
+   * @return no messages if the chunk is corrupt
+   */
+  std::vector<BagMessage> ReadChunk(const ChunkInfo &chunk) const;
+
+ private:
+  std::string      filename_;
+  BagReaderOptions options_;
+  MappedFile       file_;
+
+  std::vector<BagConnection> connections_;
+  std::vector<int>           connection_index_;  // index into connections_ by connection id, -1 if not wanted or unknown
+  std::vector<ChunkInfo>     chunks_;            // with wanted messages, sorted by start time
+  double                     start_time_ = 0;
+  double                     end_time_   = 0;
+
+  size_t                                    next_chunk_ = 0;  // next chunk to schedule
+  std::queue<std::unique_ptr<PendingChunk>> pending_chunks_;  // scheduled and not merged yet, in chunks_ order
+
+  std::priority_queue<OrderedMessage, std::vector<OrderedMessage>, LaterMessage> reorder_buffer_;
+  uint64_t                                                                       merged_num_ = 0;
+
+  std::unique_ptr<ThreadPool> thread_pool_;  // destroyed first, waits for scheduled chunks
+};
@@ -0,0 +1,162 @@
+#include <bzlib.h>
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "common/test_utils.h"
+#include "offline/bag_reader.h"
+
+namespace {
+
+std::string Bytes(const void *data, size_t size) {
+  return std::string(static_cast<const char *>(data), size);
+}
+
+template <typename T>
+std::string Bytes(T value) {
+  return Bytes(&value, sizeof(value));
+}
+
+std::string TimeBytes(double time) {
+  uint32_t sec_nsec[2] = {uint32_t(time), uint32_t((time - uint32_t(time)) * 1e9 + 0.5)};
+  return Bytes(sec_nsec, sizeof(sec_nsec));
+}
+
+std::string Field(const std::string &name, const std::string &value) {
+  return Bytes(uint32_t(name.size() + 1 + value.size())) + name + "=" + value;
+}
+
+std::string Record(const std::string &header, const std::string &data) {
+  return Bytes(uint32_t(header.size())) + header + Bytes(uint32_t(data.size())) + data;
+}
+
+struct TestMessage {
+  uint32_t    connection;
+  double      time;
+  std::string data;
+};
+
+/**
+ * @brief Minimal bag writer, one chunk per call of AddChunk
+ */
+class TestBagWriter {
+ public:
+  void AddConnection(uint32_t id, const std::string &topic, const std::string &type) {
+    connections_ += Record(Field("op", Bytes(uint8_t(0x07))) + Field("conn", Bytes(id)) + Field("topic", topic), Field("topic", topic) + Field("type", type) + Field("md5sum", "*"));
+  }
+
+  void AddChunk(const std::vector<TestMessage> &messages, bool bz2) {
+    std::string           data;
+    double                start_time = messages.front().time, end_time = messages.front().time;
+    std::vector<uint32_t> connections;
+    for (const auto &message : messages) {
+      data += Record(Field("op", Bytes(uint8_t(0x02))) + Field("conn", Bytes(message.connection)) + Field("time", TimeBytes(message.time)), message.data);
+      start_time = std::min(start_time, message.time);
+      end_time   = std::max(end_time, message.time);
+      if (std::find(connections.begin(), connections.end(), message.connection) == connections.end()) {
+        connections.push_back(message.connection);
+      }
+    }
+    std::string compressed = data;
+    if (bz2) {
+      unsigned int size = data.size() * 2 + 600;
+      compressed.resize(size);
+      CHECK_EQ(BZ2_bzBuffToBuffCompress(compressed.data(), &size, data.data(), data.size(), 9, 0, 0), BZ_OK);
+      compressed.resize(size);
+    }
+
+    std::string chunk_info_data;
+    for (uint32_t connection : connections) {
+      chunk_info_data += Bytes(connection) + Bytes(uint32_t(1));
+    }
+    chunk_infos_ += Record(Field("op", Bytes(uint8_t(0x06))) + Field("ver", Bytes(uint32_t(1))) + Field("chunk_pos", Bytes(uint64_t(kHeaderSize + chunks_.size()))) + Field("start_time", TimeBytes(start_time)) + Field("end_time", TimeBytes(end_time)) + Field("count", Bytes(uint32_t(connections.size()))), chunk_info_data);
+    chunks_ += Record(Field("op", Bytes(uint8_t(0x05))) + Field("compression", bz2 ? "bz2" : "none") + Field("size", Bytes(uint32_t(data.size()))), compressed);
+  }
+
+  void Write(const std::string &filename) const {
+    std::string header = "#ROSBAG V2.0\n" + Record(Field("op", Bytes(uint8_t(0x03))) + Field("index_pos", Bytes(uint64_t(kHeaderSize + chunks_.size()))), "");
+    CHECK_EQ(header.size(), kHeaderSize);
+    std::ofstream ofs(filename, std::ios::binary);
+    ofs << header << chunks_ << connections_ << chunk_infos_;
+  }
+
+ private:
+  static constexpr size_t kHeaderSize = 13 + 4 + 8 + 22 + 4;  // magic, op and index_pos fields, empty data, without the usual padding
+
+  std::string chunks_;
+  std::string connections_;
+  std::string chunk_infos_;
+};
+
+std::string WriteTestBag() {
+  TestBagWriter writer;
+  writer.AddConnection(0, "/imu", "sensor_msgs/Imu");
+  writer.AddConnection(1, "/points", "sensor_msgs/PointCloud2");
+  writer.AddConnection(2, "/log", "std_msgs/String");
+  // the second chunk overlaps the first one in time
+  writer.AddChunk({{0, 1.0, "a"}, {0, 2.0, "c"}, {2, 2.2, "x"}, {0, 3.0, "e"}}, false);
+  writer.AddChunk({{1, 1.5, "b"}, {1, 2.5, "d"}}, true);
+  writer.AddChunk({{2, 3.5, "y"}}, false);
+  writer.AddChunk({{0, 4.0, "f"}}, true);
+
+  std::string filename = UniqueTestPath("reader.bag");
+  writer.Write(filename);
+  return filename;
+}
+
+std::string ReadAll(BagReader *reader, std::vector<double> *times = nullptr) {
+  std::string result;
+  BagMessage  message;
+  while (reader->Next(&message)) {
+    result += Bytes(message.data, message.size);
+    if (times) {
+      times->push_back(message.time);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(BagReader, TimeOrderAcrossChunks) {
+  std::string filename = WriteTestBag();
+
+  BagReaderOptions options;
+  options.types             = {"sensor_msgs/Imu", "sensor_msgs/PointCloud2"};
+  options.thread_num        = 2;
+  options.max_pending_chunk = 1;
+  BagReader reader(filename, options);
+  ASSERT_EQ(reader.Connections().size(), 3);
+  EXPECT_EQ(reader.Connections()[1].topic, "/points");
+  EXPECT_DOUBLE_EQ(reader.StartTime(), 1.0);
+  EXPECT_DOUBLE_EQ(reader.EndTime(), 4.0);
+
+  std::vector<double> times;
+  EXPECT_EQ(ReadAll(&reader, &times), "abcdef");
+  EXPECT_TRUE(std::is_sorted(times.begin(), times.end()));
+
+  BagReader all(filename);
+  EXPECT_EQ(ReadAll(&all), "abcxdeyf");
+
+  unlink(filename.c_str());
+}
+
+TEST(BagReader, TimeRange) {
+  std::string filename = WriteTestBag();
+
+  BagReaderOptions options;
+  options.start_time = 1.8;
+  options.end_time   = 3.2;
+  BagReader reader(filename, options);
+  EXPECT_EQ(ReadAll(&reader), "cxde");
+
+  options.start_time          = 0.8;
+  options.end_time            = 2.2;
+  options.time_from_bag_start = true;
+  BagReader relative(filename, options);
+  EXPECT_EQ(ReadAll(&relative), "cxde");
+
+  unlink(filename.c_str());
+}
@@ -0,0 +1,113 @@
+#include "offline/bag_replay.h"
+
+#include <glog/logging.h>
+#include <ros/serialization.h>
+#include <algorithm>
+
+#include "common/msg_conversion.h"
+
+namespace {
+
+BagReaderOptions WithSensorTypes(BagReaderOptions options) {
+  options.types = {ros::message_traits::DataType<sensor_msgs::Imu>::value(), ros::message_traits::DataType<sensor_msgs::PointCloud2>::value()};
+  return options;
+}
+
+template <typename T>
+bool Deserialize(const BagMessage &bag_message, T *msg) {
+  const auto &md5sum = bag_message.connection->md5sum;
+  if (md5sum != "*" && md5sum != ros::message_traits::MD5Sum<T>::value()) {
+    return false;
+  }
+  ros::serialization::IStream stream(const_cast<uint8_t *>(bag_message.data), bag_message.size);
+  ros::serialization::deserialize(stream, *msg);
+  return true;
+}
+
+}  // namespace
+
+BagReplayStats ReplayBag(const std::string                   &bag_filename,
+                         SensorBridge                        *bridge,
+                         const std::function<bool()>         &should_stop,
+                         const BagReaderOptions              &reader_options,
+                         const std::vector<std::string>      &lidar_topics,
+                         const std::vector<LidarPointLayout> &lidar_layouts) {
+  LOG(INFO) << "Reading bag file " << bag_filename << " ...";
+  BagDatasetReader reader(bag_filename, reader_options, lidar_topics.size() > 1 ? lidar_topics : std::vector<std::string>(), lidar_layouts);
+  return ReplayDataset(&reader, bridge, should_stop);
+}
+
+void GetBagTimeRange(const std::string &bag_filename, double *start_time, double *end_time) {
+  // only the chunk index is read, no chunk is decompressed
+  BagReaderOptions options;
+  options.thread_num = 1;
+  BagReader reader(bag_filename, options);
+  *start_time = reader.StartTime();
+  *end_time   = reader.EndTime();
+}
+
+BagReplayStats ReplayDataset(DatasetReader *reader, SensorBridge *bridge, const std::function<bool()> &should_stop) {
+  BagReplayStats stats;
+  DatasetMessage message;
+  while (reader->Next(&message)) {
+    if (should_stop && should_stop()) {
+      LOG(INFO) << "Replay of dataset stopped.";
+      break;
+    }
+    if (message.type == DatasetMessage::Type::kLidar) {
+      bridge->HandleLidarScan(message.cloud, message.lidar_id);
+      ++stats.lidar_msg_num;
+    } else {
+      bridge->HandleImuData(message.imu);
+      ++stats.imu_msg_num;
+    }
+    if (stats.imu_msg_num + stats.lidar_msg_num == 1) {
+      stats.first_stamp = message.timestamp;
+    }
+    stats.last_stamp = message.timestamp;
+  }
+  return stats;
+}
+
+BagDatasetReader::BagDatasetReader(const std::string &bag_filename, BagReaderOptions options, const std::vector<std::string> &lidar_topics, const std::vector<LidarPointLayout> &lidar_layouts)
+    : reader_(bag_filename, WithSensorTypes(std::move(options))), lidar_topics_(lidar_topics), lidar_layouts_(lidar_layouts) {}
+
+bool BagDatasetReader::Next(DatasetMessage *message) {
+  BagMessage bag_message;
+  while (reader_.Next(&bag_message)) {
+    if (bag_message.connection->type == ros::message_traits::DataType<sensor_msgs::Imu>::value()) {
+      sensor_msgs::Imu msg;
+      if (!Deserialize(bag_message, &msg)) {
+        continue;
+      }
+      message->type                    = DatasetMessage::Type::kImu;
+      message->timestamp               = msg.header.stamp.toSec();
+      message->imu.timestamp           = message->timestamp;
+      message->imu.linear_acceleration = FromROS(msg.linear_acceleration);
+      message->imu.angular_velocity    = FromROS(msg.angular_velocity);
+      message->cloud.reset();
+      return true;
+    }
+    int lidar_id = 0;
+    if (!lidar_topics_.empty()) {
+      lidar_id = std::find(lidar_topics_.begin(), lidar_topics_.end(), bag_message.connection->topic) - lidar_topics_.begin();
+      if (lidar_id == lidar_topics_.size()) {
+        continue;
+      }
+    }
+    sensor_msgs::PointCloud2 msg;
+    if (!Deserialize(bag_message, &msg)) {
+      continue;
+    }
+    message->type      = DatasetMessage::Type::kLidar;
+    message->timestamp = msg.header.stamp.toSec();
+    message->lidar_id  = lidar_id;
+    message->cloud.reset(new pcl::PointCloud<hilti_ros::Point>);
+    if (!DecodePointCloud(lidar_id < lidar_layouts_.size() ? lidar_layouts_[lidar_id] : LidarPointLayout::kHesai, msg, message->cloud.get())) {
+      LOG(ERROR) << "Scan of lidar " << lidar_id << " on " << bag_message.connection->topic << " does not match its point layout, skipped.";
+      continue;
+    }
+    return true;
+  }
+  return false;
+}
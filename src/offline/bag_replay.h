@@ -0,0 +1,82 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "offline/bag_reader.h"
+#include "offline/dataset_reader.h"
+#include "sensor/sensor_bridge.h"
+
+struct BagReplayStats {
+  int    imu_msg_num   = 0;
+  int    lidar_msg_num = 0;
+  double first_stamp   = 0;  // header stamp of the first replayed message
+  double last_stamp    = 0;  // header stamp of the last replayed message
+
+  double Duration() const { return last_stamp - first_stamp; }
+};
+
+/**
+ * @brief Feed all Imu and PointCloud2 messages of a bag into a sensor bridge in bag order
+ *
+ * Reads with BagDatasetReader and replays with ReplayDataset, so scans carry the lidar id of their topic. Does not
+ * need a ros master.
+ *
+ * @param bag_filename
+ * @param bridge
+ * @param should_stop polled before every message, replay ends early if it returns true
+ * @param reader_options time range and decompression threads of the BagReader, types are replaced
+ * @param lidar_topics PointCloud2 topic of every lidar by lidar id, see LidarTopics. With a single lidar every
+ * PointCloud2 topic is read as lidar 0.
+ * @param lidar_layouts point layout by lidar id, see LidarPointLayouts
+ * @return replay statistics
+ */
+BagReplayStats ReplayBag(const std::string                   &bag_filename,
+                         SensorBridge                        *bridge,
+                         const std::function<bool()>         &should_stop    = nullptr,
+                         const BagReaderOptions              &reader_options = BagReaderOptions(),
+                         const std::vector<std::string>      &lidar_topics   = {},
+                         const std::vector<LidarPointLayout> &lidar_layouts  = {});
+
+/**
+ * @brief Get the time range of all messages recorded in a bag from its chunk index, see BagReader::StartTime
+ *
+ * @param bag_filename
+ * @param start_time bag time of the first message in seconds
+ * @param end_time bag time of the last message in seconds
+ */
+void GetBagTimeRange(const std::string &bag_filename, double *start_time, double *end_time);
+
+/**
+ * @brief Feed all messages of a dataset reader into a sensor bridge in reader order
+ *
+ * @param reader
+ * @param bridge
+ * @param should_stop polled before every message, replay ends early if it returns true
+ * @return replay statistics, with message times as stamps
+ */
+BagReplayStats ReplayDataset(DatasetReader *reader, SensorBridge *bridge, const std::function<bool()> &should_stop = nullptr);
+
+/**
+ * @brief Imu and PointCloud2 messages of a bag in record time order, read with BagReader
+ *
+ * Message timestamps are header stamps as in ReplayBag, points of the scans keep the order of the message.
+ */
+class BagDatasetReader : public DatasetReader {
+ public:
+  /**
+   * @param options types are replaced by the Imu and PointCloud2 types
+   * @param lidar_topics PointCloud2 topic of every lidar by lidar id, other PointCloud2 topics are skipped. Empty to
+   * read all PointCloud2 messages as lidar 0.
+   * @param lidar_layouts point layout by lidar id, hesai for lidars not listed
+   */
+  explicit BagDatasetReader(const std::string &bag_filename, BagReaderOptions options = BagReaderOptions(), const std::vector<std::string> &lidar_topics = {}, const std::vector<LidarPointLayout> &lidar_layouts = {});
+
+  bool Next(DatasetMessage *message) override;
+
+ private:
+  BagReader                     reader_;
+  std::vector<std::string>      lidar_topics_;
+  std::vector<LidarPointLayout> lidar_layouts_;
+};
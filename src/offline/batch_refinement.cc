@@ -0,0 +1,104 @@
+#include "offline/batch_refinement.h"
+
+#include <ceres/ceres.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "common/utils.h"
+#include "odometry/knn_surfel_matcher.h"
+#include "odometry/odometry_problem.h"
+
+BatchRefinement::BatchRefinement(const LioConfig &config, const BatchRefinementOptions &options) : config_(config), options_(options) {
+}
+
+void BatchRefinement::AddCommit(const OdometryCommit &commit) {
+  CHECK(sample_states_.empty() || commit.sample_states.empty() || sample_states_.back()->timestamp < commit.sample_states.front()->timestamp);
+  sample_states_.insert(sample_states_.end(), commit.sample_states.begin(), commit.sample_states.end());
+  imu_states_.insert(imu_states_.end(), commit.imu_states.begin(), commit.imu_states.end());
+  surfels_.insert(surfels_.end(), commit.surfels.begin(), commit.surfels.end());
+}
+
+BatchRefinementSummary BatchRefinement::Refine() {
+  CHECK_GT(options_.ordering_group_duration, 0);
+  BatchRefinementSummary refinement_summary;
+  if (sample_states_.size() < 4) {
+    LOG(WARNING) << "Too few sample states to refine: " << sample_states_.size();
+    return refinement_summary;
+  }
+
+  // surfels out of the time range of the sample states can not be constrained
+  std::deque<Surfel::Ptr> surfels;
+  for (auto &surfel : surfels_) {
+    if (surfel->timestamp > sample_states_.front()->timestamp && surfel->timestamp < sample_states_.back()->timestamp) {
+      surfels.push_back(surfel);
+    }
+  }
+  LOG(INFO) << "Batch refinement of sample_states_" << sample_states_.size() << " imu_states_" << imu_states_.size() << " surfels_" << surfels.size();
+
+  for (int iter_num = 0; iter_num < options_.outer_iter_num_max; ++iter_num) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    // 1. match all surfels against all surfels of the run
+    std::vector<SurfelCorrespondence> surfel_corrs;
+    KnnSurfelMatcher                  surfel_matcher(KnnSurfelMatcherOptionsFromConfig(config_));
+    surfel_matcher.BuildIndex(surfels);
+    surfel_matcher.Match(surfels, surfel_corrs);
+    int loop_corr_num = std::count_if(surfel_corrs.begin(), surfel_corrs.end(), [&](const SurfelCorrespondence &corr) {
+      return corr.s2->timestamp - corr.s1->timestamp > config_.sliding_window_duration;
+    });
+
+    // 2. solve all sample states jointly
+    ceres::Problem                      problem;
+    std::vector<ceres::ResidualBlockId> surfel_residual_ids, imu_residual_ids;
+    BuildBinaryLidarResiduals(sample_states_, surfel_corrs, problem, surfel_residual_ids, config_.lidar_loss_scale, config_.float_lidar_residuals);
+    BuildImuResiduals(sample_states_, imu_states_, config_, problem, imu_residual_ids);
+    PrintSurfelResiduals(surfel_residual_ids, problem, "Batch");
+    PrintImuResiduals(imu_residual_ids, problem);
+
+    // fix the pose of the first sample state as the gauge, as the odometry does
+    if (problem.HasParameterBlock(sample_states_.front()->data_cor)) {
+      problem.SetParameterization(sample_states_.front()->data_cor, new ceres::SubsetParameterization(12, {0, 1, 2, 3, 4, 5}));
+    }
+
+    // the jacobian is banded in time plus sparse loop blocks. Eliminating coarse time blocks in order keeps the fill
+    // of the band near it, the fill reducing ordering inside every block is free to order the states of its loops
+    auto ordering = std::make_shared<ceres::ParameterBlockOrdering>();
+    for (auto &sample_state : sample_states_) {
+      if (problem.HasParameterBlock(sample_state->data_cor)) {
+        int group = (sample_state->timestamp - sample_states_.front()->timestamp) / options_.ordering_group_duration;
+        ordering->AddElementToGroup(sample_state->data_cor, group);
+      }
+    }
+    ceres::Solver::Options option;
+    option.linear_solver_type     = ceres::SPARSE_NORMAL_CHOLESKY;
+    option.linear_solver_ordering = ordering;
+    option.max_num_iterations     = options_.inner_iter_num_max;
+    option.num_threads            = config_.deterministic ? 1 : options_.num_threads;
+    ceres::Solver::Summary summary;
+    ceres::Solve(option, &problem, &summary);
+
+    UpdateImuPoses(sample_states_, imu_states_);
+    UpdateSurfelPoses(imu_states_, surfels);
+    UpdateSamplePoses(sample_states_);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Batch refinement iteration " << iter_num << ": corrs_" << surfel_corrs.size() << " loop_corrs_" << loop_corr_num << " in " << seconds << " s, " << summary.BriefReport();
+
+    if (iter_num == 0) {
+      refinement_summary.initial_cost = summary.initial_cost;
+    }
+    refinement_summary.final_cost = summary.final_cost;
+    refinement_summary.iter_num   = iter_num + 1;
+  }
+  return refinement_summary;
+}
+
+std::vector<TimedPose> BatchRefinement::Trajectory() const {
+  std::vector<TimedPose> trajectory;
+  for (auto &sample_state : sample_states_) {
+    trajectory.push_back({sample_state->timestamp, Rigid3d(sample_state->pos, sample_state->rot)});
+  }
+  return trajectory;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "common/trajectory.h"
+#include "odometry/lidar_odometry.h"
+#include "odometry/lio_config.h"
+#include "odometry/surfel.h"
+
+struct BatchRefinementOptions {
+  int    outer_iter_num_max      = 3;     // rounds of global surfel matching
+  int    inner_iter_num_max      = 50;    // solver iterations per round
+  int    num_threads             = 1;
+  double ordering_group_duration = 10.0;  // the solver eliminates the sample states in time blocks of this length, in order, in seconds
+};
+
+struct BatchRefinementSummary {
+  int    iter_num     = 0;
+  double initial_cost = 0;  // of the first round, before solving
+  double final_cost   = 0;  // of the last round, after solving
+};
+
+/**
+ * @brief Offline refinement of all states of a run in one problem
+ *
+ * Collects the states committed by LidarOdometry, re-matches every surfel against all surfels of the run
+ * with one spatial index and solves the same surfel and imu factors as the odometry jointly. Correspondences
+ * between surfels far apart in time, e.g. on revisits, act as loop edges.
+ *
+ * Usage: forward every OdometryCommit to AddCommit, call LidarOdometry::Finish after the last scan, then Refine.
+ */
+class BatchRefinement {
+ public:
+  BatchRefinement(const LioConfig &config, const BatchRefinementOptions &options);
+
+  void AddCommit(const OdometryCommit &commit);
+
+  /**
+   * @brief Optimize all states, must not run while the odometry producing the commits still runs
+   *
+   * Every round re-matches the surfels, so costs of different rounds are only comparable with a single round.
+   */
+  BatchRefinementSummary Refine();
+
+  /**
+   * @brief Poses of all sample states
+   *
+   */
+  std::vector<TimedPose> Trajectory() const;
+
+  const std::deque<Surfel::Ptr> &Surfels() const { return surfels_; }
+
+ private:
+  LioConfig              config_;
+  BatchRefinementOptions options_;
+
+  std::deque<SampleState::Ptr> sample_states_;
+  std::deque<ImuState>         imu_states_;
+  std::deque<Surfel::Ptr>      surfels_;
+};
@@ -0,0 +1,110 @@
+#include "offline/batch_refinement.h"
+
+#include <gtest/gtest.h>
+#include <cmath>
+
+#include "common/utils.h"
+#include "odometry/odometry_problem.h"
+
+namespace {
+
+const Vector3d kGravity(0, 0, -9.81);
+
+Vector3d GroundTruthPosition(double timestamp) {
+  return Vector3d(timestamp, 0.2 * timestamp * timestamp, 0);
+}
+
+Vector3d GroundTruthAcceleration(double timestamp) {
+  return Vector3d(0, 0.4, 0);
+}
+
+/**
+ * @brief Smooth error of the odometry poses, zero at the first sample state which is the gauge
+ */
+Vector3d PositionError(double timestamp) {
+  return Vector3d(0.05 * std::sin(2 * timestamp), -0.03 * std::sin(3 * timestamp), 0.04 * std::sin(timestamp));
+}
+
+/**
+ * @brief Surfels on the walls, floor and ceiling of a 10m x 10m x 10m room, all observed at timestamp
+ */
+std::vector<Surfel::Ptr> RoomSurfels(double timestamp) {
+  std::vector<Surfel::Ptr> surfels;
+  for (int axis = 0; axis < 3; ++axis) {
+    Vector3d norm = Vector3d::Unit(axis);
+    Matrix3d cov  = Matrix3d::Identity() * 0.01 - norm * norm.transpose() * (0.01 - 1e-6);
+    for (double offset : {-5.0, 5.0}) {
+      for (int u = -4; u <= 4; ++u) {
+        for (int v = -4; v <= 4; ++v) {
+          Vector3d center;
+          center[axis]           = offset;
+          center[(axis + 1) % 3] = u;
+          center[(axis + 2) % 3] = v;
+          surfels.push_back(std::make_shared<Surfel>(timestamp, center, cov, norm, 1.0, 0.001));
+        }
+      }
+    }
+  }
+  return surfels;
+}
+
+/**
+ * @brief States of a run without rotation whose poses carry a smooth error, as one commit
+ */
+OdometryCommit MakeCommit(const LioConfig &config) {
+  OdometryCommit commit;
+  for (int i = 0; i <= 20; ++i) {
+    auto sample_state       = std::make_shared<SampleState>();
+    sample_state->timestamp = i * 0.1;
+    sample_state->grav      = kGravity;
+    sample_state->rot       = Quaterniond::Identity();
+    sample_state->pos       = GroundTruthPosition(sample_state->timestamp) + PositionError(sample_state->timestamp);
+    commit.sample_states.push_back(sample_state);
+  }
+
+  std::deque<ImuState> imu_states;
+  for (int i = 0; i <= std::lround(2 * config.imu_rate); ++i) {
+    ImuState imu_state;
+    imu_state.timestamp = i / config.imu_rate;
+    imu_state.rot       = Quaterniond::Identity();
+    imu_state.pos       = GroundTruthPosition(imu_state.timestamp) + PositionError(imu_state.timestamp);
+    imu_state.acc       = GroundTruthAcceleration(imu_state.timestamp) - kGravity;
+    imu_state.gyr       = Vector3d::Zero();
+    imu_states.push_back(imu_state);
+  }
+
+  // the surfels are observed at the ground truth poses, but placed by the odometry poses
+  std::deque<Surfel::Ptr> surfels;
+  for (double timestamp : {0.25, 0.65, 1.05, 1.45, 1.85}) {
+    for (auto &surfel : RoomSurfels(timestamp)) {
+      surfel->UpdatePose(GroundTruthPosition(timestamp), Quaterniond::Identity());
+      surfels.push_back(surfel);
+    }
+  }
+  UpdateSurfelPoses(imu_states, surfels);
+
+  commit.imu_states.assign(imu_states.begin(), imu_states.end());
+  commit.surfels.assign(surfels.begin(), surfels.end());
+  return commit;
+}
+
+}  // namespace
+
+TEST(BatchRefinement, RefineDoesNotIncreaseCost) {
+  LioConfig              config;
+  BatchRefinementOptions options;
+  options.outer_iter_num_max = 1;  // one round, so both costs are of the same correspondences
+
+  BatchRefinement refinement(config, options);
+  refinement.AddCommit(MakeCommit(config));
+  auto summary = refinement.Refine();
+  EXPECT_EQ(summary.iter_num, 1);
+  EXPECT_GE(summary.final_cost, 0);
+  EXPECT_LE(summary.final_cost, summary.initial_cost);
+
+  auto trajectory = refinement.Trajectory();
+  ASSERT_EQ(trajectory.size(), 21);
+  for (auto &timed_pose : trajectory) {
+    EXPECT_TRUE(std::isfinite(timed_pose.pose.translation().norm())) << timed_pose.timestamp;
+  }
+}
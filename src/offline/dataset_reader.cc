@@ -0,0 +1,241 @@
+#include "offline/dataset_reader.h"
+
+#include <glog/logging.h>
+#include <pcl/io/pcd_io.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "common/thread_utils.h"
+
+namespace {
+
+std::vector<std::string> ListFiles(const std::string &dir, const std::string &extension) {
+  std::vector<std::string> filenames;
+  for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.is_regular_file() && entry.path().extension() == extension) {
+      filenames.push_back(entry.path().string());
+    }
+  }
+  std::sort(filenames.begin(), filenames.end());
+  return filenames;
+}
+
+/**
+ * @brief Parse a number up to the next separator
+ *
+ * @return false if there is no number at begin
+ */
+bool ParseDouble(const char *&begin, const char *end, double *value) {
+  while (begin < end && (*begin == ' ' || *begin == '\t')) {
+    ++begin;
+  }
+  auto result = std::from_chars(begin, end, *value);
+  if (result.ec != std::errc()) {
+    return false;
+  }
+  begin = result.ptr;
+  while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == ',')) {
+    ++begin;
+  }
+  return true;
+}
+
+}  // namespace
+
+LidarSequenceReader::LidarSequenceReader(const std::string &dir, const std::string &extension, const LidarSequenceOptions &options) : options_(options) {
+  filenames_ = ListFiles(dir, extension);
+  if (!options_.times_filename.empty()) {
+    std::ifstream ifs(options_.times_filename);
+    CHECK(ifs) << "Failed to open scan times " << options_.times_filename;
+    double time;
+    while (ifs >> time) {
+      start_times_.push_back(time);
+    }
+    CHECK_GE(start_times_.size(), filenames_.size()) << "Fewer scan times in " << options_.times_filename << " than scans in " << dir;
+  } else {
+    for (const auto &filename : filenames_) {
+      std::string stem = std::filesystem::path(filename).stem().string();
+      double      time;
+      auto        result = std::from_chars(stem.data(), stem.data() + stem.size(), time);
+      CHECK(result.ec == std::errc() && result.ptr == stem.data() + stem.size()) << "No time in scan file name " << filename << ", a times file is required.";
+      start_times_.push_back(time);
+    }
+  }
+  LOG(INFO) << "Found " << filenames_.size() << " scans in " << dir;
+}
+
+bool LidarSequenceReader::Next(DatasetMessage *message) {
+  while (index_ < filenames_.size()) {
+    const auto &filename   = filenames_[index_];
+    double      start_time = start_times_[index_];
+    ++index_;
+
+    pcl::PointCloud<hilti_ros::Point>::Ptr cloud(new pcl::PointCloud<hilti_ros::Point>);
+    if (!LoadScan(filename, cloud.get())) {
+      LOG(ERROR) << "Failed to read scan " << filename << ", skipped.";
+      continue;
+    }
+    if (cloud->empty()) {
+      continue;
+    }
+
+    bool has_time = std::any_of(cloud->begin(), cloud->end(), [](const hilti_ros::Point &point) { return point.time != 0; });
+    if (!has_time) {
+      for (auto &point : *cloud) {
+        point.time = start_time + options_.scan_period * (M_PI - std::atan2(double(point.y), double(point.x))) / (2 * M_PI);
+      }
+    }
+    std::stable_sort(cloud->begin(), cloud->end(), [](const hilti_ros::Point &lhs, const hilti_ros::Point &rhs) { return lhs.time < rhs.time; });
+
+    message->type      = DatasetMessage::Type::kLidar;
+    message->timestamp = cloud->back().time;
+    message->cloud     = cloud;
+    return true;
+  }
+  return false;
+}
+
+bool KittiBinReader::LoadScan(const std::string &filename, pcl::PointCloud<hilti_ros::Point> *cloud) {
+  if (!file_.Open(filename) || file_.Size() % (4 * sizeof(float)) != 0) {
+    return false;
+  }
+  const float *data = reinterpret_cast<const float *>(file_.Data());
+  size_t       num  = file_.Size() / (4 * sizeof(float));
+  cloud->resize(num);
+  for (size_t i = 0; i < num; ++i) {
+    auto &point     = cloud->points[i];
+    point.x         = data[4 * i + 0];
+    point.y         = data[4 * i + 1];
+    point.z         = data[4 * i + 2];
+    point.intensity = data[4 * i + 3];
+    point.time      = 0;
+    point.ring      = 0;
+  }
+  file_.Close();
+  return true;
+}
+
+bool PcdSequenceReader::LoadScan(const std::string &filename, pcl::PointCloud<hilti_ros::Point> *cloud) {
+  // binary pcd files are memory mapped by pcl, fields missing in the file are left at 0
+  return pcl::io::loadPCDFile(filename, *cloud) == 0;
+}
+
+CsvImuReader::CsvImuReader(const std::string &filename, const CsvImuOptions &options) : options_(options) {
+  CHECK(file_.Open(filename)) << "Failed to open imu log " << filename;
+}
+
+bool CsvImuReader::Next(DatasetMessage *message) {
+  const char *data = file_.Data();
+  while (offset_ < file_.Size()) {
+    const char *begin = data + offset_;
+    const char *end   = static_cast<const char *>(memchr(begin, '\n', file_.Size() - offset_));
+    end               = end ? end : data + file_.Size();
+    offset_           = end - data + 1;
+
+    double values[7];
+    int    num = 0;
+    while (num < 7 && ParseDouble(begin, end, &values[num])) {
+      ++num;
+    }
+    if (num < 7) {
+      continue;  // header, comment or incomplete line
+    }
+
+    Vector3d first(values[1], values[2], values[3]);
+    Vector3d second(values[4], values[5], values[6]);
+    message->type                    = DatasetMessage::Type::kImu;
+    message->timestamp               = values[0] * options_.time_scale;
+    message->imu.timestamp           = message->timestamp;
+    message->imu.angular_velocity    = options_.gyro_first ? first : second;
+    message->imu.linear_acceleration = options_.gyro_first ? second : first;
+    message->cloud.reset();
+    return true;
+  }
+  return false;
+}
+
+MergedDatasetReader::MergedDatasetReader(std::vector<std::unique_ptr<DatasetReader>> readers) : readers_(std::move(readers)) {
+  heads_.resize(readers_.size());
+  valid_.resize(readers_.size());
+  for (int i = 0; i < readers_.size(); ++i) {
+    valid_[i] = readers_[i]->Next(&heads_[i]);
+  }
+}
+
+bool MergedDatasetReader::Next(DatasetMessage *message) {
+  int earliest = -1;
+  for (int i = 0; i < readers_.size(); ++i) {
+    if (valid_[i] && (earliest < 0 || heads_[i].timestamp < heads_[earliest].timestamp)) {
+      earliest = i;
+    }
+  }
+  if (earliest < 0) {
+    return false;
+  }
+  *message         = std::move(heads_[earliest]);
+  valid_[earliest] = readers_[earliest]->Next(&heads_[earliest]);
+  return true;
+}
+
+PrefetchDatasetReader::PrefetchDatasetReader(std::unique_ptr<DatasetReader> reader, int capacity) : reader_(std::move(reader)), capacity_(capacity) {
+  CHECK_GT(capacity_, 0);
+  thread_ = std::thread(&PrefetchDatasetReader::Run, this);
+}
+
+PrefetchDatasetReader::~PrefetchDatasetReader() {
+  {
+    absl::MutexLock lock(&mutex_);
+    running_ = false;
+  }
+  thread_.join();
+}
+
+bool PrefetchDatasetReader::Next(DatasetMessage *message) {
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return !messages_.empty() || done_;
+  };
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(&predicate));
+  if (messages_.empty()) {
+    return false;
+  }
+  *message = std::move(messages_.front());
+  messages_.pop_front();
+  return true;
+}
+
+void PrefetchDatasetReader::Run() {
+  ConfigureCurrentThread("dataset_prefetch");
+  const auto predicate = [this]() EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    return messages_.size() < capacity_ || !running_;
+  };
+  while (true) {
+    DatasetMessage message;
+    bool           ok = reader_->Next(&message);
+
+    absl::MutexLock lock(&mutex_);
+    if (!ok) {
+      done_ = true;
+      return;
+    }
+    messages_.push_back(std::move(message));
+    mutex_.Await(absl::Condition(&predicate));
+    if (!running_) {
+      return;
+    }
+  }
+}
+
+std::unique_ptr<DatasetReader> OpenLidarSequence(const std::string &dir, const LidarSequenceOptions &options) {
+  if (!ListFiles(dir, ".bin").empty()) {
+    return std::make_unique<KittiBinReader>(dir, options);
+  }
+  if (!ListFiles(dir, ".pcd").empty()) {
+    return std::make_unique<PcdSequenceReader>(dir, options);
+  }
+  return nullptr;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <pcl/point_cloud.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "io/mapped_file.h"
+#include "common/common.h"
+
+/**
+ * @brief One imu measurement or one lidar scan of a dataset
+ */
+struct DatasetMessage {
+  enum class Type {
+    kImu,
+    kLidar,
+  };
+
+  Type                                   type      = Type::kImu;
+  double                                 timestamp = 0;  // of the imu measurement, or of the scan, see the reader
+  ImuData                                imu;
+  pcl::PointCloud<hilti_ros::Point>::Ptr cloud;  // in the lidar frame with absolute point times
+  int                                    lidar_id = 0;
+};
+
+/**
+ * @brief Sequential reader of a recorded sensor stream
+ */
+class DatasetReader {
+ public:
+  virtual ~DatasetReader() = default;
+
+  /**
+   * @return false at the end of the dataset
+   */
+  virtual bool Next(DatasetMessage *message) = 0;
+};
+
+struct LidarSequenceOptions {
+  std::string times_filename;       // scan start times in seconds, one per line, empty to parse them from the file names
+  double      scan_period   = 0.1;  // used to derive point times from the azimuth if the files have none, in seconds
+};
+
+/**
+ * @brief Directory of one file per scan, read in file name order
+ *
+ * Scan start times come from the times file, or from the file names, e.g. 1634567890.123456.bin. Points without
+ * times get one from their azimuth, assuming a clockwise rotation seen from above that starts at the negative x axis.
+ * Points are sorted by time and the scan timestamp is the time of the last point.
+ */
+class LidarSequenceReader : public DatasetReader {
+ public:
+  /**
+   * @param extension of the scan files, e.g. ".bin", other files are ignored
+   */
+  LidarSequenceReader(const std::string &dir, const std::string &extension, const LidarSequenceOptions &options);
+
+  bool Next(DatasetMessage *message) override;
+
+  int ScanNum() const { return filenames_.size(); }
+
+ protected:
+  /**
+   * @brief Load one scan, leave the point times at 0 if the file has none
+   *
+   * @return false if the file can not be read
+   */
+  virtual bool LoadScan(const std::string &filename, pcl::PointCloud<hilti_ros::Point> *cloud) = 0;
+
+ private:
+  LidarSequenceOptions     options_;
+  std::vector<std::string> filenames_;
+  std::vector<double>      start_times_;
+  int                      index_ = 0;
+};
+
+/**
+ * @brief KITTI velodyne scans, 4 floats x, y, z, reflectance per point
+ */
+class KittiBinReader : public LidarSequenceReader {
+ public:
+  explicit KittiBinReader(const std::string &dir, const LidarSequenceOptions &options = LidarSequenceOptions()) : LidarSequenceReader(dir, ".bin", options) {}
+
+ protected:
+  bool LoadScan(const std::string &filename, pcl::PointCloud<hilti_ros::Point> *cloud) override;
+
+ private:
+  MappedFile file_;
+};
+
+/**
+ * @brief PCD scans, with the fields of hilti_ros::Point if available
+ */
+class PcdSequenceReader : public LidarSequenceReader {
+ public:
+  explicit PcdSequenceReader(const std::string &dir, const LidarSequenceOptions &options = LidarSequenceOptions()) : LidarSequenceReader(dir, ".pcd", options) {}
+
+ protected:
+  bool LoadScan(const std::string &filename, pcl::PointCloud<hilti_ros::Point> *cloud) override;
+};
+
+struct CsvImuOptions {
+  double time_scale = 1e-9;  // seconds per time unit of the first column, nanoseconds by default
+  bool   gyro_first = true;  // columns are time, gyro xyz, acc xyz as in EuRoC, otherwise time, acc xyz, gyro xyz
+};
+
+/**
+ * @brief Comma separated imu log, lines that do not start with a number are skipped
+ */
+class CsvImuReader : public DatasetReader {
+ public:
+  explicit CsvImuReader(const std::string &filename, const CsvImuOptions &options = CsvImuOptions());
+
+  bool Next(DatasetMessage *message) override;
+
+ private:
+  CsvImuOptions options_;
+  MappedFile    file_;
+  size_t        offset_ = 0;
+};
+
+/**
+ * @brief Merge readers by message time, each reader must be sorted by time
+ */
+class MergedDatasetReader : public DatasetReader {
+ public:
+  explicit MergedDatasetReader(std::vector<std::unique_ptr<DatasetReader>> readers);
+
+  bool Next(DatasetMessage *message) override;
+
+ private:
+  std::vector<std::unique_ptr<DatasetReader>> readers_;
+  std::vector<DatasetMessage>                 heads_;
+  std::vector<bool>                           valid_;
+};
+
+/**
+ * @brief Read ahead of the consumer on a background thread, e.g. to decode scans while the odometry runs
+ */
+class PrefetchDatasetReader : public DatasetReader {
+ public:
+  /**
+   * @param capacity max number of messages read ahead
+   */
+  PrefetchDatasetReader(std::unique_ptr<DatasetReader> reader, int capacity);
+  ~PrefetchDatasetReader() override;
+
+  PrefetchDatasetReader(const PrefetchDatasetReader &)            = delete;
+  PrefetchDatasetReader &operator=(const PrefetchDatasetReader &) = delete;
+
+  bool Next(DatasetMessage *message) override LOCKS_EXCLUDED(mutex_);
+
+ private:
+  void Run();
+
+ private:
+  std::unique_ptr<DatasetReader> reader_;  // owned by the prefetch thread
+  int                            capacity_;
+
+  absl::Mutex                mutex_;
+  std::deque<DatasetMessage> messages_ GUARDED_BY(mutex_);
+  bool                       done_ GUARDED_BY(mutex_)    = false;  // the reader has no more messages
+  bool                       running_ GUARDED_BY(mutex_) = true;
+  std::thread                thread_;
+};
+
+/**
+ * @brief Open a directory of .bin or .pcd scans, depending on the files found in it
+ *
+ * @return null if the directory has no scans
+ */
+std::unique_ptr<DatasetReader> OpenLidarSequence(const std::string &dir, const LidarSequenceOptions &options = LidarSequenceOptions());
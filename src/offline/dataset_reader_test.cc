@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+
+#include "common/test_utils.h"
+#include "offline/dataset_reader.h"
+
+namespace {
+
+std::string UniqueDir(const std::string &suffix) {
+  std::string dir = UniqueTestPath(suffix);
+  std::filesystem::create_directories(dir);
+  return dir;
+}
+
+/**
+ * @brief KITTI scans at 0.1 s, each with 4 points at azimuths 90, 180, -90 and 0 degrees
+ */
+void WriteKittiScans(const std::string &dir, int scan_num) {
+  std::ofstream times(dir + "/times.txt");
+  for (int i = 0; i < scan_num; ++i) {
+    char name[16];
+    snprintf(name, sizeof(name), "/%06d.bin", i);
+    std::ofstream ofs(dir + name, std::ios::binary);
+    float         points[4][4] = {{0, 10, 0, 1}, {-10, 0, 0, 2}, {0, -10, 0, 3}, {10, 0, 0, 4}};
+    ofs.write(reinterpret_cast<const char *>(points), sizeof(points));
+    times << 100 + i * 0.1 << "\n";
+  }
+}
+
+}  // namespace
+
+TEST(DatasetReader, KittiBin) {
+  std::string dir = UniqueDir("kitti");
+  WriteKittiScans(dir, 3);
+
+  LidarSequenceOptions options;
+  options.times_filename = dir + "/times.txt";
+  KittiBinReader reader(dir, options);
+  ASSERT_EQ(reader.ScanNum(), 3);
+
+  DatasetMessage message;
+  ASSERT_TRUE(reader.Next(&message));
+  ASSERT_EQ(message.type, DatasetMessage::Type::kLidar);
+  ASSERT_EQ(message.cloud->size(), 4);
+  // sorted by the time derived from the azimuth, starting at the negative x axis and turning clockwise
+  EXPECT_EQ(message.cloud->points[0].intensity, 2);
+  EXPECT_EQ(message.cloud->points[1].intensity, 1);
+  EXPECT_EQ(message.cloud->points[2].intensity, 4);
+  EXPECT_EQ(message.cloud->points[3].intensity, 3);
+  EXPECT_NEAR(message.cloud->points[0].time, 100, 1e-9);
+  EXPECT_NEAR(message.cloud->points[3].time, 100.075, 1e-9);
+  EXPECT_EQ(message.timestamp, message.cloud->points[3].time);
+
+  ASSERT_TRUE(reader.Next(&message));
+  ASSERT_TRUE(reader.Next(&message));
+  EXPECT_FALSE(reader.Next(&message));
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DatasetReader, MergedCsvImuAndPrefetchedScans) {
+  std::string dir = UniqueDir("merged");
+  WriteKittiScans(dir, 5);
+  {
+    std::ofstream ofs(dir + "/imu.csv");
+    ofs << "#timestamp [ns],w_x [rad s^-1],w_y [rad s^-1],w_z [rad s^-1],a_x [m s^-2],a_y [m s^-2],a_z [m s^-2]\n";
+    for (int i = 0; i < 100; ++i) {
+      ofs << 100'000'000'000LL + i * 5'000'000LL << ",0.1,0.2,0.3,0,0,9.81\n";
+    }
+  }
+
+  LidarSequenceOptions options;
+  options.times_filename = dir + "/times.txt";
+  std::vector<std::unique_ptr<DatasetReader>> readers;
+  readers.emplace_back(new PrefetchDatasetReader(OpenLidarSequence(dir, options), 2));
+  readers.emplace_back(new CsvImuReader(dir + "/imu.csv"));
+  MergedDatasetReader reader(std::move(readers));
+
+  DatasetMessage message;
+  int            imu_num = 0, lidar_num = 0;
+  double         last_timestamp = 0;
+  while (reader.Next(&message)) {
+    EXPECT_GE(message.timestamp, last_timestamp);
+    last_timestamp = message.timestamp;
+    if (message.type == DatasetMessage::Type::kImu) {
+      EXPECT_EQ(message.imu.angular_velocity, Vector3d(0.1, 0.2, 0.3));
+      EXPECT_EQ(message.imu.linear_acceleration, Vector3d(0, 0, 9.81));
+      ++imu_num;
+    } else {
+      ++lidar_num;
+    }
+  }
+  EXPECT_EQ(imu_num, 100);
+  EXPECT_EQ(lidar_num, 5);
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,68 @@
+#include "offline/segment_stitcher.h"
+
+#include <glog/logging.h>
+#include <iomanip>
+#include <limits>
+
+namespace {
+
+std::vector<Surfel::Ptr> SurfelsInTimeRange(const std::vector<Surfel::Ptr> &surfels, double start_time, double end_time) {
+  std::vector<Surfel::Ptr> ret;
+  for (auto &surfel : surfels) {
+    if (surfel->timestamp >= start_time && surfel->timestamp <= end_time) {
+      ret.push_back(surfel);
+    }
+  }
+  return ret;
+}
+
+}  // namespace
+
+SegmentAlignment AlignSegment(const SegmentResult &previous, const SegmentResult &current, const SegmentStitchOptions &options) {
+  SegmentAlignment alignment;
+
+  // 1. initial guess from the overlapping poses
+  double  timestamp = current.boundary - options.registration_window / 2;
+  Rigid3d previous_pose, current_pose;
+  if (!InterpolatePose(previous.trajectory, timestamp, &previous_pose) || !InterpolatePose(current.trajectory, timestamp, &current_pose)) {
+    LOG(ERROR) << std::fixed << std::setprecision(3) << "No overlapping poses at " << timestamp << ", segment at " << current.boundary << " is not aligned.";
+    return alignment;
+  }
+  alignment.to_previous = previous_pose * current_pose.inverse();
+
+  // 2. refine by surfel registration
+  double  window_start = current.boundary - options.registration_window;
+  auto    target       = SurfelsInTimeRange(previous.surfels, window_start, current.boundary);
+  auto    source       = SurfelsInTimeRange(current.surfels, window_start, current.boundary);
+  Rigid3d to_previous  = alignment.to_previous;
+  if (RegisterSurfels(target, source, options.registration, &to_previous, &alignment.summary)) {
+    alignment.to_previous = to_previous;
+    alignment.registered  = true;
+  } else {
+    LOG(WARNING) << std::fixed << std::setprecision(3) << "Surfel registration failed, segment at " << current.boundary << " is aligned by poses only.";
+  }
+  return alignment;
+}
+
+std::vector<TimedPose> StitchSegments(const std::vector<SegmentResult> &segments, const SegmentStitchOptions &options, std::vector<SegmentAlignment> *alignments) {
+  std::vector<TimedPose> trajectory;
+  Rigid3d                segment_to_world;
+  for (int i = 0; i < segments.size(); ++i) {
+    if (i > 0) {
+      CHECK_LT(segments[i - 1].boundary, segments[i].boundary);
+      auto alignment   = AlignSegment(segments[i - 1], segments[i], options);
+      segment_to_world = segment_to_world * alignment.to_previous;
+      if (alignments) {
+        alignments->push_back(alignment);
+      }
+    }
+
+    double end = i + 1 < segments.size() ? segments[i + 1].boundary : std::numeric_limits<double>::max();
+    for (auto &timed_pose : segments[i].trajectory) {
+      if (timed_pose.timestamp >= segments[i].boundary && timed_pose.timestamp < end) {
+        trajectory.push_back({timed_pose.timestamp, segment_to_world * timed_pose.pose});
+      }
+    }
+  }
+  return trajectory;
+}
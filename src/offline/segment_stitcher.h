@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "common/trajectory.h"
+#include "odometry/surfel.h"
+#include "odometry/surfel_registration.h"
+
+/**
+ * @brief Output of an odometry run over one time segment of a sequence
+ *
+ * Timeline of segment k, where b_k is its boundary:
+ *
+ *   start_time               b_k                              b_{k+1}            end_time
+ *       |---- overlap with k-1 ----|---------- poses of segment k ----------|-- tail --|
+ *
+ * The first half of the overlap is the warm up of the odometry and is never used.
+ */
+struct SegmentResult {
+  double                   start_time = 0;
+  double                   boundary   = 0;  // poses from here on belong to this segment
+  double                   end_time   = 0;
+  std::vector<TimedPose>   trajectory;      // in the world frame of this segment
+  std::vector<Surfel::Ptr> surfels;         // finalized surfels near the boundaries, in the world frame of this segment
+};
+
+struct SegmentStitchOptions {
+  double                    registration_window = 15.0;  // surfels in [b_k - registration_window, b_k] are used to align segment k to k-1
+  SurfelRegistrationOptions registration;
+};
+
+struct SegmentAlignment {
+  Rigid3d                   to_previous;         // segment k world frame to segment k-1 world frame
+  bool                      registered = false;  // false if only the overlapping poses were used
+  SurfelRegistrationSummary summary;
+};
+
+/**
+ * @brief Align segment k to segment k-1
+ *
+ * The initial guess comes from the poses of both segments in the middle of the registration window,
+ * then it is refined by registering the surfels both segments finalized in the registration window.
+ */
+SegmentAlignment AlignSegment(const SegmentResult &previous, const SegmentResult &current, const SegmentStitchOptions &options);
+
+/**
+ * @brief Chain all segments into the world frame of the first segment and concatenate their trajectories
+ *
+ * @param segments sorted by boundary
+ * @param options
+ * @param alignments optional, alignment of every segment but the first one
+ * @return stitched trajectory
+ */
+std::vector<TimedPose> StitchSegments(const std::vector<SegmentResult> &segments, const SegmentStitchOptions &options, std::vector<SegmentAlignment> *alignments = nullptr);
@@ -0,0 +1,111 @@
+#include "offline/segment_stitcher.h"
+
+#include <gtest/gtest.h>
+#include <cmath>
+
+#include "common/utils.h"
+
+namespace {
+
+/**
+ * @brief Pose of the ground truth trajectory, a slow turn through a room
+ */
+Rigid3d GroundTruthPose(double timestamp) {
+  return Rigid3d(Vector3d(0.1 * timestamp, std::sin(0.05 * timestamp), 0.01 * timestamp), Exp(Vector3d(0, 0, 0.02 * timestamp)));
+}
+
+/**
+ * @brief Surfels on the walls, floor and ceiling of a 10m x 10m x 10m room, all finalized at timestamp
+ */
+std::vector<Surfel::Ptr> RoomSurfels(double timestamp) {
+  std::vector<Surfel::Ptr> surfels;
+  for (int axis = 0; axis < 3; ++axis) {
+    Vector3d norm = Vector3d::Unit(axis);
+    Matrix3d cov  = Matrix3d::Identity() * 0.01 - norm * norm.transpose() * (0.01 - 1e-6);
+    for (double offset : {-5.0, 5.0}) {
+      for (int u = -4; u <= 4; ++u) {
+        for (int v = -4; v <= 4; ++v) {
+          Vector3d center;
+          center[axis]           = offset;
+          center[(axis + 1) % 3] = u;
+          center[(axis + 2) % 3] = v;
+          surfels.push_back(std::make_shared<Surfel>(timestamp, center, cov, norm, 1.0, 0.001));
+        }
+      }
+    }
+  }
+  return surfels;
+}
+
+/**
+ * @brief Segment over [start_time, end_time] whose world frame is the ground truth world frame moved by world_to_segment
+ */
+SegmentResult MakeSegment(double start_time, double boundary, double end_time, const Rigid3d &world_to_segment) {
+  SegmentResult segment;
+  segment.start_time = start_time;
+  segment.boundary   = boundary;
+  segment.end_time   = end_time;
+  for (int i = std::lround(start_time * 10); i <= std::lround(end_time * 10); ++i) {
+    segment.trajectory.push_back({i / 10.0, world_to_segment * GroundTruthPose(i / 10.0)});
+  }
+  // the room is finalized again every 10s, so that every registration window has surfels of both segments
+  for (double timestamp = start_time + 5; timestamp <= end_time; timestamp += 10) {
+    for (auto &surfel : RoomSurfels(timestamp)) {
+      segment.surfels.push_back(TransformSurfel(world_to_segment, surfel));
+    }
+  }
+  return segment;
+}
+
+}  // namespace
+
+TEST(SegmentStitcher, AlignSegmentRecoverTransform) {
+  Rigid3d world_to_current(Vector3d(3, -2, 0.5), Exp(Vector3d(0.1, -0.05, 0.8)));
+  auto    previous = MakeSegment(0, 0, 30, Rigid3d());
+  auto    current  = MakeSegment(10, 20, 50, world_to_current);
+
+  auto alignment = AlignSegment(previous, current, SegmentStitchOptions());
+  EXPECT_TRUE(alignment.registered);
+  EXPECT_TRUE(alignment.summary.converged);
+  Rigid3d to_previous_gt = world_to_current.inverse();
+  EXPECT_LT((alignment.to_previous.translation() - to_previous_gt.translation()).norm(), 1e-6);
+  EXPECT_LT(alignment.to_previous.rotation().angularDistance(to_previous_gt.rotation()), 1e-6);
+}
+
+TEST(SegmentStitcher, AlignSegmentByPosesWithoutSurfels) {
+  Rigid3d world_to_current(Vector3d(-1, 4, 0), Exp(Vector3d(0, 0, -1.2)));
+  auto    previous = MakeSegment(0, 0, 30, Rigid3d());
+  auto    current  = MakeSegment(10, 20, 50, world_to_current);
+  current.surfels.clear();
+
+  auto alignment = AlignSegment(previous, current, SegmentStitchOptions());
+  EXPECT_FALSE(alignment.registered);
+  Rigid3d to_previous_gt = world_to_current.inverse();
+  EXPECT_LT((alignment.to_previous.translation() - to_previous_gt.translation()).norm(), 1e-6);
+  EXPECT_LT(alignment.to_previous.rotation().angularDistance(to_previous_gt.rotation()), 1e-6);
+}
+
+TEST(SegmentStitcher, StitchSegmentsIntoFirstWorldFrame) {
+  std::vector<SegmentResult> segments = {MakeSegment(0, 0, 30, Rigid3d()),
+                                         MakeSegment(10, 20, 50, Rigid3d(Vector3d(3, -2, 0.5), Exp(Vector3d(0.1, -0.05, 0.8)))),
+                                         MakeSegment(30, 40, 60, Rigid3d(Vector3d(-1, 4, 0), Exp(Vector3d(0, 0, -1.2))))};
+
+  std::vector<SegmentAlignment> alignments;
+  auto                          trajectory = StitchSegments(segments, SegmentStitchOptions(), &alignments);
+  ASSERT_EQ(alignments.size(), 2);
+  EXPECT_TRUE(alignments[0].registered);
+  EXPECT_TRUE(alignments[1].registered);
+
+  // every pose once, from the segment its timestamp belongs to
+  ASSERT_EQ(trajectory.size(), 601);
+  EXPECT_NEAR(trajectory.front().timestamp, 0, 1e-9);
+  EXPECT_NEAR(trajectory.back().timestamp, 60, 1e-9);
+  for (int i = 0; i < trajectory.size(); ++i) {
+    if (i > 0) {
+      EXPECT_GT(trajectory[i].timestamp, trajectory[i - 1].timestamp);
+    }
+    Rigid3d pose_gt = GroundTruthPose(trajectory[i].timestamp);
+    EXPECT_LT((trajectory[i].pose.translation() - pose_gt.translation()).norm(), 1e-6) << trajectory[i].timestamp;
+    EXPECT_LT(trajectory[i].pose.rotation().angularDistance(pose_gt.rotation()), 1e-6) << trajectory[i].timestamp;
+  }
+}
@@ -0,0 +1,44 @@
+#include "sensor/point_cloud_decoder.h"
+
+bool ParseLidarPointLayout(const std::string &name, LidarPointLayout *layout) {
+  if (name == "hesai") {
+    *layout = LidarPointLayout::kHesai;
+  } else if (name == "ouster") {
+    *layout = LidarPointLayout::kOuster;
+  } else if (name == "velodyne") {
+    *layout = LidarPointLayout::kVelodyne;
+  } else if (name == "livox") {
+    *layout = LidarPointLayout::kLivox;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace internal {
+
+int FindPointField(const sensor_msgs::PointCloud2 &msg, const char *name, std::uint8_t datatype, int size) {
+  for (const auto &field : msg.fields) {
+    if (field.name == name) {
+      bool valid = field.datatype == datatype && field.count <= 1 && field.offset + size <= msg.point_step;
+      return valid ? field.offset : -1;
+    }
+  }
+  return -1;
+}
+
+}  // namespace internal
+
+bool DecodePointCloud(LidarPointLayout layout, const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<hilti_ros::Point> *cloud) {
+  switch (layout) {
+    case LidarPointLayout::kHesai:
+      return DecodePointCloud<point_layout::Hesai>(msg, cloud);
+    case LidarPointLayout::kOuster:
+      return DecodePointCloud<point_layout::Ouster>(msg, cloud);
+    case LidarPointLayout::kVelodyne:
+      return DecodePointCloud<point_layout::Velodyne>(msg, cloud);
+    case LidarPointLayout::kLivox:
+      return DecodePointCloud<point_layout::Livox>(msg, cloud);
+  }
+  return false;
+}
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <pcl/point_cloud.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "common/common.h"
+
+/**
+ * @brief Point layouts of the PointCloud2 messages of the supported lidar drivers
+ *
+ * All layouts have float x, y, z and optionally float intensity.
+ */
+enum class LidarPointLayout {
+  kHesai,     // double timestamp in seconds, uint16 ring, as in the Hilti datasets
+  kOuster,    // uint32 t in nanoseconds since the header stamp, uint16 ring
+  kVelodyne,  // float time in seconds since the header stamp, uint16 ring
+  kLivox,     // double timestamp in nanoseconds, uint8 line, as published by livox_ros_driver2
+};
+
+/**
+ * @param name hesai, ouster, velodyne or livox
+ * @return false for an unknown name
+ */
+bool ParseLidarPointLayout(const std::string &name, LidarPointLayout *layout);
+
+namespace point_layout {
+
+struct Hesai {
+  using TimeType = double;
+  using RingType = std::uint16_t;
+
+  static constexpr const char *kTimeField = "timestamp";
+  static constexpr const char *kRingField = "ring";
+
+  static double AbsoluteTime(TimeType time, double /*stamp*/) { return time; }
+};
+
+struct Ouster {
+  using TimeType = std::uint32_t;
+  using RingType = std::uint16_t;
+
+  static constexpr const char *kTimeField = "t";
+  static constexpr const char *kRingField = "ring";
+
+  static double AbsoluteTime(TimeType time, double stamp) { return stamp + time * 1e-9; }
+};
+
+struct Velodyne {
+  using TimeType = float;
+  using RingType = std::uint16_t;
+
+  static constexpr const char *kTimeField = "time";
+  static constexpr const char *kRingField = "ring";
+
+  static double AbsoluteTime(TimeType time, double stamp) { return stamp + time; }
+};
+
+struct Livox {
+  using TimeType = double;
+  using RingType = std::uint8_t;
+
+  static constexpr const char *kTimeField = "timestamp";
+  static constexpr const char *kRingField = "line";
+
+  static double AbsoluteTime(TimeType time, double /*stamp*/) { return time * 1e-9; }
+};
+
+}  // namespace point_layout
+
+namespace internal {
+
+template <typename T>
+struct PointFieldType;
+
+template <>
+struct PointFieldType<std::uint8_t> {
+  static constexpr std::uint8_t kValue = sensor_msgs::PointField::UINT8;
+};
+
+template <>
+struct PointFieldType<std::uint16_t> {
+  static constexpr std::uint8_t kValue = sensor_msgs::PointField::UINT16;
+};
+
+template <>
+struct PointFieldType<std::uint32_t> {
+  static constexpr std::uint8_t kValue = sensor_msgs::PointField::UINT32;
+};
+
+template <>
+struct PointFieldType<float> {
+  static constexpr std::uint8_t kValue = sensor_msgs::PointField::FLOAT32;
+};
+
+template <>
+struct PointFieldType<double> {
+  static constexpr std::uint8_t kValue = sensor_msgs::PointField::FLOAT64;
+};
+
+/**
+ * @return byte offset of a scalar field with this name and type within a point, -1 if there is none
+ */
+int FindPointField(const sensor_msgs::PointCloud2 &msg, const char *name, std::uint8_t datatype, int size);
+
+template <typename T>
+int FindPointField(const sensor_msgs::PointCloud2 &msg, const char *name) {
+  return FindPointField(msg, name, PointFieldType<T>::kValue, sizeof(T));
+}
+
+template <typename T>
+T ReadPointField(const std::uint8_t *point, int offset) {
+  T value;
+  memcpy(&value, point + offset, sizeof(T));
+  return value;
+}
+
+}  // namespace internal
+
+/**
+ * @brief Decode a PointCloud2 of a known layout straight into points with absolute times, in one pass
+ *
+ * Field offsets are looked up once per message, the per point reads are specialized for the layout. Points with
+ * non-finite coordinates are skipped. Missing intensity and ring fields are read as 0.
+ *
+ * @return false if the message is big endian, truncated, or lacks the coordinates or the time field of the layout
+ */
+template <typename Layout>
+bool DecodePointCloud(const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<hilti_ros::Point> *cloud) {
+  using TimeType = typename Layout::TimeType;
+  using RingType = typename Layout::RingType;
+
+  const int x_offset         = internal::FindPointField<float>(msg, "x");
+  const int y_offset         = internal::FindPointField<float>(msg, "y");
+  const int z_offset         = internal::FindPointField<float>(msg, "z");
+  const int time_offset      = internal::FindPointField<TimeType>(msg, Layout::kTimeField);
+  const int intensity_offset = internal::FindPointField<float>(msg, "intensity");
+  const int ring_offset      = internal::FindPointField<RingType>(msg, Layout::kRingField);
+  if (msg.is_bigendian || x_offset < 0 || y_offset < 0 || z_offset < 0 || time_offset < 0 ||
+      uint64_t(msg.point_step) * msg.width > msg.row_step || msg.data.size() < uint64_t(msg.row_step) * msg.height) {
+    return false;
+  }
+
+  const double stamp = msg.header.stamp.toSec();
+  cloud->clear();
+  cloud->reserve(uint64_t(msg.width) * msg.height);
+  for (uint32_t row = 0; row < msg.height; ++row) {
+    const std::uint8_t *point = msg.data.data() + uint64_t(row) * msg.row_step;
+    for (uint32_t col = 0; col < msg.width; ++col, point += msg.point_step) {
+      hilti_ros::Point pt;
+      pt.x = internal::ReadPointField<float>(point, x_offset);
+      pt.y = internal::ReadPointField<float>(point, y_offset);
+      pt.z = internal::ReadPointField<float>(point, z_offset);
+      if (!std::isfinite(pt.x) || !std::isfinite(pt.y) || !std::isfinite(pt.z)) {
+        continue;
+      }
+      pt.intensity = intensity_offset < 0 ? 0 : internal::ReadPointField<float>(point, intensity_offset);
+      pt.time      = Layout::AbsoluteTime(internal::ReadPointField<TimeType>(point, time_offset), stamp);
+      pt.ring      = ring_offset < 0 ? 0 : internal::ReadPointField<RingType>(point, ring_offset);
+      cloud->push_back(pt);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Decode a PointCloud2 with the decoder specialized for a layout chosen at runtime
+ */
+bool DecodePointCloud(LidarPointLayout layout, const sensor_msgs::PointCloud2 &msg, pcl::PointCloud<hilti_ros::Point> *cloud);
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "sensor/point_cloud_decoder.h"
+
+namespace {
+
+sensor_msgs::PointField MakeField(const std::string &name, uint32_t offset, uint8_t datatype) {
+  sensor_msgs::PointField field;
+  field.name     = name;
+  field.offset   = offset;
+  field.datatype = datatype;
+  field.count    = 1;
+  return field;
+}
+
+/**
+ * @brief Organized 2x2 cloud in the ouster-ros layout, with one invalid point
+ */
+sensor_msgs::PointCloud2 MakeOusterCloud() {
+  sensor_msgs::PointCloud2 msg;
+  msg.header.stamp = ros::Time(100.0);
+  msg.height       = 2;
+  msg.width        = 2;
+  msg.fields       = {
+      MakeField("x", 0, sensor_msgs::PointField::FLOAT32),
+      MakeField("y", 4, sensor_msgs::PointField::FLOAT32),
+      MakeField("z", 8, sensor_msgs::PointField::FLOAT32),
+      MakeField("intensity", 16, sensor_msgs::PointField::FLOAT32),
+      MakeField("t", 20, sensor_msgs::PointField::UINT32),
+      MakeField("reflectivity", 24, sensor_msgs::PointField::UINT16),
+      MakeField("ring", 26, sensor_msgs::PointField::UINT16),
+  };
+  msg.point_step = 48;
+  msg.row_step   = msg.point_step * msg.width;
+  msg.data.resize(msg.row_step * msg.height);
+  for (int i = 0; i < 4; ++i) {
+    uint8_t *point     = msg.data.data() + i * msg.point_step;
+    float    xyz[3]    = {float(i + 1), 0, i == 2 ? NAN : 0.f};
+    float    intensity = 10 * i;
+    uint32_t t         = i * 25'000'000;
+    uint16_t ring      = i / 2;
+    memcpy(point, xyz, sizeof(xyz));
+    memcpy(point + 16, &intensity, sizeof(intensity));
+    memcpy(point + 20, &t, sizeof(t));
+    memcpy(point + 26, &ring, sizeof(ring));
+  }
+  return msg;
+}
+
+}  // namespace
+
+TEST(PointCloudDecoder, Ouster) {
+  auto                              msg = MakeOusterCloud();
+  pcl::PointCloud<hilti_ros::Point> cloud;
+  ASSERT_TRUE(DecodePointCloud(LidarPointLayout::kOuster, msg, &cloud));
+  ASSERT_EQ(cloud.size(), 3);
+  EXPECT_EQ(cloud[0].x, 1);
+  EXPECT_EQ(cloud[1].intensity, 10);
+  EXPECT_EQ(cloud[2].x, 4);
+  EXPECT_NEAR(cloud[2].time, 100.075, 1e-9);
+  EXPECT_EQ(cloud[2].ring, 1);
+
+  // the time field of another layout is missing
+  EXPECT_FALSE(DecodePointCloud(LidarPointLayout::kVelodyne, msg, &cloud));
+  msg.data.resize(msg.data.size() - 1);
+  EXPECT_FALSE(DecodePointCloud(LidarPointLayout::kOuster, msg, &cloud));
+}
+
+TEST(PointCloudDecoder, ParseLayout) {
+  LidarPointLayout layout;
+  EXPECT_TRUE(ParseLidarPointLayout("livox", &layout));
+  EXPECT_EQ(layout, LidarPointLayout::kLivox);
+  EXPECT_FALSE(ParseLidarPointLayout("robosense", &layout));
+}
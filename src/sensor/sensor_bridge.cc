@@ -0,0 +1,60 @@
+#include "sensor/sensor_bridge.h"
+
+#include <glog/logging.h>
+
+#include "absl/strings/str_split.h"
+
+#include "common/msg_conversion.h"
+
+SensorBridge::SensorBridge(int imu_rate, LidarOdometry *odometry, const std::vector<LidarPointLayout> &lidar_layouts)
+    : imu_resampler_(imu_rate), odometry_(odometry), lidar_layouts_(lidar_layouts) {
+  CHECK(odometry_);
+}
+
+void SensorBridge::HandleImuMessage(const sensor_msgs::ImuConstPtr &msg) {
+  ImuData imu_data;
+  imu_data.timestamp           = msg->header.stamp.toSec();
+  imu_data.linear_acceleration = FromROS(msg->linear_acceleration);
+  imu_data.angular_velocity    = FromROS(msg->angular_velocity);
+  HandleImuData(imu_data);
+}
+
+void SensorBridge::HandleLidarMessage(const sensor_msgs::PointCloud2ConstPtr &msg, int lidar_id) {
+  auto                                   layout = lidar_id < lidar_layouts_.size() ? lidar_layouts_[lidar_id] : LidarPointLayout::kHesai;
+  pcl::PointCloud<hilti_ros::Point>::Ptr cloud(new pcl::PointCloud<hilti_ros::Point>);
+  if (!DecodePointCloud(layout, *msg, cloud.get())) {
+    LOG(ERROR) << "Scan of lidar " << lidar_id << " does not match its point layout, dropped.";
+    return;
+  }
+  HandleLidarScan(cloud, lidar_id);
+}
+
+void SensorBridge::HandleImuData(const ImuData &imu_data) {
+  imu_resampler_.AddImuData(imu_data);
+  auto resampled_imu_data = imu_resampler_.AdvanceGetResampledImuData();
+  if (resampled_imu_data) {
+    odometry_->AddImuData(*resampled_imu_data);
+  }
+}
+
+void SensorBridge::HandleLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &cloud, int lidar_id) {
+  odometry_->AddLidarScan(cloud, lidar_id);
+}
+
+std::vector<LidarPointLayout> LidarPointLayouts(const LioConfig &config) {
+  std::vector<LidarPointLayout> layouts(config.extra_lidars.size() + 1);
+  CHECK(ParseLidarPointLayout(config.lidar_point_layout, &layouts[0])) << "Unknown lidar point layout " << config.lidar_point_layout;
+  for (int i = 0; i < config.extra_lidars.size(); ++i) {
+    CHECK(ParseLidarPointLayout(config.extra_lidars[i].point_layout, &layouts[i + 1])) << "Unknown lidar point layout " << config.extra_lidars[i].point_layout;
+  }
+  return layouts;
+}
+
+std::vector<std::string> LidarTopics(const LioConfig &config, const std::string &extra_lidar_topics) {
+  std::vector<std::string> lidar_topics = {"/hesai/pandar"};
+  for (auto topic : absl::StrSplit(extra_lidar_topics, ',', absl::SkipEmpty())) {
+    lidar_topics.emplace_back(topic);
+  }
+  CHECK_EQ(lidar_topics.size(), config.extra_lidars.size() + 1) << "One topic per extra lidar of the config is required.";
+  return lidar_topics;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "odometry/lidar_odometry.h"
+#include "sensor/imu_resampler.h"
+#include "sensor/point_cloud_decoder.h"
+
+/**
+ * @brief Converts ROS sensor messages or raw sensor data and feeds them into one LidarOdometry
+ *
+ * IMU messages are resampled to a fixed rate first. Each odometry instance needs its own bridge
+ * because the resampler is stateful. PointCloud2 messages are decoded with the point layout of their lidar.
+ */
+class SensorBridge {
+ public:
+  /**
+   * @param lidar_layouts point layout by lidar id, hesai for lidars not listed
+   */
+  SensorBridge(int imu_rate, LidarOdometry *odometry, const std::vector<LidarPointLayout> &lidar_layouts = {});
+
+  void HandleImuMessage(const sensor_msgs::ImuConstPtr &msg);
+
+  /**
+   * @param lidar_id index of the lidar in the odometry, see LidarOdometry::AddLidarScan
+   */
+  void HandleLidarMessage(const sensor_msgs::PointCloud2ConstPtr &msg, int lidar_id = 0);
+
+  /**
+   * @brief Raw imu measurement, e.g. read from a dataset
+   */
+  void HandleImuData(const ImuData &imu_data);
+
+  /**
+   * @brief Raw points in the lidar frame, e.g. read from a dataset
+   */
+  void HandleLidarScan(const pcl::PointCloud<hilti_ros::Point>::Ptr &cloud, int lidar_id = 0);
+
+ private:
+  ImuResampler                  imu_resampler_;
+  LidarOdometry                *odometry_;
+  std::vector<LidarPointLayout> lidar_layouts_;
+};
+
+/**
+ * @brief Point layouts of lidar 0 and the extra lidars of a config, which must be valid
+ */
+std::vector<LidarPointLayout> LidarPointLayouts(const LioConfig &config);
+
+/**
+ * @brief PointCloud2 topics of lidar 0, which is /hesai/pandar, and the extra lidars of a config
+ *
+ * @param extra_lidar_topics comma separated topics of the extra lidars in order, one per extra lidar
+ */
+std::vector<std::string> LidarTopics(const LioConfig &config, const std::string &extra_lidar_topics);
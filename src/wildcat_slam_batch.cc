@@ -0,0 +1,374 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
+
+#include "common/thread_pool.h"
+#include "common/thread_utils.h"
+#include "common/trajectory.h"
+#include "odometry/lidar_odometry.h"
+#include "odometry/lio_config_loader.h"
+#include "offline/bag_replay.h"
+#include "offline/batch_refinement.h"
+#include "sensor/sensor_bridge.h"
+
+DEFINE_string(manifest_filename, "", "Manifest with one job per line: <job_name> <bag_filename> [<config_filename> [<config_preset>]]. A config or preset of - or none falls back to --config_filename and --config_preset. Empty lines and lines starting with # are ignored.");
+DEFINE_string(output_dir, "", "Directory receiving <job_name>.trajectory.txt, <job_name>.metrics.txt, <job_name>.config.pbtxt and summary.txt.");
+DEFINE_int32(num_threads, 0, "Global thread budget, split evenly between the jobs running at the same time for their solvers and refinement. 0 uses one thread per cpu of --cpu_list, or per hardware thread.");
+DEFINE_int32(num_jobs, 0, "Number of jobs running at the same time, at most --num_threads. 0 runs as many as there are jobs, up to --num_threads.");
+DEFINE_int32(bag_reader_thread_num, 4, "Threads decompressing the chunks of the bag of each job.");
+DEFINE_string(cpu_list, "", "Cpus the jobs are pinned to, e.g. \"0-7,16-23\". The cpus are split into one contiguous group per job slot. Empty to leave scheduling to the os.");
+DEFINE_int32(imu_rate, 200, "IMU rate in Hz, overrides imu_rate of the config if set.");
+DEFINE_string(extra_lidar_topics, "", "Comma separated PointCloud2 topics of the lidars in extra_lidars of the configs, in order. The first lidar is /hesai/pandar.");
+DEFINE_bool(refine, false, "Refine the whole run in one problem after the replay and write <job_name>.refined_trajectory.txt.");
+DEFINE_bool(write_surfel_map, false, "Stream committed surfels and poses of each job to <job_name>.surfels.bin.");
+DEFINE_string(config_filename, "", "Text format wildcat_slam.proto.LioConfig shared by all jobs, see proto/lio_config.proto and config/.");
+DEFINE_string(config_preset, "", "Preset applied before --config_filename: low_power, balanced or max_accuracy.");
+DEFINE_bool(write_dense_map, false, "Accumulate a dense cloud of each job into PLY tiles in <job_name>.dense_map/.");
+DEFINE_string(reference_dir, "", "Output directory of an earlier batch. Each trajectory is compared with the one of the same job there, e.g. to validate a faster configuration.");
+DEFINE_double(max_translation_deviation, 0.05, "Largest translation deviation from the --reference_dir trajectories in meters, above which a job fails.");
+DEFINE_double(max_rotation_deviation, 0.01, "Largest rotation deviation from the --reference_dir trajectories in radians, above which a job fails.");
+DEFINE_int32(job_index, -1, "Internal: run only this job of the manifest in this process. Every job runs in its own process, so that a crash fails only that job.");
+
+namespace {
+
+struct BatchJob {
+  std::string name;
+  std::string bag_filename;
+  std::string config_filename;  // empty for --config_filename
+  std::string config_preset;    // empty for --config_preset
+};
+
+struct BatchJobResult {
+  std::string         name;
+  bool                ok = false;
+  std::string         error;  // why the job process failed, empty if it exited normally
+  BagReplayStats      replay_stats;
+  int                 sweep_num    = 0;
+  double              wall_seconds = 0;
+  TrajectoryDeviation deviation;
+};
+
+std::vector<BatchJob> ReadManifest(const std::string &manifest_filename) {
+  std::ifstream ifs(manifest_filename);
+  CHECK(ifs) << "Failed to open manifest " << manifest_filename;
+  std::vector<BatchJob> jobs;
+  std::string           line;
+  while (std::getline(ifs, line)) {
+    std::istringstream iss(line);
+    BatchJob           job;
+    if (!(iss >> job.name) || job.name[0] == '#') {
+      continue;
+    }
+    CHECK(iss >> job.bag_filename) << "Missing bag filename for job " << job.name;
+    iss >> job.config_filename >> job.config_preset;
+    if (job.config_filename == "-") {
+      job.config_filename.clear();
+    }
+    if (job.config_preset == "-") {
+      job.config_preset.clear();
+    }
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+void WriteMetrics(const BatchJobResult &result, const std::string &filename) {
+  std::ofstream ofs(filename);
+  ofs << "ok: " << result.ok << "\n";
+  if (!result.error.empty()) {
+    ofs << "error: " << result.error << "\n";
+  }
+  ofs << std::fixed << std::setprecision(3)
+      << "imu_msg_num: " << result.replay_stats.imu_msg_num << "\n"
+      << "lidar_msg_num: " << result.replay_stats.lidar_msg_num << "\n"
+      << "sweep_num: " << result.sweep_num << "\n"
+      << "first_stamp: " << result.replay_stats.first_stamp << "\n"
+      << "last_stamp: " << result.replay_stats.last_stamp << "\n"
+      << "bag_seconds: " << result.replay_stats.Duration() << "\n"
+      << "wall_seconds: " << result.wall_seconds << "\n"
+      << "realtime_factor: " << result.replay_stats.Duration() / std::max(result.wall_seconds, 1e-9) << "\n";
+  if (!FLAGS_reference_dir.empty()) {
+    ofs << std::setprecision(6)
+        << "max_translation_deviation: " << result.deviation.max_translation << "\n"
+        << "max_rotation_deviation: " << result.deviation.max_rotation << "\n";
+  }
+}
+
+/**
+ * @brief Read back the metrics a job process wrote with WriteMetrics
+ *
+ * @return false if the file is missing, e.g. because the job process crashed
+ */
+bool ReadMetrics(const std::string &filename, BatchJobResult *result) {
+  std::ifstream ifs(filename);
+  std::string   key;
+  bool          ok_found = false;
+  while (ifs >> key) {
+    if (key == "ok:") {
+      ok_found = static_cast<bool>(ifs >> result->ok);
+    } else if (key == "imu_msg_num:") {
+      ifs >> result->replay_stats.imu_msg_num;
+    } else if (key == "lidar_msg_num:") {
+      ifs >> result->replay_stats.lidar_msg_num;
+    } else if (key == "sweep_num:") {
+      ifs >> result->sweep_num;
+    } else if (key == "first_stamp:") {
+      ifs >> result->replay_stats.first_stamp;
+    } else if (key == "last_stamp:") {
+      ifs >> result->replay_stats.last_stamp;
+    } else if (key == "wall_seconds:") {
+      ifs >> result->wall_seconds;
+    } else if (key == "max_translation_deviation:") {
+      ifs >> result->deviation.max_translation;
+    } else if (key == "max_rotation_deviation:") {
+      ifs >> result->deviation.max_rotation;
+    } else {
+      ifs.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+  }
+  return ok_found;
+}
+
+/**
+ * @brief Compare trajectory files of a job with the ones in --reference_dir, keeping the largest deviation
+ *
+ * @return false if a reference is missing or deviates by more than the limits
+ */
+bool CompareWithReference(const std::string &filename, const std::string &reference_filename, TrajectoryDeviation *deviation) {
+  std::vector<TimedPose> trajectory, reference;
+  if (!ReadTumTrajectory(filename, &trajectory) || !ReadTumTrajectory(reference_filename, &reference)) {
+    LOG(ERROR) << "Failed to read " << filename << " or " << reference_filename;
+    return false;
+  }
+  TrajectoryDeviation current = CompareTrajectories(trajectory, reference);
+  deviation->pose_num += current.pose_num;
+  deviation->max_translation = std::max(deviation->max_translation, current.max_translation);
+  deviation->max_rotation    = std::max(deviation->max_rotation, current.max_rotation);
+  if (current.pose_num == 0 || current.max_translation > FLAGS_max_translation_deviation || current.max_rotation > FLAGS_max_rotation_deviation) {
+    LOG(ERROR) << filename << " deviates from " << reference_filename << " by " << current.max_translation << " m and " << current.max_rotation
+               << " rad over " << current.pose_num << " poses.";
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Run a job in this process
+ *
+ * @param num_threads thread budget of the job, caps the solver threads of the config and sets the refinement threads
+ */
+BatchJobResult RunJob(const BatchJob &job, const std::string &output_dir, int num_threads) {
+  BatchJobResult result;
+  result.name = job.name;
+
+  auto start_time = std::chrono::steady_clock::now();
+
+  std::ofstream trajectory(output_dir + "/" + job.name + ".trajectory.txt");
+  CHECK(trajectory) << "Failed to open trajectory file for job " << job.name;
+
+  LioConfig   config;
+  std::string config_preset   = job.config_preset.empty() ? FLAGS_config_preset : job.config_preset;
+  std::string config_filename = job.config_filename.empty() ? FLAGS_config_filename : job.config_filename;
+  if (!config_preset.empty()) {
+    CHECK(ApplyLioConfigPreset(config_preset, &config)) << "Unknown preset " << config_preset;
+  }
+  if (!config_filename.empty()) {
+    CHECK(LoadLioConfig(config_filename, &config)) << "Failed to load config " << config_filename;
+  }
+  if (!gflags::GetCommandLineFlagInfoOrDie("imu_rate").is_default) {
+    config.imu_rate = FLAGS_imu_rate;
+    config.UpdateImuCostWeights();
+  }
+  config.solver_num_threads = std::min(config.solver_num_threads, num_threads);
+  config.enable_ros_output  = false;
+  config.instance_name      = job.name;
+  if (FLAGS_write_surfel_map) {
+    config.surfel_map_filename = output_dir + "/" + job.name + ".surfels.bin";
+  }
+  if (FLAGS_write_dense_map) {
+    config.dense_map_dir = output_dir + "/" + job.name + ".dense_map";
+  }
+  std::ofstream(output_dir + "/" + job.name + ".config.pbtxt") << LioConfigToString(config);
+
+  LidarOdometry odometry(config);
+  odometry.SetPoseCallback([&](double timestamp, const Rigid3d &pose) {
+    WriteTumPose(trajectory, {timestamp, pose});
+    ++result.sweep_num;
+  });
+  SensorBridge bridge(config.imu_rate, &odometry, LidarPointLayouts(config));
+
+  BatchRefinementOptions refinement_options;
+  refinement_options.num_threads = num_threads;
+  BatchRefinement refinement(config, refinement_options);
+  if (FLAGS_refine) {
+    odometry.SetCommitCallback([&](const OdometryCommit &commit) { refinement.AddCommit(commit); });
+  }
+
+  BagReaderOptions reader_options;
+  reader_options.thread_num = FLAGS_bag_reader_thread_num;
+  // an unreadable bag aborts the job process, which fails only this job
+  result.replay_stats = ReplayBag(job.bag_filename, &bridge, nullptr, reader_options, LidarTopics(config, FLAGS_extra_lidar_topics), LidarPointLayouts(config));
+  result.ok           = true;
+
+  odometry.Finish();
+  if (FLAGS_refine) {
+    refinement.Refine();
+    WriteTumTrajectory(output_dir + "/" + job.name + ".refined_trajectory.txt", refinement.Trajectory());
+  }
+  trajectory.close();
+  if (!FLAGS_reference_dir.empty()) {
+    std::vector<std::string> suffixes = {".trajectory.txt"};
+    if (FLAGS_refine) {
+      suffixes.push_back(".refined_trajectory.txt");
+    }
+    for (const auto &suffix : suffixes) {
+      result.ok &= CompareWithReference(output_dir + "/" + job.name + suffix, FLAGS_reference_dir + "/" + job.name + suffix, &result.deviation);
+    }
+  }
+
+  result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  WriteMetrics(result, output_dir + "/" + job.name + ".metrics.txt");
+  return result;
+}
+
+/**
+ * @brief Run a job in a child process of this binary, so that a CHECK failure or a crash fails only this job
+ *
+ * @param args command line of this process
+ * @param num_threads thread budget of the job
+ * @param cpus cpus of the job slot, empty to leave scheduling to the os
+ */
+BatchJobResult SpawnJob(const std::vector<std::string> &args, const BatchJob &job, int job_index, int num_threads, const std::vector<int> &cpus) {
+  std::vector<std::string> job_args = args;
+  job_args.push_back("--job_index=" + std::to_string(job_index));
+  job_args.push_back("--num_threads=" + std::to_string(num_threads));
+  job_args.push_back("--cpu_list=" + absl::StrJoin(cpus, ","));
+  std::vector<char *> job_argv;
+  for (auto &arg : job_args) {
+    job_argv.push_back(arg.data());
+  }
+  job_argv.push_back(nullptr);
+
+  BatchJobResult result;
+  result.name                  = job.name;
+  std::string metrics_filename = FLAGS_output_dir + "/" + job.name + ".metrics.txt";
+  std::filesystem::remove(metrics_filename);  // of an earlier batch
+
+  pid_t pid;
+  int   status = 0;
+  int   error  = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, job_argv.data(), environ);
+  if (error != 0) {
+    result.error = std::string("spawn failed: ") + std::strerror(error);
+  } else if (waitpid(pid, &status, 0) != pid) {
+    result.error = std::string("wait failed: ") + std::strerror(errno);
+  } else if (WIFSIGNALED(status)) {
+    result.error = "killed by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+  } else if (!ReadMetrics(metrics_filename, &result)) {
+    result.error = "exited with status " + std::to_string(WEXITSTATUS(status)) + " without metrics";
+  }
+  if (!result.error.empty()) {
+    result.ok = false;
+    LOG(ERROR) << "Job " << job.name << " failed: " << result.error;
+    WriteMetrics(result, metrics_filename);
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args(argv, argv + argc);  // before gflags removes the flags, to start the job processes
+  FLAGS_alsologtostderr = true;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_NE(FLAGS_manifest_filename, "");
+  CHECK_NE(FLAGS_output_dir, "");
+
+  std::vector<BatchJob> jobs        = ReadManifest(FLAGS_manifest_filename);
+  std::vector<int>      cpus        = ParseCpuList(FLAGS_cpu_list);
+  int                   num_threads = FLAGS_num_threads;
+  if (num_threads <= 0) {
+    num_threads = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+  }
+
+  if (FLAGS_job_index >= 0) {
+    CHECK_LT(FLAGS_job_index, jobs.size());
+    // inherited by every thread the job starts
+    if (!cpus.empty() && !SetCurrentThreadAffinity(cpus)) {
+      LOG(WARNING) << "Failed to pin job " << jobs[FLAGS_job_index].name << " to cpus " << FLAGS_cpu_list;
+    }
+    return RunJob(jobs[FLAGS_job_index], FLAGS_output_dir, num_threads).ok ? 0 : 1;
+  }
+
+  int num_jobs    = std::max(1, std::min<int>(FLAGS_num_jobs > 0 ? FLAGS_num_jobs : jobs.size(), num_threads));
+  int job_threads = num_threads / num_jobs;
+  std::filesystem::create_directories(FLAGS_output_dir);
+  LOG(INFO) << "Running " << jobs.size() << " jobs with " << num_jobs << " in parallel and " << job_threads << " threads each.";
+
+  std::vector<BatchJobResult> results(jobs.size());
+  absl::Mutex                 slots_mutex;
+  std::vector<int>            free_slots;  // slot i runs on the i-th group of job_threads cpus
+  for (int i = num_jobs - 1; i >= 0; --i) {
+    free_slots.push_back(i);
+  }
+  auto start_time = std::chrono::steady_clock::now();
+  {
+    ThreadPool pool(num_jobs);
+    for (int i = 0; i < jobs.size(); ++i) {
+      pool.Schedule([&, i]() {
+        int slot;
+        {
+          absl::MutexLock lock(&slots_mutex);
+          slot = free_slots.back();
+          free_slots.pop_back();
+        }
+        std::vector<int> slot_cpus;
+        for (int j = 0; j < job_threads && !cpus.empty(); ++j) {
+          slot_cpus.push_back(cpus[(slot * job_threads + j) % cpus.size()]);
+        }
+        results[i] = SpawnJob(args, jobs[i], i, job_threads, slot_cpus);
+        {
+          absl::MutexLock lock(&slots_mutex);
+          free_slots.push_back(slot);
+        }
+        LOG(INFO) << "Job " << jobs[i].name << (results[i].ok ? " finished" : " failed") << " in " << results[i].wall_seconds << " s.";
+      });
+    }
+  }
+  double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  int    ok_num = 0, sweep_num = 0;
+  double bag_seconds = 0;
+  for (auto &result : results) {
+    ok_num += result.ok;
+    sweep_num += result.sweep_num;
+    bag_seconds += result.replay_stats.Duration();
+  }
+  std::ostringstream summary;
+  summary << std::fixed << std::setprecision(3)
+          << "jobs: " << results.size() << "\n"
+          << "failed_jobs: " << results.size() - ok_num << "\n"
+          << "parallel_jobs: " << num_jobs << "\n"
+          << "threads_per_job: " << job_threads << "\n"
+          << "wall_seconds: " << wall_seconds << "\n"
+          << "bag_seconds: " << bag_seconds << "\n"
+          << "aggregate_realtime_factor: " << bag_seconds / wall_seconds << "\n"
+          << "sweeps_per_second: " << sweep_num / wall_seconds << "\n";
+  std::ofstream(FLAGS_output_dir + "/summary.txt") << summary.str();
+  LOG(INFO) << "Batch done:\n"
+            << summary.str();
+
+  return ok_num == results.size() ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "io/surfel_map_file.h"
+#include "mapping/localization_map.h"
+
+DEFINE_string(surfel_map_filename, "", "Surfel map streamed by a mapping run, see --surfel_map_filename of wildcat_slam_node.");
+DEFINE_string(output_filename, "", "Localization map to write.");
+DEFINE_double(tile_size, 20, "Edge length of the map tiles in meters.");
+
+int main(int argc, char **argv) {
+  FLAGS_alsologtostderr = true;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_NE(FLAGS_surfel_map_filename, "");
+  CHECK_NE(FLAGS_output_filename, "");
+
+  SurfelMapReader reader;
+  CHECK(reader.Open(FLAGS_surfel_map_filename)) << "Failed to open surfel map " << FLAGS_surfel_map_filename;
+  std::vector<Surfel::Ptr> surfels, chunk_surfels;
+  for (int i = 0; i < reader.ChunkNum(); ++i) {
+    CHECK(reader.ReadChunk(i, &chunk_surfels)) << "Failed to read chunk " << i;
+    surfels.insert(surfels.end(), chunk_surfels.begin(), chunk_surfels.end());
+  }
+
+  CHECK(WriteLocalizationMap(surfels, FLAGS_tile_size, FLAGS_output_filename)) << "Failed to write " << FLAGS_output_filename;
+  LOG(INFO) << "Wrote localization map with surfels_" << surfels.size() << " from chunks_" << reader.ChunkNum() << ".";
+  return 0;
+}
@@ -1,56 +1,50 @@
 
+#include <boost/bind/bind.hpp>
 #include <gflags/gflags.h>
 #include <glog/logging.h>
-#include <pcl_conversions/pcl_conversions.h>
 #include <ros/ros.h>
-#include <rosbag/bag.h>
-#include <rosbag/view.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <signal.h>
+#include <algorithm>
+#include <filesystem>
 #include <thread>
 
-#include "common/msg_conversion.h"
+#include "common/thread_utils.h"
 #include "odometry/lidar_odometry.h"
-#include "sensor/imu_resampler.h"
+#include "odometry/lio_config_loader.h"
+#include "offline/bag_replay.h"
+#include "sensor/sensor_bridge.h"
 
 DEFINE_bool(enable_online_mode, false, "Enable online mode.");
+DEFINE_string(config_filename, "", "Text format wildcat_slam.proto.LioConfig, see proto/lio_config.proto and config/. Flags given on the command line override it.");
+DEFINE_string(config_preset, "", "Preset applied before --config_filename: low_power, balanced or max_accuracy.");
 DEFINE_string(bag_filename, "/home/rick/Documents/raw_data/hilti/exp04_construction_upper_level.bag-filtered.bag", "Bag file to read in offline mode.");
+DEFINE_string(extra_lidar_topics, "", "Comma separated PointCloud2 topics of the lidars in extra_lidars of the config, in order. The first lidar is /hesai/pandar.");
+DEFINE_int32(bag_reader_thread_num, 4, "Threads decompressing chunks of --bag_filename.");
+DEFINE_double(start_time, 0, "Replay --bag_filename from this many seconds after its first message. Chunks before are not read.");
+DEFINE_double(duration, 0, "Replay this many seconds of --bag_filename after --start_time, 0 for the rest of the bag.");
+DEFINE_double(warmup, 10, "Seconds replayed before --start_time to initialize the sliding window, should exceed sliding_window_duration.");
+DEFINE_string(lidar_dir, "", "Directory of .bin (KITTI) or .pcd scans to read in offline mode instead of --bag_filename.");
+DEFINE_string(lidar_times_filename, "", "Scan start times for --lidar_dir, one per line. Empty to parse them from the scan file names.");
+DEFINE_string(imu_csv_filename, "", "Imu log for --lidar_dir: time in ns, gyro xyz, acc xyz per line as in EuRoC.");
 DEFINE_int32(imu_rate, 200, "IMU rate in Hz.");
-
-volatile sig_atomic_t         g_signal_stop = 0;
-std::shared_ptr<ImuResampler> g_imu_resampler;
+DEFINE_bool(enable_shm_output, false, "Publish poses and undistorted sweeps to a shared memory ring for same-host readers.");
+DEFINE_string(shm_channel_name, "/wildcat_slam", "Name prefix of the shared memory rings.");
+DEFINE_bool(enable_backend, false, "Correct drift with a submap pose graph and publish the map -> world transform.");
+DEFINE_string(surfel_map_filename, "", "Stream committed surfels and poses to this binary surfel map file. Empty to disable.");
+DEFINE_string(dense_map_dir, "", "Accumulate a dense voxel deduplicated cloud into PLY tiles in this directory. Empty to disable.");
+DEFINE_string(checkpoint_filename, "", "Write the odometry state to this checkpoint periodically. Empty to disable.");
+DEFINE_double(checkpoint_period, 10.0, "Checkpoint period in seconds of sensor time.");
+DEFINE_bool(resume, false, "Continue from --checkpoint_filename if it exists, e.g. after a restart of the node.");
+DEFINE_string(localization_map_filename, "", "Localize against this map built by wildcat_slam_build_map instead of mapping. The run must start at the origin of the mapping run.");
+
+volatile sig_atomic_t g_signal_stop = 0;
 
 void signal_handler(int status) {
   g_signal_stop = 1;
 }
 
-// DEFINE_string(config_filename, "", "Configuration file.");
-
-void HandleImuMessage(
-    const sensor_msgs::ImuConstPtr       &msg,
-    const std::shared_ptr<LidarOdometry> &laser_odometry_handler) {
-  ImuData imu_data;
-  imu_data.timestamp           = msg->header.stamp.toSec();
-  imu_data.linear_acceleration = FromROS(msg->linear_acceleration);
-  imu_data.angular_velocity    = FromROS(msg->angular_velocity);
-
-  g_imu_resampler->AddImuData(imu_data);
-  auto resampled_imu_data = g_imu_resampler->AdvanceGetResampledImuData();
-  if (resampled_imu_data) {
-    // LOG(INFO) << "Resampled imu data: " << std::fixed << std::setprecision(6) << resampled_imu_data->timestamp;
-    laser_odometry_handler->AddImuData(*resampled_imu_data);
-  }
-}
-
-void HandleLidarMessage(
-    const sensor_msgs::PointCloud2ConstPtr &msg,
-    const std::shared_ptr<LidarOdometry>   &laser_odometry_handler) {
-  pcl::PointCloud<hilti_ros::Point>::Ptr cloud(new pcl::PointCloud<hilti_ros::Point>);
-  pcl::fromROSMsg(*msg, *cloud);
-  laser_odometry_handler->AddLidarScan(cloud);
-}
-
 int main(int argc, char **argv) {
   // Set glog and gflags
   FLAGS_alsologtostderr = true;
@@ -63,41 +57,112 @@ int main(int argc, char **argv) {
 
   signal(SIGINT, signal_handler);
 
-  std::shared_ptr<LidarOdometry> so{new LidarOdometry()};
+  // defaults < preset < config file < flags given on the command line
+  LioConfig config;
+  if (!FLAGS_config_preset.empty()) {
+    CHECK(ApplyLioConfigPreset(FLAGS_config_preset, &config)) << "Unknown preset " << FLAGS_config_preset;
+  }
+  if (!FLAGS_config_filename.empty()) {
+    CHECK(LoadLioConfig(FLAGS_config_filename, &config)) << "Failed to load config " << FLAGS_config_filename;
+  }
+  const auto is_set = [](const char *name) { return !gflags::GetCommandLineFlagInfoOrDie(name).is_default; };
+  if (is_set("imu_rate")) {
+    config.imu_rate = FLAGS_imu_rate;
+    config.UpdateImuCostWeights();
+  }
+  if (is_set("enable_shm_output")) {
+    config.enable_shm_output = FLAGS_enable_shm_output;
+  }
+  if (is_set("shm_channel_name")) {
+    config.shm_channel_name = FLAGS_shm_channel_name;
+  }
+  if (is_set("enable_backend")) {
+    config.enable_backend = FLAGS_enable_backend;
+  }
+  if (is_set("surfel_map_filename")) {
+    config.surfel_map_filename = FLAGS_surfel_map_filename;
+  }
+  if (is_set("dense_map_dir")) {
+    config.dense_map_dir = FLAGS_dense_map_dir;
+  }
+  if (is_set("localization_map_filename")) {
+    config.localization_map_filename = FLAGS_localization_map_filename;
+  }
+  if (is_set("checkpoint_filename")) {
+    config.checkpoint_filename = FLAGS_checkpoint_filename;
+  }
+  if (is_set("checkpoint_period")) {
+    config.checkpoint_period = FLAGS_checkpoint_period;
+  }
+  LOG(INFO) << "Effective config:\n" << LioConfigToString(config);
+
+  // before any pipeline thread starts, lidar scans are processed on the main thread
+  SetThreadConfigs(config.threads);
+  if (config.lock_memory) {
+    LockProcessMemory();
+  }
+  ConfigureCurrentThread("odometry");
+
+  std::shared_ptr<LidarOdometry> so{new LidarOdometry(config)};
+  std::shared_ptr<SensorBridge>  bridge{new SensorBridge(config.imu_rate, so.get(), LidarPointLayouts(config))};
+  if (FLAGS_resume && std::filesystem::exists(config.checkpoint_filename)) {
+    CHECK(so->RestoreCheckpoint(config.checkpoint_filename)) << "Failed to resume from " << config.checkpoint_filename;
+  }
+
+  std::vector<std::string> lidar_topics = LidarTopics(config, FLAGS_extra_lidar_topics);
 
-  g_imu_resampler.reset(new ImuResampler(FLAGS_imu_rate));
   if (FLAGS_enable_online_mode) {
     LOG(INFO) << "Using online mode ...";
-    auto imu_sub   = nh.subscribe<sensor_msgs::Imu>("/alphasense/imu", 100000, boost::bind(HandleImuMessage, _1, so));
-    auto lidar_sub = nh.subscribe<sensor_msgs::PointCloud2>("/hesai/pandar", 10000, boost::bind(HandleLidarMessage, _1, so));
-
-    while (ros::ok() && !g_signal_stop) {
-      ros::spinOnce();
-      std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    auto imu_sub = nh.subscribe<sensor_msgs::Imu>("/alphasense/imu", 100000, &SensorBridge::HandleImuMessage, bridge.get());
+    std::vector<ros::Subscriber> lidar_subs;
+    for (int i = 0; i < lidar_topics.size(); ++i) {
+      lidar_subs.push_back(nh.subscribe<sensor_msgs::PointCloud2>(lidar_topics[i], 10000, boost::bind(&SensorBridge::HandleLidarMessage, bridge.get(), boost::placeholders::_1, i)));
     }
 
+    // the odometry runs in the callbacks, so the wakeup latency of the loop is the one of the odometry thread
+    RunPollingLoop(
+        "odometry", std::chrono::milliseconds(3),
+        []() {
+          ros::spinOnce();
+          return false;
+        },
+        []() { return ros::ok() && !g_signal_stop; });
+
     LOG(INFO) << "Exit.";
   } else {
     LOG(INFO) << "Using offline mode ...";
-    CHECK_NE(FLAGS_bag_filename, "");
-    rosbag::Bag bag;
-    bag.open(FLAGS_bag_filename);
-    LOG(INFO) << "Reading bag file " << FLAGS_bag_filename << " ...";
-    for (auto &m : rosbag::View(bag)) {
-      if (g_signal_stop) {
-        LOG(INFO) << "Exit.";
-        break;
-      }
-      if (m.isType<sensor_msgs::PointCloud2>()) {
-        HandleLidarMessage(m.instantiate<sensor_msgs::PointCloud2>(),
-                           so);
-      } else if (m.isType<sensor_msgs::Imu>()) {
-        HandleImuMessage(m.instantiate<sensor_msgs::Imu>(),
-                         so);
+    if (!FLAGS_lidar_dir.empty()) {
+      CHECK_NE(FLAGS_imu_csv_filename, "");
+      CHECK(FLAGS_start_time == 0 && FLAGS_duration == 0) << "--start_time and --duration only apply to --bag_filename.";
+      LidarSequenceOptions lidar_options;
+      lidar_options.times_filename = FLAGS_lidar_times_filename;
+      auto lidar_reader            = OpenLidarSequence(FLAGS_lidar_dir, lidar_options);
+      CHECK(lidar_reader) << "No scans in " << FLAGS_lidar_dir;
+
+      std::vector<std::unique_ptr<DatasetReader>> readers;
+      readers.emplace_back(new PrefetchDatasetReader(std::move(lidar_reader), 4));
+      readers.emplace_back(new CsvImuReader(FLAGS_imu_csv_filename));
+      MergedDatasetReader reader(std::move(readers));
+      ReplayDataset(&reader, bridge.get(), []() { return g_signal_stop != 0; });
+    } else {
+      CHECK_NE(FLAGS_bag_filename, "");
+      BagReaderOptions bag_options;
+      bag_options.thread_num = FLAGS_bag_reader_thread_num;
+      if (FLAGS_start_time > 0 || FLAGS_duration > 0) {
+        bag_options.start_time          = std::max(0.0, FLAGS_start_time - FLAGS_warmup);
+        bag_options.end_time            = FLAGS_duration > 0 ? FLAGS_start_time + FLAGS_duration : 0;
+        bag_options.time_from_bag_start = true;
+        LOG(INFO) << "Replaying from " << bag_options.start_time << " s, warming up for " << FLAGS_start_time - bag_options.start_time << " s.";
       }
+      // with a single lidar every PointCloud2 topic is read, as before
+      auto                  bag_reader = std::make_unique<BagDatasetReader>(FLAGS_bag_filename, bag_options, lidar_topics.size() > 1 ? lidar_topics : std::vector<std::string>(), LidarPointLayouts(config));
+      PrefetchDatasetReader reader(std::move(bag_reader), 64);
+      ReplayDataset(&reader, bridge.get(), []() { return g_signal_stop != 0; });
     }
-    bag.close();
   }
 
+  // commit the last sliding window, so that the surfel map, the dense map and the backend get the tail of the run
+  so->Finish();
+
   return 0;
 }
@@ -0,0 +1,133 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <thread>
+
+#include "common/thread_pool.h"
+#include "common/thread_utils.h"
+#include "common/trajectory.h"
+#include "odometry/lidar_odometry.h"
+#include "odometry/lio_config_loader.h"
+#include "offline/bag_replay.h"
+#include "offline/segment_stitcher.h"
+#include "sensor/sensor_bridge.h"
+
+DEFINE_string(bag_filename, "", "Bag file to process.");
+DEFINE_string(output_filename, "", "Stitched trajectory in TUM format.");
+DEFINE_double(segment_duration, 300, "Duration of a segment in seconds, excluding the overlap.");
+DEFINE_double(segment_overlap, 30, "Each segment starts this many seconds before its boundary. The first half warms up the odometry, the second half aligns the segment to the previous one.");
+DEFINE_double(segment_tail, 8, "Each segment is replayed this many seconds past the next boundary, so that all surfels up to the boundary leave the sliding window. Should exceed the sliding window duration.");
+DEFINE_int32(num_threads, 0, "Number of segments processed at the same time. 0 uses one per cpu of --cpu_list, or per hardware thread.");
+DEFINE_string(cpu_list, "", "Cpus the segments are pinned to, e.g. \"0-7\". Empty to leave scheduling to the os.");
+DEFINE_int32(imu_rate, 200, "IMU rate in Hz, overrides imu_rate of the config if set.");
+DEFINE_string(config_filename, "", "Text format wildcat_slam.proto.LioConfig of all segments, see proto/lio_config.proto and config/.");
+DEFINE_string(config_preset, "", "Preset applied before --config_filename: low_power, balanced or max_accuracy.");
+DEFINE_string(extra_lidar_topics, "", "Comma separated PointCloud2 topics of the lidars in extra_lidars of the config, in order. The first lidar is /hesai/pandar.");
+
+namespace {
+
+SegmentResult RunSegment(const LioConfig &segment_config, int segment_id, double start_time, double boundary, double next_boundary, double end_time, double registration_window) {
+  SegmentResult result;
+  result.start_time = start_time;
+  result.boundary   = boundary;
+  result.end_time   = end_time;
+
+  LioConfig config     = segment_config;
+  config.instance_name = "segment_" + std::to_string(segment_id);
+
+  LidarOdometry odometry(config);
+  odometry.SetPoseCallback([&](double timestamp, const Rigid3d &pose) {
+    result.trajectory.push_back({timestamp, pose});
+  });
+  odometry.SetCommitCallback([&](const OdometryCommit &commit) {
+    // only surfels near the boundaries take part in stitching
+    for (auto &surfel : commit.surfels) {
+      if ((surfel->timestamp >= boundary - registration_window && surfel->timestamp <= boundary) ||
+          (surfel->timestamp >= next_boundary - registration_window && surfel->timestamp <= next_boundary)) {
+        result.surfels.push_back(surfel);
+      }
+    }
+  });
+  SensorBridge bridge(config.imu_rate, &odometry, LidarPointLayouts(config));
+  BagReaderOptions reader_options;
+  reader_options.start_time = start_time;
+  reader_options.end_time   = end_time;
+  ReplayBag(FLAGS_bag_filename, &bridge, nullptr, reader_options, LidarTopics(config, FLAGS_extra_lidar_topics), LidarPointLayouts(config));
+  odometry.Finish();  // the surfels of the last sliding window may be near the next boundary
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  FLAGS_alsologtostderr = true;
+  google::InitGoogleLogging(argv[0]);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_NE(FLAGS_bag_filename, "");
+  CHECK_NE(FLAGS_output_filename, "");
+  CHECK_GT(FLAGS_segment_duration, FLAGS_segment_overlap);
+
+  // defaults < preset < config file < flags given on the command line
+  LioConfig config;
+  if (!FLAGS_config_preset.empty()) {
+    CHECK(ApplyLioConfigPreset(FLAGS_config_preset, &config)) << "Unknown preset " << FLAGS_config_preset;
+  }
+  if (!FLAGS_config_filename.empty()) {
+    CHECK(LoadLioConfig(FLAGS_config_filename, &config)) << "Failed to load config " << FLAGS_config_filename;
+  }
+  if (!gflags::GetCommandLineFlagInfoOrDie("imu_rate").is_default) {
+    config.imu_rate = FLAGS_imu_rate;
+    config.UpdateImuCostWeights();
+  }
+  config.enable_ros_output = false;
+  LOG(INFO) << "Effective config:\n" << LioConfigToString(config);
+
+  double bag_start_time, bag_end_time;
+  GetBagTimeRange(FLAGS_bag_filename, &bag_start_time, &bag_end_time);
+  int segment_num = std::max(1, int(std::ceil((bag_end_time - bag_start_time) / FLAGS_segment_duration)));
+
+  std::vector<int> cpus        = ParseCpuList(FLAGS_cpu_list);
+  int              num_threads = FLAGS_num_threads;
+  if (num_threads <= 0) {
+    num_threads = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+  }
+  LOG(INFO) << std::fixed << std::setprecision(3) << "Processing " << bag_end_time - bag_start_time << " s in " << segment_num << " segments with " << num_threads << " in parallel.";
+
+  SegmentStitchOptions options;
+  options.registration_window     = FLAGS_segment_overlap / 2;
+  options.registration.loss_scale = config.lidar_loss_scale;
+  options.registration.matcher    = KnnSurfelMatcherOptionsFromConfig(config);
+
+  std::vector<SegmentResult> segments(segment_num);
+  auto                       start_time = std::chrono::steady_clock::now();
+  {
+    ThreadPool pool(num_threads, cpus);
+    for (int i = 0; i < segment_num; ++i) {
+      double boundary      = bag_start_time + i * FLAGS_segment_duration;
+      double next_boundary = i + 1 < segment_num ? boundary + FLAGS_segment_duration : bag_end_time;
+      double start         = i == 0 ? 0 : boundary - FLAGS_segment_overlap;
+      double end           = i + 1 < segment_num ? next_boundary + FLAGS_segment_tail : 0;
+      pool.Schedule([&, i, boundary, next_boundary, start, end]() {
+        segments[i] = RunSegment(config, i, start, boundary, next_boundary, end, options.registration_window);
+        LOG(INFO) << "Segment " << i << " finished with " << segments[i].trajectory.size() << " poses and " << segments[i].surfels.size() << " boundary surfels.";
+      });
+    }
+  }
+  double odometry_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  std::vector<SegmentAlignment> alignments;
+  auto                          trajectory = StitchSegments(segments, options, &alignments);
+  for (int i = 0; i < alignments.size(); ++i) {
+    LOG(INFO) << "Segment " << i + 1 << " to " << i << ": " << alignments[i].to_previous
+              << " registered_" << alignments[i].registered
+              << " corrs_" << alignments[i].summary.correspondence_num
+              << " iters_" << alignments[i].summary.iter_num;
+  }
+  WriteTumTrajectory(FLAGS_output_filename, trajectory);
+
+  double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  LOG(INFO) << std::fixed << std::setprecision(3) << "Done in " << wall_seconds << " s (odometry " << odometry_seconds << " s), realtime factor " << (bag_end_time - bag_start_time) / wall_seconds << ".";
+  return 0;
+}